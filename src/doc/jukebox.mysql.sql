@@ -5,6 +5,7 @@ DROP TABLE IF EXISTS queue;
 DROP TABLE IF EXISTS users;
 DROP TABLE IF EXISTS collections;
 DROP TABLE IF EXISTS collection_contents;
+DROP TABLE IF EXISTS catalog_changes;
 
 /* artists: holds all artists available */
 CREATE TABLE artists (
@@ -19,7 +20,8 @@ CREATE TABLE albums (
 	artistid BIGINT,
 	name VARCHAR(255) NOT NULL,
 	INDEX (artistid),
-	INDEX (name)
+	INDEX (name),
+	INDEX (artistid, name)
 );
 
 /* tracks: holds all tracks available */
@@ -32,10 +34,20 @@ CREATE TABLE tracks (
 	year YEAR,
 	trackno INTEGER NOT NULL,
 	playcount INTEGER NOT NULL,
+	filesize BIGINT NOT NULL DEFAULT 0,
+	mtime BIGINT NOT NULL DEFAULT 0,
+	inode BIGINT NOT NULL DEFAULT 0,
+	device BIGINT NOT NULL DEFAULT 0,
+	fingerprint CHAR(16) NOT NULL DEFAULT '',
+	duration INTEGER NOT NULL DEFAULT 0,
+	bitrate INTEGER NOT NULL DEFAULT 0,
+	samplerate INTEGER NOT NULL DEFAULT 0,
 	INDEX (artistid),
 	INDEX (title),
 	INDEX (albumid),
-	INDEX (albumid, trackno)
+	INDEX (albumid, trackno),
+	INDEX (albumid, title),
+	INDEX (filename(255))
 );
 
 /* queue: holds the tracks to play */
@@ -70,4 +82,12 @@ CREATE TABLE collection_contents (
 	INDEX (collectionid)
 );
 
+/* catalog_changes: holds the changes made to artists, albums and tracks */
+CREATE TABLE catalog_changes (
+	id BIGINT NOT NULL PRIMARY KEY AUTO_INCREMENT,
+	kind INTEGER NOT NULL,
+	action INTEGER NOT NULL,
+	objectid BIGINT NOT NULL
+);
+
 /* vim:set ts=2 sw=2: */
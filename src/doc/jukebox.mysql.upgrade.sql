@@ -0,0 +1,39 @@
+/*
+ * jukebox.mysql.upgrade.sql
+ *
+ * This will bring an existing database up to date with jukebox.mysql.sql. Only
+ * run the parts your database doesn't have yet; they are in the order they
+ * were added.
+ */
+
+/* catalog_changes: holds the changes made to artists, albums and tracks */
+CREATE TABLE catalog_changes (
+	id BIGINT NOT NULL PRIMARY KEY AUTO_INCREMENT,
+	kind INTEGER NOT NULL,
+	action INTEGER NOT NULL,
+	objectid BIGINT NOT NULL
+);
+
+/* keyset paging of the catalog listings */
+ALTER TABLE albums ADD INDEX (artistid, name);
+ALTER TABLE tracks ADD INDEX (albumid, title);
+
+/* file signatures, used by the scanner to skip files which did not change */
+ALTER TABLE tracks ADD filesize BIGINT NOT NULL DEFAULT 0;
+ALTER TABLE tracks ADD mtime BIGINT NOT NULL DEFAULT 0;
+ALTER TABLE tracks ADD inode BIGINT NOT NULL DEFAULT 0;
+ALTER TABLE tracks ADD device BIGINT NOT NULL DEFAULT 0;
+ALTER TABLE tracks ADD INDEX (filename(255));
+
+/* audio fingerprints, used by the scanner to tell moved files from new ones */
+ALTER TABLE tracks ADD fingerprint CHAR(16) NOT NULL DEFAULT '';
+
+/* playing time, bitrate and sample rate. clearing the signatures has the next
+ * scan look at, and measure, every track once more
+ */
+ALTER TABLE tracks ADD duration INTEGER NOT NULL DEFAULT 0;
+ALTER TABLE tracks ADD bitrate INTEGER NOT NULL DEFAULT 0;
+ALTER TABLE tracks ADD samplerate INTEGER NOT NULL DEFAULT 0;
+UPDATE tracks SET mtime=0;
+
+/* vim:set ts=2 sw=2: */
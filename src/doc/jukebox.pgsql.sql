@@ -5,18 +5,20 @@ DROP TABLE queue CASCADE;
 DROP TABLE users CASCADE;
 DROP TABLE collections CASCADE;
 DROP TABLE collection_contents CASCADE;
+DROP TABLE catalog_changes CASCADE;
 DROP SEQUENCE artists_id_seq;
 DROP SEQUENCE albums_id_seq;
 DROP SEQUENCE tracks_id_seq;
 DROP SEQUENCE queue_id_seq;
 DROP SEQUENCE collections_id_seq;
 DROP SEQUENCE collections_contents_id_seq;
+DROP SEQUENCE catalog_changes_id_seq;
 
 CREATE TABLE artists (
 	id SERIAL NOT NULL PRIMARY KEY,
 	name VARCHAR(255) NOT NULL
 );
-CREATE INDEX artists_name_index ON artists (name);
+CREATE INDEX artists_name_index ON artists (name, id);
 
 CREATE TABLE albums (
 	id SERIAL NOT NULL PRIMARY KEY,
@@ -25,6 +27,8 @@ CREATE TABLE albums (
 	FOREIGN KEY (artistid) REFERENCES artists (id) ON DELETE CASCADE ON UPDATE CASCADE
 );
 CREATE INDEX albums_artistid_index ON albums (artistid);
+CREATE INDEX albums_name_index ON albums (name, id);
+CREATE INDEX albums_artistid_name_index ON albums (artistid, name, id);
 
 CREATE TABLE tracks (
 	id SERIAL NOT NULL PRIMARY KEY,
@@ -35,11 +39,22 @@ CREATE TABLE tracks (
 	year INTEGER,
 	trackno INTEGER NOT NULL,
 	playcount INTEGER NOT NULL,
+	filesize BIGINT NOT NULL DEFAULT 0,
+	mtime BIGINT NOT NULL DEFAULT 0,
+	inode BIGINT NOT NULL DEFAULT 0,
+	device BIGINT NOT NULL DEFAULT 0,
+	fingerprint CHAR(16) NOT NULL DEFAULT '',
+	duration INTEGER NOT NULL DEFAULT 0,
+	bitrate INTEGER NOT NULL DEFAULT 0,
+	samplerate INTEGER NOT NULL DEFAULT 0,
 	FOREIGN KEY (artistid) REFERENCES artists (id) ON DELETE CASCADE ON UPDATE CASCADE,
 	FOREIGN KEY (albumid) REFERENCES albums (id) ON DELETE CASCADE ON UPDATE CASCADE
 );
 CREATE INDEX tracks_artistid_index ON tracks (artistid);
 CREATE INDEX tracks_albumid_index ON tracks (albumid);
+CREATE INDEX tracks_albumid_trackno_index ON tracks (albumid, trackno, id);
+CREATE INDEX tracks_albumid_title_index ON tracks (albumid, title, id);
+CREATE INDEX tracks_filename_index ON tracks (filename);
 
 CREATE TABLE queue (
 	id SERIAL NOT NULL PRIMARY KEY,
@@ -70,3 +85,10 @@ CREATE TABLE collection_contents (
 	FOREIGN KEY (collectionid) REFERENCES collections (id) ON DELETE CASCADE ON UPDATE CASCADE
 );
 CREATE INDEX collection_contents_collectionid_index ON collection_contents (collectionid);
+
+CREATE TABLE catalog_changes (
+	id SERIAL NOT NULL PRIMARY KEY,
+	kind INTEGER NOT NULL,
+	action INTEGER NOT NULL,
+	objectid BIGINT NOT NULL
+);
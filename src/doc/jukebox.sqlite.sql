@@ -3,6 +3,7 @@ CREATE TABLE artists (
 	id INTEGER NOT NULL PRIMARY KEY,
 	name VARCHAR(255) NOT NULL
 );
+CREATE INDEX artists_name_index ON artists (name, id);
 
 /* albums: holds all albums available */
 CREATE TABLE albums (
@@ -10,6 +11,8 @@ CREATE TABLE albums (
 	artistid INTEGER,
 	name VARCHAR(255) NOT NULL
 );
+CREATE INDEX albums_name_index ON albums (name, id);
+CREATE INDEX albums_artistid_name_index ON albums (artistid, name, id);
 
 /* tracks: holds all tracks available */
 CREATE TABLE tracks (
@@ -20,8 +23,19 @@ CREATE TABLE tracks (
 	filename TEXT NOT NULL,
 	year YEAR,
 	trackno INTEGER NOT NULL,
-	playcount INTEGER NOT NULL
+	playcount INTEGER NOT NULL,
+	filesize INTEGER NOT NULL DEFAULT 0,
+	mtime INTEGER NOT NULL DEFAULT 0,
+	inode INTEGER NOT NULL DEFAULT 0,
+	device INTEGER NOT NULL DEFAULT 0,
+	fingerprint CHAR(16) NOT NULL DEFAULT '',
+	duration INTEGER NOT NULL DEFAULT 0,
+	bitrate INTEGER NOT NULL DEFAULT 0,
+	samplerate INTEGER NOT NULL DEFAULT 0
 );
+CREATE INDEX tracks_albumid_trackno_index ON tracks (albumid, trackno, id);
+CREATE INDEX tracks_albumid_title_index ON tracks (albumid, title, id);
+CREATE INDEX tracks_filename_index ON tracks (filename);
 
 /* queue: holds the tracks to play */
 CREATE TABLE queue (
@@ -53,4 +67,14 @@ CREATE TABLE collection_contents (
 	trackid INTEGER NOT NULL
 );
 
+/* catalog_changes: holds the changes made to artists, albums and tracks.
+ * AUTOINCREMENT makes sure pruned sequence numbers are never handed out again
+ */
+CREATE TABLE catalog_changes (
+	id INTEGER PRIMARY KEY AUTOINCREMENT,
+	kind INTEGER NOT NULL,
+	action INTEGER NOT NULL,
+	objectid INTEGER NOT NULL
+);
+
 /* vim:set ts=2 sw=2: */
@@ -0,0 +1,44 @@
+/*
+ * jukebox.sqlite.upgrade.sql
+ *
+ * This will bring an existing database up to date with jukebox.sqlite.sql. Only
+ * run the parts your database doesn't have yet; they are in the order they
+ * were added.
+ */
+
+/* catalog_changes: holds the changes made to artists, albums and tracks.
+ * AUTOINCREMENT makes sure pruned sequence numbers are never handed out again
+ */
+CREATE TABLE catalog_changes (
+	id INTEGER PRIMARY KEY AUTOINCREMENT,
+	kind INTEGER NOT NULL,
+	action INTEGER NOT NULL,
+	objectid INTEGER NOT NULL
+);
+
+/* keyset paging of the catalog listings */
+CREATE INDEX artists_name_index ON artists (name, id);
+CREATE INDEX albums_name_index ON albums (name, id);
+CREATE INDEX albums_artistid_name_index ON albums (artistid, name, id);
+CREATE INDEX tracks_albumid_trackno_index ON tracks (albumid, trackno, id);
+CREATE INDEX tracks_albumid_title_index ON tracks (albumid, title, id);
+
+/* file signatures, used by the scanner to skip files which did not change */
+ALTER TABLE tracks ADD COLUMN filesize INTEGER NOT NULL DEFAULT 0;
+ALTER TABLE tracks ADD COLUMN mtime INTEGER NOT NULL DEFAULT 0;
+ALTER TABLE tracks ADD COLUMN inode INTEGER NOT NULL DEFAULT 0;
+ALTER TABLE tracks ADD COLUMN device INTEGER NOT NULL DEFAULT 0;
+CREATE INDEX tracks_filename_index ON tracks (filename);
+
+/* audio fingerprints, used by the scanner to tell moved files from new ones */
+ALTER TABLE tracks ADD COLUMN fingerprint CHAR(16) NOT NULL DEFAULT '';
+
+/* playing time, bitrate and sample rate. clearing the signatures has the next
+ * scan look at, and measure, every track once more
+ */
+ALTER TABLE tracks ADD COLUMN duration INTEGER NOT NULL DEFAULT 0;
+ALTER TABLE tracks ADD COLUMN bitrate INTEGER NOT NULL DEFAULT 0;
+ALTER TABLE tracks ADD COLUMN samplerate INTEGER NOT NULL DEFAULT 0;
+UPDATE tracks SET mtime=0;
+
+/* vim:set ts=2 sw=2: */
@@ -7,6 +7,8 @@
 #include <string.h>
 #include <unistd.h>
 #include "album.h"
+#include "change.h"
+#include "dbutil.h"
 #include "jukebox.h"
 
 /*
@@ -107,24 +109,28 @@ ALBUM::update() {
 	if (id != 0) {
 		// yes. just update the album
 		db->execute ("UPDATE albums SET name=?,artistid=# WHERE id=#", name, artistID, id);
+		CHANGE::record (CHANGE_KIND_ALBUM, CHANGE_ACTION_UPDATE, id);
 		return;
 	}
 
 	// no. create a new artist
 	db->execute ("INSERT INTO albums (artistid,name) VALUES (#,?)", artistID, name);
 
-	// fetch the id
-	DBRESULT* res = db->query ("SELECT id FROM albums WHERE name=? AND artistID=#", name, artistID);
-	if (res == NULL) {
-		// this shouldn't happen...
-	 id = 0;
-	 return;
-	}
+	// fetch the id, looking it up if the database can't tell
+	id = DBUTIL::lastInsertID ("albums");
+	if (id == 0) {
+		DBRESULT* res = db->query ("SELECT id FROM albums WHERE name=? AND artistID=#", name, artistID);
+		if (res == NULL)
+			// this shouldn't happen...
+			return;
 
-	id = res->fetchColumnAsInteger (0);
+		id = res->fetchColumnAsInteger (0);
+		delete res;
+	}
 
-	// all done
-	delete res;
+	// tell the world it's there
+	if (id != 0)
+		CHANGE::record (CHANGE_KIND_ALBUM, CHANGE_ACTION_INSERT, id);
 }
 
 /*
@@ -161,31 +167,7 @@ void ALBUM::setArtistID (int newid) { artistID = newid; }
 int
 ALBUM::fetchNext() {
 	// fetch the information from the database
-	DBRESULT* res = db->limitQuery ("SELECT id,artistid,name FROM albums WHERE id># ORDER BY id ASC", 1, 0, id);
-	if (res == NULL)
-		// this failed. oh my...
-		return 0;
-
-	// got a result?	
-	if (res->numRows() == 0) {
-		// no. free the result and return failure
-		delete res;
-		return 0;
-	}
-
-	// free the name first, if needed
-	if (name)
-		free (name);
-
-	// copy the data
-	this->id = res->fetchColumnAsInteger (0);
-	artistID = res->fetchColumnAsInteger (1);
-	name     = strdup (res->fetchColumnAsString (2));
-
-	delete res;
-
-	// all done
-	return 1;
+	return copyFetched (db->limitQuery ("SELECT id,artistid,name FROM albums WHERE id># ORDER BY id ASC", 1, 0, id));
 }
 
 /*
@@ -228,7 +210,49 @@ ALBUM::fetchTrack (int pos, int* trackid) {
 int
 ALBUM::fetchArtistNext(int artistid) {
 	// fetch the information from the database
-	DBRESULT* res = db->limitQuery ("SELECT id,artistid,name FROM albums WHERE artistid=# AND id># ORDER BY id ASC", 1, 0, artistid, id);
+	return copyFetched (db->limitQuery ("SELECT id,artistid,name FROM albums WHERE artistid=# AND id># ORDER BY id ASC", 1, 0, artistid, id));
+}
+
+/*
+ * ALBUM::fetchNextByName()
+ *
+ * This will try to fetch the next album by name in place. The current name
+ * and ID are the position to continue from. It will return 0 on failure or
+ * non-zero on success.
+ *
+ */
+int
+ALBUM::fetchNextByName() {
+	const char* cur = (name != NULL) ? name : "";
+
+	// fetch the information from the database
+	return copyFetched (db->limitQuery ("SELECT id,artistid,name FROM albums WHERE name>? OR (name=? AND id>#) ORDER BY name ASC, id ASC", 1, 0, cur, cur, id));
+}
+
+/*
+ * ALBUM::fetchArtistNextByName (int artistid)
+ *
+ * This will try to fetch the next album by name for artist [artistid]. It
+ * will return 0 on failure or non-zero on success.
+ *
+ */
+int
+ALBUM::fetchArtistNextByName (int artistid) {
+	const char* cur = (name != NULL) ? name : "";
+
+	// fetch the information from the database
+	return copyFetched (db->limitQuery ("SELECT id,artistid,name FROM albums WHERE artistid=# AND (name>? OR (name=? AND id>#)) ORDER BY name ASC, id ASC", 1, 0, artistid, cur, cur, id));
+}
+
+/*
+ * ALBUM::copyFetched (DBRESULT* res)
+ *
+ * This will copy the album fetched by [res] in place, and free [res]. It
+ * will return 0 if nothing was fetched or non-zero if something was.
+ *
+ */
+int
+ALBUM::copyFetched (DBRESULT* res) {
 	if (res == NULL)
 		// this failed. oh my...
 		return 0;
@@ -255,5 +279,4 @@ ALBUM::fetchArtistNext(int artistid) {
 	return 1;
 }
 
-
 /* vim:set ts=2 sw=2: */
@@ -6,6 +6,8 @@
  */
 #include <stdlib.h>
 
+class DBRESULT;
+
 #ifndef __ALBUM_H__
 #define __ALBUM_H__
 
@@ -99,7 +101,28 @@ public:
 	 */
 	int fetchTrack (int pos, int* trackid);
 
+	/*! \brief Fetches the next available album by name
+	 *
+	 *  The albums are ordered by name, and by ID if the names are equal.
+	 *  This will return zero on failure or non-zero on success.
+	 */
+	int fetchNextByName();
+
+	/*! \brief Fetches the next available album for an artist by name
+	 *  \param artistid The artist ID to fetch for
+	 *
+	 *  This will return zero on failure or non-zero on success.
+	 */
+	int fetchArtistNextByName (int artistid);
+
 private:
+	/*! \brief Copies the album fetched
+	 *  \param res The result of the query, which is freed
+	 *
+	 *  This will return zero if there was nothing fetched or non-zero if there was.
+	 */
+	int copyFetched (DBRESULT* res);
+
 	int id;
 	int artistID;
 	char*	name;
@@ -7,6 +7,8 @@
 #include <string.h>
 #include <unistd.h>
 #include "artist.h"
+#include "change.h"
+#include "dbutil.h"
 #include "jukebox.h"
 
 /*
@@ -121,24 +123,28 @@ ARTIST::update() {
 	if (id != 0) {
 		// yes. just update the artist
 		db->execute ("UPDATE artists SET name=? WHERE id=#", name, id);
+		CHANGE::record (CHANGE_KIND_ARTIST, CHANGE_ACTION_UPDATE, id);
 		return;
 	}
 
 	// no. create a new artist
 	db->execute ("INSERT INTO artists (name) VALUES (?)", name);
 
-	// fetch the id
-	DBRESULT* res = db->query ("SELECT id FROM artists WHERE name=?", name);
-	if (res == NULL) {
-		// this shouldn't happen...
-	 id = 0;
-	 return;
-	}
+	// fetch the id, looking it up if the database can't tell
+	id = DBUTIL::lastInsertID ("artists");
+	if (id == 0) {
+		DBRESULT* res = db->query ("SELECT id FROM artists WHERE name=?", name);
+		if (res == NULL)
+			// this shouldn't happen...
+			return;
 
-	id = res->fetchColumnAsInteger (0);
+		id = res->fetchColumnAsInteger (0);
+		delete res;
+	}
 
-	// all done
-	delete res;
+	// tell the world it's there
+	if (id != 0)
+		CHANGE::record (CHANGE_KIND_ARTIST, CHANGE_ACTION_INSERT, id);
 }
 
 /*
@@ -151,7 +157,34 @@ ARTIST::update() {
 int
 ARTIST::fetchNext() {
 	// fetch the information from the database
-	DBRESULT* res = db->limitQuery ("SELECT id,name FROM artists WHERE id># ORDER BY id ASC", 1, 0, id);
+	return copyFetched (db->limitQuery ("SELECT id,name FROM artists WHERE id># ORDER BY id ASC", 1, 0, id));
+}
+
+/*
+ * ARTIST::fetchNextByName()
+ *
+ * This will try to fetch the next artist by name in place. The current
+ * name and ID are the position to continue from. It will return 0 on
+ * failure or non-zero on success.
+ *
+ */
+int
+ARTIST::fetchNextByName() {
+	const char* cur = (name != NULL) ? name : "";
+
+	// fetch the information from the database
+	return copyFetched (db->limitQuery ("SELECT id,name FROM artists WHERE name>? OR (name=? AND id>#) ORDER BY name ASC, id ASC", 1, 0, cur, cur, id));
+}
+
+/*
+ * ARTIST::copyFetched (DBRESULT* res)
+ *
+ * This will copy the artist fetched by [res] in place, and free [res]. It
+ * will return 0 if nothing was fetched or non-zero if something was.
+ *
+ */
+int
+ARTIST::copyFetched (DBRESULT* res) {
 	if (res == NULL)
 		// this failed. oh my...
 		return 0;
@@ -6,6 +6,8 @@
  */
 #include <stdlib.h>
 
+class DBRESULT;
+
 #ifndef __ARTIST_H__
 #define __ARTIST_H__
 
@@ -74,7 +76,21 @@ public:
 	 */
 	int fetchNext();
 
+	/*! \brief Fetches the next available artist by name
+	 *
+	 *  The artists are ordered by name, and by ID if the names are equal.
+	 *  This will return zero on failure or non-zero on success.
+	 */
+	int fetchNextByName();
+
 private:
+	/*! \brief Copies the artist fetched
+	 *  \param res The result of the query, which is freed
+	 *
+	 *  This will return zero if there was nothing fetched or non-zero if there was.
+	 */
+	int copyFetched (DBRESULT* res);
+
 	int id;
 	char*	name;
 };
@@ -0,0 +1,586 @@
+/*
+ * audioinfo.cc - Jukebox audio information code
+ *
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include "audioinfo.h"
+
+// ID3V1_LEN is the length of an ID3v1 tag
+#define ID3V1_LEN		128
+
+// ID3V2_HEADER_LEN is the length of the header (and footer) of an ID3v2 tag
+#define ID3V2_HEADER_LEN	10
+
+// AUDIOINFO_MAX_SECONDS is the longest a file can play, as a duration in milliseconds must fit
+#define AUDIOINFO_MAX_SECONDS	(0x7fffffff / 1000)
+
+// MP3_READ_LEN is the number of bytes read after the ID3v2 tag to find the first frames
+#define MP3_READ_LEN		4096
+
+// MP3_VERSION_xxx are the MPEG versions, as the frame header has them
+#define MP3_VERSION_25	0
+#define MP3_VERSION_2		2
+#define MP3_VERSION_1		3
+
+// OGG_PAGE_MAX is the largest an Ogg page can be
+#define OGG_PAGE_MAX		(27 + 255 + 255 * 255)
+
+// OGG_READ_LEN is the number of bytes read from either end of an Ogg file at first
+#define OGG_READ_LEN		8192
+
+// FLAC_STREAMINFO_LEN is the length of the STREAMINFO metadata block
+#define FLAC_STREAMINFO_LEN	34
+
+// MODULE_READ_LEN is the number of bytes read from the start of a module
+#define MODULE_READ_LEN		(0x410 + 128)
+
+// MODULE_ROWS is the number of rows each pattern is taken to have
+#define MODULE_ROWS			64
+
+// MODULE_SPEED and MODULE_TEMPO are the speed and tempo modules start with by default
+#define MODULE_SPEED		6
+#define MODULE_TEMPO		125
+
+/*
+ * MP3_FRAME is what the header of an MPEG audio frame tells.
+ */
+struct MP3_FRAME {
+	int		version, layer, bitrate, samplerate, samples, len, mono;
+};
+
+// the bitrates in kbit/s of MPEG-1 layers I, II and III, and of MPEG-2 layers I and II/III
+static const short mp3Bitrates[5][16] = {
+	{ 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 },
+	{ 0, 32, 48, 56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },
+	{ 0, 32, 40, 48,  56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 0 },
+	{ 0, 32, 48, 56,  64,  80,  96, 112, 128, 144, 160, 176, 192, 224, 256, 0 },
+	{ 0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160, 0 }
+};
+
+// the sample rates of MPEG-1; MPEG-2 has half of them, MPEG-2.5 a quarter
+static const int mp3SampleRates[3] = { 44100, 48000, 32000 };
+
+/*
+ * readBE32 (const unsigned char* p)
+ *
+ * This will return the big endian 32-bit value at [p].
+ *
+ */
+static inline unsigned int
+readBE32 (const unsigned char* p) {
+	return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | (unsigned int)p[3];
+}
+
+/*
+ * readLE32 (const unsigned char* p)
+ *
+ * This will return the little endian 32-bit value at [p].
+ *
+ */
+static inline unsigned int
+readLE32 (const unsigned char* p) {
+	return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+/*
+ * readLE16 (const unsigned char* p)
+ *
+ * This will return the little endian 16-bit value at [p].
+ *
+ */
+static inline int
+readLE16 (const unsigned char* p) {
+	return p[0] | (p[1] << 8);
+}
+
+/*
+ * setDuration (AUDIOINFO* info, long long samples, long long rate)
+ *
+ * This will set the duration of [info] to that of [samples] samples played
+ * at [rate] per second. Durations which don't fit are taken to be bogus.
+ *
+ */
+static void
+setDuration (AUDIOINFO* info, long long samples, long long rate) {
+	if ((samples <= 0) || (rate <= 0) || (samples / rate >= AUDIOINFO_MAX_SECONDS))
+		info->duration = 0;
+	else
+		info->duration = (int)(samples * 1000 / rate);
+}
+
+/*
+ * setBitrate (AUDIOINFO* info, long long bytes)
+ *
+ * This will set the bitrate of [info] to that of [bytes] bytes of audio
+ * playing for its duration.
+ *
+ */
+static void
+setBitrate (AUDIOINFO* info, long long bytes) {
+	// bits per millisecond are kbit/s
+	if (info->duration > 0)
+		info->bitrate = (int)((bytes * 8 + info->duration / 2) / info->duration);
+}
+
+/*
+ * parseFrame (const unsigned char* p, MP3_FRAME* f)
+ *
+ * This will parse MPEG audio frame header [p] into [f]. It will return zero
+ * if [p] isn't a valid frame header or non-zero if it is.
+ *
+ */
+static int
+parseFrame (const unsigned char* p, MP3_FRAME* f) {
+	int idx, pad;
+
+	// got the sync, and nothing reserved?
+	if ((p[0] != 0xff) || ((p[1] & 0xe0) != 0xe0))
+		return 0;
+	f->version = (p[1] >> 3) & 3; f->layer = 4 - ((p[1] >> 1) & 3);
+	idx = (p[2] >> 2) & 3;
+	if ((f->version == 1) || (f->layer == 4) || (idx == 3))
+		return 0;
+
+	// free format frames can't be told apart, so they are of no use to us
+	if (f->version == MP3_VERSION_1)
+		f->bitrate = mp3Bitrates[f->layer - 1][p[2] >> 4];
+	else
+		f->bitrate = mp3Bitrates[(f->layer == 1) ? 3 : 4][p[2] >> 4];
+	if (f->bitrate == 0)
+		return 0;
+
+	f->samplerate = mp3SampleRates[idx];
+	if (f->version == MP3_VERSION_2)
+		f->samplerate /= 2;
+	else if (f->version == MP3_VERSION_25)
+		f->samplerate /= 4;
+	f->mono = ((p[3] >> 6) == 3);
+
+	pad = (p[2] >> 1) & 1;
+	if (f->layer == 1) {
+		f->samples = 384;
+		f->len = (12000 * f->bitrate / f->samplerate + pad) * 4;
+	} else {
+		f->samples = ((f->layer == 3) && (f->version != MP3_VERSION_1)) ? 576 : 1152;
+		f->len = (f->samples / 8) * 1000 * f->bitrate / f->samplerate + pad;
+	}
+	return 1;
+}
+
+/*
+ * sameStream (MP3_FRAME* a, MP3_FRAME* b)
+ *
+ * This will return non-zero if frames [a] and [b] can be of the same stream.
+ *
+ */
+static int
+sameStream (MP3_FRAME* a, MP3_FRAME* b) {
+	return (a->version == b->version) && (a->layer == b->layer) && (a->samplerate == b->samplerate);
+}
+
+/*
+ * xingOffset (MP3_FRAME* f)
+ *
+ * This will return where the Xing header of layer III frame [f] would be,
+ * which is right after the side information.
+ *
+ */
+static int
+xingOffset (MP3_FRAME* f) {
+	if (f->version == MP3_VERSION_1)
+		return (f->mono) ? 4 + 17 : 4 + 32;
+	return (f->mono) ? 4 + 9 : 4 + 17;
+}
+
+/*
+ * readMP3Info (const char* fname, AUDIOINFO* info)
+ *
+ * This will put the duration, bitrate and sample rate of MP3 file [fname]
+ * in [info]. A Xing, Info or VBRI header in the first frame tells the
+ * number of frames; without one, the file is taken to have the bitrate of
+ * the frames within the first MP3_READ_LEN bytes. It will return zero on
+ * failure or non-zero on success.
+ *
+ */
+int
+readMP3Info (const char* fname, AUDIOINFO* info) {
+	unsigned char buf[MP3_READ_LEN];
+	struct stat fs;
+	MP3_FRAME f, g;
+	long long start = 0, end, frames = 0, bytes = 0, sum;
+	int fd, have, pos, x, off, flags, n, delay = 0;
+
+	info->duration = 0; info->bitrate = 0; info->samplerate = 0;
+
+	// open the file
+	fd = open (fname, O_RDONLY);
+	if (fd < 0)
+		// this failed. bail out
+		return 0;
+	if (fstat (fd, &fs) < 0) {
+		close (fd);
+		return 0;
+	}
+
+	// skip the ID3v2 tag, and leave the ID3v1 tag out of the audio
+	if ((pread (fd, buf, ID3V2_HEADER_LEN, 0) == ID3V2_HEADER_LEN) && (!memcmp (buf, "ID3", 3)))
+		start = ID3V2_HEADER_LEN + (((buf[6] & 0x7f) << 21) | ((buf[7] & 0x7f) << 14) | ((buf[8] & 0x7f) << 7) | (buf[9] & 0x7f)) +
+		        ((buf[5] & 0x10) ? ID3V2_HEADER_LEN : 0);
+	end = fs.st_size;
+	if ((end - start >= ID3V1_LEN) && (pread (fd, buf, 3, end - ID3V1_LEN) == 3) && (!memcmp (buf, "TAG", 3)))
+		end -= ID3V1_LEN;
+	have = pread (fd, buf, sizeof (buf), start);
+	close (fd);
+	if (have < 4)
+		return 0;
+
+	// find the first frame. the one after it must fit too, if we have it
+	for (pos = 0; pos + 4 <= have; pos++) {
+		if (!parseFrame (buf + pos, &f))
+			continue;
+		if (pos + f.len + 4 > have)
+			break;
+		if ((parseFrame (buf + pos + f.len, &g)) && (sameStream (&f, &g)))
+			break;
+	}
+	if (pos + 4 > have)
+		// no frames. this isn't MPEG audio
+		return 0;
+	info->samplerate = f.samplerate;
+
+	// got a Xing or Info header?
+	x = pos + xingOffset (&f);
+	if ((f.layer == 3) && (x + 8 <= have) && ((!memcmp (buf + x, "Xing", 4)) || (!memcmp (buf + x, "Info", 4)))) {
+		// yes. fetch what it has
+		flags = readBE32 (buf + x + 4); off = x + 8;
+		if ((flags & 1) && (off + 4 <= have)) { frames = readBE32 (buf + off); off += 4; }
+		if ((flags & 2) && (off + 4 <= have)) { bytes  = readBE32 (buf + off); off += 4; }
+		if (flags & 4) off += 100;
+		if (flags & 8) off += 4;
+
+		// the LAME header after it tells how many samples were added at either end
+		if ((off + 24 <= have) && ((!memcmp (buf + off, "LAME", 4)) || (!memcmp (buf + off, "Lav", 3))))
+			delay = (buf[off + 21] << 4) + (buf[off + 22] >> 4) + ((buf[off + 22] & 0x0f) << 8) + buf[off + 23];
+	} else if ((f.layer == 3) && (pos + 36 + 18 <= have) && (!memcmp (buf + pos + 36, "VBRI", 4))) {
+		// a VBRI header then
+		bytes = readBE32 (buf + pos + 36 + 10);
+		frames = readBE32 (buf + pos + 36 + 14);
+	}
+
+	if (frames > 0) {
+		// we know the number of frames
+		setDuration (info, frames * f.samples - delay, f.samplerate);
+		setBitrate (info, (bytes > 0) ? bytes : end - start - pos);
+		return 1;
+	}
+
+	// average the bitrate of the frames we have
+	for (x = pos, sum = 0, n = 0; x + 4 <= have; x += g.len, n++) {
+		if ((!parseFrame (buf + x, &g)) || (!sameStream (&f, &g)))
+			break;
+		sum += g.bitrate;
+	}
+	if (n == 0) {
+		sum = f.bitrate; n = 1;
+	}
+	// this many bytes at this many kbit/s
+	info->bitrate = (int)(sum / n);
+	setDuration (info, (end - start - pos) * 8 * n, sum * 1000);
+	return 1;
+}
+
+/*
+ * oggIdent (const unsigned char* p, int len, AUDIOINFO* info, long long* preskip,
+ *           int* granuleRate)
+ *
+ * This will parse identification header [p], which is [len] bytes long, into
+ * [info]. The samples to skip at the start go in [preskip], the rate of the
+ * granule positions in [granuleRate]. It will return zero if the codec is
+ * not known or non-zero if it is.
+ *
+ */
+static int
+oggIdent (const unsigned char* p, int len, AUDIOINFO* info, long long* preskip, int* granuleRate) {
+	*preskip = 0;
+	if ((len >= 16) && (!memcmp (p, "\001vorbis", 7))) {
+		// Vorbis positions are in samples
+		info->samplerate = readLE32 (p + 12);
+		*granuleRate = info->samplerate;
+		return 1;
+	}
+	if ((len >= 16) && (!memcmp (p, "OpusHead", 8))) {
+		// Opus is always decoded at 48 kHz, whatever went in
+		*preskip = readLE16 (p + 10);
+		info->samplerate = readLE32 (p + 12);
+		if (info->samplerate == 0)
+			info->samplerate = 48000;
+		*granuleRate = 48000;
+		return 1;
+	}
+	if ((len >= 17 + FLAC_STREAMINFO_LEN) && (!memcmp (p, "\177FLAC", 5)) && (!memcmp (p + 9, "fLaC", 4))) {
+		// the STREAMINFO block follows the marker
+		info->samplerate = (p[27] << 12) | (p[28] << 4) | (p[29] >> 4);
+		*granuleRate = info->samplerate;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * lastGranule (int fd, long long size, unsigned int serial, int len)
+ *
+ * This will look for the last page of stream [serial] which has a granule
+ * position within the last [len] bytes of [fd], which is [size] bytes. It
+ * will return the position, or -1 if there is none.
+ *
+ */
+static long long
+lastGranule (int fd, long long size, unsigned int serial, int len) {
+	unsigned char* buf;
+	const unsigned char* h;
+	long long granule = -1;
+	int have, i;
+
+	if (len > size)
+		len = (int)size;
+	buf = (unsigned char*)malloc (len);
+	if (buf == NULL)
+		return -1;
+	have = pread (fd, buf, len, size - len);
+
+	// walk back from the end
+	for (i = have - 27; i >= 0; i--) {
+		h = buf + i;
+		if ((h[0] != 'O') || (memcmp (h, "OggS", 4)) || (h[4] != 0) || (readLE32 (h + 14) != serial))
+			continue;
+		if ((readLE32 (h + 6) == 0xffffffff) && (readLE32 (h + 10) == 0xffffffff))
+			// no packet ends on this page
+			continue;
+		granule = ((long long)readLE32 (h + 10) << 32) | readLE32 (h + 6);
+		break;
+	}
+
+	free (buf);
+	return granule;
+}
+
+/*
+ * readOggInfo (const char* fname, AUDIOINFO* info)
+ *
+ * This will put the duration, bitrate and sample rate of Ogg file [fname]
+ * in [info]. The first stream we know the codec of is used, and its length
+ * is taken from the granule position of its last page. It will return zero
+ * on failure or non-zero on success.
+ *
+ */
+int
+readOggInfo (const char* fname, AUDIOINFO* info) {
+	unsigned char buf[OGG_READ_LEN];
+	const unsigned char* h;
+	struct stat fs;
+	unsigned int serial = 0;
+	long long preskip = 0, granule;
+	int fd, have, pos, nsegs = 0, i, bodyLen = 0, packetLen, granuleRate = 0, known = 0;
+
+	info->duration = 0; info->bitrate = 0; info->samplerate = 0;
+
+	// open the file, and fetch the start of it
+	fd = open (fname, O_RDONLY);
+	if (fd < 0)
+		// this failed. bail out
+		return 0;
+	if (fstat (fd, &fs) < 0) {
+		close (fd);
+		return 0;
+	}
+	have = pread (fd, buf, sizeof (buf), 0);
+
+	// the identification headers are alone on the first page of each stream
+	for (pos = 0; (!known) && (pos + 27 <= have); pos += 27 + nsegs + bodyLen) {
+		h = buf + pos;
+		if ((memcmp (h, "OggS", 4)) || (h[4] != 0) || (!(h[5] & 0x02)))
+			// not the first page of a stream. we are out of streams
+			break;
+		nsegs = h[26];
+		if (pos + 27 + nsegs > have)
+			break;
+		for (i = 0, bodyLen = 0, packetLen = -1; i < nsegs; i++) {
+			bodyLen += h[27 + i];
+			if ((packetLen < 0) && (h[27 + i] < 255))
+				packetLen = bodyLen;
+		}
+		if (packetLen < 0)
+			packetLen = bodyLen;
+		if (pos + 27 + nsegs + packetLen > have)
+			break;
+		serial = readLE32 (h + 14);
+		known = oggIdent (h + 27 + nsegs, packetLen, info, &preskip, &granuleRate);
+	}
+	if ((!known) || (granuleRate <= 0)) {
+		close (fd);
+		info->samplerate = 0;
+		return 0;
+	}
+
+	// the last page is usually small, but it may be up to OGG_PAGE_MAX bytes
+	granule = lastGranule (fd, fs.st_size, serial, OGG_READ_LEN);
+	if (granule < 0)
+		granule = lastGranule (fd, fs.st_size, serial, 2 * OGG_PAGE_MAX);
+	close (fd);
+
+	setDuration (info, granule - preskip, granuleRate);
+	setBitrate (info, fs.st_size);
+	return 1;
+}
+
+/*
+ * readFLACInfo (const char* fname, AUDIOINFO* info)
+ *
+ * This will put the duration, bitrate and sample rate of FLAC file [fname]
+ * in [info], as the STREAMINFO block tells them. It will return zero on
+ * failure or non-zero on success.
+ *
+ */
+int
+readFLACInfo (const char* fname, AUDIOINFO* info) {
+	unsigned char buf[8 + FLAC_STREAMINFO_LEN];
+	const unsigned char* p = buf + 8;
+	struct stat fs;
+	long long pos = 0, samples;
+	int fd;
+
+	info->duration = 0; info->bitrate = 0; info->samplerate = 0;
+
+	// open the file
+	fd = open (fname, O_RDONLY);
+	if (fd < 0)
+		// this failed. bail out
+		return 0;
+	if ((fstat (fd, &fs) < 0) || (pread (fd, buf, ID3V2_HEADER_LEN, 0) != ID3V2_HEADER_LEN)) {
+		close (fd);
+		return 0;
+	}
+
+	if (!memcmp (buf, "ID3", 3))
+		// some taggers put an ID3v2 tag up front anyway
+		pos = ID3V2_HEADER_LEN + (((buf[6] & 0x7f) << 21) | ((buf[7] & 0x7f) << 14) | ((buf[8] & 0x7f) << 7) | (buf[9] & 0x7f)) +
+		      ((buf[5] & 0x10) ? ID3V2_HEADER_LEN : 0);
+
+	// the marker must be followed by the STREAMINFO block
+	if ((pread (fd, buf, sizeof (buf), pos) != sizeof (buf)) || (memcmp (buf, "fLaC", 4)) || ((buf[4] & 0x7f) != 0)) {
+		close (fd);
+		return 0;
+	}
+	close (fd);
+
+	// 20 bits of sample rate, 3 of channels, 5 of sample size, 36 of samples
+	info->samplerate = (p[10] << 12) | (p[11] << 4) | (p[12] >> 4);
+	samples = ((long long)(p[13] & 0x0f) << 32) | readBE32 (p + 14);
+	if (info->samplerate == 0)
+		return 0;
+	setDuration (info, samples, info->samplerate);
+	setBitrate (info, fs.st_size - pos);
+	return 1;
+}
+
+/*
+ * countOrders (const unsigned char* p, int num, int avail, int skip, int end)
+ *
+ * This will return the number of patterns in order list [p], which has
+ * [num] entries, of which [avail] were read. Entries [skip] are markers,
+ * which don't play, and an entry [end] ends the list.
+ *
+ */
+static int
+countOrders (const unsigned char* p, int num, int avail, int skip, int end) {
+	int i, n = 0;
+
+	if (num > avail)
+		num = avail;
+	for (i = 0; (i < num) && (p[i] != end); i++)
+		if (p[i] != skip)
+			n++;
+	return n;
+}
+
+/*
+ * readModuleInfo (const char* fname, AUDIOINFO* info)
+ *
+ * This will estimate the duration of module [fname], as told by its
+ * extension, and put it in [info]. Each of the orders is taken to be
+ * MODULE_ROWS rows at the initial speed and tempo. It will return zero on
+ * failure or non-zero on success.
+ *
+ */
+int
+readModuleInfo (const char* fname, AUDIOINFO* info) {
+	unsigned char p[MODULE_READ_LEN];
+	const char* ext = strrchr (fname, '.');
+	int fd, have, orders = 0, speed = MODULE_SPEED, tempo = MODULE_TEMPO;
+
+	info->duration = 0; info->bitrate = 0; info->samplerate = 0;
+	if (ext == NULL)
+		return 0;
+	ext++;
+
+	// fetch the header
+	fd = open (fname, O_RDONLY);
+	if (fd < 0)
+		// this failed. bail out
+		return 0;
+	have = pread (fd, p, sizeof (p), 0);
+	close (fd);
+
+	if (!strcasecmp (ext, "mod")) {
+		// the song length follows the samples, of which there are 15 without a signature
+		if ((have >= 1084) && (p[1080] >= 0x20) && (p[1081] >= 0x20) && (p[1082] >= 0x20) && (p[1083] >= 0x20))
+			orders = p[950];
+		else if (have >= 600)
+			orders = p[470];
+		if (orders > 128)
+			orders = 0;
+	} else if (!strcasecmp (ext, "stm")) {
+		// the upper nibble of the tempo is the speed; the tempo itself is fixed
+		if ((have >= MODULE_READ_LEN) && (p[28] == 0x1a) && (p[29] == 2)) {
+			speed = p[0x20] >> 4;
+			orders = countOrders (p + 0x410, 128, 128, 255, 99);
+		}
+	} else if (!strcasecmp (ext, "s3m")) {
+		if ((have >= 0x60) && (!memcmp (p + 0x2c, "SCRM", 4))) {
+			speed = p[0x31]; tempo = p[0x32];
+			orders = countOrders (p + 0x60, readLE16 (p + 0x20), have - 0x60, 254, 255);
+		}
+	} else if (!strcasecmp (ext, "it")) {
+		if ((have >= 0xc0) && (!memcmp (p, "IMPM", 4))) {
+			speed = p[0x32]; tempo = p[0x33];
+			orders = countOrders (p + 0xc0, readLE16 (p + 0x20), have - 0xc0, 254, 255);
+		}
+	} else if (!strcasecmp (ext, "xm")) {
+		if ((have >= 80) && (!memcmp (p, "Extended Module:", 16))) {
+			orders = readLE16 (p + 64);
+			if (orders > 256)
+				orders = 0;
+			speed = readLE16 (p + 76); tempo = readLE16 (p + 78);
+		}
+	}
+
+	if ((speed < 1) || (speed > 31))
+		speed = MODULE_SPEED;
+	if ((tempo < 32) || (tempo > 255))
+		tempo = MODULE_TEMPO;
+	if (orders == 0)
+		return 0;
+
+	// a row lasts [speed] ticks, a tick 2.5 / [tempo] seconds
+	info->duration = orders * MODULE_ROWS * speed * 2500 / tempo;
+	return 1;
+}
+
+/* vim:set ts=2 sw=2: */
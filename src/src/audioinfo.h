@@ -0,0 +1,77 @@
+/*
+ * audioinfo.h
+ *
+ * This is the jukebox audio information reader, which tells how long a file
+ * plays, along with its bitrate and sample rate, from its headers.
+ *
+ */
+#include <stdlib.h>
+
+#ifndef __AUDIOINFO_H__
+#define __AUDIOINFO_H__
+
+/*!
+ * \struct AUDIOINFO
+ * \brief This is what is known about the audio of a file
+ *
+ * Anything that isn't known is zero.
+ */
+struct AUDIOINFO {
+	//! \brief The playing time, in milliseconds
+	int		duration;
+
+	//! \brief The average bitrate, in kbit/s
+	int		bitrate;
+
+	//! \brief The sample rate, in Hz
+	int		samplerate;
+};
+
+/*! \brief Reads the audio information of an MP3 file
+ *  \param fname The file to read
+ *  \param info Where the information goes
+ *
+ *  The first frame after the ID3v2 tag is looked at. If it holds a Xing,
+ *  Info or VBRI header, the number of frames is taken from there, less the
+ *  encoder delay and padding a LAME header tells about. Otherwise the
+ *  bitrate of the frames within the first few kilobytes is taken to be that
+ *  of the whole file. This will return zero if the file couldn't be read or
+ *  non-zero if it could.
+ */
+int readMP3Info (const char* fname, AUDIOINFO* info);
+
+/*! \brief Reads the audio information of an Ogg Vorbis, Opus or Ogg FLAC file
+ *  \param fname The file to read
+ *  \param info Where the information goes
+ *
+ *  The sample rate comes from the identification header, the duration from
+ *  the granule position of the last page of the stream, which is looked for
+ *  backwards from the end of the file. This will return zero if the file
+ *  couldn't be read or non-zero if it could.
+ */
+int readOggInfo (const char* fname, AUDIOINFO* info);
+
+/*! \brief Reads the audio information of a FLAC file
+ *  \param fname The file to read
+ *  \param info Where the information goes
+ *
+ *  Everything comes from the STREAMINFO block, which comes first. This will
+ *  return zero if the file couldn't be read or non-zero if it could.
+ */
+int readFLACInfo (const char* fname, AUDIOINFO* info);
+
+/*! \brief Estimates how long a module plays
+ *  \param fname The file to read
+ *  \param info Where the information goes
+ *
+ *  .MOD, .STM, .S3M, .IT and .XM files are known. The number of orders is
+ *  taken from the header, and each pattern is taken to be 64 rows at the
+ *  initial speed and tempo. Jumps and tempo changes within the patterns are
+ *  not looked at, so this is an estimate. This will return zero if the
+ *  file couldn't be read or non-zero if it could.
+ */
+int readModuleInfo (const char* fname, AUDIOINFO* info);
+
+#endif /* __AUDIOINFO_H__ */
+
+/* vim:set ts=2 sw=2: */
@@ -0,0 +1,112 @@
+/*
+ * change.cc - Jukebox catalog change log code
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "change.h"
+#include "jukebox.h"
+
+/*
+ * CHANGE::CHANGE (unsigned int since)
+ *
+ * This will initialize the object to read the changes after sequence number
+ * [since].
+ *
+ */
+CHANGE::CHANGE (unsigned int since) {
+	seq = since; kind = action = objectID = 0;
+}
+
+/*
+ * CHANGE::record (int kind, int action, int id)
+ *
+ * This will log that [action] happened to object [id] of kind [kind].
+ *
+ */
+void
+CHANGE::record (int kind, int action, int id) {
+	db->execute ("INSERT INTO catalog_changes (kind,action,objectid) VALUES (#,#,#)", kind, action, id);
+}
+
+/*
+ * CHANGE::getRange (unsigned int* oldest, unsigned int* latest)
+ *
+ * This will store the oldest and latest sequence number in the log in
+ * [oldest] and [latest]. It will return 0 on failure or 1 on success.
+ *
+ */
+int
+CHANGE::getRange (unsigned int* oldest, unsigned int* latest) {
+	DBRESULT* res = db->query ("SELECT MIN(id),MAX(id) FROM catalog_changes");
+	if (res == NULL)
+		// this failed. oh my...
+		return 0;
+
+	// an empty log yields NULLs, which come out as zero
+	*oldest = *latest = 0;
+	if (res->numRows() > 0) {
+		*oldest = res->fetchColumnAsInteger (0);
+		*latest = res->fetchColumnAsInteger (1);
+	}
+
+	// all done
+	delete res;
+	return 1;
+}
+
+/*
+ * CHANGE::prune (unsigned int keep)
+ *
+ * This will throw away all but the latest [keep] changes.
+ *
+ */
+void
+CHANGE::prune (unsigned int keep) {
+	unsigned int oldest, latest;
+
+	// anything to throw away?
+	if ((!getRange (&oldest, &latest)) || (latest - oldest < keep))
+		// no. bail out
+		return;
+
+	db->execute ("DELETE FROM catalog_changes WHERE id<=#", latest - keep);
+}
+
+/*
+ * CHANGE::fetchNext()
+ *
+ * This will try to fetch the next change in place. It will return 0 on
+ * failure or non-zero on success.
+ *
+ */
+int
+CHANGE::fetchNext() {
+	// fetch the information from the database
+	DBRESULT* res = db->limitQuery ("SELECT id,kind,action,objectid FROM catalog_changes WHERE id># ORDER BY id ASC", 1, 0, seq);
+	if (res == NULL)
+		// this failed. oh my...
+		return 0;
+
+	// got a result?
+	if (res->numRows() == 0) {
+		// no. free the result and return failure
+		delete res;
+		return 0;
+	}
+
+	// copy the data
+	seq      = res->fetchColumnAsInteger (0);
+	kind     = res->fetchColumnAsInteger (1);
+	action   = res->fetchColumnAsInteger (2);
+	objectID = res->fetchColumnAsInteger (3);
+
+	delete res;
+
+	// all done
+	return 1;
+}
+
+/* vim:set ts=2 sw=2: */
@@ -0,0 +1,90 @@
+/*
+ * change.h
+ *
+ * This is the jukebox catalog change log.
+ *
+ */
+#include <stdlib.h>
+
+#ifndef __CHANGE_H__
+#define __CHANGE_H__
+
+// CHANGE_KIND_xxx are the kinds of catalog objects which can change
+#define CHANGE_KIND_ARTIST		0
+#define CHANGE_KIND_ALBUM			1
+#define CHANGE_KIND_TRACK			2
+#define CHANGE_KIND_CATALOG		3
+
+// CHANGE_ACTION_xxx are the things which can happen to them
+#define CHANGE_ACTION_INSERT	0
+#define CHANGE_ACTION_UPDATE	1
+#define CHANGE_ACTION_DELETE	2
+
+//! \brief CHANGE_MAX_LIST is the maximum number of changes listed at once
+#define CHANGE_MAX_LIST				1000
+
+//! \brief CHANGE_DEFAULT_LOG_SIZE is the default number of changes kept
+#define CHANGE_DEFAULT_LOG_SIZE	100000
+
+/*!
+ * \class CHANGE
+ * \brief A single change made to the catalog
+ *
+ * Every change gets a sequence number, which is shared by all kinds of
+ * objects, so a client which knows the last sequence number it has seen can
+ * ask for everything after it. A wipe of the entire catalog is logged as the
+ * deletion of the CHANGE_KIND_CATALOG object.
+ */
+class CHANGE {
+public:
+	/*! \brief Constructs a change log reader
+	 *  \param since The sequence number after which to start
+	 */
+	CHANGE (unsigned int since);
+
+	/*! \brief Logs a change
+	 *  \param kind The CHANGE_KIND_xxx kind of object
+	 *  \param action The CHANGE_ACTION_xxx which happened
+	 *  \param id The ID of the object
+	 */
+	static void record (int kind, int action, int id);
+
+	/*! \brief Fetches the range of sequence numbers in the log
+	 *  \param oldest Receives the oldest sequence number, 0 if the log is empty
+	 *  \param latest Receives the latest sequence number, 0 if the log is empty
+	 *
+	 *  This will return zero on failure or non-zero on success.
+	 */
+	static int getRange (unsigned int* oldest, unsigned int* latest);
+
+	/*! \brief Throws away all but the latest changes
+	 *  \param keep The number of changes to keep
+	 */
+	static void prune (unsigned int keep);
+
+	/*! \brief Fetches the next change
+	 *
+	 *  This will return zero on failure or non-zero on success.
+	 */
+	int fetchNext();
+
+	//! \brief Returns the sequence number of the change
+	inline unsigned int getSeq() { return seq; }
+
+	//! \brief Returns the CHANGE_KIND_xxx kind of object changed
+	inline int getKind() { return kind; }
+
+	//! \brief Returns the CHANGE_ACTION_xxx which happened
+	inline int getAction() { return action; }
+
+	//! \brief Returns the ID of the object changed
+	inline int getObjectID() { return objectID; }
+
+private:
+	unsigned int seq;
+	int kind, action, objectID;
+};
+
+#endif /* __CHANGE_H__ */
+
+/* vim:set ts=2 sw=2: */
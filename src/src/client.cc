@@ -2,7 +2,12 @@
  * client.cc - Jukebox daemon client code
  *
  */
+#include <sys/types.h>
+#include <sys/socket.h>
 #include <sys/time.h>
+#include <errno.h>
+#include <pwd.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,13 +15,304 @@
 #include <libplusplus/network.h>
 #include "artist.h"
 #include "album.h"
+#include "change.h"
 #include "jukebox.h"
 #include "client.h"
+#include "fold.h"
 #include "server.h"
+#include "session.h"
 #include "track.h"
 #include "ident.h"
+#include "local.h"
 #include "user.h"
 
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif /* MSG_NOSIGNAL */
+
+// deltaNames are the names of the QUEUE_DELTA_xxx changes
+static const char* deltaNames[] = {
+	"added", "removed", "playing", "notplaying", "cleared"
+};
+
+// changeNames are the names of the CHANGE_ACTION_xxx actions
+static const char* changeNames[] = {
+	"insert", "update", "delete"
+};
+
+// kindNames are the names of the CHANGE_KIND_xxx objects
+static const char* kindNames[] = {
+	"artist", "album", "track", "catalog"
+};
+
+// commandNames maps every spelling of a command to the JUKECLIENT_CMD_xxx
+// name its cost and rights are configured under
+static char* commandNames[][2] = {
+	{ JUKECLIENT_CMD_USER, JUKECLIENT_CMD_USER },
+	{ JUKECLIENT_CMD_PASSWORD, JUKECLIENT_CMD_PASSWORD },
+	{ JUKECLIENT_CMD_PASSWORD2, JUKECLIENT_CMD_PASSWORD },
+	{ JUKECLIENT_CMD_PAUSE, JUKECLIENT_CMD_PAUSE },
+	{ JUKECLIENT_CMD_CONTINUE, JUKECLIENT_CMD_CONTINUE },
+	{ JUKECLIENT_CMD_CONTINUE2, JUKECLIENT_CMD_CONTINUE },
+	{ JUKECLIENT_CMD_STOP, JUKECLIENT_CMD_STOP },
+	{ JUKECLIENT_CMD_PLAY, JUKECLIENT_CMD_PLAY },
+	{ JUKECLIENT_CMD_NEXT, JUKECLIENT_CMD_NEXT },
+	{ JUKECLIENT_CMD_NEXT2, JUKECLIENT_CMD_NEXT },
+	{ JUKECLIENT_CMD_USERS, JUKECLIENT_CMD_USERS },
+	{ JUKECLIENT_CMD_STATUS, JUKECLIENT_CMD_STATUS },
+	{ JUKECLIENT_CMD_STATUS2, JUKECLIENT_CMD_STATUS },
+	{ JUKECLIENT_CMD_RANDOM, JUKECLIENT_CMD_RANDOM },
+	{ JUKECLIENT_CMD_RANDOM2, JUKECLIENT_CMD_RANDOM },
+	{ JUKECLIENT_CMD_QUEUE, JUKECLIENT_CMD_QUEUE },
+	{ JUKECLIENT_CMD_QUEUE2, JUKECLIENT_CMD_QUEUE },
+	{ JUKECLIENT_CMD_REMOVE, JUKECLIENT_CMD_REMOVE },
+	{ JUKECLIENT_CMD_REMOVE2, JUKECLIENT_CMD_REMOVE },
+	{ JUKECLIENT_CMD_LOCK, JUKECLIENT_CMD_LOCK },
+	{ JUKECLIENT_CMD_UNLOCK, JUKECLIENT_CMD_UNLOCK },
+	{ JUKECLIENT_CMD_CLEAR, JUKECLIENT_CMD_CLEAR },
+	{ JUKECLIENT_CMD_ALBUMS, JUKECLIENT_CMD_ALBUMS },
+	{ JUKECLIENT_CMD_ARTISTALBUMS, JUKECLIENT_CMD_ARTISTALBUMS },
+	{ JUKECLIENT_CMD_ARTISTS, JUKECLIENT_CMD_ARTISTS },
+	{ JUKECLIENT_CMD_ENQUEUETR, JUKECLIENT_CMD_ENQUEUETR },
+	{ JUKECLIENT_CMD_ENQUEUEAL, JUKECLIENT_CMD_ENQUEUEAL },
+	{ JUKECLIENT_CMD_LISTALBUM, JUKECLIENT_CMD_LISTALBUM },
+	{ JUKECLIENT_CMD_GETARTIST, JUKECLIENT_CMD_GETARTIST },
+	{ JUKECLIENT_CMD_GETALBUM, JUKECLIENT_CMD_GETALBUM },
+	{ JUKECLIENT_CMD_GETTRACK, JUKECLIENT_CMD_GETTRACK },
+	{ JUKECLIENT_CMD_VOLUME, JUKECLIENT_CMD_VOLUME },
+	{ JUKECLIENT_CMD_VOLUP, JUKECLIENT_CMD_VOLUP },
+	{ JUKECLIENT_CMD_VOLDN, JUKECLIENT_CMD_VOLDN },
+	{ JUKECLIENT_CMD_IDENT, JUKECLIENT_CMD_IDENT },
+	{ JUKECLIENT_CMD_UPDATES, JUKECLIENT_CMD_UPDATES },
+	{ JUKECLIENT_CMD_RESUME, JUKECLIENT_CMD_RESUME },
+	{ JUKECLIENT_CMD_COUNTERS, JUKECLIENT_CMD_COUNTERS },
+	{ JUKECLIENT_CMD_CHANGES, JUKECLIENT_CMD_CHANGES },
+	{ JUKECLIENT_CMD_SEARCH, JUKECLIENT_CMD_SEARCH },
+	{ JUKECLIENT_CMD_COMPLETE, JUKECLIENT_CMD_COMPLETE },
+	{ JUKECLIENT_CMD_FUZZY, JUKECLIENT_CMD_FUZZY },
+	{ NULL, NULL }
+};
+
+// completeNames are the names of the COMPLETE_KIND_xxx kinds
+static const char* completeNames[COMPLETE_NUM_KINDS] = {
+	"artist", "album", "title"
+};
+
+// topicNames are the names of the JUKECLIENT_TOPIC_xxx topics
+static const char* topicNames[JUKECLIENT_NUM_TOPICS] = {
+	"song", "queue", "volume", "state", "users"
+};
+
+/*
+ * JUKECLIENT::JUKECLIENT()
+ *
+ * This will construct a client which is connected over TCP.
+ *
+ */
+JUKECLIENT::JUKECLIENT() {
+	local = 0; localfd = -1; peeruid = -1;
+	outBuf = NULL; outLen = outSize = 0;
+	overflowed = 0; lastActive = time ((time_t*)NULL);
+}
+
+/*
+ * JUKECLIENT::JUKECLIENT (int fd, int uid)
+ *
+ * This will construct a client which is connected over AF_UNIX socket [fd],
+ * by user ID [uid].
+ *
+ */
+JUKECLIENT::JUKECLIENT (int fd, int uid) {
+	local = 1; localfd = fd; peeruid = uid;
+	outBuf = NULL; outLen = outSize = 0;
+	overflowed = 0; lastActive = time ((time_t*)NULL);
+}
+
+/*
+ * JUKECLIENT::~JUKECLIENT()
+ *
+ * This will destroy the client. Local clients are closed and removed from
+ * the local server.
+ *
+ */
+JUKECLIENT::~JUKECLIENT() {
+	if (local) {
+		if (localfd >= 0)
+			::close (localfd);
+		localserver->remove (this);
+	}
+	if (outBuf) free (outBuf);
+}
+
+/*
+ * JUKECLIENT::sendf (const char* fmt, ...)
+ *
+ * This will send [fmt] to the client, printf() style. It will return 0 on
+ * failure or 1 on success.
+ *
+ */
+int
+JUKECLIENT::sendf (const char* fmt, ...) {
+	char buf[JUKECLIENT_MAX_LINE];
+	char* ptr = buf;
+	va_list va;
+	int len, result;
+
+	// print it in our buffer
+	va_start (va, fmt);
+	len = vsnprintf (buf, sizeof (buf), fmt, va);
+	va_end (va);
+	if (len < 0)
+		// this failed. bail out
+		return 0;
+
+	// did it fit?
+	if (len >= (int)sizeof (buf)) {
+		// no. use a bigger one
+		ptr = (char*)malloc (len + 1);
+		if (ptr == NULL)
+			return 0;
+		va_start (va, fmt);
+		vsnprintf (ptr, len + 1, fmt, va);
+		va_end (va);
+	}
+
+	// send it the way the client is connected
+	if (local)
+		result = sendLocal (ptr, len);
+	else
+		result = SERVICECLIENT::sendf ("%s", ptr);
+
+	if (ptr != buf) free (ptr);
+	return result;
+}
+
+/*
+ * JUKECLIENT::sendLocal (const char* data, int len)
+ *
+ * This will send [len] bytes of [data] over the AF_UNIX socket. Whatever
+ * does not fit in the socket is buffered, and sent by flush() once there is
+ * room. It will return 0 on failure or 1 on success.
+ *
+ */
+int
+JUKECLIENT::sendLocal (const char* data, int len) {
+	int sent = 0;
+	char* ptr;
+
+	// is the socket still there?
+	if (localfd < 0)
+		// no. bail out
+		return 0;
+
+	// nothing waiting? then try to send it right away
+	if (outLen == 0) {
+		sent = ::send (localfd, data, len, MSG_NOSIGNAL);
+		if (sent < 0) {
+			// did this fail for real?
+			if ((errno != EAGAIN) && (errno != EINTR))
+				// yes. the client will be cleaned up once we notice the hangup
+				return 0;
+			sent = 0;
+		}
+		if (sent == len)
+			// all done
+			return 1;
+	}
+
+	// would this take too much room?
+	if ((config->getMaxOutput() > 0) && (outLen + len - sent > config->getMaxOutput())) {
+		// yes. the client isn't reading, have it disconnected
+		overflowed = 1;
+		return 0;
+	}
+
+	// buffer the rest
+	if (outLen + len - sent > outSize) {
+		ptr = (char*)realloc (outBuf, outLen + len - sent + JUKECLIENT_OUTPUT_CHUNK);
+		if (ptr == NULL)
+			// this failed. drop the text
+			return 0;
+		outBuf = ptr; outSize = outLen + len - sent + JUKECLIENT_OUTPUT_CHUNK;
+	}
+	memcpy (outBuf + outLen, data + sent, len - sent);
+	outLen += len - sent;
+	return 1;
+}
+
+/*
+ * JUKECLIENT::flush()
+ *
+ * This will send as much of the buffered output over the AF_UNIX socket as
+ * it takes. It will return 0 if the connection failed or 1 otherwise.
+ *
+ */
+int
+JUKECLIENT::flush() {
+	int sent;
+
+	// anything to do?
+	if ((localfd < 0) || (outLen == 0))
+		// no. bail out
+		return 1;
+
+	sent = ::send (localfd, outBuf, outLen, MSG_NOSIGNAL);
+	if (sent < 0) {
+		// did this fail for real?
+		if ((errno != EAGAIN) && (errno != EINTR)) {
+			// yes. nobody will read this anymore
+			outLen = 0;
+			return 0;
+		}
+		return 1;
+	}
+
+	// remove what was sent
+	outLen -= sent;
+	memmove (outBuf, outBuf + sent, outLen);
+	return 1;
+}
+
+/*
+ * JUKECLIENT::recv (char* buf, int len)
+ *
+ * This will receive at most [len] bytes into [buf]. It will return the number
+ * of bytes received, or zero or less if there was nothing.
+ *
+ */
+int
+JUKECLIENT::recv (char* buf, int len) {
+	// connected over TCP?
+	if (!local)
+		// yes. let the network library handle it
+		return SERVICECLIENT::recv (buf, len);
+
+	return (localfd >= 0) ? ::recv (localfd, buf, len, 0) : 0;
+}
+
+/*
+ * JUKECLIENT::close()
+ *
+ * This will close the connection. Local clients get their waiting output
+ * sent first, if the socket takes it.
+ *
+ */
+void
+JUKECLIENT::close() {
+	// connected over TCP?
+	if (!local) {
+		// yes. let the network library handle it
+		SERVICECLIENT::close();
+		return;
+	}
+
+	// send what we can and hang up
+	flush();
+	if (localfd >= 0)
+		::close (localfd);
+	localfd = -1; outLen = 0;
+}
+
 /*
  * JUKECLIENT::getState()
  *
@@ -48,13 +344,78 @@ JUKECLIENT::getUser() {
  */
 void
 JUKECLIENT::welcome() {
+	static unsigned int nextSerial = 0;
+
 	// initialize the state
-	state = JUKECLIENT_STATE_CONN; userid = -1; sendUpdates = 0;
+	state = JUKECLIENT_STATE_CONN; userid = -1;
+	topics = pendingTopics = 0; updateWindow = config->getUpdateWindow();
+	queueVersion = queue->getVersion();
+	memset (pendingCount, 0, sizeof (pendingCount));
+	serial = ++nextSerial; suspended = 0; pendingLen = 0; pendingOverflow = 0;
+
+	// start with a full bucket of commands
+	lastActive = time ((time_t*)NULL);
+	tokens = config->getCommandBurst() * 1000L;
+	gettimeofday (&lastRefill, NULL);
 
 	// send the welcome
 	sendf (JUKECLIENT_MSG_WELCOME);
 }
 
+/*
+ * JUKECLIENT::suspend (JUKECLIENT_JOB* job)
+ *
+ * This will hand [job] to the worker pool. No more commands are handled until
+ * it has been completed.
+ *
+ */
+void
+JUKECLIENT::suspend (JUKECLIENT_JOB* job) {
+	suspended = 1;
+	workers->submit (job);
+}
+
+/*
+ * JUKECLIENT::resume()
+ *
+ * This will handle the commands which were received while we were suspended,
+ * until there are no more or we are suspended again.
+ *
+ */
+void
+JUKECLIENT::resume() {
+	char line[JUKECLIENT_MAX_DATA_LENGTH];
+	char* ptr;
+	int len;
+
+	suspended = 0;
+	while ((!suspended) && (pendingLen > 0)) {
+		// isolate the first line
+		ptr = (char*)memchr (pending, '\n', pendingLen);
+		len = (ptr != NULL) ? (ptr - pending) + 1 : pendingLen;
+		if (len > (int)sizeof (line) - 1)
+			len = sizeof (line) - 1;
+		memcpy (line, pending, len);
+		line[len] = 0;
+
+		// remove it from the buffer
+		pendingLen -= len;
+		memmove (pending, pending + len, pendingLen);
+
+		// handle it
+		if (!execute (line))
+			// the client is gone. bail out
+			return;
+	}
+
+	// did we have to drop anything?
+	if ((!suspended) && (pendingOverflow)) {
+		// yes. tell the client, now that the order is right
+		pendingOverflow = 0;
+		sendf (JUKECLIENT_MSG_OVERFLOW);
+	}
+}
+
 /*
  * JUKECLIENT::checkPriv (char* cmd)
  *
@@ -78,40 +439,29 @@ JUKECLIENT::checkPriv (char* cmd) {
 /*
  * JUKECLIENT::cmdUser (char* arg)
  *
- * This will set the username to [arg].
+ * This will set the username to [arg]. The backends are asked by the worker
+ * pool.
  *
  */
 void
 JUKECLIENT::cmdUser (char* arg) {
-	USERS* userDB = users;
-
-	// try all backends
-	while (userDB) {
-		// try to fetch the user
-		if (userDB->fetchUserByName (arg, &user)) {
-			// victory
-			userid = user.id;
-			sendf (JUKECLIENT_MSG_USEROK);
-			return;
-		}
+	JUKECLIENT_JOB* job = new JUKECLIENT_JOB (this, JUKECLIENT_JOB_USER);
 
-		// next
-		userDB = userDB->getNextDB();
-	}
-
-	// this failed. complain
-	sendf (JUKECLIENT_MSG_NOUSER);
+	// look the user up
+	strncpy (job->arg, arg, sizeof (job->arg) - 1);
+	suspend (job);
 }
 
 /*
  * JUKECLIENT::cmdPassword (char* arg)
  *
- * This will try to authenticate the user.
+ * This will try to authenticate the user. The backends are asked by the worker
+ * pool.
  *
  */
 void
 JUKECLIENT::cmdPassword (char* arg) {
-	USERS* userDB = users;
+	JUKECLIENT_JOB* job;
 
 	// got an userid?
 	if (userid == -1) {
@@ -120,23 +470,48 @@ JUKECLIENT::cmdPassword (char* arg) {
 		return;
 	}
 
-	// try all backends
-	while (userDB) {
-		// password match?
-		if (userDB->verifyPassword ((const char*)arg, &user)) {
-			// yes. victory!
-			state = JUKECLIENT_STATE_AUTH;
-			sendf (JUKECLIENT_MSG_PASSOK, user.username);
-			return;
-		}
+	// verify the password
+	job = new JUKECLIENT_JOB (this, JUKECLIENT_JOB_PASSWORD);
+	memcpy (&job->user, &user, sizeof (USER));
+	strncpy (job->arg, arg, sizeof (job->arg) - 1);
+	suspend (job);
+}
 
-		// next
-		userDB = userDB->getNextDB();
+/*
+ * JUKECLIENT::issueSession()
+ *
+ * This will hand the freshly authenticated client a session token, which can
+ * be used to skip authentication on later connections.
+ *
+ */
+void
+JUKECLIENT::issueSession() {
+	char token[SESSION_TOKEN_LEN + 1];
+
+	// create the session. if sessions are disabled, say nothing
+	if (sessions->create (&user, token))
+		sendf (JUKECLIENT_MSG_SESSION, token);
+}
+
+/*
+ * JUKECLIENT::cmdResumeSession (char* arg)
+ *
+ * This will try to authenticate the user using session token [arg].
+ *
+ */
+void
+JUKECLIENT::cmdResumeSession (char* arg) {
+	// is this session known?
+	if (!sessions->resume (arg, &user)) {
+		// no. complain
+		sendf (JUKECLIENT_MSG_BADSESSION);
+		return;
 	}
 
-	// no suitable backends found. complain and log
-	sendf (JUKECLIENT_MSG_BADPASS);
-	logger->log (LOG_INFO, "User %s supplied a bad password", user.username);
+	// yes. the user is back
+	userid = user.id;
+	state = JUKECLIENT_STATE_AUTH;
+	sendf (JUKECLIENT_MSG_PASSOK, user.username);
 }
 
 /*
@@ -172,7 +547,7 @@ JUKECLIENT::cmdPause() {
 
 	// inform all clients who care
 	snprintf (tmp, sizeof (tmp), JUKECLIENT_UPDATE_SONG, 'p', "", "");
-	server->sendUpdate (tmp);
+	server->sendUpdate (JUKECLIENT_TOPIC_SONG, tmp, 1);
 
 	// logging
 	logger->log (LOG_INFO, "Playback paused by %s", user.username);
@@ -197,7 +572,7 @@ JUKECLIENT::cmdResume() {
 
 	// inform all clients who care
 	snprintf (tmp, sizeof (tmp), JUKECLIENT_UPDATE_SONG, 'P', "", "");
-	server->sendUpdate (tmp);
+	server->sendUpdate (JUKECLIENT_TOPIC_SONG, tmp, 1);
 
 	// logging
 	logger->log (LOG_INFO, "Playback resumed by %s", user.username);
@@ -222,7 +597,7 @@ JUKECLIENT::cmdStop() {
 
 	// inform all clients who care
 	snprintf (tmp, sizeof (tmp), JUKECLIENT_UPDATE_SONG, 'I', "", "");
-	server->sendUpdate (tmp);
+	server->sendUpdate (JUKECLIENT_TOPIC_SONG, tmp, 1);
 
 	// logging
 	logger->log (LOG_INFO, "Playback stopped by %s", user.username);
@@ -294,12 +669,10 @@ JUKECLIENT::cmdSkip() {
  */
 void
 JUKECLIENT::cmdUsers() {
-	VECTOR* clients = server->getClients();
-
 	// handle all users
-	for (int i = 0; i < clients->count(); i++) {
+	for (int i = 0; i < server->getNumClients(); i++) {
 		// fetch the user
-		JUKECLIENT* client = (JUKECLIENT*)clients->elementAt (i);
+		JUKECLIENT* client = server->getClient (i);
 
 		// is the user authenticated?
 		if (client->getState() == JUKECLIENT_STATE_AUTH) {
@@ -379,6 +752,7 @@ JUKECLIENT::cmdRandom (char* arg) {
 
 	// set the random play
 	queue->setRandom (on);
+	updateState();
 
 	// tell the user what we did and log it
 	if (on) {
@@ -391,13 +765,87 @@ JUKECLIENT::cmdRandom (char* arg) {
 }
 
 /*
- * JUKECLIENT::cmdQueue()
+ * JUKECLIENT::cmdQueue (char* arg)
+ *
+ * This will handle the displaying of the queue. If [arg] is SINCE followed by
+ * a version, only the changes after that version are sent, provided they are
+ * still known; otherwise the entire queue is.
+ *
+ */
+void
+JUKECLIENT::cmdQueue (char* arg) {
+	unsigned long since;
+	char* start;
+	char* ptr;
+
+	// just the queue?
+	if (!*arg) {
+		// yes. list it
+		listQueue();
+		sendf (JUKECLIENT_MSG_QUEUEDONE);
+		return;
+	}
+
+	// it must be SINCE and a version
+	if (strncasecmp (arg, "SINCE ", 6)) {
+		// it isn't. complain
+		sendf (JUKECLIENT_MSG_QUEUESYN);
+		return;
+	}
+	for (start = arg + 6; *start == ' '; start++);
+	since = strtoul (start, &ptr, 10);
+	if ((ptr == start) || (*ptr)) {
+		// this is no number. complain
+		sendf (JUKECLIENT_MSG_QUEUESYN);
+		return;
+	}
+
+	// do we still know what happened since?
+	if (queue->hasDeltasSince (since)) {
+		// yes. send the changes
+		sendf (JUKECLIENT_MSG_QUEUEDELTAS, queue->getVersion());
+		sendQueueDeltas (since);
+	} else {
+		// no. the user will have to start over
+		sendf (JUKECLIENT_MSG_QUEUESNAPSHOT, queue->getVersion());
+		listQueue();
+	}
+	sendf (JUKECLIENT_MSG_QUEUEDONE);
+}
+
+/*
+ * JUKECLIENT::sendQueueDeltas (unsigned int since)
+ *
+ * This will send all changes made to the queue after version [since]. It
+ * will return 0 if they are not known (anymore) or 1 on success.
+ *
+ */
+int
+JUKECLIENT::sendQueueDeltas (unsigned int since) {
+	unsigned int v, version = queue->getVersion();
+	QUEUE_DELTA* d;
+
+	// do we know them all?
+	if (!queue->hasDeltasSince (since))
+		// no. bail out
+		return 0;
+
+	for (v = since + 1; v <= version; v++) {
+		d = queue->getDelta (v);
+		if (d != NULL)
+			sendf (JUKECLIENT_MSG_QUEUEDELTA, d->version, deltaNames[d->type], d->playid, d->trackid);
+	}
+	return 1;
+}
+
+/*
+ * JUKECLIENT::listQueue()
  *
- * This will handle the displaying of the queue.
+ * This will send all items in the queue.
  *
  */
 void
-JUKECLIENT::cmdQueue() {
+JUKECLIENT::listQueue() {
 	char title[TRACK_MAX_TITLE_LEN];;
 	char artist[QUEUE_MAX_ARTIST_LEN];
 	int playid, trackid;
@@ -436,9 +884,6 @@ JUKECLIENT::cmdQueue() {
 		// next
 		n++;
 	}
-
-	// all done
-	sendf (JUKECLIENT_MSG_QUEUEDONE);
 }
 
 /*
@@ -522,6 +967,7 @@ JUKECLIENT::cmdLock() {
 
 	// lock it
 	player->lock();
+	updateState();
 
 	// all done
 	sendf (JUKECLIENT_MSG_LOCKED);
@@ -543,6 +989,7 @@ JUKECLIENT::cmdUnlock() {
 
 	// unlock it
 	player->unlock();
+	updateState();
 
 	// all done
 	sendf (JUKECLIENT_MSG_UNLOCKED);
@@ -586,79 +1033,136 @@ JUKECLIENT::cmdHelp() {
 "help                    Display this text\n" \
 "user <username>         authenticate with <username>\n" \
 "pass(word) <password>   authenticate with <password>\n" \
+"resume <token>          authenticate with a previous session token\n" \
 "play                    start playback\n" \
 "pause                   pause playback\n" \
 "cont(inue)              continue playback\n" \
 "skip                    skip playing track\n" \
 "stop                    stop playback\n" \
 "rand(om) <yes|no>       enable or disable random queue\n" \
-"q(ueue)                 display queue\n" \
+"q(ueue) [since <ver>]   display queue, or its changes after a version\n" \
 "rem(ove)                remove first track in queue\n" \
 "lock                    lock queue for adding tracks\n" \
 "unlock                  unlock queue for adding tracks\n" \
 "users                   display currently connected users\n" 
 "stat(us)                display status of jukebox\n" \
 "clear                   clear the jukebox queue\n" \
-"albums                  display all albums\n" \
-"artistalbums <id>       display all albums by an artist\n" \
-"artists                 display all artists\n" \
+"albums [opts]           display all albums\n" \
+"artistalbums <id> [opts]  display all albums by an artist\n" \
+"artists [opts]          display all artists\n" \
 "getalbum <id>           fetch information on an album\n" \
 "getartist <id>          fetch information on an artist n" \
 "gettrack <id>           fetch information on a track\n" \
-"listalbum <id>          displays all tracks in an album\n" \
+"listalbum <id> [opts]   displays all tracks in an album\n" \
 "enqeueutrack <id>		   enqueue a track\n" \
 "enqeueualbum <id>		   enqueue a complete album\n" \
 "bye                     see you later..\n" \
 "exit                    close client\n" \
 "disc(onnect)            close connection with server\n" \
 "updates <yes|no>        receive updates on player changes\n" \
+"updates <all|topics> [ms]  receive updates on song,queue,volume,state,users\n" \
+"counters                display connection statistics\n" \
+"changes since <seq>     display catalog changes after a sequence number\n" \
+"  listing opts: [sort name|id] [after <id>] [limit <n>], to list page by page\n" \
+"search <words>          search titles, artists and albums\n" \
+"complete <artist|album|title> <prefix> [limit <n>]  complete a name\n" \
+"fuzzy <artist|album|title> <name> [limit <n>]  find names despite typos\n" \
 "\n");
 }
 
 /*
- * JUKECLIENT::cmdAlbums()
+ * JUKECLIENT::parsePage (char* arg, JUKECLIENT_JOB* job)
  *
- * This will display all albums known to the jukebox.
+ * This will parse the paging options [arg] of a listing command into [job].
+ * They are SORT NAME or SORT ID, AFTER followed by the ID of the last item
+ * seen and LIMIT followed by the number of items to list, all optional. It
+ * will return 0 if the options are invalid or 1 if not.
  *
  */
-void
-JUKECLIENT::cmdAlbums() {
-	ALBUM* album = new ALBUM();
+int
+JUKECLIENT::parsePage (char* arg, JUKECLIENT_JOB* job) {
+	char* opt;
+	char* val;
+	char* ptr;
+	char* saveptr;
+	long l;
 
-	// handle all albums
-	while (album->fetchNext ()) {
-		// send the data
-		sendf (JUKECLIENT_MSG_ALBUM, album->getID(), album->getArtistID(), album->getName());
+	for (opt = strtok_r (arg, " ", &saveptr); opt != NULL; opt = strtok_r (NULL, " ", &saveptr)) {
+		// every option has a value
+		val = strtok_r (NULL, " ", &saveptr);
+		if (val == NULL)
+			return 0;
+
+		// the sort order?
+		if (!strcasecmp (opt, "sort")) {
+			// yes. names and titles are the same thing here
+			if ((!strcasecmp (val, "name")) || (!strcasecmp (val, "title")))
+				job->sortByName = 1;
+			else if (!strcasecmp (val, "id"))
+				job->sortByName = 0;
+			else
+				return 0;
+			continue;
+		}
+
+		// the others are numbers
+		l = strtol (val, &ptr, 10);
+		if ((*ptr) || (l < 1))
+			return 0;
+		if (!strcasecmp (opt, "after"))
+			job->after = l;
+		else if (!strcasecmp (opt, "limit"))
+			job->limit = l;
+		else
+			return 0;
 	}
+	return 1;
+}
+
+/*
+ * JUKECLIENT::cmdAlbums (char* arg)
+ *
+ * This will display the albums known to the jukebox. [arg] are the paging
+ * options.
+ *
+ */
+void
+JUKECLIENT::cmdAlbums (char* arg) {
+	JUKECLIENT_JOB* job = new JUKECLIENT_JOB (this, JUKECLIENT_JOB_ALBUMS);
 
-	// terminate the list
-	sendf (JUKECLIENT_MSG_ALBUMEND);
+	// are the options any good?
+	if (!parsePage (arg, job)) {
+		// no. complain
+		sendf (JUKECLIENT_MSG_PAGESYN);
+		delete job;
+		return;
+	}
 
-	// bye bye
-	delete album;
+	// let the worker pool fetch them
+	suspend (job);
 }
 
 /*
- * JUKECLIENT::cmdArtists()
+ * JUKECLIENT::cmdArtists (char* arg)
  *
- * This will display all artists known to the jukebox.
+ * This will display the artists known to the jukebox. [arg] are the paging
+ * options.
  *
  */
 void
-JUKECLIENT::cmdArtists() {
-	ARTIST* artist = new ARTIST();
+JUKECLIENT::cmdArtists (char* arg) {
+	JUKECLIENT_JOB* job = new JUKECLIENT_JOB (this, JUKECLIENT_JOB_ARTISTS);
 
-	// handle all artists
-	while (artist->fetchNext()) {
-		// send the data
-		sendf (JUKECLIENT_MSG_ARTIST, artist->getID(), artist->getName());
+	// are the options any good?
+	if (!parsePage (arg, job)) {
+		// no. complain
+		sendf (JUKECLIENT_MSG_PAGESYN);
+		delete job;
+		return;
 	}
 
-	// terminate the list
-	sendf (JUKECLIENT_MSG_ARTISTEND);
-
-	// bye bye
-	delete artist;
+	// let the worker pool fetch them
+	suspend (job);
 }
 
 /*
@@ -785,53 +1289,28 @@ JUKECLIENT::cmdEnqueueAlbum(char* arg) {
  */
 void
 JUKECLIENT::cmdListAlbum(char* arg) {
+	JUKECLIENT_JOB* job;
 	long l;
 	char* ptr;
-	int pos = 0;
-	int trackid;
 
 	// try to resolve the number
 	l = strtol (arg, &ptr, 10);
-	if ((!strlen (arg)) || (*ptr)) {
+	if ((!strlen (arg)) || ((*ptr) && (*ptr != ' '))) {
 		// this failed. complain
 		sendf (JUKECLIENT_MSG_LISTSYN);
 		return;
 	}
 
-	// wade through the album
-	try {
-		// try to fetch the album
-		ALBUM* album = new ALBUM (l);
-
-		// keep fetching tracks
-		while (album->fetchTrack (pos, &trackid)) {
-			// this worked. fetch the track itself
-			try {
-				TRACK* track = new TRACK (trackid);
-
-				// send it over
-				sendf (JUKECLIENT_MSG_TRACK, trackid, track->getTitle());
-
-				// remove the track
-				delete track;
-			} catch (TrackException e) {
-				// ... silently ignore it ...
-			}
-
-			// next
-			pos++;
-		}
-
-		// enough is enough
-		delete album;
-	} catch (AlbumException e) {
-		// bummer
-		sendf (JUKECLIENT_MSG_NOALBUM);
+	// let the worker pool wade through the album
+	job = new JUKECLIENT_JOB (this, JUKECLIENT_JOB_LISTALBUM);
+	job->id = l;
+	if (!parsePage (ptr, job)) {
+		// the options are wrong. complain
+		sendf (JUKECLIENT_MSG_PAGESYN);
+		delete job;
 		return;
 	}
-
-	// all done
-	sendf (JUKECLIENT_MSG_LISTOK);
+	suspend (job);
 }
 
 /*
@@ -944,31 +1423,28 @@ JUKECLIENT::cmdGetTrack (char* arg) {
  */
 void
 JUKECLIENT::cmdArtistAlbums(char* arg) {
+	JUKECLIENT_JOB* job;
 	long l;
 	char* ptr;
 
 	// try to resolve the number
 	l = strtol (arg, &ptr, 10);
-	if ((!strlen (arg)) || (*ptr)) {
+	if ((!strlen (arg)) || ((*ptr) && (*ptr != ' '))) {
 		// this failed. complain
 		sendf (JUKECLIENT_MSG_GETASYN);
 		return;
 	}
 
-	// create a blank album
-	ALBUM* album = new ALBUM();
-
-	// handle all albums
-	while (album->fetchArtistNext (l)) {
-		// send the data
-		sendf (JUKECLIENT_MSG_ALBUM, album->getID(), album->getArtistID(), album->getName());
+	// let the worker pool fetch them
+	job = new JUKECLIENT_JOB (this, JUKECLIENT_JOB_ARTISTALBUMS);
+	job->id = l;
+	if (!parsePage (ptr, job)) {
+		// the options are wrong. complain
+		sendf (JUKECLIENT_MSG_PAGESYN);
+		delete job;
+		return;
 	}
-
-	// terminate the list
-	sendf (JUKECLIENT_MSG_ALBUMEND);
-
-	// bye bye
-	delete album;
+	suspend (job);
 }
 
 /*
@@ -1003,6 +1479,7 @@ JUKECLIENT::cmdVolume (char* arg) {
 	// update the volume
 	if (l > 100) l = 100;
 	volume->setVolume (l);
+	updateVolume();
 
 	// all done
 	sendf (JUKECLIENT_MSG_VOLOK);
@@ -1035,6 +1512,7 @@ JUKECLIENT::cmdVolumeUp() {
 	else
 		i += VOLUME_STEPSIZE;
 	volume->setVolume (i);
+	updateVolume();
 
 	// all done
 	sendf (JUKECLIENT_MSG_VOLOK);
@@ -1067,6 +1545,7 @@ JUKECLIENT::cmdVolumeDown() {
 	else
 		i -= VOLUME_STEPSIZE;
 	volume->setVolume (i);
+	updateVolume();
 
 	// all done
 	sendf (JUKECLIENT_MSG_VOLOK);
@@ -1080,7 +1559,7 @@ JUKECLIENT::cmdVolumeDown() {
  */
 void
 JUKECLIENT::cmdIdent() {
-	IDENT* ident;
+	JUKECLIENT_JOB* job;
 
 	// got an userid?
 	if (userid == -1) {
@@ -1089,6 +1568,23 @@ JUKECLIENT::cmdIdent() {
 		return;
 	}
 
+	// connected over an AF_UNIX socket?
+	if (local) {
+		// yes. the kernel told us who is there. may we trust that?
+		if (!config->isLocalAuthAllowed()) {
+			// no. complain
+			sendf (JUKECLIENT_MSG_NOIDENT);
+			return;
+		}
+
+		// map the user ID to a name. this may need a directory service
+		job = new JUKECLIENT_JOB (this, JUKECLIENT_JOB_PEERCRED);
+		memcpy (&job->user, &user, sizeof (USER));
+		job->id = peeruid;
+		suspend (job);
+		return;
+	}
+
 	// is IDENT allowed?
 	if (!config->isIdentAllowed()) {
 		// no. complain
@@ -1103,74 +1599,533 @@ JUKECLIENT::cmdIdent() {
 		return;
 	}
 
-	// try to identify ourselves
-	ident = new IDENT();
-	if (!ident->identify (getClientAddress(), user.username)) {
-		// this failed. complain	
-		delete ident;
-		sendf (JUKECLIENT_MSG_IDENTFAIL);
-		return;
-	}
-
-	// victory
-	delete ident;
-	state = JUKECLIENT_STATE_AUTH;
-	sendf (JUKECLIENT_MSG_PASSOK, user.username);
+	// ask the ident server. this won't block, but we have to wait for it
+	job = new JUKECLIENT_JOB (this, JUKECLIENT_JOB_IDENT);
+	memcpy (&job->user, &user, sizeof (USER));
+	suspended = 1;
+	ident->identify (getClientAddress(), user.username, job);
 }
 
 /*
  * JUKECLIENT::cmdUpdates (char* arg)
  *
- * This will handle the setting of updates.
+ * This will handle the setting of updates. [arg] is YES (song changes only,
+ * as it always was), NO, ALL or a comma-separated list of topics, optionally
+ * followed by the coalescing window in milliseconds. Unless a window is
+ * given, YES sends every update right away, as it always did.
  *
  */
 void
 JUKECLIENT::cmdUpdates (char* arg) {
+	int mask = 0, window = -1;
+	char* ptr;
+	char* end;
+	int i;
+
 	// privilege check
 	JUKECLIENT_HANDLE_PRIV (JUKECLIENT_CMD_UPDATES)
 
-	// is the argument YES or NO?
-	if ((strcasecmp (arg, "YES")) && (strcasecmp (arg, "NO"))) {
-		// no. complain
-		sendf (JUKECLIENT_MSG_YESORNO);
-		return;
+	// got a window?
+	ptr = strchr (arg, ' ');
+	if (ptr != NULL) {
+		// yes. isolate it
+		*ptr++ = 0;
+		while (*ptr == ' ') ptr++;
+		window = strtol (ptr, &end, 10);
+		while (*end == ' ') end++;
+		if ((*end) || (window < 0)) {
+			// this is no number. complain
+			sendf (JUKECLIENT_MSG_BADTOPIC);
+			return;
+		}
+	}
+
+	// figure out the topics
+	if (!strcasecmp (arg, "YES")) {
+		mask = 1 << JUKECLIENT_TOPIC_SONG;
+		if (window < 0) window = 0;
+	} else if (!strcasecmp (arg, "ALL"))
+		mask = JUKECLIENT_TOPIC_ALL;
+	else if (strcasecmp (arg, "NO")) {
+		// walk the list
+		for (ptr = arg; ptr != NULL; ptr = end) {
+			end = strchr (ptr, ',');
+			if (end != NULL)
+				*end++ = 0;
+			for (i = 0; i < JUKECLIENT_NUM_TOPICS; i++)
+				if (!strcasecmp (ptr, topicNames[i]))
+					break;
+			if (i == JUKECLIENT_NUM_TOPICS) {
+				// unknown topic. complain
+				sendf (JUKECLIENT_MSG_BADTOPIC);
+				return;
+			}
+			mask |= 1 << i;
+		}
 	}
 
-	// yes. update the values
-	sendUpdates = (!strcasecmp (arg, "YES")) ? 1 : 0;
+	// no window given? use the configured one
+	if (window < 0)
+		window = config->getUpdateWindow();
 
-	// tell the user what we did and log it
-	if (sendUpdates)
+	// update the values. anything queued is of no interest anymore
+	topics = mask; updateWindow = window; pendingTopics = 0;
+	queueVersion = queue->getVersion();
+	memset (pendingCount, 0, sizeof (pendingCount));
+
+	// tell the user what we did
+	if (topics)
 		sendf (JUKECLIENT_MSG_UPDATESON);
 	else
 		sendf (JUKECLIENT_MSG_UPDATESOFF);
 }
 
 /*
- * JUKECLIENT::incoming()
+ * JUKECLIENT::notify (int topic, const char* msg, unsigned int count)
  *
- * This will be called on incoming data.
+ * This will queue update [msg] about [count] changes of [topic]. An update of
+ * the same topic which is still queued is replaced, so a burst of changes
+ * ends up as a single update once the window has passed.
  *
  */
 void
-JUKECLIENT::incoming() {
-	char data[JUKECLIENT_MAX_DATA_LENGTH];
-	int	 len = recv (data, sizeof (data) - 1);
-	char* cmd = data;
-	char* arg = "";
-	char* ptr;
+JUKECLIENT::notify (int topic, const char* msg, unsigned int count) {
+	struct timeval now;
+
+	// remember the latest news
+	if (msg != NULL) {
+		strncpy (pendingMsg[topic], msg, JUKECLIENT_MAX_UPDATE - 1);
+		pendingMsg[topic][JUKECLIENT_MAX_UPDATE - 1] = 0;
+	}
+	pendingCount[topic] += count;
+
+	// is this the first news of the window?
+	gettimeofday (&now, NULL);
+	if (!pendingTopics) {
+		// yes. the window starts now
+		flushAt.tv_sec = now.tv_sec + updateWindow / 1000;
+		flushAt.tv_usec = now.tv_usec + (updateWindow % 1000) * 1000;
+		if (flushAt.tv_usec >= 1000000) {
+			flushAt.tv_sec++; flushAt.tv_usec -= 1000000;
+		}
+		if (updateWindow > 0)
+			server->scheduleFlush (updateWindow);
+	}
+	pendingTopics |= 1 << topic;
 
-	// if we got no data, bail out
-	if (!len)
-		return;
+	// no window? then off it goes
+	if (updateWindow == 0)
+		flushUpdates (&now);
+}
+
+/*
+ * JUKECLIENT::flushUpdates (struct timeval* now)
+ *
+ * This will send all queued updates if it is [now] time to do so.
+ *
+ */
+void
+JUKECLIENT::flushUpdates (struct timeval* now) {
+	int i;
+
+	// anything due?
+	if ((!pendingTopics) || (timercmp (now, &flushAt, <)))
+		// no. bail out
+		return;
+
+	// send them in a fixed order
+	for (i = 0; i < JUKECLIENT_NUM_TOPICS; i++) {
+		if (!(pendingTopics & (1 << i)))
+			continue;
+		if (i == JUKECLIENT_TOPIC_QUEUE) {
+			// send what changed and the summary. if the changes were pushed out
+			// of the log, the client will have to list the queue again
+			if (!sendQueueDeltas (queueVersion))
+				sendf (JUKECLIENT_UPDATE_QUEUESYNC, queue->getVersion());
+			queueVersion = queue->getVersion();
+			sendf (JUKECLIENT_UPDATE_QUEUE, pendingCount[i], queueVersion);
+		} else
+			sendf ("%s", pendingMsg[i]);
+		pendingCount[i] = 0;
+	}
+	pendingTopics = 0;
+}
+
+/*
+ * JUKECLIENT::updateState()
+ *
+ * This will tell the subscribed clients about the random and lock state.
+ *
+ */
+void
+JUKECLIENT::updateState() {
+	char tmp[256 /* XXX */];
+
+	snprintf (tmp, sizeof (tmp), JUKECLIENT_UPDATE_STATE, (queue->getRandom()) ? 'Y' : 'N', (player->isLocked()) ? 'Y' : 'N');
+	server->sendUpdate (JUKECLIENT_TOPIC_STATE, tmp, 1);
+}
+
+/*
+ * JUKECLIENT::updateVolume()
+ *
+ * This will tell the subscribed clients about the volume.
+ *
+ */
+void
+JUKECLIENT::updateVolume() {
+	char tmp[256 /* XXX */];
+
+	snprintf (tmp, sizeof (tmp), JUKECLIENT_UPDATE_VOLUME, volume->getVolume());
+	server->sendUpdate (JUKECLIENT_TOPIC_VOLUME, tmp, 1);
+}
+
+/*
+ * JUKECLIENT::cmdChanges (char* arg)
+ *
+ * This will handle the CHANGES command. [arg] must be SINCE followed by the
+ * sequence number of the last change the client knows about.
+ *
+ */
+void
+JUKECLIENT::cmdChanges (char* arg) {
+	JUKECLIENT_JOB* job;
+	unsigned long since;
+	char* start;
+	char* ptr;
+
+	// it must be SINCE and a sequence number
+	if (strncasecmp (arg, "SINCE ", 6)) {
+		// it isn't. complain
+		sendf (JUKECLIENT_MSG_CHANGESYN);
+		return;
+	}
+	for (start = arg + 6; *start == ' '; start++);
+	since = strtoul (start, &ptr, 10);
+	if ((ptr == start) || (*ptr)) {
+		// this is no number. complain
+		sendf (JUKECLIENT_MSG_CHANGESYN);
+		return;
+	}
+
+	// let the worker pool fetch them
+	job = new JUKECLIENT_JOB (this, JUKECLIENT_JOB_CHANGES);
+	job->id = since;
+	suspend (job);
+}
+
+/*
+ * JUKECLIENT::cmdSearch (char* arg)
+ *
+ * This will handle the SEARCH command. [arg] are the words to look for; the
+ * tracks containing all of them are listed, best match first.
+ *
+ */
+void
+JUKECLIENT::cmdSearch (char* arg) {
+	SEARCH_RESULT results[SEARCH_MAX_RESULTS];
+	SEARCHINDEX* idx = search->getIndex();
+	SEARCH_DOC* d;
+	int i, num;
+
+	// got anything to look for?
+	if (!*arg) {
+		// no. complain
+		sendf (JUKECLIENT_MSG_SEARCHSYN);
+		return;
+	}
+
+	// is the index built yet?
+	if (idx == NULL) {
+		// no. complain
+		sendf (JUKECLIENT_MSG_SEARCHBUSY);
+		return;
+	}
+
+	// the index is in memory, so there is no need to bother the workers
+	num = idx->search (arg, results, SEARCH_MAX_RESULTS);
+	for (i = 0; i < num; i++) {
+		d = idx->getTrack (results[i].id);
+		sendf (JUKECLIENT_MSG_SEARCHRESULT, d->id, results[i].score, idx->getArtistName (d->artistid), idx->getAlbumName (d->albumid), d->title);
+	}
+	sendf (JUKECLIENT_MSG_SEARCHDONE, num);
+}
+
+/*
+ * JUKECLIENT::parseNameArgs (char* arg, int* kind, char** text, int* limit)
+ *
+ * This will parse [arg], which must be the kind of name, the text and
+ * optionally LIMIT followed by the maximum number of names to list, into
+ * [kind], [text] and [limit]. Text which folds to nothing would match every
+ * name and is refused. It will return 0 if the arguments are invalid or 1 if
+ * not.
+ *
+ */
+int
+JUKECLIENT::parseNameArgs (char* arg, int* kind, char** text, int* limit) {
+	char key[COMPLETE_MAX_KEY];
+	char* ptr;
+	char* word;
+	char* end;
+	int i;
+
+	// figure out the kind
+	for (*kind = 0; *kind < COMPLETE_NUM_KINDS; (*kind)++)
+		if ((!strncasecmp (arg, completeNames[*kind], strlen (completeNames[*kind]))) &&
+		    (arg[strlen (completeNames[*kind])] == ' '))
+			break;
+	if (*kind == COMPLETE_NUM_KINDS)
+		// this kind is unknown. complain
+		return 0;
+	for (*text = arg + strlen (completeNames[*kind]); **text == ' '; (*text)++);
+
+	// is there a limit at the end?
+	*limit = COMPLETE_DEFAULT_LIMIT;
+	ptr = strrchr (*text, ' ');
+	if (ptr != NULL) {
+		// find the word before the last one
+		i = strtol (ptr + 1, &end, 10);
+		while ((ptr > *text) && (*(ptr - 1) == ' ')) ptr--;
+		for (word = ptr; (word > *text) && (*(word - 1) != ' '); word--);
+		if ((end != ptr + 1) && (!*end) && (ptr - word == 5) && (!strncasecmp (word, "limit", 5))) {
+			// yes. cut it off
+			*limit = i;
+			while ((word > *text) && (*(word - 1) == ' ')) word--;
+			*word = 0;
+		}
+	}
+	if ((!foldText (*text, key, sizeof (key))) || (*limit < 1))
+		// nothing to look for
+		return 0;
+	if (*limit > COMPLETE_MAX_LIMIT)
+		*limit = COMPLETE_MAX_LIMIT;
+	return 1;
+}
+
+/*
+ * JUKECLIENT::lookupName (SEARCHINDEX* idx, int kind, int id)
+ *
+ * This will return the name of object [id] of kind [kind] in [idx].
+ *
+ */
+const char*
+JUKECLIENT::lookupName (SEARCHINDEX* idx, int kind, int id) {
+	SEARCH_DOC* d;
+
+	switch (kind) {
+		case COMPLETE_KIND_ARTIST: return idx->getArtistName (id);
+		 case COMPLETE_KIND_ALBUM: return idx->getAlbumName (id);
+	}
+	d = idx->getTrack (id);
+	return (d != NULL) ? d->title : "?";
+}
 
-	// terminate the data buffer
+/*
+ * JUKECLIENT::cmdComplete (char* arg)
+ *
+ * This will handle the COMPLETE command. [arg] must be the kind of name, the
+ * prefix and optionally LIMIT followed by the maximum number of names to list.
+ *
+ */
+void
+JUKECLIENT::cmdComplete (char* arg) {
+	int ids[COMPLETE_MAX_LIMIT];
+	SEARCHINDEX* idx = search->getIndex();
+	char* prefix;
+	int kind, limit, i, num;
+
+	if (!parseNameArgs (arg, &kind, &prefix, &limit)) {
+		// this is wrong. complain
+		sendf (JUKECLIENT_MSG_COMPLETESYN);
+		return;
+	}
+
+	// is the index built yet?
+	if (idx == NULL) {
+		// no. complain
+		sendf (JUKECLIENT_MSG_SEARCHBUSY);
+		return;
+	}
+
+	num = idx->complete (kind, prefix, ids, limit);
+	for (i = 0; i < num; i++)
+		sendf (JUKECLIENT_MSG_COMPLETION, completeNames[kind], ids[i], lookupName (idx, kind, ids[i]));
+	sendf (JUKECLIENT_MSG_COMPLETEDONE, num);
+}
+
+/*
+ * JUKECLIENT::cmdFuzzy (char* arg)
+ *
+ * This will handle the FUZZY command. [arg] must be the kind of name, the
+ * name and optionally LIMIT followed by the maximum number of names to list.
+ * The names which differ only by a few typos are listed, along with their
+ * edit distance.
+ *
+ */
+void
+JUKECLIENT::cmdFuzzy (char* arg) {
+	FUZZY_RESULT results[COMPLETE_MAX_LIMIT];
+	SEARCHINDEX* idx = search->getIndex();
+	char* name;
+	int kind, limit, i, num;
+
+	if (!parseNameArgs (arg, &kind, &name, &limit)) {
+		// this is wrong. complain
+		sendf (JUKECLIENT_MSG_FUZZYSYN);
+		return;
+	}
+
+	// is the index built yet?
+	if (idx == NULL) {
+		// no. complain
+		sendf (JUKECLIENT_MSG_SEARCHBUSY);
+		return;
+	}
+
+	num = idx->match (kind, name, results, limit);
+	for (i = 0; i < num; i++)
+		sendf (JUKECLIENT_MSG_FUZZYMATCH, completeNames[kind], results[i].id, results[i].distance, lookupName (idx, kind, results[i].id));
+	sendf (JUKECLIENT_MSG_FUZZYDONE, num);
+}
+
+/*
+ * JUKECLIENT::cmdCounters()
+ *
+ * This will list the connection statistics.
+ *
+ */
+void
+JUKECLIENT::cmdCounters() {
+	JUKESERVER_COUNTERS* c = server->getCounters();
+
+	// privilege check
+	JUKECLIENT_HANDLE_PRIV (JUKECLIENT_CMD_COUNTERS)
+
+	sendf (JUKECLIENT_MSG_COUNTER, "connections", (unsigned long)server->getNumClients());
+	sendf (JUKECLIENT_MSG_COUNTER, "accepted", c->accepted);
+	sendf (JUKECLIENT_MSG_COUNTER, "refused", c->refused);
+	sendf (JUKECLIENT_MSG_COUNTER, "idle_timeouts", c->idleTimeouts);
+	sendf (JUKECLIENT_MSG_COUNTER, "commands", c->commands);
+	sendf (JUKECLIENT_MSG_COUNTER, "throttled", c->throttled);
+	sendf (JUKECLIENT_MSG_COUNTER, "output_overflows", c->outputOverflows);
+	sendf (JUKECLIENT_MSG_COUNTERSEND);
+}
+
+/*
+ * JUKECLIENT::charge (char* cmd)
+ *
+ * This will charge the client the cost of command [cmd], using a token
+ * bucket: tokens flow in at the command rate, up to the burst size, and
+ * every command takes its cost out. Aliases are charged as the command they
+ * stand for, in any case; unknown commands cost the default. It will return
+ * 0 if there are not enough tokens, or 1 if the command may be handled.
+ *
+ */
+int
+JUKECLIENT::charge (char* cmd) {
+	int rate = config->getCommandRate();
+	long burst = config->getCommandBurst() * 1000L;
+	long cost, elapsed;
+	struct timeval now;
+	char* name = JUKECONFIG_PRIV_DEFAULTKEY;
+	int i;
+
+	server->getCounters()->commands++;
+
+	// is there a limit at all?
+	if (rate <= 0)
+		// no. go ahead
+		return 1;
+
+	// top the bucket up. an hour refills anything
+	gettimeofday (&now, NULL);
+	elapsed = (now.tv_sec - lastRefill.tv_sec) * 1000L + (now.tv_usec - lastRefill.tv_usec) / 1000L;
+	if ((elapsed < 0) || (elapsed > 3600000L))
+		elapsed = 3600000L;
+	tokens += elapsed * rate;
+	if (tokens > burst)
+		tokens = burst;
+	lastRefill = now;
+
+	// which command is this really?
+	for (i = 0; commandNames[i][0] != NULL; i++)
+		if (!strcasecmp (cmd, commandNames[i][0])) {
+			// this one
+			name = commandNames[i][1];
+			break;
+		}
+
+	// a command may never cost more than the whole bucket
+	cost = config->getCommandCost (name) * 1000L;
+	if (cost > burst)
+		cost = burst;
+
+	// can the client afford this?
+	if (tokens < cost) {
+		// no. refuse it
+		server->getCounters()->throttled++;
+		return 0;
+	}
+
+	// yes. pay up
+	tokens -= cost;
+	return 1;
+}
+
+/*
+ * JUKECLIENT::incoming()
+ *
+ * This will be called on incoming data.
+ *
+ */
+void
+JUKECLIENT::incoming() {
+	char data[JUKECLIENT_MAX_DATA_LENGTH];
+	int	 len = recv (data, sizeof (data) - 1);
+
+	// if we got no data, bail out
+	if (len <= 0)
+		return;
+	lastActive = time ((time_t*)NULL);
+
+	// are we waiting for a job to complete?
+	if (suspended) {
+		// yes. is there room to queue this?
+		if (pendingLen + len + 1 > JUKECLIENT_MAX_PENDING) {
+			// no. drop it
+			pendingOverflow = 1;
+			return;
+		}
+
+		// queue it, as a line of its own
+		memcpy (pending + pendingLen, data, len);
+		pendingLen += len;
+		if (data[len - 1] != '\n')
+			pending[pendingLen++] = '\n';
+		return;
+	}
+
+	// terminate the data buffer and handle it
 	data[len] = 0;
+	execute (data);
+}
+
+/*
+ * JUKECLIENT::execute (char* data)
+ *
+ * This will handle command line [data]. It will return zero if the client
+ * has been destroyed, or non-zero otherwise.
+ *
+ */
+int
+JUKECLIENT::execute (char* data) {
+	char* cmd = data;
+	char* arg = "";
+	char* ptr;
+	int len = strlen (data);
 
 	// get rid of any trailing newlines
-	len--;
-	while ((data[len] == '\n') || (data[len] == '\r'))
-		data[len--] = 0;
+	while ((len > 0) && ((data[len - 1] == '\n') || (data[len - 1] == '\r')))
+		data[--len] = 0;
 
 	// scan for a space
 	ptr = strchr (cmd, ' ');
@@ -1185,14 +2140,14 @@ JUKECLIENT::incoming() {
 	}
 
 	#ifdef DEBUG
-	logger->log (LOG_INFO, "JUKECLIENT::incoming(): got command [%s] arg [%s]", cmd, arg);
+	logger->log (LOG_INFO, "JUKECLIENT::execute(): got command [%s] arg [%s]", cmd, arg);
 	#endif
 
 	// want help?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_HELP)) {
 		// ok now tell them something
 		cmdHelp();
-		return;
+		return 1;
 	}
 
 	// disconnect?
@@ -1202,14 +2157,21 @@ JUKECLIENT::incoming() {
 			(!strcasecmp (cmd, JUKECLIENT_CMD_BYE))) {
 		// yes. bye bye!
 		cmdDisconnect();
-		return;
+		return 0;
+	}
+
+	// may the client do this right now?
+	if ((*cmd) && (!charge (cmd))) {
+		// no. complain
+		sendf (JUKECLIENT_MSG_THROTTLED);
+		return 1;
 	}
 
 	// set user?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_USER)) {
 		// yes. handle it
 		cmdUser (arg);
-		return;
+		return 1;
 	}
 
 	// set password?
@@ -1217,14 +2179,21 @@ JUKECLIENT::incoming() {
 			(!strcasecmp (cmd, JUKECLIENT_CMD_PASSWORD2))) {
 		// yes. handle it
 		cmdPassword (arg);
-		return;
+		return 1;
+	}
+
+	// need to resume a session?
+	if (!strcasecmp (cmd, JUKECLIENT_CMD_RESUME)) {
+		// yes. handle it
+		cmdResumeSession (arg);
+		return 1;
 	}
 
 	// need to identify ourselves?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_IDENT)) {
 		// yes. handle it
 		cmdIdent();
-		return;
+		return 1;
 	}
 
 	// need to display status?
@@ -1234,12 +2203,12 @@ JUKECLIENT::incoming() {
 		if ((state == JUKECLIENT_STATE_CONN) && (!config->isAnonStatusAllowed())) {
 			// yes, and we are not. complain
 			sendf (JUKECLIENT_MSG_MUSTAUTH);
-			return;
+			return 1;
 		}
 
 		// do it
 		cmdStatus();
-		return;
+		return 1;
 	}
 
 
@@ -1247,36 +2216,36 @@ JUKECLIENT::incoming() {
 	if (state == JUKECLIENT_STATE_CONN) {
 		// no! bad boy, complain!
 		sendf (JUKECLIENT_MSG_MUSTAUTH);
-		return;
+		return 1;
 	}
 
 	// need to display the users?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_USERS)) {
 		// yes. handle it
 		cmdUsers();
-		return;
+		return 1;
 	}
 
 	// need to display the queue?
 	if ((!strcasecmp (cmd, JUKECLIENT_CMD_QUEUE)) ||
 			(!strcasecmp (cmd, JUKECLIENT_CMD_QUEUE2))) {
 		// yes. handle it
-		cmdQueue();
-		return;
+		cmdQueue (arg);
+		return 1;
 	}
 
 	// is the player locked and this user NOT an admin?
 	if ((player->isLocked()) && (user.status < USER_STATUS_ADMIN)) {
 		// yes. complain
 		sendf (JUKECLIENT_MSG_LOCKERR);
-		return;
+		return 1;
 	}
 
 	// need to pause?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_PAUSE)) {
 		// yes. do it
 		cmdPause();
-		return;
+		return 1;
 	}
 
 	// need to continue?
@@ -1284,21 +2253,21 @@ JUKECLIENT::incoming() {
 			(!strcasecmp (cmd, JUKECLIENT_CMD_CONTINUE2))) {
 		// yes. handle it
 		cmdResume();
-		return;
+		return 1;
 	}
 
 	// need to stop?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_STOP)) {
 		// yes. do it
 		cmdStop();
-		return;
+		return 1;
 	}
 
 	// need to play?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_PLAY)) {
 		// yes. do it
 		cmdPlay();
-		return;
+		return 1;
 	}
 
 	// need to skip a song?
@@ -1306,7 +2275,7 @@ JUKECLIENT::incoming() {
 			(!strcasecmp (cmd, JUKECLIENT_CMD_NEXT2))) {
 		// yes. handle it
 		cmdSkip();
-		return;
+		return 1;
 	}
 
 	// need to set random play?
@@ -1314,7 +2283,7 @@ JUKECLIENT::incoming() {
 			(!strcasecmp (cmd, JUKECLIENT_CMD_RANDOM2))) {
 		// yes. handle it
 		cmdRandom (arg);
-		return;
+		return 1;
 	}
 
 	// need to remove a queue item?
@@ -1322,123 +2291,511 @@ JUKECLIENT::incoming() {
 			(!strcasecmp (cmd, JUKECLIENT_CMD_REMOVE2))) {
 		// yes. handle it
 		cmdRemove (arg);
-		return;
+		return 1;
 	}
 
 	// need to lock the player?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_LOCK)) {
 		// yes. handle it
 		cmdLock();
-		return;
+		return 1;
 	}
 
 	// need to unlock the player?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_UNLOCK)) {
 		// yes. handle it
 		cmdUnlock();
-		return;
+		return 1;
 	}
 
 	// need to clear the player?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_CLEAR)) {
 		// yes. handle it
 		cmdClear();
-		return;
+		return 1;
 	}
 
 	// need to fetch all albums ?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_ALBUMS)) {
 		// yes. handle it
-		cmdAlbums();
-		return;
+		cmdAlbums (arg);
+		return 1;
 	}
 
 	// need to fetch all artists ?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_ARTISTS)) {
 		// yes. handle it
-		cmdArtists();
-		return;
+		cmdArtists (arg);
+		return 1;
 	}
 
 	// need to enqueue a track ?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_ENQUEUETR)) {
 		// yes. handle it
 		cmdEnqueueTrack (arg);
-		return;
+		return 1;
 	}
 
 	// need to enqueue a track ?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_ENQUEUEAL)) {
 		// yes. handle it
 		cmdEnqueueAlbum (arg);
-		return;
+		return 1;
 	}
 
 	// need to list an album ?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_LISTALBUM)) {
 		// yes. handle it
 		cmdListAlbum (arg);
-		return;
+		return 1;
 	}
 
 	// need to fetch an album ?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_GETALBUM)) {
 		// yes. handle it
 		cmdGetAlbum (arg);
-		return;
+		return 1;
 	}
 
 	// need to fetch an artist?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_GETARTIST)) {
 		// yes. handle it
 		cmdGetArtist (arg);
-		return;
+		return 1;
 	}
 
 	// need to fetch an track?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_GETTRACK)) {
 		// yes. handle it
 		cmdGetTrack (arg);
-		return;
+		return 1;
 	}
 
 	// need to fetch all albums by an artist?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_ARTISTALBUMS)) {
 		// yes. handle it
 		cmdArtistAlbums (arg);
-		return;
+		return 1;
 	}
 
 	// need to fetch or modify the volume?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_VOLUME)) {
 		// yes. handle it
 		cmdVolume (arg);
-		return;
+		return 1;
 	}
 
 	// need to increase the volume?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_VOLUP)) {
 		// yes. handle it
 		cmdVolumeUp();
-		return;
+		return 1;
 	}
 
 	// need to decrease the volume?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_VOLDN)) {
 		// yes. handle it
 		cmdVolumeDown();
-		return;
+		return 1;
 	}
 
 	// need to handle update status?
 	if (!strcasecmp (cmd, JUKECLIENT_CMD_UPDATES)) {
 		// yes. handle it
 		cmdUpdates (arg);
-		return;
+		return 1;
+	}
+
+	// need to list the counters?
+	if (!strcasecmp (cmd, JUKECLIENT_CMD_COUNTERS)) {
+		// yes. handle it
+		cmdCounters();
+		return 1;
+	}
+
+	// need to list the catalog changes?
+	if (!strcasecmp (cmd, JUKECLIENT_CMD_CHANGES)) {
+		// yes. handle it
+		cmdChanges (arg);
+		return 1;
+	}
+
+	// need to search the catalog?
+	if (!strcasecmp (cmd, JUKECLIENT_CMD_SEARCH)) {
+		// yes. handle it
+		cmdSearch (arg);
+		return 1;
+	}
+
+	// need to complete a name?
+	if (!strcasecmp (cmd, JUKECLIENT_CMD_COMPLETE)) {
+		// yes. handle it
+		cmdComplete (arg);
+		return 1;
+	}
+
+	// need to find a misspelled name?
+	if (!strcasecmp (cmd, JUKECLIENT_CMD_FUZZY)) {
+		// yes. handle it
+		cmdFuzzy (arg);
+		return 1;
 	}
 
 	// what's this ?
 	sendf (JUKECLIENT_MSG_UNKNOWN);
+	return 1;
+}
+
+/*
+ * JUKECLIENT_JOB::JUKECLIENT_JOB (JUKECLIENT* c, int t)
+ *
+ * This will construct a job of type [t] for client [c].
+ *
+ */
+JUKECLIENT_JOB::JUKECLIENT_JOB (JUKECLIENT* c, int t) {
+	client = c; serial = c->getSerial(); type = t;
+	maxOutput = config->getMaxOutput();
+	memset (arg, 0, sizeof (arg)); id = 0;
+	memset (&user, 0, sizeof (USER));
+	sortByName = 0; after = limit = 0;
+}
+
+/*
+ * JUKECLIENT_JOB::~JUKECLIENT_JOB()
+ *
+ * This will destroy the job.
+ *
+ */
+JUKECLIENT_JOB::~JUKECLIENT_JOB() {
+	// don't leave passwords lying around
+	memset (arg, 0, sizeof (arg));
+	memset (&user, 0, sizeof (USER));
+}
+
+/*
+ * JUKECLIENT_JOB::run()
+ *
+ * This will do the blocking part of the command. It runs on a worker thread,
+ * so the client may not be touched; all output is collected instead. IDENT
+ * jobs are not run here, but completed by the ident client.
+ *
+ */
+void
+JUKECLIENT_JOB::run() {
+	USERS* userDB;
+	ALBUM* album;
+	ARTIST* artist;
+	TRACK* track;
+	struct passwd pw;
+	struct passwd* pwptr;
+	char pwbuf[1024];
+	int pos = 0;
+	unsigned int oldest, latest;
+	CHANGE* change;
+
+	switch (type) {
+		case JUKECLIENT_JOB_USER: // try all backends
+		                          for (userDB = users; userDB != NULL; userDB = userDB->getNextDB())
+		                            if (userDB->fetchUserByName (arg, &user)) {
+		                              result = 1;
+		                              break;
+		                            }
+		                          break;
+		case JUKECLIENT_JOB_PASSWORD: // try all backends
+		                          for (userDB = users; userDB != NULL; userDB = userDB->getNextDB())
+		                            if (userDB->verifyPassword ((const char*)arg, &user)) {
+		                              result = 1;
+		                              break;
+		                            }
+		                          break;
+		case JUKECLIENT_JOB_PEERCRED: // is the peer the user it claims to be?
+		                          if ((id >= 0) && (getpwuid_r ((uid_t)id, &pw, pwbuf, sizeof (pwbuf), &pwptr) == 0) &&
+		                              (pwptr != NULL) && (!strcmp (pw.pw_name, user.username)))
+		                            result = 1;
+		                          break;
+		case JUKECLIENT_JOB_ARTISTS: // handle the artists
+		                          listArtists();
+		                          break;
+		case JUKECLIENT_JOB_ALBUMS:
+		case JUKECLIENT_JOB_ARTISTALBUMS: // handle the albums
+		                          listAlbums();
+		                          break;
+		case JUKECLIENT_JOB_LISTALBUM: // wade through the album
+		                          listTracks();
+		                          break;
+		case JUKECLIENT_JOB_CHANGES: // do we still know what happened?
+		                          if (!CHANGE::getRange (&oldest, &latest)) {
+		                            // no idea. the client still needs an answer
+		                            output (JUKECLIENT_MSG_CHANGESFAIL);
+		                            break;
+		                          }
+		                          if (((unsigned long)id > latest) || ((unsigned long)id + 1 < oldest)) {
+		                            // no. the client has to start over
+		                            output (JUKECLIENT_MSG_CHANGESNAPSHOT, latest);
+		                            break;
+		                          }
+
+		                          // yes. send them, along with the current data
+		                          change = new CHANGE (id);
+		                          while ((pos < CHANGE_MAX_LIST) && (change->fetchNext())) {
+		                            output (JUKECLIENT_MSG_CHANGE, change->getSeq(), changeNames[change->getAction()], kindNames[change->getKind()], change->getObjectID());
+		                            pos++;
+
+		                            // deletions need no data. neither does anything
+		                            // which is gone by now; its deletion follows
+		                            if (change->getAction() == CHANGE_ACTION_DELETE)
+		                              continue;
+		                            try {
+		                              switch (change->getKind()) {
+		                                case CHANGE_KIND_ARTIST: artist = new ARTIST (change->getObjectID());
+		                                                         output (JUKECLIENT_MSG_ARTIST, artist->getID(), artist->getName());
+		                                                         delete artist;
+		                                                         break;
+		                                 case CHANGE_KIND_ALBUM: album = new ALBUM (change->getObjectID());
+		                                                         output (JUKECLIENT_MSG_ALBUM, album->getID(), album->getArtistID(), album->getName());
+		                                                         delete album;
+		                                                         break;
+		                                 case CHANGE_KIND_TRACK: track = new TRACK (change->getObjectID());
+		                                                         output (JUKECLIENT_MSG_CHANGEDTRACK, track->getID(), track->getArtistID(), track->getAlbumID(), track->getTitle());
+		                                                         delete track;
+		                                                         break;
+		                              }
+		                            } catch (ArtistException e) {
+		                            } catch (AlbumException e) {
+		                            } catch (TrackException e) {
+		                            }
+		                          }
+		                          output (JUKECLIENT_MSG_CHANGESEND, change->getSeq(), (change->getSeq() < latest) ? 'Y' : 'N');
+		                          delete change;
+		                          result = 1;
+		                          break;
+	}
+}
+
+/*
+ * JUKECLIENT_JOB::listArtists()
+ *
+ * This will list the artists after [after], by ID or by name, up to [limit]
+ * of them. If there are more, the last artist listed is reported so the
+ * client can ask for the next page.
+ *
+ */
+void
+JUKECLIENT_JOB::listArtists() {
+	ARTIST* artist;
+	long n = 0;
+	int last = 0;
+
+	// start at the beginning, or at the artist to continue after
+	try {
+		artist = (after) ? new ARTIST (after) : new ARTIST();
+	} catch (ArtistException e) {
+		// it's gone. complain
+		output (JUKECLIENT_MSG_NOAFTER);
+		return;
+	}
+
+	while ((sortByName) ? artist->fetchNextByName() : artist->fetchNext()) {
+		// is the page full?
+		if ((limit) && (n == limit)) {
+			// yes. tell where to go on
+			output (JUKECLIENT_MSG_MORE, last);
+			break;
+		}
+		output (JUKECLIENT_MSG_ARTIST, artist->getID(), artist->getName());
+		last = artist->getID(); n++;
+	}
+	output (JUKECLIENT_MSG_ARTISTEND);
+	delete artist;
+}
+
+/*
+ * JUKECLIENT_JOB::listAlbums()
+ *
+ * This will list the albums after [after], by ID or by name, up to [limit]
+ * of them. ARTISTALBUMS jobs only list the albums of artist [id], and only
+ * continue after one of them.
+ *
+ */
+void
+JUKECLIENT_JOB::listAlbums() {
+	ALBUM* album;
+	long n = 0;
+	int last = 0, ok;
+
+	// start at the beginning, or at the album to continue after
+	try {
+		album = (after) ? new ALBUM (after) : new ALBUM();
+	} catch (AlbumException e) {
+		// it's gone. complain
+		output (JUKECLIENT_MSG_NOAFTER);
+		return;
+	}
+
+	// is it one of the albums listed?
+	if ((after) && (type == JUKECLIENT_JOB_ARTISTALBUMS) && (album->getArtistID() != id)) {
+		// no. complain
+		delete album;
+		output (JUKECLIENT_MSG_NOAFTER);
+		return;
+	}
+
+	while (1) {
+		if (type == JUKECLIENT_JOB_ARTISTALBUMS)
+			ok = (sortByName) ? album->fetchArtistNextByName (id) : album->fetchArtistNext (id);
+		else
+			ok = (sortByName) ? album->fetchNextByName() : album->fetchNext();
+		if (!ok)
+			break;
+
+		// is the page full?
+		if ((limit) && (n == limit)) {
+			// yes. tell where to go on
+			output (JUKECLIENT_MSG_MORE, last);
+			break;
+		}
+		output (JUKECLIENT_MSG_ALBUM, album->getID(), album->getArtistID(), album->getName());
+		last = album->getID(); n++;
+	}
+	output (JUKECLIENT_MSG_ALBUMEND);
+	delete album;
+}
+
+/*
+ * JUKECLIENT_JOB::listTracks()
+ *
+ * This will list the tracks of album [id] after [after], which must be on
+ * that album, by track number or by title, up to [limit] of them.
+ *
+ */
+void
+JUKECLIENT_JOB::listTracks() {
+	ALBUM* album;
+	TRACK* track;
+	long n = 0;
+	int last = 0;
+
+	// does the album exist?
+	try {
+		album = new ALBUM (id);
+		delete album;
+	} catch (AlbumException e) {
+		// bummer
+		output (JUKECLIENT_MSG_NOALBUM);
+		return;
+	}
+
+	// start at the beginning, or at the track to continue after
+	try {
+		track = (after) ? new TRACK (after) : new TRACK();
+	} catch (TrackException e) {
+		// it's gone. complain
+		output (JUKECLIENT_MSG_NOAFTER);
+		return;
+	}
+
+	// is it on this album?
+	if ((after) && (track->getAlbumID() != id)) {
+		// no. complain
+		delete track;
+		output (JUKECLIENT_MSG_NOAFTER);
+		return;
+	}
+
+	while ((sortByName) ? track->fetchAlbumNextByTitle (id) : track->fetchAlbumNext (id)) {
+		// is the page full?
+		if ((limit) && (n == limit)) {
+			// yes. tell where to go on
+			output (JUKECLIENT_MSG_MORE, last);
+			break;
+		}
+		output (JUKECLIENT_MSG_TRACK, track->getID(), track->getTitle());
+		last = track->getID(); n++;
+	}
+	output (JUKECLIENT_MSG_LISTOK);
+	delete track;
+}
+
+/*
+ * JUKECLIENT_JOB::complete()
+ *
+ * This will report the outcome of the job to the client, if it is still
+ * around, and have it handle any commands it received in the mean time.
+ *
+ */
+void
+JUKECLIENT_JOB::complete() {
+	char* ptr;
+	char* next;
+	int i;
+
+	// is the client still connected?
+	for (i = 0; i < server->getNumClients(); i++)
+		if ((server->getClient (i) == client) && (client->getSerial() == serial))
+			break;
+	if (i == server->getNumClients())
+		// no. nobody to tell
+		return;
+
+	switch (type) {
+		case JUKECLIENT_JOB_USER: // found the user?
+		                          if (!result) {
+		                            // no. complain
+		                            client->sendf (JUKECLIENT_MSG_NOUSER);
+		                            break;
+		                          }
+
+		                          // victory
+		                          memcpy (&client->user, &user, sizeof (USER));
+		                          client->userid = user.id;
+		                          client->sendf (JUKECLIENT_MSG_USEROK);
+		                          break;
+		case JUKECLIENT_JOB_PASSWORD: // password match?
+		                          if (!result) {
+		                            // no. complain and log
+		                            client->sendf (JUKECLIENT_MSG_BADPASS);
+		                            logger->log (LOG_INFO, "User %s supplied a bad password", user.username);
+		                            break;
+		                          }
+
+		                          // yes. victory!
+		                          memcpy (&client->user, &user, sizeof (USER));
+		                          client->state = JUKECLIENT_STATE_AUTH;
+		                          client->sendf (JUKECLIENT_MSG_PASSOK, user.username);
+		                          client->issueSession();
+		                          break;
+		case JUKECLIENT_JOB_IDENT:
+		case JUKECLIENT_JOB_PEERCRED: // identified?
+		                          if (!result) {
+		                            // no. complain
+		                            client->sendf (JUKECLIENT_MSG_IDENTFAIL);
+		                            break;
+		                          }
+
+		                          // victory
+		                          client->state = JUKECLIENT_STATE_AUTH;
+		                          client->sendf (JUKECLIENT_MSG_PASSOK, user.username);
+		                          client->issueSession();
+		                          break;
+		                 default: // send the output over, line by line
+		                          for (ptr = out; (ptr != NULL) && (*ptr); ptr = next) {
+		                            next = strchr (ptr, '\n');
+		                            if (next != NULL)
+		                              *next++ = 0;
+		                            client->sendf ("%s\n", ptr);
+		                          }
+
+		                          // did we have to leave anything out?
+		                          if (truncated) {
+		                            // yes. say so
+		                            server->getCounters()->outputOverflows++;
+		                            client->sendf (JUKECLIENT_MSG_TRUNCATED);
+		                          }
+		                          break;
+	}
+
+	// handle whatever the client sent while waiting
+	client->resume();
 }
 
 /* vim:set ts=2 sw=2: */
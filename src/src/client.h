@@ -4,20 +4,60 @@
  * This is the jukebox server client code. It will handle all requests.
  *
  */
+#include <sys/time.h>
 #include <stdlib.h>
+#include <time.h>
 #include <libplusplus/network.h>
 #include "user.h"
+#include "worker.h"
 
 #ifndef __JUKECLIENT_H__
 #define __JUKECLIENT_H__
 
+class JUKECLIENT_JOB;
+class SEARCHINDEX;
+
 // JUKECLIENT_MAX_DATA_LENGTH is the maximum length of a single request
 #define JUKECLIENT_MAX_DATA_LENGTH	1024
 
+// JUKECLIENT_MAX_PENDING is the maximum amount of data queued while waiting
+#define JUKECLIENT_MAX_PENDING			4096
+
+// JUKECLIENT_MAX_LINE is the length of a reply which needs no extra buffer
+#define JUKECLIENT_MAX_LINE					1024
+
+// JUKECLIENT_OUTPUT_CHUNK is the granularity of the output buffer of local clients
+#define JUKECLIENT_OUTPUT_CHUNK			4096
+
+// JUKECLIENT_MAX_UPDATE is the maximum length of an update message
+#define JUKECLIENT_MAX_UPDATE				1024
+
+// JUKECLIENT_TOPIC_xxx are the kinds of updates clients can subscribe to
+#define JUKECLIENT_TOPIC_SONG				0
+#define JUKECLIENT_TOPIC_QUEUE			1
+#define JUKECLIENT_TOPIC_VOLUME			2
+#define JUKECLIENT_TOPIC_STATE			3
+#define JUKECLIENT_TOPIC_USERS			4
+#define JUKECLIENT_NUM_TOPICS				5
+
+// JUKECLIENT_TOPIC_ALL is the mask of all topics
+#define JUKECLIENT_TOPIC_ALL				((1 << JUKECLIENT_NUM_TOPICS) - 1)
+
 // JUKECLIENT_STATE_xxx are the states an user can be in
 #define JUKECLIENT_STATE_CONN				0
 #define JUKECLIENT_STATE_AUTH				1
 
+// JUKECLIENT_JOB_xxx are the jobs handed to the worker pool
+#define JUKECLIENT_JOB_USER					0
+#define JUKECLIENT_JOB_PASSWORD			1
+#define JUKECLIENT_JOB_IDENT				2
+#define JUKECLIENT_JOB_ALBUMS				3
+#define JUKECLIENT_JOB_ARTISTS			4
+#define JUKECLIENT_JOB_ARTISTALBUMS	5
+#define JUKECLIENT_JOB_LISTALBUM		6
+#define JUKECLIENT_JOB_PEERCRED			7
+#define JUKECLIENT_JOB_CHANGES			8
+
 // JUKECLIENT_MSG_xxx are the messages we can send
 #define JUKECLIENT_MSG_WELCOME	"[I] Welcome to JukeServer 0.1\n"
 #define JUKECLIENT_MSG_UNKNOWN	"[E] Unknown command\n"
@@ -42,6 +82,10 @@
 #define JUKECLIENT_MSG_RANDOMOFF	"[I] Random play turned off\n"
 #define JUKECLIENT_MSG_QUEUEITEM	"[Q] ID:{%u} Song:{%s} Artist:{%s}\n"
 #define JUKECLIENT_MSG_QUEUEDONE	"[I] Queue listed\n"
+#define JUKECLIENT_MSG_QUEUEDELTA	"[D] Version:{%u} Change:{%s} ID:{%u} Track:{%u}\n"
+#define JUKECLIENT_MSG_QUEUEDELTAS	"[I] Queue changes Version:{%u}\n"
+#define JUKECLIENT_MSG_QUEUESNAPSHOT	"[I] Queue snapshot Version:{%u}\n"
+#define JUKECLIENT_MSG_QUEUESYN		"[E] Arguments must be empty or SINCE followed by a version\n"
 #define JUKECLIENT_MSG_REMOVESYN	"[E] Argument must be a queue item ID\n"
 #define JUKECLIENT_MSG_REMOVEOK		"[I] Queue item removed\n"
 #define JUKECLIENT_MSG_ALREADYPLAYING	"[E] Already playing\n"
@@ -62,6 +106,9 @@
 #define JUKECLIENT_MSG_TRACK			"[T] ID:{%u} Title:{%s}\n"
 #define JUKECLIENT_MSG_NOARTIST		"[E] No such artist\n"
 #define JUKECLIENT_MSG_NOALBUM		"[E] No such album\n"
+#define JUKECLIENT_MSG_MORE				"[I] More After:{%u}\n"
+#define JUKECLIENT_MSG_PAGESYN		"[E] Options must be SORT NAME or SORT ID, AFTER <id> and LIMIT <count>\n"
+#define JUKECLIENT_MSG_NOAFTER		"[E] Nothing to continue after, no such item\n"
 #define JUKECLIENT_MSG_NOTRACK		"[E] No such track\n"
 #define JUKECLIENT_MSG_NOVOL			"[E] Volume manager unavailable\n"
 #define JUKECLIENT_MSG_VOLOK			"[I] Volume changed\n"
@@ -71,7 +118,38 @@
 #define JUKECLIENT_MSG_NOIDENTHOST "[E] Ident is not allowed from this host\n"
 #define JUKECLIENT_MSG_UPDATESON	"[I] Updates turned on\n"
 #define JUKECLIENT_MSG_UPDATESOFF	"[I] Updates turned off\n"
+#define JUKECLIENT_MSG_BADTOPIC		"[E] Arguments must be YES, NO, ALL or topics (song,queue,volume,state,users), optionally followed by a window in ms\n"
+#define JUKECLIENT_MSG_SESSION		"[I] Session:{%s}\n"
+#define JUKECLIENT_MSG_BADSESSION	"[E] Unknown or expired session\n"
+#define JUKECLIENT_MSG_OVERFLOW		"[E] Too many commands pending, some were dropped\n"
+#define JUKECLIENT_MSG_TOOMANY		"[E] Too many connections\n"
+#define JUKECLIENT_MSG_IDLE				"[I] Idle for too long, disconnecting\n"
+#define JUKECLIENT_MSG_THROTTLED	"[E] Too many commands, slow down\n"
+#define JUKECLIENT_MSG_TRUNCATED	"[E] Output limit reached, listing truncated\n"
+#define JUKECLIENT_MSG_COUNTER		"[C] Counter:{%s} Value:{%lu}\n"
+#define JUKECLIENT_MSG_COUNTERSEND	"[I] Counters listed\n"
+#define JUKECLIENT_MSG_CHANGE			"[K] Seq:{%u} Change:{%s} Type:{%s} ID:{%u}\n"
+#define JUKECLIENT_MSG_CHANGEDTRACK	"[T] ID:{%u} Artist:{%u} Album:{%u} Title:{%s}\n"
+#define JUKECLIENT_MSG_CHANGESEND	"[I] Changes listed Seq:{%u} More:{%c}\n"
+#define JUKECLIENT_MSG_CHANGESNAPSHOT	"[I] Changes unknown, reload the catalog Seq:{%u}\n"
+#define JUKECLIENT_MSG_CHANGESYN	"[E] Arguments must be SINCE followed by a sequence number\n"
+#define JUKECLIENT_MSG_CHANGESFAIL	"[E] Changes unavailable, try again later\n"
+#define JUKECLIENT_MSG_SEARCHRESULT	"[R] ID:{%u} Score:{%u} Artist:{%s} Album:{%s} Title:{%s}\n"
+#define JUKECLIENT_MSG_SEARCHDONE	"[I] Search done Results:{%u}\n"
+#define JUKECLIENT_MSG_SEARCHSYN	"[E] Argument must be the words to search for\n"
+#define JUKECLIENT_MSG_SEARCHBUSY	"[E] Search index not ready yet, try again later\n"
+#define JUKECLIENT_MSG_COMPLETION	"[C] Type:{%s} ID:{%u} Name:{%s}\n"
+#define JUKECLIENT_MSG_COMPLETEDONE	"[I] Completions listed Results:{%u}\n"
+#define JUKECLIENT_MSG_COMPLETESYN	"[E] Arguments must be ARTIST, ALBUM or TITLE, a prefix and optionally LIMIT <count>\n"
+#define JUKECLIENT_MSG_FUZZYMATCH	"[F] Type:{%s} ID:{%u} Distance:{%u} Name:{%s}\n"
+#define JUKECLIENT_MSG_FUZZYDONE	"[I] Matches listed Results:{%u}\n"
+#define JUKECLIENT_MSG_FUZZYSYN		"[E] Arguments must be ARTIST, ALBUM or TITLE, a name and optionally LIMIT <count>\n"
 #define JUKECLIENT_UPDATE_SONG	    "[U] Status:{%c} Artist:{%s} Song:{%s}\n"
+#define JUKECLIENT_UPDATE_QUEUE		  "[U] Queue:{%u} Version:{%u}\n"
+#define JUKECLIENT_UPDATE_QUEUESYNC	"[U] Queue resync Version:{%u}\n"
+#define JUKECLIENT_UPDATE_VOLUME	  "[U] Volume:{%u}\n"
+#define JUKECLIENT_UPDATE_STATE		  "[U] Random:{%c} Locked:{%c}\n"
+#define JUKECLIENT_UPDATE_USERS		  "[U] Users:{%u}\n"
 
 // JUKECLIENT_CMD_xxx are the commands we support
 #define JUKECLIENT_CMD_EXIT					"exit"
@@ -115,6 +193,12 @@
 #define JUKECLIENT_CMD_VOLDN				"voldn"
 #define JUKECLIENT_CMD_IDENT				"ident"
 #define JUKECLIENT_CMD_UPDATES			"updates"
+#define JUKECLIENT_CMD_RESUME				"resume"
+#define JUKECLIENT_CMD_COUNTERS			"counters"
+#define JUKECLIENT_CMD_CHANGES			"changes"
+#define JUKECLIENT_CMD_SEARCH				"search"
+#define JUKECLIENT_CMD_COMPLETE			"complete"
+#define JUKECLIENT_CMD_FUZZY				"fuzzy"
 
 // JUKECLIENT_HANDLE_PRIV is just for ease
 #define JUKECLIENT_HANDLE_PRIV(x) if (!checkPriv(x)) return;
@@ -125,7 +209,21 @@
  *
  */
 class JUKECLIENT : public SERVICECLIENT {
+	friend class JUKECLIENT_JOB;
+
 public:
+	//! \brief Constructs a client connected over TCP
+	JUKECLIENT();
+
+	/*! \brief Constructs a client connected over an AF_UNIX socket
+	 *  \param fd The socket
+	 *  \param uid The user ID of the peer, or -1 if unknown
+	 */
+	JUKECLIENT (int fd, int uid);
+
+	//! \brief Destroys the client
+	~JUKECLIENT();
+
 	//! \brief Greets the client and sets him up
 	void			welcome();
 
@@ -136,7 +234,71 @@ public:
 	int				getState();
 
 	//! \brief Need to send the user updates?
-	inline int wantsUpdates() { return sendUpdates; }
+	inline int wantsUpdates() { return (topics != 0) ? 1 : 0; }
+
+	/*! \brief Is the user subscribed to a topic?
+	 *  \param topic The JUKECLIENT_TOPIC_xxx topic
+	 */
+	inline int isSubscribed (int topic) { return (topics & (1 << topic)) ? 1 : 0; }
+
+	/*! \brief Queues an update for the user
+	 *  \param topic The JUKECLIENT_TOPIC_xxx topic of the update
+	 *  \param msg The message, which replaces an earlier one of the same topic
+	 *  \param count The number of changes this update is about
+	 *
+	 *  Updates are sent once the coalescing window of the user has passed.
+	 */
+	void			notify (int topic, const char* msg, unsigned int count);
+
+	/*! \brief Sends the queued updates if the coalescing window has passed
+	 *  \param now The current time
+	 */
+	void			flushUpdates (struct timeval* now);
+
+	//! \brief Returns the serial number, which is unique for every connection
+	inline unsigned int getSerial() { return serial; }
+
+	//! \brief Is the client connected over an AF_UNIX socket?
+	inline int isLocal() { return local; }
+
+	//! \brief Returns the AF_UNIX socket, or -1
+	inline int getLocalFD() { return localfd; }
+
+	//! \brief Is there output waiting to be sent?
+	inline int hasOutput() { return (outLen > 0) ? 1 : 0; }
+
+	//! \brief Is the client waiting for a job to complete?
+	inline int isSuspended() { return suspended; }
+
+	//! \brief Did the output waiting to be sent exceed the limit? Never set for TCP clients
+	inline int isOverflowed() { return overflowed; }
+
+	//! \brief Returns the moment the client last sent anything
+	inline time_t getLastActive() { return lastActive; }
+
+	/*! \brief Sends data to the client
+	 *  \param fmt The format string, as per printf()
+	 *
+	 *  This will return zero on failure or non-zero on success.
+	 */
+	int				sendf (const char* fmt, ...);
+
+	/*! \brief Receives data from the client
+	 *  \param buf The buffer to put the data in
+	 *  \param len The size of the buffer
+	 *
+	 *  This will return the number of bytes received, zero or less if none.
+	 */
+	int				recv (char* buf, int len);
+
+	//! \brief Closes the connection
+	void			close();
+
+	/*! \brief Sends as much of the waiting output as the socket takes
+	 *
+	 *  This will return zero if the connection failed, or non-zero otherwise.
+	 */
+	int				flush();
 
 	/*!
 	 * \brief Returns the current user authenticated
@@ -160,10 +322,116 @@ protected:
 	//! \brief User information, if the user is authenticated
 	USER			user;
 
-	//! \brief Flag: Keep the user updated on track changes?
-	int				sendUpdates;
+	//! \brief Mask of JUKECLIENT_TOPIC_xxx topics the user is subscribed to
+	int				topics;
+
+	//! \brief The coalescing window for updates, in milliseconds
+	int				updateWindow;
+
+	//! \brief Mask of topics with updates queued
+	int				pendingTopics;
+
+	//! \brief The latest update queued per topic
+	char			pendingMsg[JUKECLIENT_NUM_TOPICS][JUKECLIENT_MAX_UPDATE];
+
+	//! \brief The number of changes queued per topic
+	unsigned int	pendingCount[JUKECLIENT_NUM_TOPICS];
+
+	//! \brief The moment the queued updates are to be sent
+	struct timeval flushAt;
+
+	//! \brief The queue version the user was last told about
+	unsigned int	queueVersion;
+
+	//! \brief The serial number of this connection
+	unsigned int	serial;
+
+	//! \brief Flag: Waiting for a job to complete?
+	int				suspended;
+
+	//! \brief Commands received while suspended
+	char			pending[JUKECLIENT_MAX_PENDING];
+
+	//! \brief Number of bytes in the pending buffer
+	int				pendingLen;
+
+	//! \brief Flag: Were pending commands dropped?
+	int				pendingOverflow;
+
+	//! \brief Flag: Connected over an AF_UNIX socket?
+	int				local;
+
+	//! \brief The AF_UNIX socket, or -1
+	int				localfd;
+
+	//! \brief The user ID of the peer on an AF_UNIX socket, or -1
+	int				peeruid;
+
+	//! \brief Output the AF_UNIX socket did not take yet
+	char*			outBuf;
+
+	//! \brief Length of the output and size of the output buffer
+	int				outLen, outSize;
+
+	//! \brief Flag: Did the output exceed the limit?
+	int				overflowed;
+
+	//! \brief The moment the client last sent anything
+	time_t		lastActive;
+
+	//! \brief The commands the client may issue right now, in thousandths
+	long			tokens;
+
+	//! \brief The moment the tokens were last topped up
+	struct timeval lastRefill;
 
 private:
+	/*!
+	 * \brief Handles a single command
+	 *
+	 * This will return zero if the client was destroyed by the command, or
+	 * non-zero otherwise.
+	 *
+	 * \param data The command line to handle
+	 *
+	 */
+	int				execute (char* data);
+
+	/*! \brief Sends raw data over the AF_UNIX socket
+	 *
+	 *  Whatever the socket does not take right away is buffered. This will
+	 *  return zero on failure or non-zero on success.
+	 *
+	 *  \param data The data to send
+	 *  \param len The length of the data
+	 */
+	int				sendLocal (const char* data, int len);
+
+	/*!
+	 * \brief Charges the client for a command
+	 *
+	 * This will return zero if the client exceeded the command rate, or
+	 * non-zero if the command may be handled.
+	 *
+	 * \param cmd The command
+	 *
+	 */
+	int				charge (char* cmd);
+
+	/*!
+	 * \brief Hands a job to the worker pool and stops handling commands
+	 *
+	 * Commands received in the mean time are queued, and handled once the
+	 * job has been completed.
+	 *
+	 * \param job The job to submit
+	 *
+	 */
+	void			suspend (JUKECLIENT_JOB* job);
+
+	//! \brief Continues handling commands after a job has been completed
+	void			resume();
+
 	/*!
 	 * \brief Checks the client for enough privileges.
 	 *
@@ -184,6 +452,12 @@ private:
 	//! \brief This will handle the PASSWORD command
 	void			cmdPassword (char*);
 
+	//! \brief This will handle the RESUME command
+	void			cmdResumeSession (char*);
+
+	//! \brief Hands a session token to a freshly authenticated client
+	void			issueSession();
+
 	//! \brief This will handle the PAUSE command
 	void			cmdPause();
 
@@ -209,7 +483,21 @@ private:
 	void			cmdRandom(char*);
 
 	//! \brief This will handle the QUEUE command
-	void			cmdQueue();
+	void			cmdQueue(char*);
+
+	//! \brief Sends all items in the queue
+	void			listQueue();
+
+	/*!
+	 * \brief Sends the changes made to the queue after a version
+	 *
+	 * This will return zero if the changes are no longer known, in which case
+	 * nothing is sent, or non-zero on success.
+	 *
+	 * \param since The version
+	 *
+	 */
+	int				sendQueueDeltas (unsigned int since);
 
 	//! \brief This will handle the REMOVE command
 	void			cmdRemove(char*);
@@ -227,10 +515,18 @@ private:
 	void			cmdClear();
 
 	//! \brief This will handle the ALBUMS command
-	void			cmdAlbums();
+	void			cmdAlbums(char*);
 
 	//! \brief This will handle the ARTISTS command
-	void			cmdArtists();
+	void			cmdArtists(char*);
+
+	/*! \brief Parses the paging options of the listing commands
+	 *  \param arg The options, which are modified
+	 *  \param job The job to store them in
+	 *
+	 *  This will return zero if the options are invalid or non-zero if not.
+	 */
+	int				parsePage(char* arg, JUKECLIENT_JOB* job);
 
 	//! \brief This will handle the ENQUEUETRACK command
 	void			cmdEnqueueTrack(char*);
@@ -267,6 +563,102 @@ private:
 
 	//! \brief This will handle the UPDATES command
 	void			cmdUpdates(char*);
+
+	//! \brief This will handle the COUNTERS command
+	void			cmdCounters();
+
+	//! \brief This will handle the CHANGES command
+	void			cmdChanges(char*);
+
+	//! \brief This will handle the SEARCH command
+	void			cmdSearch(char*);
+
+	//! \brief This will handle the COMPLETE command
+	void			cmdComplete(char*);
+
+	//! \brief This will handle the FUZZY command
+	void			cmdFuzzy(char*);
+
+	/*! \brief Parses the arguments of the COMPLETE and FUZZY commands
+	 *  \param arg The arguments, which are modified
+	 *  \param kind Receives the COMPLETE_KIND_xxx kind of name
+	 *  \param text Receives the text to look for
+	 *  \param limit Receives the number of names to list
+	 *
+	 *  This will return zero if the arguments are invalid or non-zero if not.
+	 */
+	int				parseNameArgs(char* arg, int* kind, char** text, int* limit);
+
+	/*! \brief Returns the name of an object in the search index
+	 *  \param idx The index
+	 *  \param kind The COMPLETE_KIND_xxx kind of object
+	 *  \param id The ID of the object
+	 */
+	const char*	lookupName(SEARCHINDEX* idx, int kind, int id);
+
+	//! \brief Informs everyone subscribed of the random and lock state
+	void			updateState();
+
+	//! \brief Informs everyone subscribed of the volume
+	void			updateVolume();
+};
+
+/*!
+ * \class JUKECLIENT_JOB
+ * \brief A blocking command, handled by the worker pool
+ *
+ */
+class JUKECLIENT_JOB : public WORKJOB {
+public:
+	/*! \brief Constructs a new job
+	 *  \param c The client who issued the command
+	 *  \param t The JUKECLIENT_JOB_xxx type of the job
+	 */
+	JUKECLIENT_JOB (JUKECLIENT* c, int t);
+
+	//! \brief Destroys the job
+	~JUKECLIENT_JOB();
+
+	//! \brief Does the blocking part of the command
+	void			run();
+
+	//! \brief Reports back to the client, if it is still connected
+	void			complete();
+
+	//! \brief The argument of the command
+	char			arg[JUKECLIENT_MAX_DATA_LENGTH];
+
+	//! \brief The numeric argument of the command
+	long			id;
+
+	//! \brief The user to authenticate
+	USER			user;
+
+	//! \brief Flag: Are the items listed by name rather than by ID?
+	int				sortByName;
+
+	//! \brief The item to continue after, zero to start at the beginning
+	long			after;
+
+	//! \brief The maximum number of items to list, zero for all of them
+	long			limit;
+
+private:
+	//! \brief Lists a page of artists
+	void			listArtists();
+
+	//! \brief Lists a page of albums, of all artists or of the one given
+	void			listAlbums();
+
+	//! \brief Lists a page of the tracks of an album
+	void			listTracks();
+
+	//! \brief The client and its serial number
+	JUKECLIENT*		client;
+	unsigned int	serial;
+
+	//! \brief The type of the job
+	int				type;
 };
 
 #endif // __JUKECLIENT_H__
@@ -0,0 +1,181 @@
+/*
+ * complete.cc - Jukebox completion list code
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "complete.h"
+#include "fold.h"
+
+/*
+ * compareEntries (const void* a, const void* b)
+ *
+ * This will order completion entries by key, and by ID after that.
+ *
+ */
+static int
+compareEntries (const void* a, const void* b) {
+	const COMPLETE_ENTRY* ea = (const COMPLETE_ENTRY*)a;
+	const COMPLETE_ENTRY* eb = (const COMPLETE_ENTRY*)b;
+	int i = strcmp (ea->key, eb->key);
+
+	if (i)
+		return i;
+	return (ea->id < eb->id) ? -1 : ((ea->id > eb->id) ? 1 : 0);
+}
+
+/*
+ * COMPLETELIST::COMPLETELIST()
+ *
+ * This will construct an empty list. Names added are appended until the list
+ * is sorted for the first time.
+ *
+ */
+COMPLETELIST::COMPLETELIST() {
+	entries = NULL; numEntries = entrySize = 0; sorted = 0;
+}
+
+/*
+ * COMPLETELIST::~COMPLETELIST()
+ *
+ * This will destroy the list.
+ *
+ */
+COMPLETELIST::~COMPLETELIST() {
+	int i;
+
+	for (i = 0; i < numEntries; i++)
+		free (entries[i].key);
+	if (entries) free (entries);
+}
+
+/*
+ * COMPLETELIST::lowerBound (const char* key, int id)
+ *
+ * This will return the position of the first entry which does not come
+ * before [key] and [id]. The list must be sorted.
+ *
+ */
+int
+COMPLETELIST::lowerBound (const char* key, int id) {
+	int lo = 0, hi = numEntries, mid, i;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		i = strcmp (entries[mid].key, key);
+		if ((i < 0) || ((i == 0) && (entries[mid].id < id)))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ * COMPLETELIST::add (const char* name, int id)
+ *
+ * This will add [name] of object [id]. Names which fold to nothing are not
+ * added.
+ *
+ */
+void
+COMPLETELIST::add (const char* name, int id) {
+	COMPLETE_ENTRY* ptr;
+	char key[COMPLETE_MAX_KEY];
+	char* k;
+	int pos;
+
+	// anything left after folding?
+	if (!foldText (name, key, sizeof (key)))
+		// no. there is nothing to complete then
+		return;
+
+	// make room
+	if (numEntries == entrySize) {
+		ptr = (COMPLETE_ENTRY*)realloc (entries, (entrySize + 1024) * sizeof (COMPLETE_ENTRY));
+		if (ptr == NULL)
+			// this failed. too bad
+			return;
+		entries = ptr; entrySize += 1024;
+	}
+	k = strdup (key);
+	if (k == NULL)
+		return;
+
+	// while filling, just append; sort() will put everything in place
+	pos = (sorted) ? lowerBound (key, id) : numEntries;
+	memmove (entries + pos + 1, entries + pos, (numEntries - pos) * sizeof (COMPLETE_ENTRY));
+	entries[pos].key = k; entries[pos].id = id;
+	numEntries++;
+}
+
+/*
+ * COMPLETELIST::remove (const char* name, int id)
+ *
+ * This will remove [name] of object [id].
+ *
+ */
+void
+COMPLETELIST::remove (const char* name, int id) {
+	char key[COMPLETE_MAX_KEY];
+	int pos;
+
+	// was it ever added?
+	if (!foldText (name, key, sizeof (key)))
+		// no. nothing to do
+		return;
+
+	// find it
+	sort();
+	pos = lowerBound (key, id);
+	if ((pos == numEntries) || (entries[pos].id != id) || (strcmp (entries[pos].key, key)))
+		// it's not there. bail out
+		return;
+
+	free (entries[pos].key);
+	memmove (entries + pos, entries + pos + 1, (numEntries - pos - 1) * sizeof (COMPLETE_ENTRY));
+	numEntries--;
+}
+
+/*
+ * COMPLETELIST::sort()
+ *
+ * This will put the entries in order, if they aren't already.
+ *
+ */
+void
+COMPLETELIST::sort() {
+	if (sorted)
+		return;
+
+	qsort (entries, numEntries, sizeof (COMPLETE_ENTRY), compareEntries);
+	sorted = 1;
+}
+
+/*
+ * COMPLETELIST::find (const char* prefix, int* ids, int max)
+ *
+ * This will store the IDs of at most [max] names starting with [prefix] in
+ * [ids], in name order. It will return the number of IDs stored.
+ *
+ */
+int
+COMPLETELIST::find (const char* prefix, int* ids, int max) {
+	char key[COMPLETE_MAX_KEY];
+	int len, pos, n = 0;
+
+	len = foldText (prefix, key, sizeof (key));
+
+	// the matches are all next to each other, starting here
+	sort();
+	for (pos = lowerBound (key, -1); (pos < numEntries) && (n < max); pos++) {
+		if (strncmp (entries[pos].key, key, len))
+			// this one doesn't match, so none of the others will
+			break;
+		ids[n++] = entries[pos].id;
+	}
+	return n;
+}
+
+/* vim:set ts=2 sw=2: */
@@ -0,0 +1,103 @@
+/*
+ * complete.h
+ *
+ * This is the jukebox completion list, used for type-ahead.
+ *
+ */
+#include <stdlib.h>
+
+#ifndef __COMPLETE_H__
+#define __COMPLETE_H__
+
+//! \brief COMPLETE_DEFAULT_LIMIT is the number of completions returned by default
+#define COMPLETE_DEFAULT_LIMIT		10
+
+//! \brief COMPLETE_MAX_LIMIT is the maximum number of completions returned
+#define COMPLETE_MAX_LIMIT				100
+
+//! \brief COMPLETE_MAX_KEY is the maximum length of a key
+#define COMPLETE_MAX_KEY					256
+
+// COMPLETE_KIND_xxx are the kinds of names which can be completed
+#define COMPLETE_KIND_ARTIST			0
+#define COMPLETE_KIND_ALBUM				1
+#define COMPLETE_KIND_TITLE				2
+#define COMPLETE_NUM_KINDS				3
+
+/*!
+ * \struct COMPLETE_ENTRY
+ * \brief A name in a completion list
+ */
+struct COMPLETE_ENTRY {
+	//! \brief The folded name
+	char*	key;
+
+	//! \brief The ID of the object it names
+	int		id;
+};
+
+/*!
+ * \class COMPLETELIST
+ * \brief A sorted list of folded names
+ *
+ * The names are folded using foldText() and kept ordered by key and ID, so
+ * all names starting with a prefix are next to each other and can be found
+ * with a binary search. A new list is filled by appending the names, and
+ * sorted only once, by sort() or the first lookup; names added after that
+ * are put in place right away.
+ */
+class COMPLETELIST {
+public:
+	//! \brief Constructs an empty list
+	COMPLETELIST();
+
+	//! \brief Destroys the list
+	~COMPLETELIST();
+
+	/*! \brief Adds a name
+	 *  \param name The name, which will be folded
+	 *  \param id The ID of the object it names
+	 */
+	void add (const char* name, int id);
+
+	/*! \brief Removes a name
+	 *  \param name The name, as it was added
+	 *  \param id The ID of the object it names
+	 */
+	void remove (const char* name, int id);
+
+	//! \brief Sorts the names appended since the list was last sorted
+	void sort();
+
+	/*! \brief Looks up the names starting with a prefix
+	 *  \param prefix The prefix, which will be folded
+	 *  \param ids Receives the IDs of the objects found, in name order
+	 *  \param max The number of IDs there is room for
+	 *
+	 *  This will return the number of IDs found.
+	 */
+	int find (const char* prefix, int* ids, int max);
+
+	//! \brief Returns the number of names
+	inline int getNumEntries() { return numEntries; }
+
+private:
+	/*! \brief Finds the first entry which does not come before a key and ID
+	 *  \param key The folded key
+	 *  \param id The ID
+	 */
+	int lowerBound (const char* key, int id);
+
+	//! \brief The entries
+	COMPLETE_ENTRY*	entries;
+
+	//! \brief The number of entries and the number there is room for
+	int							numEntries, entrySize;
+
+	//! \brief Flag: Are the entries in order?
+	int							sorted;
+};
+
+#endif /* __COMPLETE_H__ */
+
+/* vim:set ts=2 sw=2: */
@@ -11,9 +11,15 @@
 #include <unistd.h>
 #include <libplusplus/database.h>
 #include "config.h"
+#include "ident.h"
 #include "jukebox.h"
+#include "local.h"
+#include "search.h"
+#include "server.h"
+#include "session.h"
 #include "user_sql.h"
 #include "user_ldap.h"
+#include "worker.h"
 
 /*
  * JUKECONFIG::parse()
@@ -124,6 +130,60 @@ JUKECONFIG::parse() {
 			// yes. set the flag
 			anonstatusallowed = 1;
 	}
+
+	// fetch the session lifetime and table size
+	sessionttl = SESSION_DEFAULT_TTL; sessionmax = SESSION_DEFAULT_MAX;
+	get_value ("general", "session_ttl", &sessionttl);
+	get_value ("general", "session_max", &sessionmax);
+
+	// fetch the number of worker threads
+	workers = WORKERS_DEFAULT_THREADS;
+	get_value ("general", "workers", &workers);
+
+	// fetch the ident timeout and cache lifetime
+	identtimeout = IDENT_DEFAULT_TIMEOUT; identcachettl = IDENT_DEFAULT_CACHE_TTL;
+	get_value ("general", "ident_timeout", &identtimeout);
+	get_value ("general", "ident_cache_ttl", &identcachettl);
+	if (identtimeout < 1) identtimeout = 1;
+
+	// fetch the AF_UNIX socket and its permissions, which are octal
+	localsocket = NULL; localsocketmode = LOCALSERVER_DEFAULT_MODE;
+	get_string ("general", "local_socket", &localsocket);
+	if (get_string ("general", "local_socket_mode", &tmp) == CONFIGFILE_OK)
+		localsocketmode = strtol (tmp, NULL, 8) & 0777;
+
+	// fetch the status of local authentication
+	localauthallowed = 1;
+	if (get_string ("general", "allow_local_auth", &tmp) == CONFIGFILE_OK) {
+		// this worked. is it turned off?
+		if ((!strcasecmp (tmp, "no")) || (!strcasecmp (tmp, "false")) ||
+		    (!strcasecmp (tmp, "off")))
+			// yes. clear the flag
+			localauthallowed = 0;
+	}
+
+	// fetch the connection limits
+	maxconnections = JUKESERVER_DEFAULT_MAX_CONNECTIONS; maxperhost = JUKESERVER_DEFAULT_MAX_PER_HOST;
+	idletimeout = JUKESERVER_DEFAULT_IDLE_TIMEOUT; maxoutput = JUKESERVER_DEFAULT_MAX_OUTPUT;
+	get_value ("general", "max_connections", &maxconnections);
+	get_value ("general", "max_connections_per_host", &maxperhost);
+	get_value ("general", "idle_timeout", &idletimeout);
+	get_value ("general", "max_output", &maxoutput);
+
+	// fetch the command rate
+	commandrate = JUKESERVER_DEFAULT_COMMAND_RATE; commandburst = JUKESERVER_DEFAULT_COMMAND_BURST;
+	get_value ("general", "command_rate", &commandrate);
+	get_value ("general", "command_burst", &commandburst);
+	if (commandburst < 1) commandburst = 1;
+
+	// fetch the default update coalescing window
+	updatewindow = JUKESERVER_DEFAULT_UPDATE_WINDOW;
+	get_value ("general", "update_window", &updatewindow);
+	if (updatewindow < 0) updatewindow = 0;
+
+	// fetch the search index update interval
+	searchrefresh = SEARCH_DEFAULT_REFRESH;
+	get_value ("general", "search_refresh", &searchrefresh);
 }
 
 /*
@@ -175,6 +235,25 @@ JUKECONFIG::checkRight (char* cmd, int status) {
 	return (right > status) ? 0 : 1;
 }
 
+/*
+ * JUKECONFIG::getCommandCost (char* cmd)
+ *
+ * This will return the cost of command [cmd], as charged against the command
+ * rate.
+ *
+ */
+int
+JUKECONFIG::getCommandCost (char* cmd) {
+	int cost = 1;
+
+	// try to fetch costs->[cmd] first
+	if (get_value ("costs", cmd, &cost) != CONFIGFILE_OK)
+		// this failed. try costs->JUKECONFIG_PRIV_DEFAULTKEY instead
+		get_value ("costs", JUKECONFIG_PRIV_DEFAULTKEY, &cost);
+
+	return (cost < 0) ? 0 : cost;
+}
+
 /*
  * JUKECONFIG::getDatabase()
  *
@@ -184,11 +263,11 @@ JUKECONFIG::checkRight (char* cmd, int status) {
  */
 DATABASE*
 JUKECONFIG::getDatabase() {
-	char* type;
+	char* type = getDatabaseType();
 
-	// fetch the database type
-	if (get_string ("database", "type", &type) != CONFIGFILE_OK) {
-		// this failed. complain
+	// got a database type?
+	if (type == NULL) {
+		// no. complain
 		fprintf (stderr, "JUKECONFIG::getDatabase(): no type specified in the configuration file\n");
 		return NULL;
 	}
@@ -196,6 +275,25 @@ JUKECONFIG::getDatabase() {
 	return DATABASE::getDatabase (type);
 }
 
+/*
+ * JUKECONFIG::getDatabaseType()
+ *
+ * This will return the database type as specified in the config file, or
+ * NULL if there is none.
+ *
+ */
+char*
+JUKECONFIG::getDatabaseType() {
+	char* type;
+
+	// fetch the database type
+	if (get_string ("database", "type", &type) != CONFIGFILE_OK)
+		// this failed. too bad
+		return NULL;
+
+	return type;
+}
+
 /*
  * JUKECONFIG::checkIdentHost (NETADDRESS* addr)
  *
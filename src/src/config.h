@@ -34,6 +34,22 @@ public:
 
 	int	uid, gid, logenqueue, logremove, identallowed, anonstatusallowed;
 
+	int	sessionttl, sessionmax;
+
+	int	workers;
+
+	int	identtimeout, identcachettl;
+
+	char* localsocket;
+
+	int	localsocketmode, localauthallowed;
+
+	int	maxconnections, maxperhost, idletimeout, maxoutput, commandrate, commandburst;
+
+	int	updatewindow;
+
+	int	searchrefresh;
+
 	/*! \brief Looks up a player for the supplied extension
 	 *
 	 * This function will return zero on failure or non-zero on success.
@@ -60,6 +76,12 @@ public:
 	 */
 	DATABASE* getDatabase();
 
+	/*! \brief Returns the database type specified in the config file
+	 *
+	 * If no type is specified, NULL will be returned.
+	 */
+	char* getDatabaseType();
+
 	//! \brief Returns whether enqueues will be logged
 	inline int getLogEnqueue() { return logenqueue; }
 
@@ -75,6 +97,62 @@ public:
 	//! \brief Returns whether Status Requests for anonymous users are allowed
 	inline int isAnonStatusAllowed() { return anonstatusallowed; }
 
+	//! \brief Returns the session lifetime in seconds, zero if disabled
+	inline int getSessionTTL() { return sessionttl; }
+
+	//! \brief Returns the maximum number of sessions kept
+	inline int getSessionMax() { return sessionmax; }
+
+	//! \brief Returns the number of worker threads, zero if none are used
+	inline int getWorkers() { return workers; }
+
+	//! \brief Returns the time allowed per stage of an ident lookup, in seconds
+	inline int getIdentTimeout() { return identtimeout; }
+
+	//! \brief Returns the lifetime of cached ident results, zero if disabled
+	inline int getIdentCacheTTL() { return identcachettl; }
+
+	//! \brief Returns the filename of the AF_UNIX socket, or NULL if there is none
+	inline char* getLocalSocket() { return localsocket; }
+
+	//! \brief Returns the permissions of the AF_UNIX socket
+	inline int getLocalSocketMode() { return localsocketmode; }
+
+	//! \brief Returns whether AF_UNIX clients may authenticate by their user ID
+	inline int isLocalAuthAllowed() { return localauthallowed; }
+
+	//! \brief Returns the maximum number of clients, zero if unlimited
+	inline int getMaxConnections() { return maxconnections; }
+
+	//! \brief Returns the maximum number of TCP clients per address, zero if unlimited
+	inline int getMaxConnectionsPerHost() { return maxperhost; }
+
+	//! \brief Returns the time a client may be idle in seconds, zero if forever
+	inline int getIdleTimeout() { return idletimeout; }
+
+	//! \brief Returns the maximum output per listing, and buffered per local client, in bytes, zero if unlimited
+	inline int getMaxOutput() { return maxoutput; }
+
+	//! \brief Returns the number of commands per second allowed, zero if unlimited
+	inline int getCommandRate() { return commandrate; }
+
+	//! \brief Returns the number of commands which may be issued at once
+	inline int getCommandBurst() { return commandburst; }
+
+	//! \brief Returns the default coalescing window of updates, in milliseconds
+	inline int getUpdateWindow() { return updatewindow; }
+
+	//! \brief Returns the interval between search index updates in seconds, zero if never
+	inline int getSearchRefresh() { return searchrefresh; }
+
+	/*! \brief Returns the cost of a command, in commands
+	 *
+	 * Commands cost one, unless configured otherwise.
+	 *
+	 * \param cmd The command to look up
+	 */
+	int getCommandCost (char* cmd);
+
 	/*! \brief Checks whether IDENT authentication is allowed from a host
 	 *	\return Non-zero if it is allowed, zero if not
 	 *  \param addr The address to check
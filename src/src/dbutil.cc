@@ -0,0 +1,121 @@
+/*
+ * dbutil.cc - Jukebox database helper code
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "dbutil.h"
+#include "jukebox.h"
+
+int DBUTIL::dbType = DBUTIL_TYPE_UNKNOWN;
+
+/*
+ * DBUTIL::setType (const char* type)
+ *
+ * This will set the kind of database used to [type], which is the type name
+ * used by lib++.
+ *
+ */
+void
+DBUTIL::setType (const char* type) {
+	if (type == NULL)
+		dbType = DBUTIL_TYPE_UNKNOWN;
+	else if (!strncasecmp (type, "mysql", 5))
+		dbType = DBUTIL_TYPE_MYSQL;
+	else if ((!strncasecmp (type, "pgsql", 5)) || (!strncasecmp (type, "postgres", 8)))
+		dbType = DBUTIL_TYPE_PGSQL;
+	else if (!strncasecmp (type, "sqlite", 6))
+		dbType = DBUTIL_TYPE_SQLITE;
+	else
+		dbType = DBUTIL_TYPE_UNKNOWN;
+}
+
+/*
+ * DBUTIL::lastInsertID (const char* table)
+ *
+ * This will return the ID of the row this connection inserted into [table]
+ * last, or 0 if it can't be fetched this way.
+ *
+ */
+int
+DBUTIL::lastInsertID (const char* table) {
+	char query[128];
+	DBRESULT* res;
+	int id;
+
+	switch (dbType) {
+		 case DBUTIL_TYPE_MYSQL: // kept per connection, like the others
+		                         strcpy (query, "SELECT LAST_INSERT_ID()");
+		                         break;
+		 case DBUTIL_TYPE_PGSQL: // serial columns are backed by [table]_id_seq
+		                         snprintf (query, sizeof (query), "SELECT currval('%s_id_seq')", table);
+		                         break;
+		case DBUTIL_TYPE_SQLITE: // the ID is the rowid
+		                         strcpy (query, "SELECT last_insert_rowid()");
+		                         break;
+		                default: // no idea
+		                         return 0;
+	}
+
+	res = db->query (query);
+	if (res == NULL)
+		// this failed. the caller will have to look it up
+		return 0;
+
+	id = (res->numRows() > 0) ? res->fetchColumnAsInteger (0) : 0;
+	delete res;
+	return id;
+}
+
+/*
+ * DBUTIL::fetchBigInt (DBRESULT* res, int col)
+ *
+ * This will return the value of BIGINT column [col] of the current row of
+ * [res], or 0 if it is NULL.
+ *
+ */
+long long
+DBUTIL::fetchBigInt (DBRESULT* res, int col) {
+	char* ptr = res->fetchColumnAsString (col);
+
+	return (ptr != NULL) ? strtoll (ptr, NULL, 10) : 0;
+}
+
+/*
+ * DBUTIL::formatBigInt (long long value, char* buf)
+ *
+ * This will put [value] in [buf] as text, and return [buf].
+ *
+ */
+char*
+DBUTIL::formatBigInt (long long value, char* buf) {
+	snprintf (buf, DBUTIL_BIGINT_LEN, "%lld", value);
+	return buf;
+}
+
+/*
+ * DBUTIL::begin()
+ *
+ * This will start a transaction. All databases known agree on how to do
+ * that.
+ *
+ */
+void
+DBUTIL::begin() {
+	db->execute ("BEGIN");
+}
+
+/*
+ * DBUTIL::commit()
+ *
+ * This will commit the current transaction.
+ *
+ */
+void
+DBUTIL::commit() {
+	db->execute ("COMMIT");
+}
+
+/* vim:set ts=2 sw=2: */
@@ -0,0 +1,81 @@
+/*
+ * dbutil.h
+ *
+ * This is the jukebox database helper, for the things lib++ leaves to the
+ * database backend.
+ *
+ */
+#include <stdlib.h>
+
+#ifndef __DBUTIL_H__
+#define __DBUTIL_H__
+
+// DBUTIL_TYPE_xxx are the kinds of databases which are known
+#define DBUTIL_TYPE_UNKNOWN		0
+#define DBUTIL_TYPE_MYSQL			1
+#define DBUTIL_TYPE_PGSQL			2
+#define DBUTIL_TYPE_SQLITE		3
+
+// DBUTIL_BIGINT_LEN is the size of a buffer holding any 64-bit number as text
+#define DBUTIL_BIGINT_LEN			24
+
+class DBRESULT;
+
+/*!
+ * \class DBUTIL
+ * \brief Helpers which depend on the kind of database used
+ *
+ * lib++ hides the differences between the databases, except for a few
+ * things which have to be done in the SQL dialect of each. The type is set
+ * once, and applies to the connections of all threads.
+ */
+class DBUTIL {
+public:
+	/*! \brief Sets the kind of database used
+	 *  \param type The database type, as given to lib++
+	 */
+	static void setType (const char* type);
+
+	//! \brief Returns the DBUTIL_TYPE_xxx kind of database used
+	inline static int getType() { return dbType; }
+
+	/*! \brief Fetches the ID of the last row inserted by this connection
+	 *  \param table The table the row was inserted into
+	 *
+	 *  This will return zero if the ID can't be fetched this way, in which
+	 *  case the row has to be looked up instead.
+	 */
+	static int lastInsertID (const char* table);
+
+	/*! \brief Fetches a BIGINT column of the current row
+	 *  \param res The result to fetch from
+	 *  \param col The column number
+	 *
+	 *  lib++ only fetches integers as int, so the value is fetched as text.
+	 *  This will return zero if the column is NULL.
+	 */
+	static long long fetchBigInt (DBRESULT* res, int col);
+
+	/*! \brief Formats a BIGINT value to be passed as a ? argument
+	 *  \param value The value
+	 *  \param buf The buffer, of DBUTIL_BIGINT_LEN bytes
+	 *
+	 *  lib++ only passes int as a # argument. All databases known turn the
+	 *  quoted number back into a number. This will return [buf].
+	 */
+	static char* formatBigInt (long long value, char* buf);
+
+	//! \brief Starts a transaction
+	static void begin();
+
+	//! \brief Commits the current transaction
+	static void commit();
+
+private:
+	//! \brief The DBUTIL_TYPE_xxx kind of database used
+	static int dbType;
+};
+
+#endif /* __DBUTIL_H__ */
+
+/* vim:set ts=2 sw=2: */
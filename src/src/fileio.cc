@@ -0,0 +1,434 @@
+/*
+ * fileio.cc - Jukebox batched file access code
+ *
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "fileio.h"
+
+#ifdef URING_SUPPORT
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+// the opcodes used came along with the probe and IORING_FEAT_CUR_PERSONALITY
+#if (!defined(IORING_FEAT_CUR_PERSONALITY)) || (!defined(__NR_io_uring_setup)) || (!defined(STATX_BASIC_STATS))
+#undef URING_SUPPORT
+#endif
+#endif /* URING_SUPPORT */
+
+#ifdef URING_SUPPORT
+/*
+ * FILEIO_RING is the io_uring of a thread, along with what the requests
+ * being handled need.
+ */
+struct FILEIO_RING {
+	int											fd;
+	unsigned int*						sqHead;
+	unsigned int*						sqTail;
+	unsigned int*						sqMask;
+	unsigned int*						sqArray;
+	struct io_uring_sqe*		sqes;
+	unsigned int*						cqHead;
+	unsigned int*						cqTail;
+	unsigned int*						cqMask;
+	struct io_uring_cqe*		cqes;
+	void*										sqRing;
+	void*										cqRing;
+	size_t									sqRingLen, cqRingLen, sqesLen;
+	struct statx						stx[FILEIO_RING_SIZE];
+	int											files[FILEIO_RING_SIZE];
+};
+
+// the ring of this thread, and whether there is one: 0 if not tried yet, -1 if not
+static __thread FILEIO_RING* ring = NULL;
+static __thread int ringState = 0;
+
+/*
+ * freeRing (FILEIO_RING* r)
+ *
+ * This will free ring [r].
+ *
+ */
+static void
+freeRing (FILEIO_RING* r) {
+	if (r->sqes != NULL)
+		munmap (r->sqes, r->sqesLen);
+	if ((r->cqRing != NULL) && (r->cqRing != r->sqRing))
+		munmap (r->cqRing, r->cqRingLen);
+	if (r->sqRing != NULL)
+		munmap (r->sqRing, r->sqRingLen);
+	close (r->fd);
+	free (r);
+}
+
+/*
+ * supportsOps (int fd)
+ *
+ * This will return non-zero if ring [fd] can handle all opcodes used, or
+ * zero if it can't.
+ *
+ */
+static int
+supportsOps (int fd) {
+	static const int ops[] = { IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE };
+	struct io_uring_probe* probe;
+	unsigned int i;
+	int ok = 1;
+
+	probe = (struct io_uring_probe*)calloc (1, sizeof (struct io_uring_probe) + 256 * sizeof (struct io_uring_probe_op));
+	if (probe == NULL)
+		return 0;
+	if (syscall (__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+		ok = 0;
+	for (i = 0; (ok) && (i < sizeof (ops) / sizeof (int)); i++)
+		if ((ops[i] > probe->last_op) || (!(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)))
+			ok = 0;
+	free (probe);
+	return ok;
+}
+
+/*
+ * setupRing()
+ *
+ * This will set up the ring of this thread. It will return NULL if the kernel
+ * isn't up to it.
+ *
+ */
+static FILEIO_RING*
+setupRing() {
+	struct io_uring_params p;
+	FILEIO_RING* r;
+
+	r = (FILEIO_RING*)calloc (1, sizeof (FILEIO_RING));
+	if (r == NULL)
+		return NULL;
+	memset (&p, 0, sizeof (p));
+	r->fd = syscall (__NR_io_uring_setup, FILEIO_RING_SIZE, &p);
+	if (r->fd < 0) {
+		// no io_uring at all, or not allowed to use it
+		free (r);
+		return NULL;
+	}
+	if (!supportsOps (r->fd)) {
+		// too old. never mind
+		close (r->fd); free (r);
+		return NULL;
+	}
+
+	// map the rings; they may well share a mapping
+	r->sqRingLen = p.sq_off.array + p.sq_entries * sizeof (unsigned int);
+	r->cqRingLen = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (r->cqRingLen > r->sqRingLen)
+			r->sqRingLen = r->cqRingLen;
+		r->cqRingLen = r->sqRingLen;
+	}
+	r->sqRing = mmap (NULL, r->sqRingLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sqRing == MAP_FAILED) {
+		r->sqRing = NULL;
+		freeRing (r);
+		return NULL;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		r->cqRing = r->sqRing;
+	else {
+		r->cqRing = mmap (NULL, r->cqRingLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (r->cqRing == MAP_FAILED) {
+			r->cqRing = NULL;
+			freeRing (r);
+			return NULL;
+		}
+	}
+	r->sqesLen = p.sq_entries * sizeof (struct io_uring_sqe);
+	r->sqes = (struct io_uring_sqe*)mmap (NULL, r->sqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED) {
+		r->sqes = NULL;
+		freeRing (r);
+		return NULL;
+	}
+
+	r->sqHead  = (unsigned int*)((char*)r->sqRing + p.sq_off.head);
+	r->sqTail  = (unsigned int*)((char*)r->sqRing + p.sq_off.tail);
+	r->sqMask  = (unsigned int*)((char*)r->sqRing + p.sq_off.ring_mask);
+	r->sqArray = (unsigned int*)((char*)r->sqRing + p.sq_off.array);
+	r->cqHead  = (unsigned int*)((char*)r->cqRing + p.cq_off.head);
+	r->cqTail  = (unsigned int*)((char*)r->cqRing + p.cq_off.tail);
+	r->cqMask  = (unsigned int*)((char*)r->cqRing + p.cq_off.ring_mask);
+	r->cqes    = (struct io_uring_cqe*)((char*)r->cqRing + p.cq_off.cqes);
+	return r;
+}
+
+/*
+ * getRing()
+ *
+ * This will return the ring of this thread, setting it up if needed. It will
+ * return NULL if there isn't one.
+ *
+ */
+static FILEIO_RING*
+getRing() {
+	if (ringState == 0) {
+		ring = setupRing();
+		ringState = (ring != NULL) ? 1 : -1;
+	}
+	return ring;
+}
+
+/*
+ * nextEntry (FILEIO_RING* r, int op, int index)
+ *
+ * This will return a cleared submission entry for opcode [op] on behalf of
+ * request [index].
+ *
+ */
+static struct io_uring_sqe*
+nextEntry (FILEIO_RING* r, int op, int index) {
+	unsigned int tail = *r->sqTail;
+	unsigned int slot = tail & *r->sqMask;
+	struct io_uring_sqe* sqe = &r->sqes[slot];
+
+	memset (sqe, 0, sizeof (struct io_uring_sqe));
+	sqe->opcode = op; sqe->user_data = index;
+	r->sqArray[slot] = slot;
+	__atomic_store_n (r->sqTail, tail + 1, __ATOMIC_RELEASE);
+	return sqe;
+}
+
+/*
+ * runRing (FILEIO_RING* r, int num, int* results)
+ *
+ * This will submit the [num] entries queued, and wait for all of them to
+ * complete. The result of every entry is put in [results], by request. It
+ * will return zero on failure or non-zero on success.
+ *
+ */
+static int
+runRing (FILEIO_RING* r, int num, int* results) {
+	unsigned int head, tail;
+	int submit = num, done = 0, n;
+
+	while (done < num) {
+		n = syscall (__NR_io_uring_enter, r->fd, submit, num - done, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (n < 0) {
+			// interrupted?
+			if (errno == EINTR)
+				// yes. just try again
+				continue;
+			return 0;
+		}
+		submit -= n;
+
+		// reap what's done
+		head = *r->cqHead;
+		tail = __atomic_load_n (r->cqTail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++, done++)
+			results[r->cqes[head & *r->cqMask].user_data] = r->cqes[head & *r->cqMask].res;
+		__atomic_store_n (r->cqHead, head, __ATOMIC_RELEASE);
+	}
+	return 1;
+}
+
+/*
+ * processRing (FILEIO_RING* r, FILEIO_REQUEST* req, int num)
+ *
+ * This will handle the [num] requests [req] using ring [r]. [num] may be
+ * FILEIO_RING_SIZE at most. It will return zero on failure, in which case
+ * whatever is left to do is still flagged, or non-zero on success.
+ *
+ */
+static int
+processRing (FILEIO_RING* r, FILEIO_REQUEST* req, int num) {
+	int results[FILEIO_RING_SIZE];
+	struct io_uring_sqe* sqe;
+	struct statx* stx;
+	int i, n;
+
+	// stat everything which has to be, following symlinks like stat() does
+	for (i = 0, n = 0; i < num; i++) {
+		r->files[i] = -1;
+		if (req[i].ops & FILEIO_STAT) {
+			sqe = nextEntry (r, IORING_OP_STATX, i);
+			sqe->fd = AT_FDCWD; sqe->addr = (unsigned long)req[i].fname;
+			sqe->len = STATX_BASIC_STATS; sqe->off = (unsigned long)&r->stx[i];
+			n++;
+		}
+	}
+	if ((n > 0) && (!runRing (r, n, results)))
+		return 0;
+	for (i = 0; i < num; i++) {
+		if (!(req[i].ops & FILEIO_STAT))
+			continue;
+		req[i].ops &= ~FILEIO_STAT;
+		if (results[i] < 0) {
+			// this failed. it won't be read either
+			req[i].error = -results[i]; req[i].ops = 0;
+			continue;
+		}
+		stx = &r->stx[i];
+		memset (&req[i].st, 0, sizeof (struct stat));
+		req[i].st.st_mode = stx->stx_mode; req[i].st.st_size = stx->stx_size;
+		req[i].st.st_mtime = stx->stx_mtime.tv_sec; req[i].st.st_ino = stx->stx_ino;
+		req[i].st.st_dev = makedev (stx->stx_dev_major, stx->stx_dev_minor);
+		req[i].st.st_nlink = stx->stx_nlink;
+		req[i].error = 0;
+	}
+
+	// open everything which is to be read
+	for (i = 0, n = 0; i < num; i++)
+		if ((req[i].ops & FILEIO_READ) && (req[i].len > 0)) {
+			sqe = nextEntry (r, IORING_OP_OPENAT, i);
+			sqe->fd = AT_FDCWD; sqe->addr = (unsigned long)req[i].fname;
+			sqe->open_flags = O_RDONLY | O_CLOEXEC;
+			n++;
+		}
+	if ((n > 0) && (!runRing (r, n, results)))
+		return 0;
+	for (i = 0; i < num; i++)
+		if ((req[i].ops & FILEIO_READ) && (req[i].len > 0)) {
+			if (results[i] < 0) {
+				req[i].error = -results[i]; req[i].numRead = 0;
+			} else
+				r->files[i] = results[i];
+		}
+
+	// read them
+	for (i = 0, n = 0; i < num; i++)
+		if (r->files[i] >= 0) {
+			sqe = nextEntry (r, IORING_OP_READ, i);
+			sqe->fd = r->files[i]; sqe->addr = (unsigned long)req[i].buf;
+			sqe->len = req[i].len; sqe->off = req[i].offset;
+			n++;
+		}
+	if ((n > 0) && (!runRing (r, n, results))) {
+		// this failed. don't leave the files open
+		for (i = 0; i < num; i++)
+			if (r->files[i] >= 0)
+				close (r->files[i]);
+		return 0;
+	}
+	for (i = 0; i < num; i++)
+		if (r->files[i] >= 0) {
+			req[i].error = (results[i] < 0) ? -results[i] : 0;
+			req[i].numRead = (results[i] < 0) ? 0 : results[i];
+		}
+
+	// and close them
+	for (i = 0, n = 0; i < num; i++)
+		if (r->files[i] >= 0) {
+			sqe = nextEntry (r, IORING_OP_CLOSE, i);
+			sqe->fd = r->files[i];
+			n++;
+		}
+	if ((n > 0) && (!runRing (r, n, results)))
+		for (i = 0; i < num; i++)
+			if (r->files[i] >= 0)
+				close (r->files[i]);
+	for (i = 0; i < num; i++)
+		req[i].ops &= ~FILEIO_READ;
+	return 1;
+}
+#endif /* URING_SUPPORT */
+
+/*
+ * processOne (FILEIO_REQUEST* req)
+ *
+ * This will handle request [req] using plain system calls.
+ *
+ */
+static void
+processOne (FILEIO_REQUEST* req) {
+	int fd, n;
+
+	if (req->ops & FILEIO_STAT) {
+		if (stat (req->fname, &req->st) < 0) {
+			// this failed. it won't be read either
+			req->error = errno; req->ops = 0;
+			return;
+		}
+		req->error = 0;
+	}
+
+	if ((req->ops & FILEIO_READ) && (req->len > 0)) {
+		req->numRead = 0;
+		fd = open (req->fname, O_RDONLY);
+		if (fd < 0)
+			req->error = errno;
+		else {
+			n = pread (fd, req->buf, req->len, req->offset);
+			req->error = (n < 0) ? errno : 0;
+			req->numRead = (n < 0) ? 0 : n;
+			close (fd);
+		}
+	}
+	req->ops = 0;
+}
+
+/*
+ * FILEIO::process (FILEIO_REQUEST* req, int num)
+ *
+ * This will handle the [num] requests [req], FILEIO_RING_SIZE at a time if
+ * io_uring can be used.
+ *
+ */
+void
+FILEIO::process (FILEIO_REQUEST* req, int num) {
+	int i, n;
+
+#ifdef URING_SUPPORT
+	FILEIO_RING* r = getRing();
+
+	// batch them up if possible
+	for (i = 0; (r != NULL) && (i < num); i += n) {
+		n = (num - i > FILEIO_RING_SIZE) ? FILEIO_RING_SIZE : num - i;
+		if (!processRing (r, req + i, n)) {
+			// this failed. do the rest the old way, and stick to it
+			freeRing (r);
+			ring = r = NULL; ringState = -1;
+			break;
+		}
+	}
+#else
+	i = 0;
+#endif /* URING_SUPPORT */
+
+	for (n = i; n < num; n++)
+		processOne (&req[n]);
+}
+
+/*
+ * FILEIO::usingRing()
+ *
+ * This will return non-zero if this thread uses io_uring.
+ *
+ */
+int
+FILEIO::usingRing() {
+#ifdef URING_SUPPORT
+	return getRing() != NULL;
+#else
+	return 0;
+#endif /* URING_SUPPORT */
+}
+
+/*
+ * FILEIO::done()
+ *
+ * This will free the ring of this thread, if any.
+ *
+ */
+void
+FILEIO::done() {
+#ifdef URING_SUPPORT
+	if (ring != NULL)
+		freeRing (ring);
+	ring = NULL; ringState = 0;
+#endif /* URING_SUPPORT */
+}
+
+/* vim:set ts=2 sw=2: */
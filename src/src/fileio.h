@@ -0,0 +1,78 @@
+/*
+ * fileio.h
+ *
+ * This is the jukebox batched file access code, which looks at many files
+ * using as few system calls as possible.
+ *
+ */
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef __FILEIO_H__
+#define __FILEIO_H__
+
+//! \brief FILEIO_xxx are the things a request can ask for
+#define FILEIO_STAT		1
+#define FILEIO_READ		2
+
+//! \brief FILEIO_RING_SIZE is the number of requests handed to the kernel at once
+#define FILEIO_RING_SIZE	64
+
+/*!
+ * \struct FILEIO_REQUEST
+ * \brief This is a file to look at
+ *
+ * The FILEIO_xxx flags in [ops] tell what to do; they are cleared once
+ * done. A request which could not be stat()-ed is not read.
+ */
+struct FILEIO_REQUEST {
+	//! \brief The file to look at
+	char*				fname;
+
+	//! \brief What to do, as FILEIO_xxx flags
+	int					ops;
+
+	//! \brief The information stat() has, if asked for
+	struct stat	st;
+
+	//! \brief The error, or zero if all went well
+	int					error;
+
+	//! \brief The position and number of bytes to read, if asked for
+	int					offset, len;
+
+	//! \brief The buffer to read into, which must hold [len] bytes
+	char*				buf;
+
+	//! \brief The number of bytes read
+	int					numRead;
+};
+
+/*!
+ * \class FILEIO
+ * \brief Batched file access
+ *
+ * On Linux, io_uring is used to stat, open, read and close a whole batch of
+ * files using a few system calls. Every thread gets a ring of its own, set
+ * up the first time it is needed. If the kernel can't do this, the files
+ * are looked at one by one instead.
+ */
+class FILEIO {
+public:
+	/*! \brief Handles a batch of requests
+	 *  \param req The requests
+	 *  \param num The number of requests
+	 */
+	static void process (FILEIO_REQUEST* req, int num);
+
+	//! \brief Returns non-zero if this thread uses io_uring
+	static int usingRing();
+
+	//! \brief Frees the ring of this thread, if any
+	static void done();
+};
+
+#endif /* __FILEIO_H__ */
+
+/* vim:set ts=2 sw=2: */
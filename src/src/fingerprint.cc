@@ -0,0 +1,292 @@
+/*
+ * fingerprint.cc - Jukebox file fingerprinting code
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fingerprint.h"
+
+// XXH_PRIMEx are the primes of the 64-bit xxHash
+#define XXH_PRIME1	0x9E3779B185EBCA87ULL
+#define XXH_PRIME2	0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME3	0x165667B19E3779F9ULL
+#define XXH_PRIME4	0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME5	0x27D4EB2F165667C5ULL
+
+// FINGERPRINT_MAX_PAGES is the number of Ogg header pages skipped at most
+#define FINGERPRINT_MAX_PAGES	64
+
+/*
+ * rotl64 (unsigned long long x, int r)
+ *
+ * This will return [x] rotated left by [r] bits.
+ *
+ */
+static inline unsigned long long
+rotl64 (unsigned long long x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+/*
+ * read64 (const unsigned char* p)
+ *
+ * This will return the little endian 64-bit value at [p].
+ *
+ */
+static inline unsigned long long
+read64 (const unsigned char* p) {
+	return  (unsigned long long)p[0]        | ((unsigned long long)p[1] <<  8) |
+	       ((unsigned long long)p[2] << 16) | ((unsigned long long)p[3] << 24) |
+	       ((unsigned long long)p[4] << 32) | ((unsigned long long)p[5] << 40) |
+	       ((unsigned long long)p[6] << 48) | ((unsigned long long)p[7] << 56);
+}
+
+/*
+ * read32 (const unsigned char* p)
+ *
+ * This will return the little endian 32-bit value at [p].
+ *
+ */
+static inline unsigned int
+read32 (const unsigned char* p) {
+	return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+/*
+ * xxRound (unsigned long long acc, unsigned long long input)
+ *
+ * This will mix [input] into accumulator [acc].
+ *
+ */
+static inline unsigned long long
+xxRound (unsigned long long acc, unsigned long long input) {
+	acc += input * XXH_PRIME2;
+	return rotl64 (acc, 31) * XXH_PRIME1;
+}
+
+/*
+ * xxMerge (unsigned long long acc, unsigned long long val)
+ *
+ * This will merge accumulator [val] into hash [acc].
+ *
+ */
+static inline unsigned long long
+xxMerge (unsigned long long acc, unsigned long long val) {
+	acc ^= xxRound (0, val);
+	return acc * XXH_PRIME1 + XXH_PRIME4;
+}
+
+/*
+ * hashData (const unsigned char* data, int len, unsigned long long seed)
+ *
+ * This will return the 64-bit xxHash of the [len] bytes at [data], using
+ * [seed].
+ *
+ */
+unsigned long long
+hashData (const unsigned char* data, int len, unsigned long long seed) {
+	const unsigned char* p = data;
+	const unsigned char* end = data + len;
+	unsigned long long h, v1, v2, v3, v4;
+
+	if (len >= 32) {
+		// handle 32 bytes at a time, using four lanes
+		v1 = seed + XXH_PRIME1 + XXH_PRIME2; v2 = seed + XXH_PRIME2;
+		v3 = seed; v4 = seed - XXH_PRIME1;
+		for (; p + 32 <= end; p += 32) {
+			v1 = xxRound (v1, read64 (p));      v2 = xxRound (v2, read64 (p +  8));
+			v3 = xxRound (v3, read64 (p + 16)); v4 = xxRound (v4, read64 (p + 24));
+		}
+		h = rotl64 (v1, 1) + rotl64 (v2, 7) + rotl64 (v3, 12) + rotl64 (v4, 18);
+		h = xxMerge (h, v1); h = xxMerge (h, v2);
+		h = xxMerge (h, v3); h = xxMerge (h, v4);
+	} else
+		h = seed + XXH_PRIME5;
+	h += (unsigned long long)len;
+
+	// mix in what's left
+	for (; p + 8 <= end; p += 8)
+		h = rotl64 (h ^ xxRound (0, read64 (p)), 27) * XXH_PRIME1 + XXH_PRIME4;
+	if (p + 4 <= end) {
+		h = rotl64 (h ^ ((unsigned long long)read32 (p) * XXH_PRIME1), 23) * XXH_PRIME2 + XXH_PRIME3;
+		p += 4;
+	}
+	for (; p < end; p++)
+		h = rotl64 (h ^ (*p * XXH_PRIME5), 11) * XXH_PRIME1;
+
+	// avalanche
+	h ^= h >> 33; h *= XXH_PRIME2;
+	h ^= h >> 29; h *= XXH_PRIME3;
+	h ^= h >> 32;
+	return h;
+}
+
+/*
+ * readAt (FILE* f, long pos, unsigned char* buf, int len)
+ *
+ * This will read [len] bytes at [pos] of [f] into [buf]. It will return zero
+ * on failure or non-zero on success.
+ *
+ */
+static int
+readAt (FILE* f, long pos, unsigned char* buf, int len) {
+	if (fseek (f, pos, SEEK_SET) < 0)
+		return 0;
+	return fread (buf, len, 1, f) == 1;
+}
+
+/*
+ * readOggPage (FILE* f, long pos, long* body, int* bodyLen)
+ *
+ * This will read the header of the Ogg page at [pos] of [f]. The position of
+ * the page data is put in [body] and its length in [bodyLen]. It will return
+ * -1 if there is no page there, 0 for a header page or 1 for an audio page.
+ *
+ */
+static int
+readOggPage (FILE* f, long pos, long* body, int* bodyLen) {
+	unsigned char hdr[27], segs[255];
+	unsigned long long granule;
+	int i;
+
+	if ((!readAt (f, pos, hdr, sizeof (hdr))) || (memcmp (hdr, "OggS", 4)))
+		return -1;
+	if ((hdr[26] > 0) && (fread (segs, hdr[26], 1, f) != 1))
+		return -1;
+	for (i = 0, *bodyLen = 0; i < hdr[26]; i++)
+		*bodyLen += segs[i];
+	*body = pos + sizeof (hdr) + hdr[26];
+
+	// the header packets end at position 0; pages continuing them have none
+	granule = read64 (hdr + 6);
+	return ((granule != 0) && (granule != ~0ULL)) ? 1 : 0;
+}
+
+/*
+ * findAudio (FILE* f, long size, long* start, long* end)
+ *
+ * This will find the audio of file [f], which is [size] bytes, leaving out
+ * any tags before or after it. It will return non-zero if the audio is in
+ * Ogg pages, or zero if it isn't.
+ *
+ */
+static int
+findAudio (FILE* f, long size, long* start, long* end) {
+	unsigned char buf[32];
+	long pos, body;
+	int len, i;
+
+	*start = 0; *end = size;
+
+	// ID3v2 tag up front?
+	if ((readAt (f, 0, buf, 10)) && (!memcmp (buf, "ID3", 3))) {
+		// yes. skip it, along with its footer if there is one
+		*start = 10 + ((buf[6] & 0x7f) << 21) + ((buf[7] & 0x7f) << 14) + ((buf[8] & 0x7f) << 7) + (buf[9] & 0x7f);
+		if (buf[5] & 0x10)
+			*start += 10;
+	}
+
+	if (readAt (f, *start, buf, 4)) {
+		// FLAC? skip the metadata blocks
+		if (!memcmp (buf, "fLaC", 4)) {
+			pos = *start + 4;
+			while (readAt (f, pos, buf, 4)) {
+				pos += 4 + ((buf[1] << 16) | (buf[2] << 8) | buf[3]);
+				if (buf[0] & 0x80)
+					break;
+			}
+			*start = pos;
+		}
+
+		// Ogg? skip the header pages, as they hold the comments
+		if (!memcmp (buf, "OggS", 4)) {
+			for (i = 0, pos = *start; i < FINGERPRINT_MAX_PAGES; i++) {
+				if (readOggPage (f, pos, &body, &len) != 0)
+					break;
+				pos = body + len;
+			}
+			*start = pos;
+			return 1;
+		}
+	}
+
+	// ID3v1 tag at the end?
+	if ((*end - *start >= 128) && (readAt (f, *end - 128, buf, 3)) && (!memcmp (buf, "TAG", 3)))
+		// yes. skip it
+		*end -= 128;
+
+	// APE tag at the end?
+	if ((*end - *start >= 32) && (readAt (f, *end - 32, buf, 32)) && (!memcmp (buf, "APETAGEX", 8))) {
+		// yes. skip it, along with its header if there is one
+		*end -= read32 (buf + 12);
+		if (read32 (buf + 20) & 0x80000000)
+			*end -= 32;
+	}
+
+	if (*end < *start)
+		*end = *start;
+	return 0;
+}
+
+/*
+ * fingerprintFile (const char* fname, char* dest)
+ *
+ * This will put the fingerprint of the audio of file [fname] in [dest]. For
+ * Ogg files, only the data of the first audio pages is looked at, as their
+ * headers are numbered. It will return zero on failure or non-zero on
+ * success.
+ *
+ */
+int
+fingerprintFile (const char* fname, char* dest) {
+	unsigned char* buf;
+	long size, start, end, body;
+	int len, ogg, n = 8;
+	FILE* f;
+
+	*dest = '\0';
+	f = fopen (fname, "rb");
+	if (f == NULL)
+		// no such file. bail out
+		return 0;
+	buf = (unsigned char*)malloc (8 + 2 * FINGERPRINT_SAMPLE);
+	if ((buf == NULL) || (fseek (f, 0, SEEK_END) < 0) || ((size = ftell (f)) < 0)) {
+		// this failed. complain
+		if (buf) free (buf);
+		fclose (f);
+		return 0;
+	}
+	ogg = findAudio (f, size, &start, &end);
+
+	// the length goes first, so files which only differ in the middle differ anyway
+	for (len = 0; len < 8; len++)
+		buf[len] = (unsigned char)((unsigned long long)(end - start) >> (len * 8));
+
+	if (ogg) {
+		// gather the data of the first pages
+		while ((n < 8 + FINGERPRINT_SAMPLE) && (readOggPage (f, start, &body, &len) >= 0)) {
+			if (len > 8 + FINGERPRINT_SAMPLE - n)
+				len = 8 + FINGERPRINT_SAMPLE - n;
+			if ((len > 0) && (!readAt (f, body, buf + n, len)))
+				break;
+			n += len; start = body + len;
+		}
+	} else {
+		// the start and the end will do
+		len = (end - start > FINGERPRINT_SAMPLE) ? FINGERPRINT_SAMPLE : (int)(end - start);
+		if ((len > 0) && (readAt (f, start, buf + n, len)))
+			n += len;
+		start += len;
+		len = (end - start > FINGERPRINT_SAMPLE) ? FINGERPRINT_SAMPLE : (int)(end - start);
+		if ((len > 0) && (readAt (f, end - len, buf + n, len)))
+			n += len;
+	}
+
+	sprintf (dest, "%016llx", hashData (buf, n, 0));
+	free (buf);
+	fclose (f);
+	return 1;
+}
+
+/* vim:set ts=2 sw=2: */
@@ -0,0 +1,40 @@
+/*
+ * fingerprint.h
+ *
+ * This is the jukebox file fingerprinter, which tells files with the same
+ * audio apart from the rest.
+ *
+ */
+#include <stdlib.h>
+
+#ifndef __FINGERPRINT_H__
+#define __FINGERPRINT_H__
+
+//! \brief FINGERPRINT_LEN is the length of a fingerprint, without the terminator
+#define FINGERPRINT_LEN		16
+
+//! \brief FINGERPRINT_SAMPLE is the number of bytes looked at from both ends of the audio
+#define FINGERPRINT_SAMPLE	65536
+
+/*! \brief Fingerprints the audio of a file
+ *  \param fname The file to fingerprint
+ *  \param dest The buffer to put the fingerprint in, FINGERPRINT_LEN + 1 bytes
+ *
+ *  The fingerprint is the 64-bit xxHash of the length of the audio along
+ *  with the first and last FINGERPRINT_SAMPLE bytes of it, in hex. ID3v1,
+ *  ID3v2 and APE tags and the Ogg header pages are left out, so retagging a
+ *  file doesn't change its fingerprint. This will return zero on failure,
+ *  leaving [dest] empty, or non-zero on success.
+ */
+int fingerprintFile (const char* fname, char* dest);
+
+/*! \brief Hashes data using the 64-bit xxHash
+ *  \param data The data to hash
+ *  \param len The number of bytes to hash
+ *  \param seed The seed to use
+ */
+unsigned long long hashData (const unsigned char* data, int len, unsigned long long seed);
+
+#endif /* __FINGERPRINT_H__ */
+
+/* vim:set ts=2 sw=2: */
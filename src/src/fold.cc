@@ -0,0 +1,228 @@
+/*
+ * fold.cc - Jukebox text folding code
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fold.h"
+#include "utf8.h"
+
+// latin1Fold are the folded U+00C0 - U+00FF characters. a space means the
+// character separates words
+static const char latin1Fold[] =
+	"aaaaaaaceeeeiiiidnooooo ouuuuyts"
+	"aaaaaaaceeeeiiiidnooooo ouuuuyty";
+
+// latinExtFold are the folded U+0100 - U+017F characters
+static const char latinExtFold[] =
+	"aaaaaaccccccccddddeeeeeeeeeegggggggghhhhiiiiiiiiiiiijjkkklllllll"
+	"lllnnnnnnnnnoooooooorrrrrrssssssssttttttuuuuuuuuuuuuwwyyyzzzzzzs";
+
+/*
+ * foldChar (unsigned int cp, char* tmp)
+ *
+ * This will return what code point [cp] folds to: a string of ASCII letters,
+ * "" if it is to be dropped, " " if it separates words, or NULL if it is to
+ * be copied as it is. Single letters are put in [tmp], which must hold two
+ * bytes.
+ *
+ */
+static const char*
+foldChar (unsigned int cp, char* tmp) {
+	// plain ASCII?
+	if (cp < 0x80) {
+		// yes. letters and digits are kept
+		if ((cp >= 'A') && (cp <= 'Z')) cp += 'a' - 'A';
+		if (((cp >= 'a') && (cp <= 'z')) || ((cp >= '0') && (cp <= '9'))) {
+			tmp[0] = cp; tmp[1] = 0;
+			return tmp;
+		}
+
+		// apostrophes glue words together, anything else separates them
+		return (cp == '\'') ? "" : " ";
+	}
+
+	// the ligatures and such become more than one letter
+	switch (cp) {
+		case 0x00c6: case 0x00e6: return "ae";
+		case 0x00de: case 0x00fe: return "th";
+		case 0x00df:              return "ss";
+		case 0x0132: case 0x0133: return "ij";
+		case 0x0152: case 0x0153: return "oe";
+		case 0x2019:              return "";
+	}
+
+	// the Latin ranges are folded by table
+	tmp[1] = 0;
+	if (cp < 0xc0)
+		return " ";
+	if (cp < 0x100)
+		tmp[0] = latin1Fold[cp - 0xc0];
+	else if (cp < 0x180)
+		tmp[0] = latinExtFold[cp - 0x100];
+	else if ((cp >= 0x2000) && (cp < 0x2070))
+		// general punctuation
+		return " ";
+	else
+		// leave anything else alone
+		return NULL;
+	return tmp;
+}
+
+/*
+ * foldText (const char* src, char* dest, int len)
+ *
+ * This will fold [src] to a search key in [dest], which is [len] bytes. It
+ * will return the length of the key.
+ *
+ */
+int
+foldText (const char* src, char* dest, int len) {
+	const unsigned char* s = (const unsigned char*)src;
+	const char* out;
+	char tmp[2];
+	unsigned int cp;
+	int n = 0, clen, olen;
+
+	if (len <= 0)
+		return 0;
+
+	while (*s) {
+		// decode the character. anything which is no valid UTF-8 must be
+		// ISO-8859-1
+		cp = *s; clen = 1;
+		if ((cp >= 0xc2) && (cp < 0xe0) && ((s[1] & 0xc0) == 0x80)) {
+			cp = ((cp & 0x1f) << 6) | (s[1] & 0x3f); clen = 2;
+		} else if ((cp >= 0xe0) && (cp < 0xf0) && ((s[1] & 0xc0) == 0x80) &&
+		           ((s[2] & 0xc0) == 0x80)) {
+			cp = ((cp & 0x0f) << 12) | ((s[1] & 0x3f) << 6) | (s[2] & 0x3f); clen = 3;
+		} else if ((cp >= 0xf0) && (cp < 0xf5) && ((s[1] & 0xc0) == 0x80) &&
+		           ((s[2] & 0xc0) == 0x80) && ((s[3] & 0xc0) == 0x80)) {
+			cp = ((cp & 0x07) << 18) | ((s[1] & 0x3f) << 12) | ((s[2] & 0x3f) << 6) | (s[3] & 0x3f); clen = 4;
+		}
+
+		// figure out what it becomes
+		out = foldChar (cp, tmp);
+		if (out == NULL) {
+			// as it is. an ISO-8859-1 character is no letter, so it must be UTF-8
+			out = (const char*)s; olen = clen;
+		} else
+			olen = strlen (out);
+
+		// a separator?
+		if ((olen == 1) && (*out == ' ')) {
+			// yes. only add it between words
+			if ((n > 0) && (dest[n - 1] != ' ') && (n + 1 < len))
+				dest[n++] = ' ';
+		} else {
+			// no. does it fit?
+			if (n + olen >= len)
+				// no. stop here
+				break;
+			memcpy (dest + n, out, olen);
+			n += olen;
+		}
+		s += clen;
+	}
+
+	// no trailing spaces please
+	if ((n > 0) && (dest[n - 1] == ' '))
+		n--;
+	dest[n] = 0;
+	return n;
+}
+
+/*
+ * lowerChar (unsigned int cp)
+ *
+ * This will return the lower case of code point [cp], for the Latin, Greek
+ * and Cyrillic letters.
+ *
+ */
+static unsigned int
+lowerChar (unsigned int cp) {
+	if ((cp >= 0x00c0) && (cp <= 0x00de) && (cp != 0x00d7))
+		return cp + 0x20;
+	if (cp < 0x0100)
+		return cp;
+
+	// Latin Extended-A mostly comes in pairs, but which comes first varies
+	if ((cp < 0x0138) && (cp != 0x0130))
+		return cp | 1;
+	if (((cp >= 0x0139) && (cp < 0x0149)) || ((cp >= 0x0179) && (cp < 0x017f)))
+		return (cp & 1) ? cp + 1 : cp;
+	if ((cp >= 0x014a) && (cp < 0x0178))
+		return cp | 1;
+	if (cp == 0x0178)
+		return 0x00ff;
+
+	// Greek and Cyrillic capitals
+	if ((cp >= 0x0391) && (cp <= 0x03ab) && (cp != 0x03a2))
+		return cp + 0x20;
+	if ((cp >= 0x0410) && (cp <= 0x042f))
+		return cp + 0x20;
+	if ((cp >= 0x0400) && (cp <= 0x040f))
+		return cp + 0x50;
+	return cp;
+}
+
+/*
+ * foldCase (const char* src, char* dest, int len)
+ *
+ * This will fold the case of [src] into [dest], which is [len] bytes. It
+ * will return the length of the result.
+ *
+ */
+int
+foldCase (const char* src, char* dest, int len) {
+	const unsigned char* s = (const unsigned char*)src;
+	unsigned int cp;
+	int srcLen = strlen (src), i = 0, n = 0, run, clen, m;
+
+	if (len <= 0)
+		return 0;
+
+	while (i < srcLen) {
+		// lower the ASCII in one go
+		run = srcLen - i;
+		if (run > len - 1 - n)
+			run = len - 1 - n;
+		run = lowerASCII (s + i, run, dest + n);
+		i += run; n += run;
+		if ((i >= srcLen) || (s[i] < 0x80))
+			// done, or out of room
+			break;
+
+		// decode the character after it
+		cp = s[i]; clen = 1;
+		if ((cp >= 0xc2) && (cp < 0xe0) && ((s[i + 1] & 0xc0) == 0x80)) {
+			cp = ((cp & 0x1f) << 6) | (s[i + 1] & 0x3f); clen = 2;
+		} else if ((cp >= 0xe0) && (cp < 0xf0) && ((s[i + 1] & 0xc0) == 0x80) &&
+		           ((s[i + 2] & 0xc0) == 0x80)) {
+			cp = ((cp & 0x0f) << 12) | ((s[i + 1] & 0x3f) << 6) | (s[i + 2] & 0x3f); clen = 3;
+		} else if ((cp >= 0xf0) && (cp < 0xf5) && ((s[i + 1] & 0xc0) == 0x80) &&
+		           ((s[i + 2] & 0xc0) == 0x80) && ((s[i + 3] & 0xc0) == 0x80)) {
+			cp = ((cp & 0x07) << 18) | ((s[i + 1] & 0x3f) << 12) | ((s[i + 2] & 0x3f) << 6) | (s[i + 3] & 0x3f); clen = 4;
+		}
+
+		if (clen > 1) {
+			// a character. fold it
+			m = encodeUTF8 (lowerChar (cp), dest, n, len);
+			if (m == n)
+				// no more room
+				break;
+			n = m;
+			i += clen;
+		} else {
+			// copy anything else as it is, a byte at a time
+			if (n + 1 >= len)
+				break;
+			dest[n++] = s[i++];
+		}
+	}
+	dest[n] = 0;
+	return n;
+}
+
+/* vim:set ts=2 sw=2: */
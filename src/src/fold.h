@@ -0,0 +1,40 @@
+/*
+ * fold.h
+ *
+ * This is the jukebox text folder, which turns names into search and
+ * index keys.
+ *
+ */
+#include <stdlib.h>
+
+#ifndef __FOLD_H__
+#define __FOLD_H__
+
+/*! \brief Folds text to a search key
+ *  \param src The text, in UTF-8 or ISO-8859-1
+ *  \param dest The buffer to put the key in
+ *  \param len The size of the buffer
+ *
+ *  The key is in lower case, without accents, and every run of characters
+ *  which are neither letters nor digits is replaced by a single space;
+ *  leading and trailing spaces are dropped. Letters outside the Latin
+ *  ranges are copied as they are. Text which does not fit is cut off at a
+ *  character boundary. This will return the length of the key.
+ */
+int foldText (const char* src, char* dest, int len);
+
+/*! \brief Folds the case of text
+ *  \param src The text, in UTF-8
+ *  \param dest The buffer to put the result in
+ *  \param len The size of the buffer
+ *
+ *  Unlike foldText(), only the case is folded, so names which are equal
+ *  ignoring case get the same key. The Latin, Greek and Cyrillic letters are
+ *  folded; anything else is copied as it is. Text which does not fit is cut
+ *  off at a character boundary. This will return the length of the key.
+ */
+int foldCase (const char* src, char* dest, int len);
+
+#endif /* __FOLD_H__ */
+
+/* vim:set ts=2 sw=2: */
@@ -0,0 +1,451 @@
+/*
+ * fuzzy.cc - Jukebox fuzzy name matching code
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fold.h"
+#include "fuzzy.h"
+
+/*
+ * myersDistance (const unsigned long long* peq, int plen, const char* text,
+ *                int tlen, int max)
+ *
+ * This will calculate the edit distance between the pattern of [plen] bytes
+ * described by [peq] and [text] of [tlen] bytes. Every bit of the vertical
+ * delta vectors [pv] and [mv] is a row of the current column of the distance
+ * matrix, which is +1 or -1 from the row above; a whole column is updated
+ * using a handful of word operations. It will return the distance, or
+ * [max] + 1 as soon as it is clear the distance is larger than [max].
+ *
+ */
+static int
+myersDistance (const unsigned long long* peq, int plen, const char* text, int tlen, int max) {
+	unsigned long long pv = ~0ULL, mv = 0, ph, mh, xv, xh, eq;
+	unsigned long long last = 1ULL << (plen - 1);
+	int score = plen, j;
+
+	for (j = 0; j < tlen; j++) {
+		eq = peq[(unsigned char)text[j]];
+		xv = eq | mv;
+		xh = (((eq & pv) + pv) ^ pv) | eq;
+		ph = mv | ~(xh | pv);
+		mh = pv & xh;
+
+		// the bottom row is the distance so far
+		if (ph & last)
+			score++;
+		else if (mh & last)
+			score--;
+
+		// the top row grows by one every column
+		ph = (ph << 1) | 1;
+		mh <<= 1;
+		pv = mh | ~(xv | ph);
+		mv = ph & xv;
+
+		// the distance drops by one per column at best; can we still make it?
+		if (score - (tlen - j - 1) > max)
+			// no. bail out
+			return max + 1;
+	}
+	return score;
+}
+
+/*
+ * fuzzyDistance (const char* pattern, int plen, const char* text, int tlen,
+ *                int max)
+ *
+ * This will return the edit distance between [pattern] of [plen] bytes and
+ * [text] of [tlen] bytes, or a value above [max] if it is larger than that.
+ *
+ */
+int
+fuzzyDistance (const char* pattern, int plen, const char* text, int tlen, int max) {
+	unsigned long long peq[256];
+	int i;
+
+	// the trivial cases first
+	if (plen > FUZZY_MAX_PATTERN)
+		plen = FUZZY_MAX_PATTERN;
+	if (plen == 0)
+		return (tlen > max) ? max + 1 : tlen;
+	if ((plen - tlen > max) || (tlen - plen > max))
+		return max + 1;
+
+	memset (peq, 0, sizeof (peq));
+	for (i = 0; i < plen; i++)
+		peq[(unsigned char)pattern[i]] |= 1ULL << i;
+	return myersDistance (peq, plen, text, tlen, max);
+}
+
+/*
+ * compareFuzzy (const void* a, const void* b)
+ *
+ * This will order fuzzy results by ascending distance, and by ID after that.
+ *
+ */
+static int
+compareFuzzy (const void* a, const void* b) {
+	const FUZZY_RESULT* ra = (const FUZZY_RESULT*)a;
+	const FUZZY_RESULT* rb = (const FUZZY_RESULT*)b;
+
+	if (ra->distance != rb->distance)
+		return (ra->distance < rb->distance) ? -1 : 1;
+	return (ra->id < rb->id) ? -1 : ((ra->id > rb->id) ? 1 : 0);
+}
+
+/*
+ * compareInts (const void* a, const void* b)
+ *
+ * This will order integers.
+ *
+ */
+static int
+compareInts (const void* a, const void* b) {
+	int ia = *(const int*)a, ib = *(const int*)b;
+
+	return (ia < ib) ? -1 : ((ia > ib) ? 1 : 0);
+}
+
+/*
+ * FUZZYLIST::FUZZYLIST()
+ *
+ * This will construct an empty list.
+ *
+ */
+FUZZYLIST::FUZZYLIST() {
+	entries = NULL; numSlots = slotSize = numEntries = 0;
+	freeSlots = NULL; numFree = 0;
+	memset (buckets, 0, sizeof (buckets));
+	patternLen = maxDistance = 0;
+	counts = NULL; touched = NULL; found = NULL; scratchSize = 0;
+}
+
+/*
+ * FUZZYLIST::~FUZZYLIST()
+ *
+ * This will destroy the list.
+ *
+ */
+FUZZYLIST::~FUZZYLIST() {
+	int i;
+
+	for (i = 0; i < numSlots; i++)
+		if (entries[i].key) free (entries[i].key);
+	for (i = 0; i < FUZZY_NUM_BUCKETS; i++)
+		if (buckets[i].slots) free (buckets[i].slots);
+	if (entries) free (entries);
+	if (freeSlots) free (freeSlots);
+	if (counts) free (counts);
+	if (touched) free (touched);
+	if (found) free (found);
+}
+
+/*
+ * FUZZYLIST::trigrams (const char* key, int len, int* buckets)
+ *
+ * This will store the buckets of the trigrams of [key] of [len] bytes,
+ * padded with a space on both ends, in [buckets]. Every bucket is listed
+ * only once. It will return the number of buckets.
+ *
+ */
+int
+FUZZYLIST::trigrams (const char* key, int len, int* buckets) {
+	unsigned int c0, c1, c2, h;
+	int i, n;
+
+	// a padded key of len + 2 bytes has len trigrams
+	for (i = 0; i < len; i++) {
+		c0 = (i == 0) ? ' ' : (unsigned char)key[i - 1];
+		c1 = (unsigned char)key[i];
+		c2 = (i == len - 1) ? ' ' : (unsigned char)key[i + 1];
+		h = ((c0 << 16) | (c1 << 8) | c2) * 2654435761U;
+		buckets[i] = (h >> 16) & (FUZZY_NUM_BUCKETS - 1);
+	}
+
+	// weed out the doubles
+	qsort (buckets, len, sizeof (int), compareInts);
+	for (i = 0, n = 0; i < len; i++)
+		if ((n == 0) || (buckets[n - 1] != buckets[i]))
+			buckets[n++] = buckets[i];
+	return n;
+}
+
+/*
+ * FUZZYLIST::add (const char* name, int id)
+ *
+ * This will add [name] of object [id]. Names which fold to nothing are not
+ * added.
+ *
+ */
+void
+FUZZYLIST::add (const char* name, int id) {
+	char key[FUZZY_MAX_KEY];
+	int bucket[FUZZY_MAX_KEY];
+	FUZZY_ENTRY* ptr;
+	FUZZY_BUCKET* b;
+	int* slots;
+	int len, slot, i, n;
+
+	// anything left after folding?
+	len = foldText (name, key, sizeof (key));
+	if (!len)
+		// no. there is nothing to match then
+		return;
+
+	// grab a slot
+	if (numFree > 0)
+		slot = freeSlots[--numFree];
+	else {
+		if (numSlots == slotSize) {
+			ptr = (FUZZY_ENTRY*)realloc (entries, (slotSize + 1024) * sizeof (FUZZY_ENTRY));
+			if (ptr == NULL)
+				// this failed. too bad
+				return;
+			entries = ptr;
+			slots = (int*)realloc (freeSlots, (slotSize + 1024) * sizeof (int));
+			if (slots == NULL)
+				return;
+			freeSlots = slots; slotSize += 1024;
+		}
+		slot = numSlots++;
+	}
+	entries[slot].key = strdup (key);
+	entries[slot].len = len;
+	entries[slot].id = id;
+	numEntries++;
+
+	// list it in the buckets of its trigrams
+	n = trigrams (key, len, bucket);
+	for (i = 0; i < n; i++) {
+		b = &buckets[bucket[i]];
+		if (b->num == b->size) {
+			slots = (int*)realloc (b->slots, (b->size + 64) * sizeof (int));
+			if (slots == NULL)
+				continue;
+			b->slots = slots; b->size += 64;
+		}
+		b->slots[b->num++] = slot;
+	}
+}
+
+/*
+ * FUZZYLIST::remove (const char* name, int id)
+ *
+ * This will remove [name] of object [id].
+ *
+ */
+void
+FUZZYLIST::remove (const char* name, int id) {
+	char key[FUZZY_MAX_KEY];
+	int bucket[FUZZY_MAX_KEY];
+	FUZZY_BUCKET* b;
+	int len, slot = -1, i, j, n;
+
+	// was it ever added?
+	len = foldText (name, key, sizeof (key));
+	if (!len)
+		// no. nothing to do
+		return;
+
+	// the slot is listed in every bucket of the key, so look in the first one
+	n = trigrams (key, len, bucket);
+	b = &buckets[bucket[0]];
+	for (j = 0; j < b->num; j++)
+		if ((entries[b->slots[j]].id == id) && (!strcmp (entries[b->slots[j]].key, key))) {
+			slot = b->slots[j];
+			break;
+		}
+	if (slot < 0)
+		// it's not there. bail out
+		return;
+
+	// take it out of the buckets; the order of the slots doesn't matter
+	for (i = 0; i < n; i++) {
+		b = &buckets[bucket[i]];
+		for (j = 0; j < b->num; j++)
+			if (b->slots[j] == slot) {
+				b->slots[j] = b->slots[--b->num];
+				break;
+			}
+	}
+
+	free (entries[slot].key);
+	entries[slot].key = NULL;
+	freeSlots[numFree++] = slot;
+	numEntries--;
+}
+
+/*
+ * FUZZYLIST::growScratch()
+ *
+ * This will make sure the scratch buffers cover all slots. It will return 0
+ * on failure or 1 on success.
+ *
+ */
+int
+FUZZYLIST::growScratch() {
+	unsigned short* c;
+	int* t;
+	FUZZY_RESULT* f;
+
+	if (scratchSize >= slotSize)
+		return 1;
+
+	c = (unsigned short*)realloc (counts, slotSize * sizeof (unsigned short));
+	if (c == NULL)
+		return 0;
+	counts = c;
+	memset (counts + scratchSize, 0, (slotSize - scratchSize) * sizeof (unsigned short));
+	t = (int*)realloc (touched, slotSize * sizeof (int));
+	if (t == NULL)
+		return 0;
+	touched = t;
+	f = (FUZZY_RESULT*)realloc (found, slotSize * sizeof (FUZZY_RESULT));
+	if (f == NULL)
+		return 0;
+	found = f;
+
+	scratchSize = slotSize;
+	return 1;
+}
+
+/*
+ * FUZZYLIST::prepare (const char* query)
+ *
+ * This will fold [query] and set up the matching. It will return 0 if there
+ * is nothing to look for or 1 if there is.
+ *
+ */
+int
+FUZZYLIST::prepare (const char* query) {
+	int i;
+
+	patternLen = foldText (query, pattern, sizeof (pattern));
+	if ((!patternLen) || (!growScratch()))
+		return 0;
+
+	// short names allow fewer typos
+	if (patternLen < 3)
+		maxDistance = 0;
+	else if (patternLen < 6)
+		maxDistance = 1;
+	else if (patternLen < 10)
+		maxDistance = 2;
+	else
+		maxDistance = FUZZY_MAX_DISTANCE;
+
+	memset (peq, 0, sizeof (peq));
+	for (i = 0; i < patternLen; i++)
+		peq[(unsigned char)pattern[i]] |= 1ULL << i;
+	return 1;
+}
+
+/*
+ * FUZZYLIST::verify (int slot, int num)
+ *
+ * This will compare the name in [slot] to the query, and add it to the [num]
+ * results if it is close enough. It will return the new number of results.
+ *
+ */
+int
+FUZZYLIST::verify (int slot, int num) {
+	FUZZY_ENTRY* e = &entries[slot];
+	int d;
+
+	// is it in use, and can the length be right at all?
+	if ((e->key == NULL) || (e->len - patternLen > maxDistance) || (patternLen - e->len > maxDistance))
+		// no. skip it
+		return num;
+
+	d = myersDistance (peq, patternLen, e->key, e->len, maxDistance);
+	if (d > maxDistance)
+		return num;
+
+	found[num].id = e->id; found[num].distance = d;
+	return num + 1;
+}
+
+/*
+ * FUZZYLIST::finish (int num, FUZZY_RESULT* results, int max)
+ *
+ * This will rank the [num] results found and store at most [max] of them in
+ * [results]. It will return the number stored.
+ *
+ */
+int
+FUZZYLIST::finish (int num, FUZZY_RESULT* results, int max) {
+	qsort (found, num, sizeof (FUZZY_RESULT), compareFuzzy);
+	if (num > max)
+		num = max;
+	if (num > 0)
+		memcpy (results, found, num * sizeof (FUZZY_RESULT));
+	return num;
+}
+
+/*
+ * FUZZYLIST::find (const char* query, FUZZY_RESULT* results, int max)
+ *
+ * This will store at most [max] names resembling [query] in [results],
+ * closest first. It will return the number of names stored.
+ *
+ */
+int
+FUZZYLIST::find (const char* query, FUZZY_RESULT* results, int max) {
+	int bucket[FUZZY_MAX_PATTERN];
+	FUZZY_BUCKET* b;
+	int n, need, nt = 0, num = 0, i, j, slot;
+
+	if (!prepare (query))
+		return 0;
+
+	// every edit spoils at most three trigrams
+	n = trigrams (pattern, patternLen, bucket);
+	need = n - 3 * maxDistance;
+	if (need < 1)
+		need = 1;
+
+	// count the trigrams every name shares with the query
+	for (i = 0; i < n; i++) {
+		b = &buckets[bucket[i]];
+		for (j = 0; j < b->num; j++) {
+			slot = b->slots[j];
+			if (counts[slot]++ == 0)
+				touched[nt++] = slot;
+		}
+	}
+
+	// compare the ones sharing enough, and clean up after ourselves
+	for (i = 0; i < nt; i++) {
+		slot = touched[i];
+		if (counts[slot] >= need)
+			num = verify (slot, num);
+		counts[slot] = 0;
+	}
+
+	return finish (num, results, max);
+}
+
+/*
+ * FUZZYLIST::scan (const char* query, FUZZY_RESULT* results, int max)
+ *
+ * This will store at most [max] names resembling [query] in [results],
+ * closest first, by comparing every name. It will return the number of names
+ * stored.
+ *
+ */
+int
+FUZZYLIST::scan (const char* query, FUZZY_RESULT* results, int max) {
+	int slot, num = 0;
+
+	if (!prepare (query))
+		return 0;
+
+	for (slot = 0; slot < numSlots; slot++)
+		num = verify (slot, num);
+	return finish (num, results, max);
+}
+
+/* vim:set ts=2 sw=2: */
@@ -0,0 +1,194 @@
+/*
+ * fuzzy.h
+ *
+ * This is the jukebox fuzzy name matcher.
+ *
+ */
+#include <stdlib.h>
+
+#ifndef __FUZZY_H__
+#define __FUZZY_H__
+
+//! \brief FUZZY_NUM_BUCKETS is the number of trigram buckets, must be a power of two
+#define FUZZY_NUM_BUCKETS				4096
+
+//! \brief FUZZY_MAX_PATTERN is the maximum length of a query, in bytes
+#define FUZZY_MAX_PATTERN				64
+
+//! \brief FUZZY_MAX_KEY is the maximum length of a name, in bytes
+#define FUZZY_MAX_KEY						256
+
+//! \brief FUZZY_MAX_DISTANCE is the maximum edit distance ever allowed
+#define FUZZY_MAX_DISTANCE			3
+
+/*!
+ * \struct FUZZY_ENTRY
+ * \brief A name in a fuzzy list
+ */
+struct FUZZY_ENTRY {
+	//! \brief The folded name, or NULL if the slot is free
+	char*	key;
+
+	//! \brief The length of the name
+	int		len;
+
+	//! \brief The ID of the object it names
+	int		id;
+};
+
+/*!
+ * \struct FUZZY_BUCKET
+ * \brief The slots of the names containing the trigrams which hash here
+ */
+struct FUZZY_BUCKET {
+	int*	slots;
+	int		num, size;
+};
+
+/*!
+ * \struct FUZZY_RESULT
+ * \brief A name found, along with its distance to the query
+ */
+struct FUZZY_RESULT {
+	int		id;
+	int		distance;
+};
+
+/*! \brief Calculates the edit distance between two strings
+ *  \param pattern The first string
+ *  \param plen The length of the first string, at most FUZZY_MAX_PATTERN
+ *  \param text The second string
+ *  \param tlen The length of the second string
+ *  \param max The largest distance of interest
+ *
+ *  This uses the bit-parallel algorithm by Myers, which handles a column of
+ *  the distance matrix per step. It will return the Levenshtein distance, or
+ *  a value above [max] if it is larger than that.
+ */
+int fuzzyDistance (const char* pattern, int plen, const char* text, int tlen, int max);
+
+/*!
+ * \class FUZZYLIST
+ * \brief A list of folded names which can be matched approximately
+ *
+ * Every name is padded with a space on both ends and split into trigrams,
+ * which are hashed into buckets listing the names containing them. A name
+ * within edit distance k of a query of m bytes shares at least m - 3k of its
+ * trigrams, so only the names sharing enough trigrams are compared using
+ * fuzzyDistance(). Names are kept in slots, which are reused once free.
+ */
+class FUZZYLIST {
+public:
+	//! \brief Constructs an empty list
+	FUZZYLIST();
+
+	//! \brief Destroys the list
+	~FUZZYLIST();
+
+	/*! \brief Adds a name
+	 *  \param name The name, which will be folded
+	 *  \param id The ID of the object it names
+	 */
+	void add (const char* name, int id);
+
+	/*! \brief Removes a name
+	 *  \param name The name, as it was added
+	 *  \param id The ID of the object it names
+	 */
+	void remove (const char* name, int id);
+
+	/*! \brief Looks up the names resembling a query
+	 *  \param query The query, which will be folded
+	 *  \param results Receives the names found, closest first
+	 *  \param max The number of results there is room for
+	 *
+	 *  The distance allowed depends on the length of the query. This will
+	 *  return the number of results.
+	 */
+	int find (const char* query, FUZZY_RESULT* results, int max);
+
+	/*! \brief Looks up the names resembling a query by comparing all of them
+	 *  \param query The query, which will be folded
+	 *  \param results Receives the names found, closest first
+	 *  \param max The number of results there is room for
+	 *
+	 *  This is what find() would return without the trigram filter, and is
+	 *  only of use to measure it.
+	 */
+	int scan (const char* query, FUZZY_RESULT* results, int max);
+
+	//! \brief Returns the number of names
+	inline int getNumEntries() { return numEntries; }
+
+private:
+	/*! \brief Splits a padded key into trigram buckets
+	 *  \param key The folded key
+	 *  \param len The length of the key
+	 *  \param buckets Receives the buckets, each listed once, which must hold len of them
+	 *
+	 *  This will return the number of buckets.
+	 */
+	int trigrams (const char* key, int len, int* buckets);
+
+	/*! \brief Compares a name to the query and adds it to the results
+	 *  \param slot The slot of the name
+	 *  \param num The number of results so far
+	 *
+	 *  This will return the new number of results.
+	 */
+	int verify (int slot, int num);
+
+	/*! \brief Prepares a query
+	 *  \param query The query
+	 *
+	 *  This will return zero if there is nothing to look for or non-zero if
+	 *  there is.
+	 */
+	int prepare (const char* query);
+
+	/*! \brief Ranks the results and hands the best ones over
+	 *  \param num The number of results found
+	 *  \param results Receives the best results
+	 *  \param max The number of results there is room for
+	 *
+	 *  This will return the number of results handed over.
+	 */
+	int finish (int num, FUZZY_RESULT* results, int max);
+
+	/*! \brief Grows the scratch buffers to cover all slots
+	 *
+	 *  This will return zero on failure or non-zero on success.
+	 */
+	int growScratch();
+
+	//! \brief The slots, the number in use and the number there is room for
+	FUZZY_ENTRY*	entries;
+	int						numSlots, slotSize;
+
+	//! \brief The number of names
+	int						numEntries;
+
+	//! \brief The free slots and their number
+	int*					freeSlots;
+	int						numFree;
+
+	//! \brief The trigram buckets
+	FUZZY_BUCKET	buckets[FUZZY_NUM_BUCKETS];
+
+	//! \brief The query being looked up, its length and the distance allowed
+	char					pattern[FUZZY_MAX_PATTERN + 1];
+	int						patternLen, maxDistance;
+
+	//! \brief The positions of every byte in the query, as bits
+	unsigned long long	peq[256];
+
+	//! \brief Scratch buffers: shared trigrams per slot, the slots touched and the results
+	unsigned short*	counts;
+	int*						touched;
+	FUZZY_RESULT*		found;
+	int							scratchSize;
+};
+
+#endif /* __FUZZY_H__ */
+
+/* vim:set ts=2 sw=2: */
@@ -2,113 +2,390 @@
  * ident.cc - Identification Protocol client, as per RFC1413
  *
  */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include "config.h"
 #include "ident.h"
 #include "jukebox.h"
 
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif /* MSG_NOSIGNAL */
+
+/*
+ * IDENT::IDENT()
+ *
+ * This will construct the ident client.
+ *
+ */
+IDENT::IDENT() {
+	lookups = NULL; numLookups = 0;
+	memset (cache, 0, sizeof (cache));
+}
+
+/*
+ * IDENT::~IDENT()
+ *
+ * This will abort all lookups, without completing their jobs.
+ *
+ */
+IDENT::~IDENT() {
+	IDENT_LOOKUP* l;
+
+	while (lookups != NULL) {
+		l = lookups; lookups = l->next;
+		if (l->fd >= 0)
+			close (l->fd);
+		delete l->job;
+		free (l);
+	}
+}
+
 /*
- * IDENT::incoming()
+ * IDENT::identify (NETADDRESS* dest, const char* user, WORKJOB* job)
  *
- * This will be called whenever there is incoming data.
+ * This will start identifying [user] at [dest]. Once done, [job] is completed
+ * with the outcome in job->result.
  *
  */
 void
-IDENT::incoming() {
-	char temp[128];
+IDENT::identify (NETADDRESS* dest, const char* user, WORKJOB* job) {
+	IDENT_LOOKUP* l;
+	int len, timeout = config->getIdentTimeout();
+
+	// set the lookup up. it is failed until proven otherwise
+	l = (IDENT_LOOKUP*)malloc (sizeof (IDENT_LOOKUP));
+	memset (l, 0, sizeof (IDENT_LOOKUP));
+	l->fd = -1; l->state = IDENT_STATE_DONE; l->job = job;
+	len = dest->getInternalLength();
+	memcpy (&l->addr, dest->getInternalAddress(), (len < (int)sizeof (l->addr)) ? len : sizeof (l->addr));
+	l->clientPort = dest->getPort(); l->serverPort = config->getPort();
+	strncpy (l->user, user, USER_MAX_USERNAME_LEN - 1);
+	l->next = lookups; lookups = l;
+	numLookups++;
+
+	// did we identify this user recently?
+	if (checkCache (l)) {
+		// yes. no need to ask again
+		l->result = 1;
+		return;
+	}
 
-	// grab the data
-	int len = recv (temp, sizeof (temp) - 1);
-	if (!len)
+	// too busy?
+	if (numLookups > IDENT_MAX_LOOKUPS) {
+		// yes. complain
+		logger->log (LOG_INFO, "Too many ident lookups in progress, failing one for %s", user);
 		return;
+	}
+
+	// build the query
+	l->queryLen = sprintf (l->query, "%u, %u\r\n", l->clientPort, l->serverPort);
 
-	// terminate the string
-	temp[len] = 0;
+	// create a non-blocking socket which tells us when something happens
+	l->fd = socket (AF_INET, SOCK_STREAM, 0);
+	if (l->fd < 0)
+		// this failed. bail out
+		return;
+	fcntl (l->fd, F_SETOWN, getpid());
+	fcntl (l->fd, F_SETFL, fcntl (l->fd, F_GETFL) | O_NONBLOCK | O_ASYNC);
 
-	// display it
-	printf (temp);
+	// start connecting
+	l->addr.sin_family = AF_INET;
+	l->addr.sin_port = htons (IDENT_PORT);
+	if ((connect (l->fd, (struct sockaddr*)&l->addr, sizeof (l->addr)) < 0) && (errno != EINPROGRESS)) {
+		// this failed. bail out
+		finish (l, 0);
+		return;
+	}
+
+	// wait for it
+	l->state = IDENT_STATE_CONNECTING;
+	l->deadline = time ((time_t*)NULL) + timeout;
 }
 
 /*
- * IDENT::identify (NETADDRESS* dest, char* user)
+ * IDENT::finish (IDENT_LOOKUP* l, int result)
  *
- * This will try to identify user [user] using ident server [dest]. It will
- * return zero on failure or non-zero on success.
+ * This will finish lookup [l] with result [result]. The job is completed by
+ * poll().
  *
  */
-int
-IDENT::identify (NETADDRESS* dest, char* user) {
-	char buf[128];
-	char *ptr, *ptr2;
-	int len;
-	IPV4ADDRESS* icon = new IPV4ADDRESS();
-
-	// try to connect
-	memcpy (icon->getInternalAddress(), dest->getInternalAddress(), dest->getInternalLength());
-	icon->setPort (113);
-	if (!connect (icon)) {
-		// this failed. complain
-		delete icon;
-		return 0;
+void
+IDENT::finish (IDENT_LOOKUP* l, int result) {
+	// get rid of the socket
+	if (l->fd >= 0)
+		close (l->fd);
+	l->fd = -1;
+
+	// store the result
+	l->state = IDENT_STATE_DONE;
+	l->result = result;
+	if (result)
+		storeCache (l);
+}
+
+/*
+ * IDENT::step (IDENT_LOOKUP* l)
+ *
+ * This will advance lookup [l] as far as the socket allows.
+ *
+ */
+void
+IDENT::step (IDENT_LOOKUP* l) {
+	int len, err = 0;
+	socklen_t errlen = sizeof (err);
+	int timeout = config->getIdentTimeout();
+
+	// connected yet?
+	if (l->state == IDENT_STATE_CONNECTING) {
+		// maybe. did it work?
+		if ((getsockopt (l->fd, SOL_SOCKET, SO_ERROR, &err, &errlen) < 0) || (err != 0)) {
+			// no. bail out
+			finish (l, 0);
+			return;
+		}
+
+		// yes. send the query
+		l->state = IDENT_STATE_SENDING;
+		l->deadline = time ((time_t*)NULL) + timeout;
 	}
 
-	// address is no longer needed
-	delete icon;
+	// sending the query?
+	if (l->state == IDENT_STATE_SENDING) {
+		// yes. send whatever we can
+		len = send (l->fd, l->query + l->queryPos, l->queryLen - l->queryPos, MSG_NOSIGNAL);
+		if (len < 0) {
+			// did this fail for real?
+			if ((errno != EAGAIN) && (errno != EINTR))
+				// yes. bail out
+				finish (l, 0);
+			return;
+		}
+		l->queryPos += len;
+
+		// all sent?
+		if (l->queryPos < l->queryLen)
+			// no. wait for more room
+			return;
 
-	// send the query
-	sendf ("%u, %u\n", dest->getPort(), config->getPort());
+		// yes. wait for the reply
+		l->state = IDENT_STATE_READING;
+		l->deadline = time ((time_t*)NULL) + timeout;
+	}
 
-	// fetch the reply
-	len = recv (buf, sizeof (buf) - 1);
-	buf[len] = 0;
+	// reading the reply?
+	if (l->state == IDENT_STATE_READING) {
+		// yes. grab what's there
+		len = recv (l->fd, l->reply + l->replyLen, IDENT_MAX_REPLY - l->replyLen, 0);
+		if (len < 0) {
+			// did this fail for real?
+			if ((errno != EAGAIN) && (errno != EINTR))
+				// yes. bail out
+				finish (l, 0);
+			return;
+		}
 
-	// close the socket (we don't need it anymore)
-	close();
+		// got a complete line, or all we will get?
+		if ((len > 0) && (memchr (l->reply + l->replyLen, '\n', len) == NULL) &&
+		    (l->replyLen + len < IDENT_MAX_REPLY)) {
+			// no. wait for the rest
+			l->replyLen += len;
+			return;
+		}
 
-	// destroy any trailing CR/LF's
-	while ((ptr = strrchr (buf, '\r')) != NULL) *ptr = 0;
-	while ((ptr = strrchr (buf, '\n')) != NULL) *ptr = 0;
+		// yes. it's all up to the reply now
+		l->replyLen += len;
+		finish (l, parseReply (l->reply, l->replyLen, l->clientPort, l->serverPort, l->user));
+	}
+}
+
+/*
+ * IDENT::poll()
+ *
+ * This will advance all lookups, fail those which took too long, and complete
+ * the jobs of those which are done.
+ *
+ */
+void
+IDENT::poll() {
+	struct pollfd fds[IDENT_MAX_LOOKUPS];
+	IDENT_LOOKUP* idx[IDENT_MAX_LOOKUPS];
+	IDENT_LOOKUP* l;
+	IDENT_LOOKUP* done = NULL;
+	IDENT_LOOKUP** ptr;
+	time_t now;
+	int i, n = 0;
+
+	// anything to do?
+	if (lookups == NULL)
+		// no. bail out
+		return;
+
+	// see which sockets are ready
+	for (l = lookups; l != NULL; l = l->next) {
+		if ((l->state == IDENT_STATE_DONE) || (n == IDENT_MAX_LOOKUPS))
+			continue;
+		fds[n].fd = l->fd;
+		fds[n].events = (l->state == IDENT_STATE_READING) ? POLLIN : POLLOUT;
+		fds[n].revents = 0;
+		idx[n++] = l;
+	}
+	if ((n > 0) && (::poll (fds, n, 0) > 0))
+		// advance those
+		for (i = 0; i < n; i++)
+			if (fds[i].revents)
+				step (idx[i]);
+
+	// fail whatever is late
+	now = time ((time_t*)NULL);
+	for (l = lookups; l != NULL; l = l->next)
+		if ((l->state != IDENT_STATE_DONE) && (now >= l->deadline)) {
+			logger->log (LOG_INFO, "Ident lookup for %s timed out", l->user);
+			finish (l, 0);
+		}
+
+	// take the finished lookups out. completing them may start new ones
+	ptr = &lookups;
+	while (*ptr != NULL) {
+		l = *ptr;
+		if (l->state == IDENT_STATE_DONE) {
+			*ptr = l->next;
+			l->next = done; done = l;
+			numLookups--;
+		} else
+			ptr = &l->next;
+	}
+
+	// complete them
+	while (done != NULL) {
+		l = done; done = l->next;
+		l->job->result = l->result;
+		l->job->complete();
+		delete l->job;
+		free (l);
+	}
+}
+
+/*
+ * IDENT::parseReply (char* buf, int len, int clientPort, int serverPort,
+ *                    const char* user)
+ *
+ * This will check whether reply [buf] of [len] bytes identifies [user] for
+ * the connection from [clientPort] to [serverPort]. The reply is split in
+ * place. It will return non-zero if it does or zero if not.
+ *
+ */
+int
+IDENT::parseReply (char* buf, int len, int clientPort, int serverPort, const char* user) {
+	char* field[4];
+	char* ptr;
+	char* end;
+	int n;
+
+	// only the first line counts. the buffer has room for the terminator
+	for (ptr = buf; (ptr < buf + len) && (*ptr != '\r') && (*ptr != '\n'); ptr++);
+	*ptr = 0;
 
 	// the line should be in the format:
-	// clientport, serverport : USERID : UNIX : username
+	// clientport , serverport : USERID : opsys[,charset] : username
 	//
-	// chop off the port numbers
-	ptr = strchr (buf, ':');
-	if (ptr == NULL)
-		// humm, no colon. this is a corrupt packet, fail
-		return 0;
-	ptr++;
+	// the username may contain colons, so it takes whatever is left
+	field[0] = buf; ptr = buf;
+	for (n = 1; n < 4; n++) {
+		ptr = strchr (ptr, ':');
+		if (ptr == NULL)
+			// humm, no colon. this is a corrupt reply, fail
+			return 0;
+		*ptr++ = 0; field[n] = ptr;
+	}
 
-	// isolate the next colon
-	ptr2 = strchr (ptr, ':');
-	if (ptr2 == NULL)
-		// humm, no colon. this is a corrupt packet, fail
+	// is this about our connection?
+	if (strtol (field[0], &end, 10) != clientPort)
+		// no. ditch it
 		return 0;
-	*ptr2 = 0; ptr2++;
-
-	// skip preceding spaces
-	while (*ptr == ' ') ptr++;
-
-	// ptr2 should now be USERID, correct ?
-	if (strncasecmp (ptr, "USERID", 6))
-		// no. invalid reply, ditch it
+	while (*end == ' ') end++;
+	if (*end++ != ',')
+		return 0;
+	if (strtol (end, &end, 10) != serverPort)
+		return 0;
+	while (*end == ' ') end++;
+	if (*end)
 		return 0;
 
-	// isolate another chunk (it usually reads UNIX, but we skip it)
-	ptr = strchr (ptr2, ':');
-	if (ptr == NULL)
-		// humm, no colon. this is a corrupt packet, fail
+	// is it USERID? (rather than ERROR)
+	for (ptr = field[1]; *ptr == ' '; ptr++);
+	if ((strncasecmp (ptr, "USERID", 6)) || (strspn (ptr + 6, " ") != strlen (ptr + 6)))
+		// no. invalid reply, ditch it
 		return 0;
-	ptr++;
 
-	// the final text is all we care about now. skip trailing spaces
-	while (*ptr == ' ') ptr++;
+	// skip the spaces around the username
+	for (ptr = field[3]; *ptr == ' '; ptr++);
+	for (end = strchr (ptr, 0); (end > ptr) && (*(end - 1) == ' '); end--);
+	*end = 0;
 
 	// it's all up to the match now
 	return (!strcasecmp (ptr, user)) ? 1 : 0;
 }
 
+/*
+ * IDENT::checkCache (IDENT_LOOKUP* l)
+ *
+ * This will check whether the user of lookup [l] was identified at the same
+ * address, from a nearby port, recently. It will return non-zero if so or
+ * zero if not.
+ *
+ */
+int
+IDENT::checkCache (IDENT_LOOKUP* l) {
+	time_t now = time ((time_t*)NULL);
+	int i;
+
+	for (i = 0; i < IDENT_CACHE_SIZE; i++)
+		if ((cache[i].expires > now) &&
+		    (cache[i].addr.s_addr == l->addr.sin_addr.s_addr) &&
+		    (l->clientPort >= cache[i].lowPort) && (l->clientPort <= cache[i].highPort) &&
+		    (!strcasecmp (cache[i].user, l->user)))
+			return 1;
+
+	// not found
+	return 0;
+}
+
+/*
+ * IDENT::storeCache (IDENT_LOOKUP* l)
+ *
+ * This will remember that the user of lookup [l] was identified.
+ *
+ */
+void
+IDENT::storeCache (IDENT_LOOKUP* l) {
+	int ttl = config->getIdentCacheTTL();
+	int i, slot = 0;
+
+	// is caching enabled?
+	if (ttl <= 0)
+		// no. bail out
+		return;
+
+	// use a free slot, or else the one closest to expiry
+	for (i = 0; i < IDENT_CACHE_SIZE; i++)
+		if (cache[i].expires < cache[slot].expires)
+			slot = i;
+
+	cache[slot].addr = l->addr.sin_addr;
+	cache[slot].lowPort = l->clientPort - IDENT_CACHE_PORT_RANGE;
+	cache[slot].highPort = l->clientPort + IDENT_CACHE_PORT_RANGE;
+	strcpy (cache[slot].user, l->user);
+	cache[slot].expires = time ((time_t*)NULL) + ttl;
+}
+
 /* vim:set ts=2 sw=2: */
@@ -4,16 +4,173 @@
  * This will handle the RFC 1413 identification protocol.
  *
  */
+#include <sys/types.h>
+#include <netinet/in.h>
 #include <stdlib.h>
+#include <time.h>
 #include <libplusplus/network.h>
+#include "user.h"
+#include "worker.h"
 
 #ifndef __IDENTCLIENT_H__
 #define __IDENTCLIENT_H__
 
-class IDENT : public NETCLIENT {
+//! \brief IDENT_PORT is the port ident servers listen on
+#define IDENT_PORT							113
+
+//! \brief IDENT_DEFAULT_TIMEOUT is the default time allowed per stage, in seconds
+#define IDENT_DEFAULT_TIMEOUT		5
+
+//! \brief IDENT_DEFAULT_CACHE_TTL is the default lifetime of cached results
+#define IDENT_DEFAULT_CACHE_TTL	60
+
+//! \brief IDENT_CACHE_SIZE is the number of results cached
+#define IDENT_CACHE_SIZE				64
+
+//! \brief IDENT_CACHE_PORT_RANGE is how far a port may be from a cached one
+#define IDENT_CACHE_PORT_RANGE	32
+
+//! \brief IDENT_MAX_LOOKUPS is the maximum number of lookups in progress
+#define IDENT_MAX_LOOKUPS				64
+
+//! \brief IDENT_MAX_REPLY is the maximum length of a reply we accept
+#define IDENT_MAX_REPLY					512
+
+// IDENT_STATE_xxx are the stages a lookup goes through
+#define IDENT_STATE_CONNECTING	0
+#define IDENT_STATE_SENDING			1
+#define IDENT_STATE_READING			2
+#define IDENT_STATE_DONE				3
+
+/*!
+ * \struct IDENT_LOOKUP
+ * \brief A single lookup in progress
+ */
+struct IDENT_LOOKUP {
+	//! \brief The socket to the ident server, or -1
+	int			fd;
+
+	//! \brief The IDENT_STATE_xxx stage we are in
+	int			state;
+
+	//! \brief The moment the current stage must be done
+	time_t	deadline;
+
+	//! \brief The address of the client
+	struct sockaddr_in addr;
+
+	//! \brief The port pair we ask about
+	int			clientPort, serverPort;
+
+	//! \brief The user the client claims to be
+	char		user[USER_MAX_USERNAME_LEN];
+
+	//! \brief The query, and how much of it has been sent
+	char		query[32];
+	int			queryLen, queryPos;
+
+	//! \brief The reply received so far
+	char		reply[IDENT_MAX_REPLY + 1];
+	int			replyLen;
+
+	//! \brief Non-zero if the user was identified
+	int			result;
+
+	//! \brief The job to complete once we are done
+	WORKJOB* job;
+
+	//! \brief Next lookup in progress
+	IDENT_LOOKUP* next;
+};
+
+/*!
+ * \struct IDENT_CACHE_ENTRY
+ * \brief A recently identified user
+ */
+struct IDENT_CACHE_ENTRY {
+	//! \brief The address the user was at
+	struct in_addr addr;
+
+	//! \brief The range of client ports covered
+	int			lowPort, highPort;
+
+	//! \brief The user identified
+	char		user[USER_MAX_USERNAME_LEN];
+
+	//! \brief The moment this entry is no longer valid, 0 if unused
+	time_t	expires;
+};
+
+/*!
+ * \class IDENT
+ * \brief This will identify users using their ident servers
+ *
+ * Lookups never block: the sockets are non-blocking and each stage has a
+ * deadline. The main loop calls poll() to advance them; the sockets raise
+ * SIGIO to break the network wait whenever something happens.
+ */
+class IDENT {
 public:
-	int identify (NETADDRESS* dest, char* user);
-	void incoming();
+	//! \brief Constructs the ident client
+	IDENT();
+
+	//! \brief Aborts all lookups and destroys the client
+	~IDENT();
+
+	/*! \brief Starts identifying an user
+	 *  \param dest The address of the client to identify
+	 *  \param user The user the client claims to be
+	 *  \param job The job to complete once the lookup is done
+	 *
+	 *  The result is stored in job->result, after which the job is completed
+	 *  and deleted by poll(). This happens even if the lookup fails right away.
+	 */
+	void identify (NETADDRESS* dest, const char* user, WORKJOB* job);
+
+	//! \brief Advances all lookups, to be called from the main loop
+	void poll();
+
+	/*! \brief Parses a reply of an ident server
+	 *  \param buf The reply, which will be modified
+	 *  \param len The length of the reply
+	 *  \param clientPort The client port queried
+	 *  \param serverPort The server port queried
+	 *  \param user The user expected
+	 *  \return Non-zero if the reply identifies [user], zero otherwise
+	 */
+	static int parseReply (char* buf, int len, int clientPort, int serverPort, const char* user);
+
+private:
+	/*! \brief Handles socket activity of a lookup
+	 *  \param l The lookup
+	 */
+	void step (IDENT_LOOKUP* l);
+
+	/*! \brief Finishes a lookup
+	 *  \param l The lookup
+	 *  \param result Non-zero if the user was identified
+	 */
+	void finish (IDENT_LOOKUP* l, int result);
+
+	/*! \brief Checks the cache
+	 *  \param l The lookup to check for
+	 *  \return Non-zero if the user was identified recently
+	 */
+	int checkCache (IDENT_LOOKUP* l);
+
+	/*! \brief Stores a successful lookup in the cache
+	 *  \param l The lookup
+	 */
+	void storeCache (IDENT_LOOKUP* l);
+
+	//! \brief The lookups in progress
+	IDENT_LOOKUP*	lookups;
+
+	//! \brief The number of lookups in progress
+	int				numLookups;
+
+	//! \brief Recently identified users
+	IDENT_CACHE_ENTRY cache[IDENT_CACHE_SIZE];
 };
 
 #endif // __IDENTCLIENT_H__
@@ -0,0 +1,817 @@
+/*
+ * jukebench.cc - Jukebox benchmark utility
+ *
+ * This is not installed; build it using 'make jukebench' when needed.
+ *
+ */
+#include <sys/time.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef MP3_SUPPORT
+#include <id3.h>
+#include <id3/tag.h>
+#endif /* MP3_SUPPORT */
+#include <libplusplus/log.h>
+#include "audioinfo.h"
+#include "config.h"
+#include "fold.h"
+#include "fuzzy.h"
+#include "jukebox.h"
+#include "tagreader.h"
+#include "user_ldap.h"
+#include "utf8.h"
+#include "vcedit.h"
+
+JUKECONFIG* config;
+LOG* logger;
+
+int iterations = 100;
+
+/*
+ * now_usec()
+ *
+ * This will return the current time in microseconds.
+ *
+ */
+double
+now_usec() {
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+	return (double)tv.tv_sec * 1000000.0 + (double)tv.tv_usec;
+}
+
+/*
+ * report (char* what, double* samples, int n)
+ *
+ * This will print the average, minimum and maximum of [n] [samples], which
+ * are in microseconds.
+ *
+ */
+void
+report (char* what, double* samples, int n) {
+	double total = 0, min = samples[0], max = samples[0];
+
+	for (int i = 0; i < n; i++) {
+		total += samples[i];
+		if (samples[i] < min) min = samples[i];
+		if (samples[i] > max) max = samples[i];
+	}
+
+	printf ("%-24s %8d runs  avg %9.3f ms  min %9.3f ms  max %9.3f ms\n", what, n, total / n / 1000.0, min / 1000.0, max / 1000.0);
+}
+
+#ifdef USERDB_LDAP
+/*
+ * bench_ldap (int argc, char** argv)
+ *
+ * This will measure the login latency of the LDAP user backend. The server
+ * used is the one in the configuration file, usually a local slapd.
+ *
+ */
+int
+bench_ldap (int argc, char** argv) {
+	USERS_LDAP* ldap;
+	USER user;
+	char* username;
+	char* password = NULL;
+	double* samples;
+	double t;
+	int pass, i, ok;
+
+	// need an user, and possibly a password
+	if (argc < 1) {
+		fprintf (stderr, "usuage: jukebench ldap username [password]\n");
+		return EXIT_FAILURE;
+	}
+	username = argv[0];
+	if (argc > 1)
+		password = argv[1];
+
+	// initialize the backend
+	ldap = new USERS_LDAP();
+	if (!ldap->init()) {
+		fprintf (stderr, "jukebench: cannot initialize the LDAP backend\n");
+		return EXIT_FAILURE;
+	}
+
+	samples = (double*)malloc (iterations * sizeof (double));
+
+	// first without a pool, then with one
+	for (pass = 0; pass < 2; pass++) {
+		ldap->setPoolSize (pass);
+
+		for (i = 0, ok = 0; i < iterations; i++) {
+			t = now_usec();
+			if (ldap->fetchUserByName (username, &user))
+				if ((password == NULL) || (ldap->verifyPassword (password, &user)))
+					ok++;
+			samples[i] = now_usec() - t;
+		}
+
+		report ((char*)(pass ? "login (pooled)" : "login (unpooled)"), samples, iterations);
+		if (ok != iterations)
+			printf ("  warning: %d of %d logins failed\n", iterations - ok, iterations);
+	}
+
+	free (samples);
+	delete ldap;
+	return EXIT_SUCCESS;
+}
+#endif /* USERDB_LDAP */
+
+// syllables are what the names of the synthetic catalog are made of
+static const char* syllables[] = {
+	"ka", "lo", "mi", "ne", "ra", "su", "to", "vi", "an", "el", "or", "ur",
+	"bra", "dre", "gli", "pho", "stu", "tri", "zen", "mar", "sol", "ven",
+	"the", "ber", "ric", "kin", "dal", "fey", "mon", "lys"
+};
+#define NUM_SYLLABLES	(sizeof (syllables) / sizeof (syllables[0]))
+
+/*
+ * make_name (char* dest)
+ *
+ * This will store a random name of one to four words in [dest], which must
+ * hold at least 64 bytes.
+ *
+ */
+void
+make_name (char* dest) {
+	int words = 1 + rand() % 4, w, s, n;
+
+	*dest = 0;
+	for (w = 0; w < words; w++) {
+		if (w) strcat (dest, " ");
+		n = 1 + rand() % 3;
+		for (s = 0; s < n; s++)
+			strcat (dest, syllables[rand() % NUM_SYLLABLES]);
+	}
+	dest[0] += 'A' - 'a';
+}
+
+/*
+ * bench_fuzzy (int argc, char** argv)
+ *
+ * This will measure fuzzy name lookups in a synthetic catalog, both using
+ * the trigram filter and by comparing every name.
+ *
+ */
+int
+bench_fuzzy (int argc, char** argv) {
+	FUZZY_RESULT results[10];
+	FUZZYLIST* list;
+	char** names;
+	char query[64];
+	double* samples;
+	double t;
+	int count = 500000, pass, i, j, n, q, hits, total;
+
+	if (argc > 0)
+		count = atoi (argv[0]);
+	if (count < 1) {
+		fprintf (stderr, "usuage: jukebench fuzzy [names]\n");
+		return EXIT_FAILURE;
+	}
+
+	// build the catalog
+	srand (1);
+	names = (char**)malloc (count * sizeof (char*));
+	list = new FUZZYLIST();
+	t = now_usec();
+	for (i = 0; i < count; i++) {
+		names[i] = (char*)malloc (64);
+		make_name (names[i]);
+		list->add (names[i], i);
+	}
+	printf ("%-24s %8d names %9.3f ms\n", "build", count, (now_usec() - t) / 1000.0);
+
+	samples = (double*)malloc (iterations * sizeof (double));
+
+	// look up misspelled names, first filtered, then by brute force
+	for (pass = 0; pass < 2; pass++) {
+		srand (2);
+		for (i = 0, hits = 0, total = 0; i < iterations; i++) {
+			// misspell a name
+			q = rand() % count;
+			strcpy (query, names[q]);
+			query[rand() % strlen (query)] = 'a' + rand() % 26;
+
+			t = now_usec();
+			n = (pass) ? list->scan (query, results, 10) : list->find (query, results, 10);
+			samples[i] = now_usec() - t;
+
+			total += n;
+			for (j = 0; j < n; j++)
+				if (results[j].id == q) {
+					hits++;
+					break;
+				}
+		}
+
+		report ((char*)(pass ? "fuzzy (scan)" : "fuzzy (trigrams)"), samples, iterations);
+		printf ("  found %d of %d names, %.1f results per lookup\n", hits, iterations, (double)total / iterations);
+	}
+
+	free (samples);
+	for (i = 0; i < count; i++)
+		free (names[i]);
+	free (names);
+	delete list;
+	return EXIT_SUCCESS;
+}
+
+/*
+ * put_frame (unsigned char* p, const char* id, int version, const unsigned char* body, int len)
+ *
+ * This will store ID3v2.[version] frame [id] with [body] of [len] bytes at
+ * [p]. It will return the number of bytes stored.
+ *
+ */
+int
+put_frame (unsigned char* p, const char* id, int version, const unsigned char* body, int len) {
+	memcpy (p, id, 4);
+	if (version == 4) {
+		// syncsafe
+		p[4] = (len >> 21) & 0x7f; p[5] = (len >> 14) & 0x7f; p[6] = (len >> 7) & 0x7f; p[7] = len & 0x7f;
+	} else {
+		p[4] = len >> 24; p[5] = len >> 16; p[6] = len >> 8; p[7] = len;
+	}
+	p[8] = 0; p[9] = 0;
+	memcpy (p + 10, body, len);
+	return 10 + len;
+}
+
+/*
+ * put_text (unsigned char* p, const char* id, int version, const char* text)
+ *
+ * This will store text frame [id] holding [text] at [p]. Version 2.4 frames
+ * are stored as UTF-16, the others as Latin-1. It will return the number of
+ * bytes stored.
+ *
+ */
+int
+put_text (unsigned char* p, const char* id, int version, const char* text) {
+	unsigned char body[256];
+	int len = 1, i;
+
+	if (version == 4) {
+		// UTF-16 with a BOM
+		body[0] = 1; body[len++] = 0xff; body[len++] = 0xfe;
+		for (i = 0; text[i] != 0; i++) {
+			body[len++] = text[i]; body[len++] = 0;
+		}
+	} else {
+		body[0] = 0;
+		for (i = 0; text[i] != 0; i++)
+			body[len++] = text[i];
+	}
+	return put_frame (p, id, version, body, len);
+}
+
+/*
+ * make_mp3 (const char* fname, int kind)
+ *
+ * This will write a fake MP3 file [fname]. Depending on [kind], it has an
+ * ID3v2.3 tag, an ID3v2.4 tag with a cover picture, just an ID3v1 tag or an
+ * ID3v2.3 tag whose extended header claims to be 2GB. It will return zero on
+ * failure or non-zero on success.
+ *
+ */
+int
+make_mp3 (const char* fname, int kind) {
+	static unsigned char buf[96 * 1024];
+	char title[64], artist[64], album[64];
+	int len = 10, version = (kind == 1) ? 4 : 3, fd, ok;
+
+	make_name (title); make_name (artist); make_name (album);
+	memset (buf, 0, sizeof (buf));
+	if (kind != 2) {
+		// an ID3v2 tag
+		if (kind == 3) {
+			// with a broken extended header in front
+			buf[len] = 0x7f; buf[len + 1] = buf[len + 2] = buf[len + 3] = 0xff;
+			len += 10;
+		}
+		len += put_text (buf + len, "TIT2", version, title);
+		len += put_text (buf + len, "TPE1", version, artist);
+		len += put_text (buf + len, "TALB", version, album);
+		len += put_text (buf + len, "TRCK", version, "3/12");
+		len += put_text (buf + len, (version == 4) ? "TDRC" : "TYER", version, "1999");
+		if (kind == 1)
+			// a cover picture, which the reader should not have to touch
+			len += put_frame (buf + len, "APIC", version, buf + sizeof (buf) - 65536, 65536);
+		len += 256;
+		memcpy (buf, "ID3", 3); buf[3] = version; buf[5] = (kind == 3) ? 0x40 : 0;
+		buf[6] = ((len - 10) >> 21) & 0x7f; buf[7] = ((len - 10) >> 14) & 0x7f;
+		buf[8] = ((len - 10) >> 7) & 0x7f;  buf[9] = (len - 10) & 0x7f;
+	} else
+		len = 0;
+
+	// some audio
+	len += 16384;
+
+	if (kind == 2) {
+		// an ID3v1.1 tag
+		memcpy (buf + len, "TAG", 3);
+		strncpy ((char*)buf + len + 3, title, 30);
+		strncpy ((char*)buf + len + 33, artist, 30);
+		strncpy ((char*)buf + len + 63, album, 30);
+		memcpy (buf + len + 93, "1999", 4);
+		buf[len + 126] = 3;
+		len += 128;
+	}
+
+	fd = open (fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return 0;
+	ok = (write (fd, buf, len) == len);
+	close (fd);
+	return ok;
+}
+
+/*
+ * bench_id3 (int argc, char** argv)
+ *
+ * This will measure reading the tags of a synthetic corpus of MP3 files,
+ * using our own reader and id3lib.
+ *
+ */
+int
+bench_id3 (int argc, char** argv) {
+	char dir[] = "/tmp/jukebenchXXXXXX";
+	char fname[128];
+	char title[256], artist[256], album[256];
+	TAGINFO info;
+	double* samples;
+	double t;
+	int count = 1000, i, j, found;
+
+	if (argc > 0)
+		count = atoi (argv[0]);
+	if (count < 1) {
+		fprintf (stderr, "usuage: jukebench id3 [files]\n");
+		return EXIT_FAILURE;
+	}
+
+	// build the corpus
+	if (mkdtemp (dir) == NULL) {
+		perror ("mkdtemp");
+		return EXIT_FAILURE;
+	}
+	srand (1);
+	for (i = 0; i < count; i++) {
+		sprintf (fname, "%s/%d.mp3", dir, i);
+		if (!make_mp3 (fname, i % 3)) {
+			perror (fname);
+			count = i;
+			break;
+		}
+	}
+
+	info.title  = title;  info.titleLen  = sizeof (title);
+	info.artist = artist; info.artistLen = sizeof (artist);
+	info.album  = album;  info.albumLen  = sizeof (album);
+	samples = (double*)malloc (iterations * sizeof (double));
+
+	// a broken tag has to be survived, and yields nothing
+	sprintf (fname, "%s/broken.mp3", dir);
+	if (make_mp3 (fname, 3)) {
+		printf ("  broken extended header: %s\n", (readID3 (fname, &info) == 0) ? "ok" : "FAILED");
+		unlink (fname);
+	}
+
+	// read all tags, and make sure they were all there
+	for (i = 0, found = 0; i < iterations; i++) {
+		t = now_usec();
+		for (j = 0; j < count; j++) {
+			sprintf (fname, "%s/%d.mp3", dir, j);
+			found += (readID3 (fname, &info) == TAGINFO_ALL);
+		}
+		samples[i] = now_usec() - t;
+	}
+	report ((char*)"id3 (native)", samples, iterations);
+	printf ("  %d of %d files fully tagged\n", found / iterations, count);
+
+#ifdef MP3_SUPPORT
+	for (i = 0, found = 0; i < iterations; i++) {
+		t = now_usec();
+		for (j = 0; j < count; j++) {
+			sprintf (fname, "%s/%d.mp3", dir, j);
+			ID3_Tag tag;
+			tag.Link (fname);
+			found += (tag.Find (ID3FID_TITLE) != NULL);
+		}
+		samples[i] = now_usec() - t;
+	}
+	report ((char*)"id3 (id3lib)", samples, iterations);
+	printf ("  %d of %d files with a title\n", found / iterations, count);
+#endif /* MP3_SUPPORT */
+
+	// clean up
+	for (i = 0; i < count; i++) {
+		sprintf (fname, "%s/%d.mp3", dir, i);
+		unlink (fname);
+	}
+	rmdir (dir);
+	free (samples);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * native_tags (const char* fname, TAGINFO* info)
+ *
+ * This will read the tags of [fname] into [info] using our own readers. It
+ * will return the TAGINFO_xxx fields found.
+ *
+ */
+int
+native_tags (const char* fname, TAGINFO* info) {
+	const char* ext = strrchr (fname, '.');
+
+	if (ext == NULL)
+		return 0;
+	if (!strcasecmp (ext, ".mp3"))
+		return readID3 (fname, info);
+	if ((!strcasecmp (ext, ".ogg")) || (!strcasecmp (ext, ".oga")) || (!strcasecmp (ext, ".opus")))
+		return readOggTags (fname, info);
+	if (!strcasecmp (ext, ".flac"))
+		return readFLACTags (fname, info);
+	return 0;
+}
+
+/*
+ * library_tags (const char* fname, TAGINFO* info)
+ *
+ * This will read the tags of [fname] using id3lib or libvorbis, as far as
+ * they were built in. It will return non-zero if there were any.
+ *
+ */
+int
+library_tags (const char* fname, TAGINFO* info) {
+	const char* ext = strrchr (fname, '.');
+	int found = 0;
+
+	if (ext == NULL)
+		return 0;
+#ifdef MP3_SUPPORT
+	if (!strcasecmp (ext, ".mp3")) {
+		ID3_Tag tag;
+		tag.Link (fname);
+		found = (tag.Find (ID3FID_TITLE) != NULL);
+	}
+#endif /* MP3_SUPPORT */
+#ifdef OGG_SUPPORT
+	if (!strcasecmp (ext, ".ogg")) {
+		vcedit_state* state;
+		FILE* f = fopen (fname, "rb");
+
+		if (f == NULL)
+			return 0;
+		state = vcedit_new_state();
+		if (vcedit_open (state, f) >= 0)
+			found = (vcedit_comments (state)->comments > 0);
+		vcedit_clear (state);
+		fclose (f);
+	}
+#endif /* OGG_SUPPORT */
+	return found;
+}
+
+/*
+ * time_tags (char* what, int (*reader)(const char*, TAGINFO*), int num, char** files)
+ *
+ * This will time reading the tags of the [num] [files] using [reader]. It
+ * will return the average number of microseconds per file.
+ *
+ */
+double
+time_tags (char* what, int (*reader)(const char*, TAGINFO*), int num, char** files) {
+	char title[256], artist[256], album[256];
+	TAGINFO info;
+	double* samples;
+	double t;
+	int i, j, found;
+
+	info.title  = title;  info.titleLen  = sizeof (title);
+	info.artist = artist; info.artistLen = sizeof (artist);
+	info.album  = album;  info.albumLen  = sizeof (album);
+	samples = (double*)malloc (iterations * sizeof (double));
+
+	for (i = 0, found = 0; i < iterations; i++) {
+		t = now_usec();
+		for (j = 0; j < num; j++)
+			found += (reader (files[j], &info) != 0);
+		samples[i] = now_usec() - t;
+	}
+	report (what, samples, iterations);
+	for (i = 0, t = 0; i < iterations; i++)
+		t += samples[i];
+	printf ("  %d of %d files tagged, %.1f us per file\n", found / iterations, num, t / iterations / num);
+	free (samples);
+	return t / iterations / num;
+}
+
+/*
+ * bench_tags (int argc, char** argv)
+ *
+ * This will measure reading the tags of the files given, using our own
+ * readers and, as far as they were built in, id3lib and libvorbis.
+ *
+ */
+int
+bench_tags (int argc, char** argv) {
+	if (argc < 1) {
+		fprintf (stderr, "usuage: jukebench tags file ...\n");
+		return EXIT_FAILURE;
+	}
+
+	time_tags ((char*)"tags (native)", native_tags, argc, argv);
+#if defined(MP3_SUPPORT) || defined(OGG_SUPPORT)
+	time_tags ((char*)"tags (libraries)", library_tags, argc, argv);
+#endif
+	return EXIT_SUCCESS;
+}
+
+/*
+ * audio_info (const char* fname, AUDIOINFO* info)
+ *
+ * This will read the audio information of [fname] into [info], the way the
+ * scanner would. It will return non-zero if there was any.
+ *
+ */
+int
+audio_info (const char* fname, AUDIOINFO* info) {
+	const char* ext = strrchr (fname, '.');
+
+	if (ext == NULL)
+		return 0;
+	if (!strcasecmp (ext, ".mp3"))
+		return readMP3Info (fname, info);
+	if ((!strcasecmp (ext, ".ogg")) || (!strcasecmp (ext, ".oga")) || (!strcasecmp (ext, ".opus")))
+		return readOggInfo (fname, info);
+	if (!strcasecmp (ext, ".flac"))
+		return readFLACInfo (fname, info);
+	return readModuleInfo (fname, info);
+}
+
+/*
+ * time_info (char* what, int num, char** files)
+ *
+ * This will time reading the audio information of the [num] [files]. It
+ * will return the average number of microseconds per file.
+ *
+ */
+double
+time_info (char* what, int num, char** files) {
+	AUDIOINFO info;
+	double* samples;
+	double t, total;
+	int i, j, found;
+
+	samples = (double*)malloc (iterations * sizeof (double));
+	for (i = 0, found = 0, total = 0; i < iterations; i++) {
+		t = now_usec();
+		for (j = 0; j < num; j++)
+			found += audio_info (files[j], &info);
+		samples[i] = now_usec() - t;
+		total += samples[i];
+	}
+	report (what, samples, iterations);
+	printf ("  %d of %d files measured, %.1f us per file\n", found / iterations, num, total / iterations / num);
+	free (samples);
+	return total / iterations / num;
+}
+
+/*
+ * bench_info (int argc, char** argv)
+ *
+ * This will measure what reading the duration, bitrate and sample rate adds
+ * to scanning the files given, per format.
+ *
+ */
+int
+bench_info (int argc, char** argv) {
+	static const char* formats[][7] = {
+		{ "mp3",    ".mp3", NULL },
+		{ "ogg",    ".ogg", ".oga", ".opus", NULL },
+		{ "flac",   ".flac", NULL },
+		{ "module", ".mod", ".stm", ".s3m", ".it", ".xm", NULL }
+	};
+	int numFormats = sizeof (formats) / sizeof (formats[0]);
+	char what[64];
+	char** files;
+	const char* ext;
+	double tags, info;
+	int f, i, j, num;
+
+	if (argc < 1) {
+		fprintf (stderr, "usuage: jukebench info file ...\n");
+		return EXIT_FAILURE;
+	}
+
+	files = (char**)malloc (argc * sizeof (char*));
+	for (f = 0; f < numFormats; f++) {
+		// gather the files of this format
+		for (i = 0, num = 0; i < argc; i++) {
+			ext = strrchr (argv[i], '.');
+			for (j = 1; (ext != NULL) && (formats[f][j] != NULL); j++)
+				if (!strcasecmp (ext, formats[f][j])) {
+					files[num++] = argv[i];
+					break;
+				}
+		}
+		if (num == 0)
+			continue;
+
+		// modules have no tags, their title comes with the header read anyway
+		snprintf (what, sizeof (what), "tags (%s)", formats[f][0]);
+		tags = (strcmp (formats[f][0], "module")) ? time_tags (what, native_tags, num, files) : 0;
+		snprintf (what, sizeof (what), "audio (%s)", formats[f][0]);
+		info = time_info (what, num, files);
+		if (tags > 0)
+			printf ("  %.1f us extra per file, %.0f%% of reading the tags\n", info, 100 * info / tags);
+	}
+
+	free (files);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * time_text (const char* what, int kernel, char* src, int len, char* dest, int size)
+ *
+ * This will time text kernel [kernel] on the [len] bytes of [src], with
+ * [size] bytes of [dest] for the result, and report the throughput.
+ *
+ */
+void
+time_text (const char* what, int kernel, char* src, int len, char* dest, int size) {
+	static const char* levels[] = { "scalar", "sse2", "avx2" };
+	char name[64];
+	double* samples;
+	double t, best;
+	int i;
+
+	samples = (double*)malloc (iterations * sizeof (double));
+	for (i = 0; i < iterations; i++) {
+		t = now_usec();
+		switch (kernel) {
+			case 0: isUTF8 (src, len);
+			        break;
+			case 1: latin1ToUTF8 (src, len, dest, size);
+			        break;
+			case 2: utf16ToUTF8 ((const unsigned char*)src, len, 0, dest, size);
+			        break;
+			case 3: foldCase (src, dest, size);
+			        break;
+		}
+		samples[i] = now_usec() - t;
+	}
+
+	for (i = 0, best = samples[0]; i < iterations; i++)
+		if (samples[i] < best) best = samples[i];
+	snprintf (name, sizeof (name), "%s (%s)", what, levels[utf8SIMD]);
+	report (name, samples, iterations);
+	printf ("  %.0f MB/s at best\n", (best > 0) ? len / best : 0.0);
+	free (samples);
+}
+
+/*
+ * bench_utf8 (int argc, char** argv)
+ *
+ * This will measure the throughput of the text normalising kernels on
+ * synthetic tag text, using every instruction set the CPU has.
+ *
+ */
+int
+bench_utf8 (int argc, char** argv) {
+	char* ascii;
+	char* latin1;
+	char* utf16;
+	char* dest;
+	int len = 1024 * 1024, best, level, i;
+
+	if (argc > 0)
+		len = atoi (argv[0]) * 1024;
+	if (len < 1) {
+		fprintf (stderr, "usuage: jukebench utf8 [kbytes]\n");
+		return EXIT_FAILURE;
+	}
+
+	// build the text: ASCII names, names with an accent every so often, and both in UTF-16
+	srand (1);
+	ascii = (char*)malloc (len + 1); latin1 = (char*)malloc (len + 1);
+	utf16 = (char*)malloc (2 * len); dest = (char*)malloc (2 * len + 1);
+	for (i = 0; i < len; i++) {
+		ascii[i] = (rand() % 6) ? 'A' + rand() % 58 : ' ';
+		if ((ascii[i] > 'Z') && (ascii[i] < 'a'))
+			ascii[i] = ' ';
+		latin1[i] = (rand() % 16) ? ascii[i] : (char)(0xc0 + rand() % 64);
+		utf16[2 * i] = latin1[i]; utf16[2 * i + 1] = 0;
+	}
+	ascii[len] = 0; latin1[len] = 0;
+
+	asciiPrefix ((const unsigned char*)ascii, 0);
+	best = utf8SIMD;
+	for (level = UTF8_SIMD_NONE; level <= best; level++) {
+		utf8SIMD = level;
+		time_text ("validate", 0, ascii, len, dest, 2 * len + 1);
+		time_text ("latin1", 1, latin1, len, dest, 2 * len + 1);
+		time_text ("utf16", 2, utf16, 2 * len, dest, 2 * len + 1);
+		time_text ("fold case", 3, ascii, len, dest, 2 * len + 1);
+	}
+
+	free (dest); free (utf16); free (latin1); free (ascii);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * usuage()
+ *
+ * This will display a brief usuage.
+ *
+ */
+void
+usuage() {
+	fprintf (stderr, "usuage: jukebench [-c filename] [-n count] benchmark [args]\n\n");
+	fprintf (stderr, "        -c filename   Specify configuration filename\n");
+	fprintf (stderr, "        -n count      Number of iterations (default 100)\n\n");
+	fprintf (stderr, "benchmarks:\n");
+	fprintf (stderr, "        fuzzy [names]                fuzzy lookups in a synthetic catalog (default 500000 names)\n");
+	fprintf (stderr, "        id3 [files]                  reading the tags of synthetic MP3 files (default 1000 files)\n");
+	fprintf (stderr, "        info file ...                reading the duration of the files given, per format\n");
+	fprintf (stderr, "        tags file ...                reading the tags of the files given\n");
+	fprintf (stderr, "        utf8 [kbytes]                text normalising throughput (default 1024 KiB)\n");
+#ifdef USERDB_LDAP
+	fprintf (stderr, "        ldap username [password]   LDAP login latency\n");
+#endif /* USERDB_LDAP */
+}
+
+/*
+ * main (int argc, char** argv)
+ *
+ * This is the main code.
+ *
+ */
+int
+main (int argc, char** argv) {
+	char* configfile = CONFIG_FILENAME;
+	int ch;
+
+	// parse the parameters
+	while ((ch = getopt (argc, argv, "c:n:h?")) != -1) {
+		switch (ch) {
+			case 'c': // config file
+			          configfile = optarg;
+			          break;
+			case 'n': // iterations
+			          iterations = atoi (optarg);
+			          if (iterations < 1) iterations = 1;
+			          break;
+			case '?':
+			case 'h':
+			 default: // help
+			          usuage();
+			          exit (EXIT_FAILURE);
+		}
+	}
+	argc -= optind; argv += optind;
+	if (argc < 1) {
+		usuage();
+		exit (EXIT_FAILURE);
+	}
+
+	// load the configuration
+	config = new JUKECONFIG();
+	if (config->load (configfile) != CONFIGFILE_OK) {
+		// this failed. complain
+		fprintf (stderr, "JUKECONFIG::load(): unable to load configuration file '%s'\n", configfile);
+		return EXIT_FAILURE;
+	}
+
+	// initialize the logger
+	logger = LOG::getLog ("stderr", "jukebench");
+
+	if (!strcasecmp (argv[0], "fuzzy"))
+		return bench_fuzzy (argc - 1, argv + 1);
+	if (!strcasecmp (argv[0], "id3"))
+		return bench_id3 (argc - 1, argv + 1);
+	if (!strcasecmp (argv[0], "info"))
+		return bench_info (argc - 1, argv + 1);
+	if (!strcasecmp (argv[0], "tags"))
+		return bench_tags (argc - 1, argv + 1);
+	if (!strcasecmp (argv[0], "utf8"))
+		return bench_utf8 (argc - 1, argv + 1);
+#ifdef USERDB_LDAP
+	if (!strcasecmp (argv[0], "ldap"))
+		return bench_ldap (argc - 1, argv + 1);
+#endif /* USERDB_LDAP */
+
+	// what's this?
+	usuage();
+	return EXIT_FAILURE;
+}
+
+/* vim:set ts=2 sw=2: */
@@ -8,10 +8,15 @@
 #include "paths.h"
 #include "player.h"
 #include "queue.h"
+#include "search.h"
 #include "server.h"
+#include "session.h"
 #include "config.h"
+#include "ident.h"
+#include "local.h"
 #include "user.h"
 #include "volume.h"
+#include "worker.h"
 
 #ifndef __JUKEBOX_H__
 #define __JUKEBOX_H__
@@ -27,13 +32,19 @@
 #endif /* CONFIG_PORT */
 
 extern JUKECONFIG* config;
-extern DATABASE* db;
+// every worker thread has a database connection of its own
+extern __thread DATABASE* db;
 extern LOG* logger;
 extern QUEUE* queue;
 extern USERS* users;
 extern PLAYER* player;
 extern JUKESERVER* server;
 extern VOLUME* volume;
+extern SESSIONS* sessions;
+extern WORKERS* workers;
+extern IDENT* ident;
+extern LOCALSERVER* localserver;
+extern SEARCH* search;
 
 #endif // __JUKEBOX_H__
 
@@ -2,6 +2,13 @@
  * jukectl.cc - Jukebox Control Utility
  *
  */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,6 +29,170 @@ int error = 0;
 // JUKECTL_DEFAULT_CONFIGFILE is the default configuration file
 #define JUKECTL_DEFAULT_CONFIGFILE "/.jukectl.conf"
 
+// JUKECTL_SESSIONFILE is the file in which the session token is cached
+#define JUKECTL_SESSIONFILE "/.jukectl.session"
+
+// JUKECTL_SESSION_PREFIX is what the server prefixes session tokens with
+#define JUKECTL_SESSION_PREFIX "[I] Session:{"
+
+// JUKECTL_MAX_TOKEN_LEN is the maximum length of a session token we accept
+#define JUKECTL_MAX_TOKEN_LEN 64
+
+char session_token[JUKECTL_MAX_TOKEN_LEN + 1] = "";
+
+/*
+ * JUKECTLCLIENT::JUKECTLCLIENT()
+ *
+ * This will construct a client, which is not connected yet.
+ *
+ */
+JUKECTLCLIENT::JUKECTLCLIENT() {
+	local = 0; localfd = -1;
+}
+
+/*
+ * JUKECTLCLIENT::connectLocal (const char* path)
+ *
+ * This will connect to the server over AF_UNIX socket [path]. It will return
+ * zero on failure or non-zero on success.
+ *
+ */
+int
+JUKECTLCLIENT::connectLocal (const char* path) {
+	struct sockaddr_un sun;
+
+	// will the path fit?
+	if (strlen (path) >= sizeof (sun.sun_path))
+		// no. bail out
+		return 0;
+	memset (&sun, 0, sizeof (sun));
+	sun.sun_family = AF_UNIX;
+	strcpy (sun.sun_path, path);
+
+	// connect
+	localfd = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (localfd < 0)
+		return 0;
+	if (::connect (localfd, (struct sockaddr*)&sun, sizeof (sun)) < 0) {
+		// this failed. bail out
+		::close (localfd); localfd = -1;
+		return 0;
+	}
+
+	// victory
+	local = 1;
+	return 1;
+}
+
+/*
+ * JUKECTLCLIENT::waitLocal()
+ *
+ * This will wait for data on the AF_UNIX socket and handle it, which is what
+ * NETWORK::run() does for TCP connections.
+ *
+ */
+void
+JUKECTLCLIENT::waitLocal() {
+	struct pollfd pfd;
+
+	pfd.fd = localfd; pfd.events = POLLIN; pfd.revents = 0;
+	while ((localfd >= 0) && (poll (&pfd, 1, -1) < 0))
+		// interrupted. try again
+		if (errno != EINTR)
+			return;
+	incoming();
+}
+
+/*
+ * JUKECTLCLIENT::sendf (const char* fmt, ...)
+ *
+ * This will send [fmt] to the server, printf() style. It will return zero on
+ * failure or non-zero on success.
+ *
+ */
+int
+JUKECTLCLIENT::sendf (const char* fmt, ...) {
+	char buf[1024];
+	va_list va;
+	int len, sent;
+
+	va_start (va, fmt);
+	len = vsnprintf (buf, sizeof (buf), fmt, va);
+	va_end (va);
+	if ((len < 0) || (len >= (int)sizeof (buf)))
+		len = strlen (buf);
+
+	// connected over TCP?
+	if (!local)
+		// yes. let the network library handle it
+		return NETCLIENT::sendf ("%s", buf);
+
+	// write it all
+	for (sent = 0; (localfd >= 0) && (sent < len); ) {
+		int n = ::write (localfd, buf + sent, len - sent);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return 0;
+		}
+		sent += n;
+	}
+	return (sent == len) ? 1 : 0;
+}
+
+/*
+ * JUKECTLCLIENT::recv (char* buf, int len)
+ *
+ * This will receive at most [len] bytes into [buf]. It will return the number
+ * of bytes received. Once the server hangs up, the connection is closed.
+ *
+ */
+int
+JUKECTLCLIENT::recv (char* buf, int len) {
+	int n;
+
+	// connected over TCP?
+	if (!local)
+		// yes. let the network library handle it
+		return NETCLIENT::recv (buf, len);
+
+	// did the server hang up?
+	n = (localfd >= 0) ? ::read (localfd, buf, len) : 0;
+	if (n <= 0) {
+		// yes. we're done
+		if (localfd >= 0)
+			::close (localfd);
+		localfd = -1;
+		return 0;
+	}
+	return n;
+}
+
+/*
+ * JUKECTLCLIENT::isActive()
+ *
+ * This will return non-zero if we are still connected.
+ *
+ */
+int
+JUKECTLCLIENT::isActive() {
+	return (local) ? ((localfd >= 0) ? 1 : 0) : NETCLIENT::isActive();
+}
+
+/*
+ * runNetwork()
+ *
+ * This will wait for the server to say something, and handle it.
+ *
+ */
+void
+runNetwork() {
+	if (client->isLocal())
+		client->waitLocal();
+	else
+		net->run();
+}
+
 /*
  * JUKECTLCLIENT::incoming()
  *
@@ -33,6 +204,7 @@ JUKECTLCLIENT::incoming() {
 	char temp[512];
 	char* ptr;
 	char* nextPtr;
+	char* end;
 
 	// grab the data
 	memset (temp, 0, sizeof (temp));
@@ -53,7 +225,14 @@ JUKECTLCLIENT::incoming() {
 			*nextPtr = 0; nextPtr++;
 		}
 
-		if ((ptr[1] != 'I') || (verbose))
+		// session token?
+		if (!strncmp (ptr, JUKECTL_SESSION_PREFIX, strlen (JUKECTL_SESSION_PREFIX))) {
+			// yes. remember it, but never show it
+			strncpy (session_token, ptr + strlen (JUKECTL_SESSION_PREFIX), JUKECTL_MAX_TOKEN_LEN);
+			session_token[JUKECTL_MAX_TOKEN_LEN] = 0;
+			if ((end = strchr (session_token, '}')) != NULL)
+				*end = 0;
+		} else if ((ptr[1] != 'I') || (verbose))
 			printf ("%s\n", ptr);
 
 		// error ?
@@ -74,6 +253,73 @@ JUKECTLCLIENT::incoming() {
 	}
 }
 
+/*
+ * loadSession (char* fname, char* hostname, int portno, char* username)
+ *
+ * This will load the cached session token of [username] for
+ * [hostname]:[portno] from [fname] into session_token. It will return zero
+ * on failure or non-zero on success.
+ *
+ */
+int
+loadSession (char* fname, char* hostname, int portno, char* username) {
+	char line[1024];
+	char host[256];
+	char user[256];
+	char token[JUKECTL_MAX_TOKEN_LEN + 1];
+	int port;
+	FILE* f;
+
+	// open the file
+	if ((f = fopen (fname, "r")) == NULL)
+		// no session cached
+		return 0;
+
+	// the file is in the format 'hostname port username token'
+	session_token[0] = 0;
+	if ((fgets (line, sizeof (line), f) != NULL) &&
+	    (sscanf (line, "%255s %d %255s %64s", host, &port, user, token) == 4) &&
+	    (!strcasecmp (host, hostname)) && (port == portno) && (!strcmp (user, username)))
+		// this is the one
+		strcpy (session_token, token);
+
+	fclose (f);
+	return (session_token[0]) ? 1 : 0;
+}
+
+/*
+ * saveSession (char* fname, char* hostname, int portno, char* username)
+ *
+ * This will store session_token of [username] for [hostname]:[portno] in
+ * [fname]. If there is no token, the file will be removed instead.
+ *
+ */
+void
+saveSession (char* fname, char* hostname, int portno, char* username) {
+	FILE* f;
+	int fd;
+
+	// got a token, for a username that can be stored as a single word?
+	if ((!session_token[0]) || (strpbrk (username, " \t\r\n") != NULL)) {
+		// no. ditch whatever is cached
+		unlink (fname);
+		return;
+	}
+
+	// only we may read this file
+	fd = open (fname, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		// this failed. never mind, we'll just log in next time
+		return;
+	if ((f = fdopen (fd, "w")) == NULL) {
+		close (fd);
+		return;
+	}
+
+	fprintf (f, "%s %d %s %s\n", hostname, portno, username, session_token);
+	fclose (f);
+}
+
 /*
  * usuage()
  *
@@ -102,17 +348,22 @@ main (int argc, char** argv, char** env) {
 	char* hostname = NULL;
 	char* username = NULL;
 	char* password = NULL;
+	char* sockname = NULL;
 	char* tmp;
 	int	  portno = -1;
 	int	  use_ident;
+	int	  use_session;
 	int		login_ok;
 	char ch;
 	char* home = getenv("HOME");
 	char* defcfile = (char*)malloc(strlen(home)+strlen(JUKECTL_DEFAULT_CONFIGFILE)+1);
 	char* cfile = defcfile;
+	char* sfile = (char*)malloc(strlen(home)+strlen(JUKECTL_SESSIONFILE)+1);
 
 	strcpy(cfile, home);
 	strcat(cfile, JUKECTL_DEFAULT_CONFIGFILE);
+	strcpy(sfile, home);
+	strcat(sfile, JUKECTL_SESSIONFILE);
 	int		cmd_begin;
 
 	// handle command line parameters
@@ -156,6 +407,7 @@ main (int argc, char** argv, char** env) {
 	config->get_string ("general", "username", &username);
 	config->get_string ("general", "password", &password);
 	config->get_value  ("general", "port",     &portno);
+	config->get_string ("general", "socket",   &sockname);
 
 	// fetch the status of ident authentication
 	use_ident = 0;
@@ -167,6 +419,21 @@ main (int argc, char** argv, char** env) {
 			use_ident = 1;
 	}
 
+	// fetch the status of session caching
+	use_session = 1;
+	if (config->get_string ("general", "use_session", &tmp) == CONFIGFILE_OK) {
+		// check whether sessions are to be cached
+		if ((!strcasecmp (tmp, "no")) || (!strcasecmp (tmp, "false")) ||
+		    (!strcasecmp (tmp, "off")))
+			// no. clear the flag
+			use_session = 0;
+	}
+
+	// using the local socket? then it takes the place of the host and port
+	if (sockname != NULL) {
+		hostname = sockname; portno = 0;
+	}
+
 	// ensure we have a configuration
 	if (hostname == NULL) {
 		fprintf (stderr, "jukectl: no hostname specified in configuration file\n");
@@ -187,49 +454,77 @@ main (int argc, char** argv, char** env) {
 	// create the host
 	netaddr = new IPV4ADDRESS();
 
-	// resolve the host
-	if (!netaddr->setAddr (hostname)) {
-		// this failed. complain
-		printf ("jukectl: cannot resolve '%s'\n", hostname);
-		return EXIT_FAILURE;
-	}
-
-	// fill the port number out
-	netaddr->setPort (portno);
-
 	// build a new client
 	client = new JUKECTLCLIENT();
 
-	// try to connect
-	if (!client->connect (netaddr)) {
-		// this failed. complain
-		printf ("jukectl: unable to connect to %s:%u\n", hostname, portno);
-		return EXIT_FAILURE;
-	}
+	// got a local socket?
+	if (sockname != NULL) {
+		// yes. try to connect to it
+		if (!client->connectLocal (sockname)) {
+			// this failed. complain
+			printf ("jukectl: unable to connect to %s\n", sockname);
+			return EXIT_FAILURE;
+		}
+	} else {
+		// no. resolve the host
+		if (!netaddr->setAddr (hostname)) {
+			// this failed. complain
+			printf ("jukectl: cannot resolve '%s'\n", hostname);
+			return EXIT_FAILURE;
+		}
 
-	// attach the client to the network
-	net->addService (client);
+		// fill the port number out
+		netaddr->setPort (portno);
+
+		// try to connect
+		if (!client->connect (netaddr)) {
+			// this failed. complain
+			printf ("jukectl: unable to connect to %s:%u\n", hostname, portno);
+			return EXIT_FAILURE;
+		}
+
+		// attach the client to the network
+		net->addService (client);
+	}
 
 	// fetch the welcome message
-	net->run();
+	runNetwork();
+
+	// got a cached session?
+	login_ok = 0;
+	if ((use_session) && (loadSession (sfile, hostname, portno, username))) {
+		// yes. try to resume it
+		client->sendf ("RESUME %s\r\n", session_token);
+		if (verbose)
+			printf (">> RESUME (xxx)\n");
+		runNetwork();
+		if (!error)
+			// this worked!
+			login_ok = 1;
+		else
+			// the session is gone. we'll get a new one
+			session_token[0] = 0;
+		error = 0;
+	}
 
 	// send the username
-	client->sendf ("USER %s\r\n", username);
-	if (verbose)
-		printf (">> USER %s\n", username);
-	net->run();
-	if (error) {
-		delete netaddr; delete net;
-		printf ("jukectl: username refused\n");
-		return EXIT_FAILURE;
+	if (!login_ok) {
+		client->sendf ("USER %s\r\n", username);
+		if (verbose)
+			printf (">> USER %s\n", username);
+		runNetwork();
+		if (error) {
+			delete netaddr; delete net;
+			printf ("jukectl: username refused\n");
+			return EXIT_FAILURE;
+		}
 	}
 
 	// need to use ident?
-	login_ok = 0;
-	if (use_ident) {
+	if ((!login_ok) && (use_ident)) {
 		// yes. try that
 		client->sendf ("IDENT\r\n");
-		net->run();
+		runNetwork();
 		if (!error)
 			// this worked!
 			login_ok = 1;
@@ -247,7 +542,7 @@ main (int argc, char** argv, char** env) {
 		client->sendf ("PASSWORD %s\r\n", password);
 		if (verbose)
 			printf (">> PASSWORD (xxx)\n");
-		net->run();
+		runNetwork();
 		if (error) {
 			delete netaddr; delete net;
 			printf ("jukectl: password refused\n");
@@ -267,7 +562,12 @@ main (int argc, char** argv, char** env) {
 
 	// handle the network
 	while (client->isActive())
-		net->run();
+		runNetwork();
+
+	// keep the session for next time
+	if (use_session)
+		saveSession (sfile, hostname, portno, username);
+	free (sfile);
 
 	// remove all objects
 	delete netaddr;
@@ -12,7 +12,20 @@
 
 class JUKECTLCLIENT : public NETCLIENT {
 public:
+	JUKECTLCLIENT();
+
 	void incoming();
+
+	int  connectLocal (const char* path);
+	void waitLocal();
+	int  sendf (const char* fmt, ...);
+	int  recv (char* buf, int len);
+	int  isActive();
+
+	inline int isLocal() { return local; }
+
+private:
+	int local, localfd;
 };
 
 #endif // __JUKECTL_H__
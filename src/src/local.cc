@@ -0,0 +1,286 @@
+/*
+ * local.cc - Jukebox local server code
+ *
+ */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "client.h"
+#include "jukebox.h"
+#include "local.h"
+
+/*
+ * LOCALSERVER::LOCALSERVER()
+ *
+ * This will construct the local server.
+ *
+ */
+LOCALSERVER::LOCALSERVER() {
+	fd = -1; numClients = 0;
+}
+
+/*
+ * LOCALSERVER::~LOCALSERVER()
+ *
+ * This will disconnect all clients and destroy the server. The socket is
+ * left in place, as we may no longer be allowed to remove it; create() takes
+ * care of it next time.
+ *
+ */
+LOCALSERVER::~LOCALSERVER() {
+	// the clients remove themselves
+	while (numClients > 0)
+		delete clients[numClients - 1];
+
+	if (fd >= 0)
+		close (fd);
+}
+
+/*
+ * LOCALSERVER::create (const char* path, int mode)
+ *
+ * This will start listening on socket [path], which gets permissions [mode].
+ * It will return 0 on failure or 1 on success.
+ *
+ */
+int
+LOCALSERVER::create (const char* path, int mode) {
+	struct sockaddr_un sun;
+	struct stat fs;
+
+	// will the path fit?
+	if (strlen (path) >= sizeof (sun.sun_path))
+		// no. bail out
+		return 0;
+	memset (&sun, 0, sizeof (sun));
+	sun.sun_family = AF_UNIX;
+	strcpy (sun.sun_path, path);
+
+	// is a previous incarnation still in the way?
+	if ((lstat (path, &fs) == 0) && (S_ISSOCK (fs.st_mode)))
+		// yes. get rid of it
+		unlink (path);
+
+	// create the socket
+	fd = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		// this failed. bail out
+		return 0;
+
+	// bind it and make it accessible
+	if ((bind (fd, (struct sockaddr*)&sun, sizeof (sun)) < 0) ||
+	    (chmod (path, mode) < 0) ||
+	    (listen (fd, LOCALSERVER_BACKLOG) < 0)) {
+		// this failed. bail out
+		close (fd); fd = -1;
+		return 0;
+	}
+
+	// never block on it
+	fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+	return 1;
+}
+
+/*
+ * LOCALSERVER::start()
+ *
+ * This will have the listening socket raise SIGIO on new connections.
+ *
+ */
+void
+LOCALSERVER::start() {
+	if (fd < 0)
+		return;
+
+	fcntl (fd, F_SETOWN, getpid());
+	fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_ASYNC);
+}
+
+/*
+ * LOCALSERVER::acceptClients()
+ *
+ * This will accept all waiting connections, and greet them.
+ *
+ */
+void
+LOCALSERVER::acceptClients() {
+	JUKECLIENT* c;
+	int cfd, uid;
+#ifdef SO_PEERCRED
+	struct ucred cred;
+	socklen_t len;
+#else
+	uid_t euid;
+	gid_t egid;
+#endif /* SO_PEERCRED */
+
+	while (1) {
+		// grab a connection
+		cfd = accept (fd, NULL, NULL);
+		if (cfd < 0)
+			// nothing left
+			return;
+
+		// do we have room for it?
+		if (numClients == LOCALSERVER_MAX_CLIENTS) {
+			// no. complain and hang up
+			logger->log (LOG_INFO, "Too many local clients, refusing connection");
+			close (cfd);
+			continue;
+		}
+
+		// who is this?
+		uid = -1;
+#ifdef SO_PEERCRED
+		len = sizeof (cred);
+		if (getsockopt (cfd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0)
+			uid = cred.uid;
+#else
+		if (getpeereid (cfd, &euid, &egid) == 0)
+			uid = euid;
+#endif /* SO_PEERCRED */
+
+		// never block, and tell us when something happens
+		fcntl (cfd, F_SETOWN, getpid());
+		fcntl (cfd, F_SETFL, fcntl (cfd, F_GETFL) | O_NONBLOCK | O_ASYNC);
+
+		// hook the client up
+		c = new JUKECLIENT (cfd, uid);
+		clients[numClients++] = c;
+
+		// are we willing to talk to it?
+		if (!server->admit (c)) {
+			// no. hang up
+			c->close();
+			delete c;
+			continue;
+		}
+
+		// be polite and greet the client
+		c->welcome();
+	}
+}
+
+/*
+ * LOCALSERVER::remove (JUKECLIENT* c)
+ *
+ * This will remove [c] from the list of clients.
+ *
+ */
+void
+LOCALSERVER::remove (JUKECLIENT* c) {
+	int i;
+
+	for (i = 0; i < numClients; i++)
+		if (clients[i] == c) {
+			// got it. move the last one in its place
+			clients[i] = clients[--numClients];
+			return;
+		}
+}
+
+/*
+ * LOCALSERVER::isClient (JUKECLIENT* c, unsigned int serial)
+ *
+ * This will return non-zero if [c] is still connected and has serial number
+ * [serial], or zero otherwise.
+ *
+ */
+int
+LOCALSERVER::isClient (JUKECLIENT* c, unsigned int serial) {
+	int i;
+
+	for (i = 0; i < numClients; i++)
+		if ((clients[i] == c) && (c->getSerial() == serial))
+			return 1;
+
+	// not found
+	return 0;
+}
+
+/*
+ * LOCALSERVER::poll()
+ *
+ * This will accept new connections, send whatever output is waiting and
+ * handle incoming data. Clients which have hung up are destroyed.
+ *
+ */
+void
+LOCALSERVER::poll() {
+	struct pollfd fds[LOCALSERVER_MAX_CLIENTS + 1];
+	JUKECLIENT* idx[LOCALSERVER_MAX_CLIENTS];
+	unsigned int serials[LOCALSERVER_MAX_CLIENTS];
+	JUKECLIENT* c;
+	int i, n, count, len;
+	char ch;
+
+	// are we listening at all?
+	if (fd < 0)
+		// no. bail out
+		return;
+
+	// see which sockets are ready. as handling a client may cause others to
+	// leave, remember who we are talking about
+	fds[0].fd = fd; fds[0].events = POLLIN; fds[0].revents = 0;
+	n = numClients;
+	for (i = 0; i < n; i++) {
+		idx[i] = clients[i]; serials[i] = clients[i]->getSerial();
+		fds[i + 1].fd = idx[i]->getLocalFD();
+		fds[i + 1].events = POLLIN | ((idx[i]->hasOutput()) ? POLLOUT : 0);
+		fds[i + 1].revents = 0;
+	}
+	if (::poll (fds, n + 1, 0) <= 0)
+		// nothing happened
+		return;
+
+	// handle the clients
+	for (i = 0; i < n; i++) {
+		if ((!fds[i + 1].revents) || (!isClient (idx[i], serials[i])))
+			continue;
+		c = idx[i];
+
+		// room to send more?
+		if (fds[i + 1].revents & POLLOUT)
+			// yes. do so
+			c->flush();
+
+		// anything to read?
+		if (!(fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+			// no. next
+			continue;
+
+		// read until there's nothing left, but give the others a chance too
+		for (count = 0; count < LOCALSERVER_MAX_READS; count++) {
+			// did the client hang up?
+			len = recv (c->getLocalFD(), &ch, 1, MSG_PEEK);
+			if ((len == 0) || ((len < 0) && (errno != EAGAIN) && (errno != EINTR))) {
+				// yes. get rid of it
+				delete c;
+				break;
+			}
+			if (len < 0)
+				// no, but there is nothing to read
+				break;
+
+			// handle the data. the client may leave while at it
+			c->incoming();
+			if (!isClient (c, serials[i]))
+				break;
+		}
+	}
+
+	// anyone new?
+	if (fds[0].revents)
+		// yes. take them
+		acceptClients();
+}
+
+/* vim:set ts=2 sw=2: */
@@ -0,0 +1,99 @@
+/*
+ * local.h
+ *
+ * This is the jukebox local (AF_UNIX) server.
+ *
+ */
+#include <sys/types.h>
+#include <stdlib.h>
+#include "client.h"
+
+#ifndef __LOCALSERVER_H__
+#define __LOCALSERVER_H__
+
+//! \brief LOCALSERVER_MAX_CLIENTS is the maximum number of local clients
+#define LOCALSERVER_MAX_CLIENTS		64
+
+//! \brief LOCALSERVER_BACKLOG is the number of connections waiting to be accepted
+#define LOCALSERVER_BACKLOG				16
+
+//! \brief LOCALSERVER_MAX_READS is the number of reads per client per poll()
+#define LOCALSERVER_MAX_READS			16
+
+//! \brief LOCALSERVER_DEFAULT_MODE is the default permissions of the socket
+#define LOCALSERVER_DEFAULT_MODE	0666
+
+/*!
+ * \class LOCALSERVER
+ * \brief This will serve clients on the same host over an AF_UNIX socket
+ *
+ * The connections are handled by the ordinary JUKECLIENT code. As the network
+ * library only knows about TCP, the sockets are handled by the main loop,
+ * which calls poll(); they raise SIGIO to break the network wait whenever
+ * something happens. The kernel tells us who is on the other end, which the
+ * IDENT command uses instead of asking an ident server.
+ */
+class LOCALSERVER {
+public:
+	//! \brief Constructs the server, which does not listen yet
+	LOCALSERVER();
+
+	//! \brief Disconnects all clients and destroys the server
+	~LOCALSERVER();
+
+	/*! \brief Starts listening
+	 *  \param path The filename of the socket
+	 *  \param mode The permissions of the socket
+	 *
+	 *  This has to be called before chroot()-ing. A stale socket at [path] is
+	 *  removed first. It will return zero on failure or non-zero on success.
+	 */
+	int create (const char* path, int mode);
+
+	/*! \brief Has SIGIO sent to us
+	 *
+	 *  This has to be called after daemonizing, as we will be another process
+	 *  by then.
+	 */
+	void start();
+
+	//! \brief Accepts new clients and handles the others, to be called from the main loop
+	void poll();
+
+	/*! \brief Forgets about a client, called when it is destroyed
+	 *  \param c The client
+	 */
+	void remove (JUKECLIENT* c);
+
+	//! \brief Returns the number of clients connected
+	inline int getNumClients() { return numClients; }
+
+	/*! \brief Returns a client
+	 *  \param i The index of the client, from 0 to getNumClients() - 1
+	 */
+	inline JUKECLIENT* getClient (int i) { return clients[i]; }
+
+private:
+	//! \brief Accepts all waiting connections
+	void acceptClients();
+
+	/*! \brief Checks whether a client is still around
+	 *  \param c The client
+	 *  \param serial The serial number it had
+	 *  \return Non-zero if it is, zero otherwise
+	 */
+	int isClient (JUKECLIENT* c, unsigned int serial);
+
+	//! \brief The listening socket, or -1
+	int				fd;
+
+	//! \brief The clients connected
+	JUKECLIENT*	clients[LOCALSERVER_MAX_CLIENTS];
+
+	//! \brief The number of clients connected
+	int				numClients;
+};
+
+#endif // __LOCALSERVER_H__
+
+/* vim:set ts=2 sw=2: */
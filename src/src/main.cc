@@ -2,6 +2,7 @@
  * main.cc - Jukebox Main Code
  *
  */
+#include <sys/time.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,13 +14,20 @@
 #include <libplusplus/network.h>
 #include <libplusplus/log.h>
 #include "config.h"
+#include "dbutil.h"
+#include "ident.h"
 #include "jukebox.h"
+#include "local.h"
 #include "player.h"
 #include "queue.h"
+#include "search.h"
 #include "server.h"
+#include "session.h"
+#include "user_cache.h"
 #include "user_sql.h"
 #include "user_ldap.h"
 #include "volume.h"
+#include "worker.h"
 
 char* configfile = CONFIG_FILENAME;
 
@@ -28,17 +36,36 @@ NETWORK* net;
 LOG* logger;
 JUKESERVER* server;
 QUEUE* queue;
-DATABASE* db;
+__thread DATABASE* db;
 PLAYER* player;
 USERS* users;
 VOLUME* volume;
+SESSIONS* sessions;
+USERS_CACHE* usercache = NULL;
+WORKERS* workers;
+IDENT* ident;
+LOCALSERVER* localserver;
+SEARCH* search;
 
 int quit = 0;
+volatile sig_atomic_t reload = 0;
 
 void sigchld_handler(int i) { player->launch(); } 
 void sigint_handler(int i) { quit = 1; }
+void sigwake_handler(int i) { }
 
-void sighup_handler(int i) {
+void sighup_handler(int i) { reload = 1; }
+
+/*
+ * reloadConfig()
+ *
+ * This will reload the configuration file. The worker threads are paused
+ * first, as they read the configuration and use the user backends, which
+ * are reconfigured as well.
+ *
+ */
+void
+reloadConfig() {
 	JUKECONFIG* newconfig;
 
 	// load the configuration
@@ -50,10 +77,20 @@ void sighup_handler(int i) {
 		return;
 	}
 
-	// wonderful, this worked. ditch the old one and use this one
+	// wonderful, this worked. wait until nobody looks at the old one
+	workers->pause();
+
+	// ditch the old one and use this one
 	delete config;
 	config = newconfig;
 	logger->log (LOG_INFO, "Configuration file successfully reloaded");
+
+	// the user cache may be wrong by now, have it start over
+	if (usercache != NULL)
+		usercache->reloadConfig();
+
+	// back to work
+	workers->resume();
 }
 
 /*
@@ -157,7 +194,6 @@ int
 main (int argc, char** argv) {
 	int ch;
 	int dflag = 0;
-	USERS* tmpUsers;
 	char* logtype = NULL;
 
 	#ifdef OS_FREEBSD
@@ -219,6 +255,25 @@ main (int argc, char** argv) {
 		return EXIT_FAILURE;
 	}
 
+	// some things have to be done in the dialect of the database
+	DBUTIL::setType (config->getDatabaseType());
+
+	// create the worker pool and connect its threads to the database
+	workers = new WORKERS (config->getWorkers());
+	if (!workers->init())
+		// this failed. notify the user (but don't quit)
+		logger->log (LOG_INFO, "worker pool failed to initialize, running jobs in the main loop");
+
+	// create the session table (needs the random device, so before chroot)
+	sessions = new SESSIONS (config->getSessionMax());
+
+	// create the local server. the socket lives outside the chroot
+	localserver = new LOCALSERVER();
+	if ((config->getLocalSocket() != NULL) &&
+	    (!localserver->create (config->getLocalSocket(), config->getLocalSocketMode())))
+		// this failed. notify the user (but don't quit)
+		logger->log (LOG_INFO, "Unable to bind local server to %s, disabling it", config->getLocalSocket());
+
 	// do we have to chroot?
 	if (config->chroot != NULL) {
 		// yes. do it
@@ -261,6 +316,12 @@ main (int argc, char** argv) {
 	// create the player
 	player = new PLAYER();
 
+	// create the ident client
+	ident = new IDENT();
+
+	// create the search index manager
+	search = new SEARCH();
+
 	// create the backends
 	users = loadBackends();
 	if (users == NULL) {
@@ -269,6 +330,10 @@ main (int argc, char** argv) {
 		return 1;
 	}
 
+	// put the cache in front of them
+	usercache = new USERS_CACHE (users);
+	users = usercache;
+
 	// create the server
 	server = new JUKESERVER();
 	if (!server->create (config->port)) {
@@ -295,34 +360,76 @@ main (int argc, char** argv) {
 			logger->log (LOG_INFO, "Unable to daemonize, running on foreground\n");
 #endif /* OS_SOLARIS */
 
+	// start the worker threads (they would not survive daemonizing)
+	workers->start();
+
+	// have the search index built
+	search->start();
+
+	// have the local server wake us up, as we may be another process by now
+	localserver->start();
+
 	// hook hangup, child, interrupt and terminate signals to us
 	signal (SIGHUP, sighup_handler);
 	signal (SIGCHLD, sigchld_handler);
 	signal (SIGINT, sigint_handler);
 	signal (SIGTERM, sigint_handler);
 
+	// the worker threads, ident lookups and local clients wake us up when they have news. as
+	// a wakeup may just miss the network wait, the ticker also does every second
+	signal (WORKERS_SIGNAL, sigwake_handler);
+	signal (SIGIO, sigwake_handler);
+	signal (JUKESERVER_TICK_SIGNAL, sigwake_handler);
+	server->startTicker();
+
 	// go!
 	player->play();
 
 	// handle the network
 	logger->log (LOG_INFO, "Jukebox doing main loop");
-	while (!quit)
+	while (!quit) {
 		net->run();
 
+		// were we asked to reload the configuration?
+		if (reload) {
+			// yes. do so
+			reload = 0;
+			reloadConfig();
+		}
+
+		// handle the local clients
+		localserver->poll();
+
+		// get rid of clients who are idle or don't keep up
+		server->expire();
+
+		// tell the clients what happened
+		server->flushUpdates();
+
+		// advance the ident lookups
+		ident->poll();
+
+		// keep the search index up to date
+		search->poll();
+
+		// report finished jobs back to the clients
+		workers->drain();
+	}
+
 	// bye!
 	logger->log (LOG_INFO, "Jukebox exiting");
 
 	// remove all objects
+	delete localserver;
+	delete ident;
+	delete workers;
+	delete search;
 	delete volume;
 	delete player;
 	delete server;
 	delete net;	
 	delete queue;
-	while (users) {
-		tmpUsers = users->getNextDB();
-		delete users;
-		users = tmpUsers;
-	}
+	delete sessions;
 	delete users;
 	delete db;
 	delete logger;
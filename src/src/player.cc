@@ -199,7 +199,7 @@ PLAYER::launch() {
 
 	// inform all clients
 	snprintf (tmp, sizeof (tmp) - 1, JUKECLIENT_UPDATE_SONG, 'N', artist, title);
-	server->sendUpdate (tmp);
+	server->sendUpdate (JUKECLIENT_TOPIC_SONG, tmp, 1);
 
 	// final logging
 	logger->log (LOG_INFO, "Now playing %s - %s", artist, title);
@@ -7,6 +7,7 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include "dbutil.h"
 #include "jukebox.h"
 #include "queue.h"
 #include "track.h"
@@ -22,7 +23,81 @@ QUEUE::QUEUE() {
 	db->execute ("DELETE FROM queue WHERE playtime IS NOT NULL");
 
 	// not random-playing
-	random = 0;
+	random = 0; version = 0; logCount = 0;
+}
+
+/*
+ * QUEUE::record (int type, int playid, int trackid)
+ *
+ * This will bump the version and remember change [type] of queue item
+ * [playid], holding track [trackid].
+ *
+ */
+void
+QUEUE::record (int type, int playid, int trackid) {
+	QUEUE_DELTA* d;
+
+	version++;
+	d = &log[version % QUEUE_LOG_SIZE];
+	d->version = version; d->type = type;
+	d->playid = playid; d->trackid = trackid;
+	if (logCount < QUEUE_LOG_SIZE)
+		logCount++;
+}
+
+/*
+ * QUEUE::hasDeltasSince (unsigned int since)
+ *
+ * This will return 1 if all changes after version [since] are in the log, or
+ * 0 if not.
+ *
+ */
+int
+QUEUE::hasDeltasSince (unsigned int since) {
+	return ((since <= version) && (version - since <= (unsigned int)logCount)) ? 1 : 0;
+}
+
+/*
+ * QUEUE::getDelta (unsigned int v)
+ *
+ * This will return the change which resulted in version [v], or NULL if it
+ * is not in the log.
+ *
+ */
+QUEUE_DELTA*
+QUEUE::getDelta (unsigned int v) {
+	QUEUE_DELTA* d = &log[v % QUEUE_LOG_SIZE];
+
+	return ((v > 0) && (hasDeltasSince (v - 1)) && (d->version == v)) ? d : NULL;
+}
+
+/*
+ * QUEUE::lastPlayID (int trackid)
+ *
+ * This will return the ID of the queue item just inserted for track
+ * [trackid], or zero if it cannot be found.
+ *
+ */
+int
+QUEUE::lastPlayID (int trackid) {
+	DBRESULT* res;
+	int id;
+
+	// can the database tell?
+	id = DBUTIL::lastInsertID ("queue");
+	if (id != 0)
+		// yes. that's it
+		return id;
+
+	// no. look it up
+	res = db->query ("SELECT MAX(id) FROM queue WHERE trackid=#", trackid);
+	if (res == NULL)
+		// this failed. too bad
+		return 0;
+	if (res->numRows() > 0)
+		id = res->fetchColumnAsInteger (0);
+	delete res;
+	return id;
 }
 
 /*
@@ -72,6 +147,7 @@ QUEUE::getNextTrackID(int* trackid, int* playid) {
 		time (&curtime);
 		strftime (now, sizeof (now), "%Y-%m-%d %H:%M:%S", localtime (&curtime));
 		db->execute ("INSERT INTO queue (trackid,timestamp) VALUES (#,?)", tid, now);
+		record (QUEUE_DELTA_ADDED, lastPlayID (tid), tid);
 	}
 
 	// fetch the information
@@ -112,6 +188,7 @@ QUEUE::markPlaying (int id) {
 	time (&curtime);
 	strftime (now, sizeof (now), "%Y-%m-%d %H:%M:%S", localtime (&curtime));
 	db->execute ("UPDATE queue SET playtime=? WHERE id=#", now, id);
+	record (QUEUE_DELTA_PLAYING, id, 0);
 }
 
 /*
@@ -124,6 +201,7 @@ void
 QUEUE::markNotPlaying (int id) {
 	// mark the song as being played
 	db->execute ("UPDATE queue SET playtime=NULL WHERE id=#",id);
+	record (QUEUE_DELTA_NOTPLAYING, id, 0);
 }
 
 /*
@@ -136,6 +214,7 @@ void
 QUEUE::remove (int id) {
 	// bye!
 	db->execute ("DELETE FROM queue WHERE id=#",id);
+	record (QUEUE_DELTA_REMOVED, id, 0);
 }
 
 /*
@@ -161,6 +240,7 @@ QUEUE::setRandom (int on) {
 	if (random) {
 		// yes. kill the playlist
 		db->execute ("DELETE FROM queue");
+		record (QUEUE_DELTA_CLEARED, 0, 0);
 	}
 }
 
@@ -238,6 +318,7 @@ void
 QUEUE::clear() {
 	// kill the playlist
 	db->execute ("DELETE FROM queue");
+	record (QUEUE_DELTA_CLEARED, 0, 0);
 }
 
 /*
@@ -261,6 +342,7 @@ QUEUE::enqueueTrack (USER* user, int id) {
 		time (&curtime);
 		strftime (now, sizeof (now), "%Y-%m-%d %H:%M:%S", localtime (&curtime));
 		db->execute ("INSERT INTO queue (trackid,timestamp) VALUES (#,?)", track->getID(), now);
+		record (QUEUE_DELTA_ADDED, lastPlayID (track->getID()), track->getID());
 
 		// bye bye
 		delete track;
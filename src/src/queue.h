@@ -20,6 +20,31 @@
 //! \brief QUEUE_MAX_FILENAME_LEN is the maximum length of a filename
 #define QUEUE_MAX_FILENAME_LEN 1024
 
+//! \brief QUEUE_LOG_SIZE is the number of changes remembered
+#define QUEUE_LOG_SIZE 512
+
+// QUEUE_DELTA_xxx are the kinds of changes made to the queue
+#define QUEUE_DELTA_ADDED				0
+#define QUEUE_DELTA_REMOVED			1
+#define QUEUE_DELTA_PLAYING			2
+#define QUEUE_DELTA_NOTPLAYING	3
+#define QUEUE_DELTA_CLEARED			4
+
+/*!
+ * \struct QUEUE_DELTA
+ * \brief A single change made to the queue
+ */
+struct QUEUE_DELTA {
+	//! \brief The version of the queue this change resulted in
+	unsigned int version;
+
+	//! \brief The QUEUE_DELTA_xxx kind of change
+	int type;
+
+	//! \brief The queue item and track involved, zero if not applicable
+	int playid, trackid;
+};
+
 /*!
  * \class QUEUE
  * \brief This will manage the queue.
@@ -127,8 +152,51 @@ public:
 	 */
 	int enqueueAlbum (USER* user, int id);
 
+	/*! \brief Returns the version of the queue
+	 *
+	 * Every change increases the version by one, so comparing it with an
+	 * earlier value tells whether, and how often, the queue changed.
+	 */
+	inline unsigned int getVersion() { return version; }
+
+	/*! \brief Checks whether the changes after a version are still known
+	 *  \param since The version
+	 *
+	 * This will return non-zero if getDelta() can supply every version after
+	 * [since], or zero if too much happened since.
+	 */
+	int hasDeltasSince (unsigned int since);
+
+	/*! \brief Returns the change which resulted in a version
+	 *  \param v The version
+	 *
+	 * This will return NULL if the change is not known (anymore).
+	 */
+	QUEUE_DELTA* getDelta (unsigned int v);
+
 private:
+	/*! \brief Records a change
+	 *  \param type The QUEUE_DELTA_xxx kind of change
+	 *  \param playid The queue item involved
+	 *  \param trackid The track involved
+	 */
+	void record (int type, int playid, int trackid);
+
+	/*! \brief Returns the ID of the queue item last inserted, or zero
+	 *  \param trackid The track which was inserted
+	 */
+	int lastPlayID (int trackid);
+
 	int random;
+
+	//! \brief The version of the queue
+	unsigned int version;
+
+	//! \brief The last QUEUE_LOG_SIZE changes, indexed by version
+	QUEUE_DELTA log[QUEUE_LOG_SIZE];
+
+	//! \brief The number of changes in the log
+	int logCount;
 };
 
 #endif // __QUEUE_H__
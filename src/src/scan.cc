@@ -4,8 +4,14 @@
  */
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <ctype.h>
+#include <sys/inotify.h>
 #include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
 #include <limits.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/signal.h>
@@ -21,21 +27,233 @@
 #include <libplusplus/log.h>
 #include "artist.h"
 #include "album.h"
+#include "audioinfo.h"
+#include "change.h"
 #include "config.h"
+#include "dbutil.h"
+#include "fileio.h"
+#include "fold.h"
+#include "fingerprint.h"
 #include "jukebox.h"
 #include "player.h"
+#include "tagreader.h"
+#include "utf8.h"
 #include "track.h"
 #include "vcedit.h"
 
 JUKECONFIG* config;
 LOG* logger;
 JUKESERVER* server;
-DATABASE* db;
+__thread DATABASE* db;
+
+// SCAN_QUEUE_SIZE is the number of tracks which may wait for the writer
+#define SCAN_QUEUE_SIZE		256
+
+// SCAN_MAX_THREADS is the maximum number of scanning threads
+#define SCAN_MAX_THREADS	64
+
+// SCAN_INSERT_ROWS is the most tracks added by a single query, see insertTracks()
+#define SCAN_INSERT_ROWS	8
+
+// SCAN_DEFAULT_BATCH_SIZE is the default number of changes per transaction
+#define SCAN_DEFAULT_BATCH_SIZE	1000
+
+// SCAN_WATCH_QUIET is the number of seconds without changes before they are applied
+#define SCAN_WATCH_QUIET	2
+
+// SCAN_WATCH_MAX_DELAY is the maximum number of seconds changes are held back
+#define SCAN_WATCH_MAX_DELAY	10
+
+// SCAN_WATCH_RESCAN is the number of seconds between rescans if not all is watched
+#define SCAN_WATCH_RESCAN	300
+
+// SCAN_EVENT_xxx are the changes seen while watching
+#define SCAN_EVENT_CHANGED	0
+#define SCAN_EVENT_MOVED		1
+#define SCAN_EVENT_GONE			2
+
+// SCAN_FORMAT_xxx are the kinds of files which are scanned
+#define SCAN_FORMAT_NONE		0
+#define SCAN_FORMAT_MP3			1
+#define SCAN_FORMAT_OGG			2
+#define SCAN_FORMAT_MODULE	3
+#define SCAN_FORMAT_RAD			4
+#define SCAN_FORMAT_RAW			5
+#define SCAN_FORMAT_ADLIB		6
+#define SCAN_FORMAT_SID			7
+#define SCAN_FORMAT_FLAC		8
+
+// SCAN_BATCH_SIZE is the number of directory entries looked at in one go
+#define SCAN_BATCH_SIZE		FILEIO_RING_SIZE
+
+// SCAN_HEADER_LEN is the most of a file read to find its title
+#define SCAN_HEADER_LEN		(0x12 + TRACK_MAX_TITLE_LEN)
+
+// SCAN_HASH_SIZE is the number of buckets of known files, must be a power of two
+#define SCAN_HASH_SIZE		65536
+
+// SCAN_KEY_LEN is the size of a normalised artist or album name, or its key
+#define SCAN_KEY_LEN			(2 * ARTIST_MAX_LEN)
+
+/*
+ * SCAN_SIGNATURE is what stat() tells about a file. If none of it changed
+ * since the last scan, neither did the file. The fingerprint and the details
+ * of the audio are only looked at once the file turns out to have changed.
+ */
+struct SCAN_SIGNATURE {
+	long long	size, mtime, inode, device;
+	char			fingerprint[FINGERPRINT_LEN + 1];
+	AUDIOINFO	audio;
+};
+
+/*
+ * SCAN_FILE is the file of a track in the database, along with the track as
+ * it was when loaded. Every thread may look at the name and signature, which
+ * never change while scanning, and flag the file as seen with an atomic
+ * store; the rest belongs to the writer.
+ */
+struct SCAN_FILE {
+	char*						fname;
+	SCAN_SIGNATURE	sig;
+	int							seen, id, artistid, albumid, year, trackno;
+	char*						title;
+	SCAN_FILE*			next;
+};
+
+/*
+ * SCAN_NAME is an artist or album in the database. Albums are known by their
+ * name along with the ID of their artist, the parent. The name is kept as
+ * UTF-8, along with its case-folded key, which is what it's hashed by.
+ */
+struct SCAN_NAME {
+	char*				name;
+	char*				key;
+	int					parent, id;
+	SCAN_NAME*	next;
+};
+
+/*
+ * SCAN_INSERT is a new track, waiting to be added along with a few others.
+ * The 64-bit parts of the signature are kept as text, which is how they are
+ * passed to the database.
+ */
+struct SCAN_INSERT {
+	char*						fname;
+	char*						title;
+	int							artistid, albumid, year, trackno;
+	SCAN_SIGNATURE	sig;
+	char						size[DBUTIL_BIGINT_LEN], mtime[DBUTIL_BIGINT_LEN];
+	char						inode[DBUTIL_BIGINT_LEN], device[DBUTIL_BIGINT_LEN];
+};
+
+/*
+ * SCAN_EVENT is a change seen while watching, waiting to be applied. Only
+ * moves have a [from].
+ */
+struct SCAN_EVENT {
+	int		type;
+	char*	path;
+	char*	from;
+};
+
+/*
+ * SCAN_ITEM is a track parsed by a scanning thread, waiting to be written to
+ * the database.
+ */
+struct SCAN_ITEM {
+	char*	fname;
+	char*	title;
+	char*	artist;
+	char*	album;
+	int		year, trackno;
+	SCAN_SIGNATURE	sig;
+};
+
+/*
+ * SCAN_TAGS is where the tags of a file are read to.
+ */
+struct SCAN_TAGS {
+	char		title[TRACK_MAX_TITLE_LEN];
+	char		artist[ARTIST_MAX_LEN];
+	char		album[ALBUM_MAX_LEN];
+	TAGINFO	info;
+};
+
+/*
+ * SCAN_BATCH is a batch of directory entries, looked at in one go. Only the
+ * headers of the files which changed are read.
+ */
+struct SCAN_BATCH {
+	FILEIO_REQUEST	req[SCAN_BATCH_SIZE];
+	SCAN_SIGNATURE	sig[SCAN_BATCH_SIZE];
+	int							format[SCAN_BATCH_SIZE];
+	char						hdr[SCAN_BATCH_SIZE][SCAN_HEADER_LEN];
+	int							num;
+};
+
+/*
+ * SCAN_WALKER is a scanning thread, along with the directories it has yet to
+ * scan. It takes the directory it found last from its own list; once that is
+ * empty, it steals the oldest directory of another thread.
+ */
+struct SCAN_WALKER {
+	pthread_t				thread;
+	pthread_mutex_t	lock;
+	char**					dirs;
+	int							numDirs, dirSize;
+	int							index, demo, running;
+};
 
 char twirl[] = "/-\\|/-\\|";
 int tpos = 0;
 int verbose = 0, quiet = 0;
-int numUpdated = 0, numNew = 0, skip = 0;
+int numUpdated = 0, numNew = 0, numUnchanged = 0, skip = 0;
+int numMoved = 0, numRemoved = 0, scanErrors = 0;
+
+// number of changes made to the database; without any, the change log is left alone
+unsigned int numChanges = 0;
+
+// are we watching for changes? the walkers are done by then
+int watching = 0;
+
+// the inotify descriptor, the directory of every watch, and whether any are missing
+int watchFD = -1, watchSize = 0, watchLimited = 0;
+char** watchDirs = NULL;
+
+// the changes waiting to be applied, and the move away waiting for its arrival
+SCAN_EVENT* events = NULL;
+int numEvents = 0, eventSize = 0;
+char* moveFrom = NULL;
+int moveIsDir = 0;
+uint32_t moveCookie = 0;
+
+// flags: did inotify lose track, and is it time to stop?
+int needRescan = 0;
+volatile sig_atomic_t stopWatching = 0;
+
+// the files known to the database and the ones added by this scan, by name
+SCAN_FILE* knownFiles[SCAN_HASH_SIZE];
+SCAN_FILE* addedFiles[SCAN_HASH_SIZE];
+
+// the artists and albums known to the database, by name
+SCAN_NAME* knownArtists[SCAN_HASH_SIZE];
+SCAN_NAME* knownAlbums[SCAN_HASH_SIZE];
+
+// the scanning threads, if any, and whether they hand their tracks to a writer
+int numThreads = 1, queueTracks = 0;
+SCAN_WALKER* walkers = NULL;
+
+// the number of directories queued or being scanned, and the number queued
+int pendingDirs = 0, queuedDirs = 0;
+pthread_mutex_t idleLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t idleCond = PTHREAD_COND_INITIALIZER;
+
+// the tracks waiting for the writer, and the number of threads feeding it
+SCAN_ITEM* itemQueue[SCAN_QUEUE_SIZE];
+int itemHead = 0, itemCount = 0, activeWalkers = 0;
+pthread_mutex_t itemLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t itemNotEmpty = PTHREAD_COND_INITIALIZER;
+pthread_cond_t itemNotFull = PTHREAD_COND_INITIALIZER;
 
 int tq_title = 1;
 int tq_artist = 1;
@@ -44,6 +262,18 @@ int tq_year = 1;
 int tq_trackno = 1;
 int tq_required = 0;
 
+int catalog_log_size = CHANGE_DEFAULT_LOG_SIZE;
+
+// the changes made since the last commit, and the new tracks yet to be added
+int batchSize = SCAN_DEFAULT_BATCH_SIZE, batchChanges = 0;
+SCAN_INSERT* newTracks = NULL;
+int numNewTracks = 0;
+
+// the queries adding 1, 2, 4, ... SCAN_INSERT_ROWS tracks at once, and
+// logging those tracks as new
+char* insertQueries[4];
+char* logQueries[4];
+
 char* module_artist = "<MODULES>";
 char* module_album = "<MODULES>";
 char* adlib_artist = "<MODULES>";
@@ -52,693 +282,2478 @@ char* sid_artist = "<SID>";
 char* sid_album = "<SID>";
 
 /*
- * getArtist (char* name)
+ * hashName (const char* name, int parent)
  *
- * This will return the ID of artist [name]. The artist will be created if
- * needed.
+ * This will return the bucket of [name] of an object of [parent], using the
+ * FNV-1a hash. Case is ignored, so names which only differ in case end up in
+ * the same bucket.
+ *
+ */
+unsigned int
+hashName (const char* name, int parent) {
+	unsigned int h = 2166136261U ^ (unsigned int)parent;
+
+	while (*name)
+		h = (h ^ (unsigned int)tolower ((unsigned char)*name++)) * 16777619U;
+	return h & (SCAN_HASH_SIZE - 1);
+}
+
+/*
+ * sameName (SCAN_NAME* n, const char* name, const char* key)
+ *
+ * This will return non-zero if artist or album [n] is the same as [name]
+ * with key [key] as far as the database is concerned. MySQL ignores case by
+ * default.
  *
  */
 int
-getArtist (char* name) {
-	ARTIST* a;
-	int id;
+sameName (SCAN_NAME* n, const char* name, const char* key) {
+	if (DBUTIL::getType() == DBUTIL_TYPE_MYSQL)
+		return !strcmp (n->key, key);
+	return !strcmp (n->name, name);
+}
 
-	try {
-		// try to fetch the artist
-		a = new ARTIST (name);
-		id = a->getID();
-		delete a;
-		return id;
-	} catch (ArtistException e) {
-		// no such artist. create one
-		a = new ARTIST();
-		a->setName (name);
-		a->update();
-		id = a->getID();
-		delete a;
+/*
+ * findName (SCAN_NAME** table, const char* name, int parent)
+ *
+ * This will return the object [name] of [parent] in [table], or NULL if it
+ * isn't there.
+ *
+ */
+SCAN_NAME*
+findName (SCAN_NAME** table, const char* name, int parent) {
+	char norm[SCAN_KEY_LEN], key[SCAN_KEY_LEN];
+	SCAN_NAME* n;
+
+	normalizeText (name, norm, sizeof (norm));
+	foldCase (norm, key, sizeof (key));
+	for (n = table[hashName (key, parent)]; n != NULL; n = n->next)
+		if ((n->parent == parent) && (sameName (n, norm, key)))
+			return n;
+	return NULL;
+}
 
-		// be verbose if needed
-		if (verbose > 1)
-			printf ("New artist '%s'[%u]\n", name, id);
-		return id;
+/*
+ * addName (SCAN_NAME** table, const char* name, int parent, int id)
+ *
+ * This will add object [id] named [name] of [parent] to [table]. It will
+ * return zero on failure or non-zero on success.
+ *
+ */
+int
+addName (SCAN_NAME** table, const char* name, int parent, int id) {
+	char norm[SCAN_KEY_LEN], key[SCAN_KEY_LEN];
+	SCAN_NAME* n = (SCAN_NAME*)malloc (sizeof (SCAN_NAME));
+	unsigned int h;
+
+	// did this work?
+	if (n == NULL)
+		// no. bail out
+		return 0;
+
+	// names stored before everything was UTF-8 may not be
+	normalizeText (name, norm, sizeof (norm));
+	foldCase (norm, key, sizeof (key));
+	h = hashName (key, parent);
+	n->name = strdup (norm); n->key = strdup (key);
+	if ((n->name == NULL) || (n->key == NULL)) {
+		free (n->name); free (n->key); free (n);
+		return 0;
 	}
+	n->parent = parent; n->id = id;
+	n->next = table[h]; table[h] = n;
+	return 1;
 }
 
 /*
- * getAlbum (char* name, int artistid)
+ * findFile (SCAN_FILE** table, const char* fname)
  *
- * This will return the ID of album [name] and artist [artistid]. The album
- * will be created if needed.
+ * This will return file [fname] in [table], or NULL if it isn't there.
  *
  */
-int
-getAlbum (char* name, int artistid) {
-	ALBUM* a;
-	int id;
+SCAN_FILE*
+findFile (SCAN_FILE** table, const char* fname) {
+	SCAN_FILE* f;
+
+	for (f = table[hashName (fname, 0)]; f != NULL; f = f->next)
+		if (!strcmp (f->fname, fname))
+			return f;
+	return NULL;
+}
 
-	try {
-		// try to fetch the artist
-		a = new ALBUM (name, artistid);
-		id = a->getID();
-		delete a;
-		return id;
-	} catch (AlbumException e) {
-		// no such artist. create one
-		a = new ALBUM();
-		a->setName (name);
-		a->setArtistID (artistid);
-		a->update();
-		id = a->getID();
-		delete a;
+/*
+ * addFile (SCAN_FILE** table, const char* fname, SCAN_SIGNATURE* sig)
+ *
+ * This will add file [fname] with signature [sig] to [table], and return it
+ * so the track can be filled in. It will return NULL on failure.
+ *
+ */
+SCAN_FILE*
+addFile (SCAN_FILE** table, const char* fname, SCAN_SIGNATURE* sig) {
+	unsigned int h = hashName (fname, 0);
+	SCAN_FILE* f = (SCAN_FILE*)malloc (sizeof (SCAN_FILE));
 
-		// be verbose if needed
-		if (verbose > 1)
-			printf ("New album '%s'[%u]\n", name, id);
-		return id;
+	// did this work?
+	if (f == NULL)
+		// no. bail out
+		return NULL;
+	f->fname = strdup (fname);
+	if (f->fname == NULL) {
+		free (f);
+		return NULL;
 	}
+	f->sig = *sig; f->title = NULL; f->seen = 0;
+	f->id = f->artistid = f->albumid = f->year = f->trackno = 0;
+	f->next = table[h]; table[h] = f;
+	return f;
 }
 
 /*
- * addTrack (char* fname, char* title, char* artist, char* album, int year,
- *           int demo)
+ * fillFile (SCAN_FILE* f, TRACK* t)
  *
- * This will add the track to the database. If [demo] is non-zero, changes will
- * not actually be committed.
+ * This will remember track [t] as the track of file [f].
  *
  */
 void
-addTrack (char* fname, char* title, char* artist, char* album, int year, int trackno, int demo) {
-	TRACK* t;
+fillFile (SCAN_FILE* f, TRACK* t) {
+	if (f->title)
+		free (f->title);
+	f->id = t->getID(); f->title = strdup (t->getTitle());
+	f->artistid = t->getArtistID(); f->albumid = t->getAlbumID();
+	f->year = t->getYear(); f->trackno = t->getTrackNo();
+}
 
-	// demo mode?
-	if (demo) {
-		// yes. try to fetch the track
-		try {
-			t = new TRACK (fname);
-			delete t;
+/*
+ * freeFile (SCAN_FILE* f)
+ *
+ * This will free known file [f].
+ *
+ */
+void
+freeFile (SCAN_FILE* f) {
+	if (f->title)
+		free (f->title);
+	free (f->fname); free (f);
+}
 
-			// be verbose if needed
-			if (verbose > 2)
-				printf ("Would update track [%s]: title '%s', artist '%s', album '%s', year %u trackno %u\n", fname, title, artist, album, year, trackno);
-		} catch (TrackException e) {
-			// be verbose if needed
-			if (verbose > 2)
-				printf ("Would add track [%s]: title '%s', artist '%s', album '%s', year %u trackno %u\n", fname, title, artist, album, year, trackno);
+/*
+ * loadCatalog()
+ *
+ * This will load all artists, albums and track files in the database, so
+ * they needn't be looked up one by one. It will return zero on failure or
+ * non-zero on success.
+ *
+ */
+int
+loadCatalog() {
+	ARTIST* artist = new ARTIST();
+	ALBUM* album = new ALBUM();
+	TRACK* t = new TRACK();
+	SCAN_SIGNATURE sig;
+	SCAN_FILE* f;
+	int ok = 1;
+
+	while ((ok) && (artist->fetchNext()))
+		ok = addName (knownArtists, artist->getName(), 0, artist->getID());
+	while ((ok) && (album->fetchNext()))
+		ok = addName (knownAlbums, album->getName(), album->getArtistID(), album->getID());
+	while ((ok) && (t->fetchNext())) {
+		sig.size = t->getFileSize(); sig.mtime = t->getModifyTime();
+		sig.inode = t->getInode(); sig.device = t->getDevice();
+		strcpy (sig.fingerprint, t->getFingerprint());
+		sig.audio.duration = t->getDuration(); sig.audio.bitrate = t->getBitrate();
+		sig.audio.samplerate = t->getSampleRate();
+		f = addFile (knownFiles, t->getFilename(), &sig);
+		if (f == NULL) {
+			// out of memory. too bad
+			ok = 0;
+			break;
 		}
-
-		// later
-		return;
+		fillFile (f, t);
 	}
 
-	int artistid = getArtist (artist);
-	int albumid = getAlbum (album, artistid);
-	try {
-		t = new TRACK (fname);
-		t->setTitle (title);
-		t->setArtistID (artistid);
-		t->setAlbumID (albumid);
-		t->setYear (year);
-		t->setTrackNo (trackno);
-		t->update();
-		delete t;
-		numUpdated++;
-
-		// be verbose if needed
-		if (verbose > 2)
-			printf ("Updated track [%s]: title '%s', artist '%s'[%u], album '%s'[%u], year %u, trackno %u\n", fname, title, artist, artistid, album, albumid, year, trackno);
-	} catch (TrackException e) {
-		t = new TRACK();
-		t->setFilename (fname);
-		t->setTitle (title);
-		t->setArtistID (artistid);
-		t->setAlbumID (albumid);
-		t->setYear (year);
-		t->setTrackNo (trackno);
-		t->update();
-		delete t;
-		numNew++;
+	delete t;
+	delete album;
+	delete artist;
+	return ok;
+}
 
-		// be verbose if needed
-		if (verbose > 1)
-			printf ("New track [%s]: title '%s', artist '%s'[%u], album '%s'[%u], year %u, trackno %u\n", fname, title, artist, artistid, album, albumid, year, trackno);
-	} 
+/*
+ * freeCatalog()
+ *
+ * This will forget all artists, albums and files known.
+ *
+ */
+void
+freeCatalog() {
+	SCAN_NAME* n;
+	SCAN_FILE* f;
+	int i;
+
+	for (i = 0; i < SCAN_HASH_SIZE; i++) {
+		while ((n = knownArtists[i]) != NULL) {
+			knownArtists[i] = n->next;
+			free (n->name); free (n->key); free (n);
+		}
+		while ((n = knownAlbums[i]) != NULL) {
+			knownAlbums[i] = n->next;
+			free (n->name); free (n->key); free (n);
+		}
+		while ((f = knownFiles[i]) != NULL) {
+			knownFiles[i] = f->next;
+			freeFile (f);
+		}
+		while ((f = addedFiles[i]) != NULL) {
+			addedFiles[i] = f->next;
+			free (f->fname); free (f);
+		}
+	}
 }
 
-#ifdef MP3_SUPPORT
 /*
- * scanFile_MP3 (char* file, int demo)
+ * adoptAddedFiles()
  *
- * This will scan file [file] for ID3 tags and add it. If [demo] is non-zero,
- * changes will not actually be committed.
+ * This will move the files added by the scan to the known files, along with
+ * their tracks. New tracks may have been added in bulk, so their IDs have to
+ * be looked up.
  *
  */
 void
-scanFile_MP3 (char* file, int demo) {
-	char title[TRACK_MAX_TITLE_LEN];
-	char artist[ARTIST_MAX_LEN];
-	char album[ALBUM_MAX_LEN];
-	char tmp[64];
-	int year = 0;
-	int tracknum = 0;
-	ID3_Frame* f;
-	int tq = 0;
+adoptAddedFiles() {
+	SCAN_FILE* f;
+	SCAN_FILE* g;
+	TRACK* t;
+	int i;
+
+	for (i = 0; i < SCAN_HASH_SIZE; i++)
+		while ((f = addedFiles[i]) != NULL) {
+			addedFiles[i] = f->next;
+			try {
+				t = new TRACK (f->fname);
+				g = addFile (knownFiles, f->fname, &f->sig);
+				if (g != NULL)
+					fillFile (g, t);
+				delete t;
+			} catch (TrackException e) {
+				// not there. never mind
+			}
+			free (f->fname); free (f);
+		}
+}
 
-	ID3_Tag tag;
-	tag.Link (file);
+/*
+ * sameSignature (SCAN_SIGNATURE* a, SCAN_SIGNATURE* b)
+ *
+ * This will return non-zero if signatures [a] and [b] are the same as far as
+ * stat() is concerned.
+ *
+ */
+int
+sameSignature (SCAN_SIGNATURE* a, SCAN_SIGNATURE* b) {
+	return (a->size == b->size) && (a->mtime == b->mtime) &&
+	       (a->inode == b->inode) && (a->device == b->device);
+}
 
-	// defaults
-	strcpy (title,  "?");
-	strcpy (album,  "?");
-	strcpy (artist, "?");
+/*
+ * sameAudio (SCAN_SIGNATURE* a, SCAN_SIGNATURE* b)
+ *
+ * This will return non-zero if the audio of signatures [a] and [b] is the
+ * same as far as its duration, bitrate and sample rate are concerned.
+ *
+ */
+int
+sameAudio (SCAN_SIGNATURE* a, SCAN_SIGNATURE* b) {
+	return (a->audio.duration == b->audio.duration) && (a->audio.bitrate == b->audio.bitrate) &&
+	       (a->audio.samplerate == b->audio.samplerate);
+}
 
-	// fetch the information
-	f = tag.Find (ID3FID_TITLE);
-	if (f != NULL) {
-		f->Field (ID3FN_TEXT).Get (title, sizeof (title));
-		tq += tq_title;
-	}
-	f = tag.Find (ID3FID_ALBUM);
-	if (f != NULL) {
-		f->Field (ID3FN_TEXT).Get (album, sizeof (album));
-		tq += tq_album;
-	}
-	f = tag.Find (ID3FID_LEADARTIST);
-	if (f != NULL) {
-		f->Field (ID3FN_TEXT).Get (artist, sizeof (artist));
-		tq += tq_artist;
-	}
-	f = tag.Find (ID3FID_YEAR);
-	if (f != NULL) {
-		f->Field (ID3FN_TEXT).Get (tmp, sizeof (tmp));
-		year = atoi (tmp); tq++;
-		tq += tq_year;
-	}
-	f = tag.Find (ID3FID_TRACKNUM);
-	if (f != NULL) {
-		f->Field (ID3FN_TEXT).Get (tmp, sizeof (tmp));
-		tracknum = atoi (tmp); tq++;
-		tq += tq_trackno;
-	}
+/*
+ * isUnchanged (char* fname, SCAN_SIGNATURE* sig)
+ *
+ * This will return non-zero if file [fname] is known and still has signature
+ * [sig], or zero if it has to be scanned. Either way, a known file is flagged
+ * as seen. The names and signatures of the known files aren't changed while
+ * scanning, so looking them up needs no locking. Several walkers may flag the
+ * same file at once, though, so the flag is stored atomically; it is only
+ * read once all threads are joined.
+ *
+ */
+int
+isUnchanged (char* fname, SCAN_SIGNATURE* sig) {
+	SCAN_FILE* f = findFile (knownFiles, fname);
 
-	// handle empty fields, they classify as having no tag at all
-	if (!strcmp (title, ""))  { strcpy (title,  "?"); tq -= tq_title;  }
-	if (!strcmp (album, ""))  { strcpy (album,  "?"); tq -= tq_album;  }
-	if (!strcmp (artist, "")) { strcpy (artist, "?"); tq -= tq_artist; }
+	if (f == NULL)
+		return 0;
+	__atomic_store_n (&f->seen, 1, __ATOMIC_RELAXED);
+	return sameSignature (&f->sig, sig);
+}
 
-	// got a good enough tag?
-	if (tq < tq_required) {
-		// need to be verbose?
-		if (verbose) {
-			// yes. display it
-			printf ("File '%s' skipped due to tag quality, needed %u got %u\n", file, tq_required, tq);
-			skip++;
+/*
+ * keepFile (char* fname)
+ *
+ * This will make sure the track of [fname] is kept, as the file is there
+ * but can't be looked at right now. A known file is flagged as seen, like
+ * isUnchanged() does. Anything else may be a directory holding known files,
+ * so it counts as a scan error and nothing is removed.
+ *
+ */
+void
+keepFile (char* fname) {
+	SCAN_FILE* f = findFile (knownFiles, fname);
+
+	if (f != NULL)
+		__atomic_store_n (&f->seen, 1, __ATOMIC_RELAXED);
+	else
+		__sync_fetch_and_add (&scanErrors, 1);
+}
+
+/*
+ * buildInsertQueries()
+ *
+ * This will build the queries adding 1, 2, 4, ... SCAN_INSERT_ROWS tracks
+ * using a single statement, along with the queries logging the tracks just
+ * added by their filenames.
+ *
+ */
+void
+buildInsertQueries() {
+	const char* head = "INSERT INTO tracks (artistid,albumid,title,filename,year,trackno,playcount,filesize,mtime,inode,device,fingerprint,duration,bitrate,samplerate) VALUES ";
+	const char* row = "(#,#,?,?,#,#,0,?,?,?,?,?,#,#,#)";
+	const char* logHead = "INSERT INTO catalog_changes (kind,action,objectid) SELECT #,#,id FROM tracks WHERE filename IN (";
+	const char* logTail = ") ORDER BY id";
+	int i, j, rows;
+
+	for (i = 0, rows = 1; rows <= SCAN_INSERT_ROWS; i++, rows *= 2) {
+		insertQueries[i] = (char*)malloc (strlen (head) + rows * (strlen (row) + 1) + 1);
+		logQueries[i] = (char*)malloc (strlen (logHead) + rows * 2 + strlen (logTail) + 1);
+		strcpy (insertQueries[i], head);
+		strcpy (logQueries[i], logHead);
+		for (j = 0; j < rows; j++) {
+			if (j > 0) {
+				strcat (insertQueries[i], ",");
+				strcat (logQueries[i], ",");
+			}
+			strcat (insertQueries[i], row);
+			strcat (logQueries[i], "?");
 		}
-	} else {
-		// add it
-		addTrack (file, title, artist, album, year, tracknum, demo);
+		strcat (logQueries[i], logTail);
 	}
 }
-#endif /* MP3_SUPPORT */
 
-#ifdef OGG_SUPPORT
+// SCAN_ROW are the values of new track [n] of [t], as insertQueries[] wants them
+#define SCAN_ROW(n) t[n].artistid, t[n].albumid, t[n].title, t[n].fname, t[n].year, t[n].trackno, \
+                    t[n].size, t[n].mtime, t[n].inode, t[n].device, t[n].sig.fingerprint, \
+                    t[n].sig.audio.duration, t[n].sig.audio.bitrate, t[n].sig.audio.samplerate
+
 /*
- * scanFile_ogg (char* file, int demo)
+ * insertTracks (SCAN_INSERT* t, int num)
  *
- * This will scan file [file] for ogg tags and add it. If [demo] is non-zero,
- * changes will not actually be commited.
+ * This will add the [num] new tracks [t] using a single query, and log the
+ * IDs they got as new using another. [num] must be a power of two, up to
+ * SCAN_INSERT_ROWS. The IDs are looked up by filename, as no database tells
+ * all IDs a single insert produced, and other rows may be added meanwhile.
  *
  */
 void
-scanFile_ogg (char* file, int demo) {
-	char title[TRACK_MAX_TITLE_LEN];
-	char artist[ARTIST_MAX_LEN];
-	char album[ALBUM_MAX_LEN];
-	int year = 0;
-	int tracknum = 0;
-	int tq = 0;
-	FILE* f;
-	vcedit_state* state;
-	vorbis_comment* vc;
+insertTracks (SCAN_INSERT* t, int num) {
+	int k = CHANGE_KIND_TRACK, a = CHANGE_ACTION_INSERT;
+
+	switch (num) {
+		case 1: db->execute (insertQueries[0], SCAN_ROW(0));
+		        db->execute (logQueries[0], k, a, t[0].fname);
+		        break;
+		case 2: db->execute (insertQueries[1], SCAN_ROW(0), SCAN_ROW(1));
+		        db->execute (logQueries[1], k, a, t[0].fname, t[1].fname);
+		        break;
+		case 4: db->execute (insertQueries[2], SCAN_ROW(0), SCAN_ROW(1), SCAN_ROW(2), SCAN_ROW(3));
+		        db->execute (logQueries[2], k, a, t[0].fname, t[1].fname, t[2].fname, t[3].fname);
+		        break;
+		case 8: db->execute (insertQueries[3], SCAN_ROW(0), SCAN_ROW(1), SCAN_ROW(2), SCAN_ROW(3),
+		                                       SCAN_ROW(4), SCAN_ROW(5), SCAN_ROW(6), SCAN_ROW(7));
+		        db->execute (logQueries[3], k, a, t[0].fname, t[1].fname, t[2].fname, t[3].fname,
+		                                          t[4].fname, t[5].fname, t[6].fname, t[7].fname);
+		        break;
+	}
+}
 
-	// defaults
-	strcpy (title,  "?");
-	strcpy (album,  "?");
-	strcpy (artist, "?");
+/*
+ * flushNewTracks()
+ *
+ * This will add all new tracks waiting to be added, and log them as new.
+ *
+ */
+void
+flushNewTracks() {
+	int i, n;
 
-	// open the file
-	if ((f = fopen (file, "rb")) == NULL)
-		// this failed. leave
+	// anything to do?
+	if (numNewTracks == 0)
+		// no. bail out
 		return;
 
-	// initialize the ogg vorbis file
-	state = vcedit_new_state();
-	if (vcedit_open (state, f) < 0) {
-		// this failed. leave
-		fclose (f);
-		return;
+	for (i = 0; i < numNewTracks; i += n) {
+		// add as many as a single query can handle
+		for (n = SCAN_INSERT_ROWS; n > numNewTracks - i; n /= 2);
+		insertTracks (newTracks + i, n);
 	}
 
-	// grab the comments
-	vc = vcedit_comments (state);
-
-	// process them
-	for (int i = 0; i < vc->comments; i++) {
-		// scan for a '='
-		char* ptr = strchr (vc->user_comments[i], '=');
+	for (i = 0; i < numNewTracks; i++) {
+		free (newTracks[i].fname); free (newTracks[i].title);
+	}
+	numNewTracks = 0;
+}
 
-		// got it?
-		if (ptr != NULL) {
+/*
+ * checkpoint()
+ *
+ * This will add the tracks waiting to be added, and commit everything done
+ * so far.
+ *
+ */
+void
+checkpoint() {
+	flushNewTracks();
+	DBUTIL::commit();
+	batchChanges = 0;
+}
+
+/*
+ * countChange()
+ *
+ * This will count a change to the database, and make a checkpoint once the
+ * transaction is large enough. A new transaction is started right away.
+ *
+ */
+void
+countChange() {
+	numChanges++;
+
+	// batching at all?
+	if (batchSize <= 0)
+		// no. every change is committed right away
+		return;
+
+	if (++batchChanges >= batchSize) {
+		checkpoint();
+		DBUTIL::begin();
+	}
+}
+
+/*
+ * queueNewTrack (char* fname, SCAN_SIGNATURE* sig, char* title, int artistid,
+ *                int albumid, int year, int trackno)
+ *
+ * This will have the new track added at the next checkpoint.
+ *
+ */
+void
+queueNewTrack (char* fname, SCAN_SIGNATURE* sig, char* title, int artistid, int albumid, int year, int trackno) {
+	SCAN_INSERT* t = &newTracks[numNewTracks++];
+
+	t->fname = strdup (fname); t->title = strdup (title); t->sig = *sig;
+	DBUTIL::formatBigInt (sig->size, t->size); DBUTIL::formatBigInt (sig->mtime, t->mtime);
+	DBUTIL::formatBigInt (sig->inode, t->inode); DBUTIL::formatBigInt (sig->device, t->device);
+	t->artistid = artistid; t->albumid = albumid;
+	t->year = year; t->trackno = trackno;
+	countChange();
+}
+
+/*
+ * getArtist (char* name)
+ *
+ * This will return the ID of artist [name]. The artist will be created if
+ * needed.
+ *
+ */
+int
+getArtist (char* name) {
+	SCAN_NAME* n = findName (knownArtists, name, 0);
+	ARTIST* a;
+	int id;
+
+	// known already?
+	if (n != NULL)
+		// yes. that was easy
+		return n->id;
+
+	// no such artist. create one
+	a = new ARTIST();
+	a->setName (name);
+	a->update();
+	id = a->getID();
+	delete a;
+	countChange();
+	addName (knownArtists, name, 0, id);
+
+	// be verbose if needed
+	if (verbose > 1)
+		printf ("New artist '%s'[%u]\n", name, id);
+	return id;
+}
+
+/*
+ * getAlbum (char* name, int artistid)
+ *
+ * This will return the ID of album [name] and artist [artistid]. The album
+ * will be created if needed.
+ *
+ */
+int
+getAlbum (char* name, int artistid) {
+	SCAN_NAME* n = findName (knownAlbums, name, artistid);
+	ALBUM* a;
+	int id;
+
+	// known already?
+	if (n != NULL)
+		// yes. that was easy
+		return n->id;
+
+	// no such album. create one
+	a = new ALBUM();
+	a->setName (name);
+	a->setArtistID (artistid);
+	a->update();
+	id = a->getID();
+	delete a;
+	countChange();
+	addName (knownAlbums, name, artistid, id);
+
+	// be verbose if needed
+	if (verbose > 1)
+		printf ("New album '%s'[%u]\n", name, id);
+	return id;
+}
+
+/*
+ * storeTrack (char* fname, SCAN_SIGNATURE* sig, char* title, char* artist,
+ *             char* album, int year, int trackno, int demo)
+ *
+ * This will add the track to the database, along with signature [sig] of the
+ * file. An existing track is only updated if anything changed. If [demo] is
+ * non-zero, changes will not actually be committed.
+ *
+ */
+void
+storeTrack (char* fname, SCAN_SIGNATURE* sig, char* title, char* artist, char* album, int year, int trackno, int demo) {
+	SCAN_FILE* f = findFile (knownFiles, fname);
+	TRACK* t;
+	int artistid, albumid;
+
+	// added by this scan already?
+	if ((f == NULL) && (findFile (addedFiles, fname) != NULL)) {
+		// yes. the directories given must overlap
+		__sync_fetch_and_add (&numUnchanged, 1);
+		return;
+	}
+
+	// demo mode?
+	if (demo) {
+		// yes. be verbose if needed
+		if (verbose > 2)
+			printf ("Would %s track [%s]: title '%s', artist '%s', album '%s', year %u trackno %u\n", (f != NULL) ? "update" : "add", fname, title, artist, album, year, trackno);
+
+		// later
+		if (f == NULL)
+			addFile (addedFiles, fname, sig);
+		return;
+	}
+
+	artistid = getArtist (artist);
+	albumid = getAlbum (album, artistid);
+
+	// known track?
+	if (f != NULL) {
+		// yes. did only the file change?
+		if ((!strcmp (f->title, title)) && (f->artistid == artistid) &&
+		    (f->albumid == albumid) && (f->year == year) && (f->trackno == trackno)) {
+			// yes. just remember the new signature, so it's skipped next time
+			if ((!sameSignature (&f->sig, sig)) || (!sameAudio (&f->sig, sig))) {
+				TRACK::updateSignature (f->id, sig->size, sig->mtime, sig->inode, sig->device, sig->fingerprint,
+				                        sig->audio.duration, sig->audio.bitrate, sig->audio.samplerate);
+				countChange();
+			}
+
+			// the walkers are done by now, so the signature can be changed
+			if (watching)
+				f->sig = *sig;
+			__sync_fetch_and_add (&numUnchanged, 1);
+			return;
+		}
+
+		// fetch the track, as it has more to it than we know of
+		try {
+			t = new TRACK (f->id);
+		} catch (TrackException e) {
+			// it's gone. someone else must have been at it
+			return;
+		}
+		t->setTitle (title);
+		t->setArtistID (artistid);
+		t->setAlbumID (albumid);
+		t->setYear (year);
+		t->setTrackNo (trackno);
+		t->setSignature (sig->size, sig->mtime, sig->inode, sig->device);
+		t->setFingerprint (sig->fingerprint);
+		t->setAudio (sig->audio.duration, sig->audio.bitrate, sig->audio.samplerate);
+		t->update();
+		countChange();
+		__sync_fetch_and_add (&numUpdated, 1);
+
+		// should the file show up again, it's unchanged
+		fillFile (f, t);
+		if (watching)
+			f->sig = *sig;
+		delete t;
+
+		// be verbose if needed
+		if (verbose > 2)
+			printf ("Updated track [%s]: title '%s', artist '%s'[%u], album '%s'[%u], year %u, trackno %u\n", fname, title, artist, artistid, album, albumid, year, trackno);
+		return;
+	}
+
+	// batching, and no need to know the ID right away?
+	if ((batchSize > 0) && (!watching)) {
+		// yes. add it along with a few others
+		queueNewTrack (fname, sig, title, artistid, albumid, year, trackno);
+		addFile (addedFiles, fname, sig);
+	} else {
+		// no. add it right away
+		t = new TRACK();
+		t->setFilename (fname);
+		t->setTitle (title);
+		t->setArtistID (artistid);
+		t->setAlbumID (albumid);
+		t->setYear (year);
+		t->setTrackNo (trackno);
+		t->setSignature (sig->size, sig->mtime, sig->inode, sig->device);
+		t->setFingerprint (sig->fingerprint);
+		t->setAudio (sig->audio.duration, sig->audio.bitrate, sig->audio.samplerate);
+		t->update();
+		countChange();
+
+		// while watching, it may have to be moved or removed later on. a rescan
+		// has seen it, too
+		f = addFile ((watching) ? knownFiles : addedFiles, fname, sig);
+		if ((f != NULL) && (watching)) {
+			fillFile (f, t);
+			f->seen = 1;
+		}
+		delete t;
+	}
+	__sync_fetch_and_add (&numNew, 1);
+
+	// be verbose if needed
+	if (verbose > 1)
+		printf ("New track [%s]: title '%s', artist '%s'[%u], album '%s'[%u], year %u, trackno %u\n", fname, title, artist, artistid, album, albumid, year, trackno);
+}
+
+/*
+ * addTrack (char* fname, SCAN_SIGNATURE* sig, char* title, char* artist,
+ *           char* album, int year, int trackno, int demo)
+ *
+ * This will add the track with file signature [sig] to the database. The
+ * names are normalised to UTF-8, and the audio is fingerprinted first, so
+ * scanning threads share that work. When scanning with more than one thread,
+ * it is handed to the writer instead, which may have to catch up first. If
+ * [demo] is non-zero, changes will not actually be committed.
+ *
+ */
+void
+addTrack (char* fname, SCAN_SIGNATURE* sig, char* title, char* artist, char* album, int year, int trackno, int demo) {
+	char t[TRACK_MAX_TITLE_LEN], ar[ARTIST_MAX_LEN], al[ALBUM_MAX_LEN];
+	SCAN_ITEM* item;
+
+	// the catalog is UTF-8 only, whatever the tags were in
+	normalizeText (title, t, sizeof (t));
+	normalizeText (artist, ar, sizeof (ar));
+	normalizeText (album, al, sizeof (al));
+
+	// the audio may have changed too, or the file may have been moved
+	fingerprintFile (fname, sig->fingerprint);
+
+	// is there a writer?
+	if (!queueTracks) {
+		// no. no need to queue anything
+		storeTrack (fname, sig, t, ar, al, year, trackno, demo);
+		return;
+	}
+
+	item = (SCAN_ITEM*)malloc (sizeof (SCAN_ITEM));
+	item->fname = strdup (fname); item->title = strdup (t);
+	item->artist = strdup (ar); item->album = strdup (al);
+	item->year = year; item->trackno = trackno; item->sig = *sig;
+
+	// wait for room, and queue it
+	pthread_mutex_lock (&itemLock);
+	while (itemCount == SCAN_QUEUE_SIZE)
+		pthread_cond_wait (&itemNotFull, &itemLock);
+	itemQueue[(itemHead + itemCount) % SCAN_QUEUE_SIZE] = item;
+	itemCount++;
+	pthread_cond_signal (&itemNotEmpty);
+	pthread_mutex_unlock (&itemLock);
+}
+
+/*
+ * initTags (SCAN_TAGS* t)
+ *
+ * This will set up [t] for a tag reader. Fields which are not found are '?'.
+ *
+ */
+void
+initTags (SCAN_TAGS* t) {
+	strcpy (t->title,  "?");
+	strcpy (t->album,  "?");
+	strcpy (t->artist, "?");
+	t->info.title  = t->title;  t->info.titleLen  = sizeof (t->title);
+	t->info.artist = t->artist; t->info.artistLen = sizeof (t->artist);
+	t->info.album  = t->album;  t->info.albumLen  = sizeof (t->album);
+	t->info.year = 0; t->info.trackno = 0;
+}
+
+/*
+ * addTagged (char* file, SCAN_SIGNATURE* sig, SCAN_TAGS* t, int tq, int demo)
+ *
+ * This will add file [file] with tags [t] if their quality [tq] is good
+ * enough. If [demo] is non-zero, changes will not actually be committed.
+ *
+ */
+void
+addTagged (char* file, SCAN_SIGNATURE* sig, SCAN_TAGS* t, int tq, int demo) {
+	// handle empty fields, they classify as having no tag at all
+	if (!strcmp (t->title, ""))  { strcpy (t->title,  "?"); tq -= tq_title;  }
+	if (!strcmp (t->album, ""))  { strcpy (t->album,  "?"); tq -= tq_album;  }
+	if (!strcmp (t->artist, "")) { strcpy (t->artist, "?"); tq -= tq_artist; }
+
+	// got a good enough tag?
+	if (tq < tq_required) {
+		// need to be verbose?
+		if (verbose) {
+			// yes. display it
+			printf ("File '%s' skipped due to tag quality, needed %u got %u\n", file, tq_required, tq);
+			__sync_fetch_and_add (&skip, 1);
+		}
+	} else {
+		// add it
+		addTrack (file, sig, t->title, t->artist, t->album, t->info.year, t->info.trackno, demo);
+	}
+}
+
+/*
+ * tagQuality (int found)
+ *
+ * This will return the quality of a tag which has the TAGINFO_xxx fields
+ * [found].
+ *
+ */
+int
+tagQuality (int found) {
+	int tq = 0;
+
+	if (found & TAGINFO_TITLE)   tq += tq_title;
+	if (found & TAGINFO_ALBUM)   tq += tq_album;
+	if (found & TAGINFO_ARTIST)  tq += tq_artist;
+	if (found & TAGINFO_YEAR)    tq += tq_year;
+	if (found & TAGINFO_TRACKNO) tq += tq_trackno;
+	return tq;
+}
+
+#ifdef MP3_SUPPORT
+/*
+ * readID3Lib (char* file, TAGINFO* info)
+ *
+ * This will read the ID3 tags of [file] into [info] using id3lib, for the
+ * files our own reader can't make sense of. It will return the TAGINFO_xxx
+ * fields found.
+ *
+ */
+int
+readID3Lib (char* file, TAGINFO* info) {
+	char tmp[64];
+	ID3_Frame* f;
+	int found = 0;
+
+	ID3_Tag tag;
+	tag.Link (file);
+
+	// fetch the information
+	f = tag.Find (ID3FID_TITLE);
+	if (f != NULL) {
+		f->Field (ID3FN_TEXT).Get (info->title, info->titleLen);
+		found |= TAGINFO_TITLE;
+	}
+	f = tag.Find (ID3FID_ALBUM);
+	if (f != NULL) {
+		f->Field (ID3FN_TEXT).Get (info->album, info->albumLen);
+		found |= TAGINFO_ALBUM;
+	}
+	f = tag.Find (ID3FID_LEADARTIST);
+	if (f != NULL) {
+		f->Field (ID3FN_TEXT).Get (info->artist, info->artistLen);
+		found |= TAGINFO_ARTIST;
+	}
+	f = tag.Find (ID3FID_YEAR);
+	if (f != NULL) {
+		f->Field (ID3FN_TEXT).Get (tmp, sizeof (tmp));
+		info->year = atoi (tmp);
+		found |= TAGINFO_YEAR;
+	}
+	f = tag.Find (ID3FID_TRACKNUM);
+	if (f != NULL) {
+		f->Field (ID3FN_TEXT).Get (tmp, sizeof (tmp));
+		info->trackno = atoi (tmp);
+		found |= TAGINFO_TRACKNO;
+	}
+	return found;
+}
+#endif /* MP3_SUPPORT */
+
+/*
+ * scanFile_MP3 (char* file, SCAN_SIGNATURE* sig, int demo)
+ *
+ * This will scan file [file] for ID3 tags and add it. If [demo] is non-zero,
+ * changes will not actually be committed.
+ *
+ */
+void
+scanFile_MP3 (char* file, SCAN_SIGNATURE* sig, int demo) {
+	SCAN_TAGS t;
+	int found, tq;
+
+	// fetch the information
+	initTags (&t);
+	readMP3Info (file, &sig->audio);
+	found = readID3 (file, &t.info);
+#ifdef MP3_SUPPORT
+	if (found == 0)
+		// nothing we could read. perhaps id3lib knows better
+		found = readID3Lib (file, &t.info);
+#endif /* MP3_SUPPORT */
+
+	// a year or track number in an ID3 tag counts a little extra
+	tq = tagQuality (found);
+	if (found & TAGINFO_YEAR)    tq++;
+	if (found & TAGINFO_TRACKNO) tq++;
+	addTagged (file, sig, &t, tq, demo);
+}
+
+#ifdef OGG_SUPPORT
+/*
+ * readVorbisLib (char* file, TAGINFO* info)
+ *
+ * This will read the comments of Ogg Vorbis file [file] into [info] using
+ * libvorbis, for the files our own reader can't make sense of. It will
+ * return the TAGINFO_xxx fields found.
+ *
+ */
+int
+readVorbisLib (char* file, TAGINFO* info) {
+	FILE* f;
+	vcedit_state* state;
+	vorbis_comment* vc;
+	int found = 0;
+
+	// open the file
+	if ((f = fopen (file, "rb")) == NULL)
+		// this failed. leave
+		return 0;
+
+	// initialize the ogg vorbis file
+	state = vcedit_new_state();
+	if (vcedit_open (state, f) < 0) {
+		// this failed. leave
+		vcedit_clear (state);
+		fclose (f);
+		return 0;
+	}
+
+	// grab the comments
+	vc = vcedit_comments (state);
+
+	// process them
+	for (int i = 0; i < vc->comments; i++) {
+		// scan for a '='
+		char* ptr = strchr (vc->user_comments[i], '=');
+
+		// got it?
+		if (ptr != NULL) {
 			// yes. isolate the value
 			*ptr = 0; ptr++;
 
 			// got an ARTIST tag?
 			if (!strcasecmp (vc->user_comments[i], "artist")) {
 				// yes. copy it over
-				strncpy (artist, ptr, sizeof (artist));
-				tq += tq_artist;
+				strncpy (info->artist, ptr, info->artistLen - 1);
+				info->artist[info->artistLen - 1] = 0;
+				found |= TAGINFO_ARTIST;
 			}
 			// got a TITLE tag?
 			if (!strcasecmp (vc->user_comments[i], "title")) {
 				// yes. copy it over
-				strncpy (title, ptr, sizeof (title));
-				tq += tq_title;
+				strncpy (info->title, ptr, info->titleLen - 1);
+				info->title[info->titleLen - 1] = 0;
+				found |= TAGINFO_TITLE;
 			}
 			// got an ALBUM tag?
 			if (!strcasecmp (vc->user_comments[i], "album")) {
 				// yes. copy it over
-				strncpy (album, ptr, sizeof (album));
-				tq += tq_album;
+				strncpy (info->album, ptr, info->albumLen - 1);
+				info->album[info->albumLen - 1] = 0;
+				found |= TAGINFO_ALBUM;
 			}
 			// got an TRACKNUMBER tag?
 			if (!strcasecmp (vc->user_comments[i], "tracknumber")) {
 				// yes. copy it over
-				tracknum = atoi (ptr);
-				tq += tq_trackno;
+				info->trackno = atoi (ptr);
+				found |= TAGINFO_TRACKNO;
 			}
 			// got a DATE tag?
 			if (!strcasecmp (vc->user_comments[i], "date")) {
 				// yes. copy it over and hope it's the year :)
-				year = atoi (ptr);
-				tq += tq_year;
+				info->year = atoi (ptr);
+				found |= TAGINFO_YEAR;
 			}
 		}
 	}
 
-	// handle empty fields, they classify as having no tag at all
-	if (!strcmp (title, ""))  { strcpy (title,  "?"); tq -= tq_title;  }
-	if (!strcmp (album, ""))  { strcpy (album,  "?"); tq -= tq_album;  }
-	if (!strcmp (artist, "")) { strcpy (artist, "?"); tq -= tq_artist; }
-
-	// got a good enough tag?
-	if (tq < tq_required) {
-		// need to be verbose?
-		if (verbose) {
-			// yes. display it
-			printf ("File '%s' skipped due to tag quality, needed %u got %u\n", file, tq_required, tq);
-			skip++;
-		}
-	} else {
-		// add it
-		addTrack (file, title, artist, album, year, tracknum, demo);
-	}
-	
 	vcedit_clear (state);
 	fclose (f);
+	return found;
+}
+#endif /* OGG_SUPPORT */
+
+/*
+ * scanFile_ogg (char* file, SCAN_SIGNATURE* sig, int demo)
+ *
+ * This will scan Ogg Vorbis, Opus or Ogg FLAC file [file] for comments and
+ * add it. If [demo] is non-zero, changes will not actually be commited.
+ *
+ */
+void
+scanFile_ogg (char* file, SCAN_SIGNATURE* sig, int demo) {
+	SCAN_TAGS t;
+	int found;
+
+	// fetch the information
+	initTags (&t);
+	readOggInfo (file, &sig->audio);
+	found = readOggTags (file, &t.info);
+#ifdef OGG_SUPPORT
+	if (found == 0)
+		// nothing we could read. perhaps libvorbis knows better
+		found = readVorbisLib (file, &t.info);
+#endif /* OGG_SUPPORT */
+
+	addTagged (file, sig, &t, tagQuality (found), demo);
+}
+
+/*
+ * scanFile_flac (char* file, SCAN_SIGNATURE* sig, int demo)
+ *
+ * This will scan FLAC file [file] for comments and add it. If [demo] is
+ * non-zero, changes will not actually be commited.
+ *
+ */
+void
+scanFile_flac (char* file, SCAN_SIGNATURE* sig, int demo) {
+	SCAN_TAGS t;
+	int found;
+
+	// fetch the information
+	initTags (&t);
+	readFLACInfo (file, &sig->audio);
+	found = readFLACTags (file, &t.info);
+	addTagged (file, sig, &t, tagQuality (found), demo);
+}
+
+/*
+ * scanFile_module (char* file, SCAN_SIGNATURE* sig, char* hdr, int len,
+ *                  int demo)
+ *
+ * This will add module file [file], using the [len] bytes of the title read
+ * at [hdr]. If [demo] is non-zero, changes will not actually be commited.
+ *
+ */
+void
+scanFile_module (char* file, SCAN_SIGNATURE* sig, char* hdr, int len, int demo) {
+	char title[TRACK_MAX_TITLE_LEN];
+	char* ptr = strrchr (file, '/');
+
+	// the title is all that was read
+	memset (title, 0, TRACK_MAX_TITLE_LEN);
+	memcpy (title, hdr, (len < TRACK_MAX_TITLE_LEN - 1) ? len : TRACK_MAX_TITLE_LEN - 1);
+
+	// got a title?
+	if (!*title)
+		// no. use the filename instead
+		strncpy (title, ptr + 1, TRACK_MAX_TITLE_LEN - 1);
+
+	// add it, along with a guess of how long it plays
+	readModuleInfo (file, &sig->audio);
+	addTrack (file, sig, title, module_artist, module_album, 0, 0, demo);
+}
+
+/*
+ * scanFile_rad (char* file, SCAN_SIGNATURE* sig, char* hdr, int len,
+ *               int demo)
+ *
+ * This will scan RAD file [file] for a module title and add it, using the
+ * [len] bytes of the header at [hdr]. If [demo] is non-zero, changes will
+ * not actually be commited.
+ *
+ */
+void
+scanFile_rad (char* file, SCAN_SIGNATURE* sig, char* hdr, int len, int demo) {
+	char title[TRACK_MAX_TITLE_LEN];
+	char* ptr = strrchr (file, '/');
+	int i = 0, j, pos;
+
+	// got a RAD file?
+	if ((len < 0x12) || (hdr[0] != 'R') || (hdr[1] != 'A') || (hdr[2] != 'D'))
+		// no. bail out
+		return;
+
+	// reset the title
+	memset (title, 0, TRACK_MAX_TITLE_LEN);
+
+	// check for a description
+	if (hdr[0x11] & 0x80) {
+		// we have a description! fetch it, as far as it fits
+		for (pos = 0x12; (pos < len) && (hdr[pos]) && (i < TRACK_MAX_TITLE_LEN - 1); pos++) {
+			// newline?
+			if (hdr[pos] == 1)
+				// yes. stop adding the song name then
+				break;
+			else if ((hdr[pos] >= 0x2) && (hdr[pos] <= 0x1f))
+				// output this many spaces
+				for (j = 0; (j < hdr[pos]) && (i < TRACK_MAX_TITLE_LEN - 1); j++)
+					title[i++] = ' ';
+			else
+				// just append it
+				title[i++] = hdr[pos];
+		}
+
+		// did the file end first?
+		if ((pos == len) && (len < SCAN_HEADER_LEN))
+			// yes. it's broken
+			return;
+	}
+
+	// got a title?
+	if (!*title)
+		// no. use the filename instead
+		strncpy (title, ptr + 1, TRACK_MAX_TITLE_LEN - 1);
+
+	// add it
+	addTrack (file, sig, title, adlib_artist, adlib_album, 0, 0, demo);
+}
+
+/*
+ * scanFile_raw (char* file, SCAN_SIGNATURE* sig, int demo)
+ *
+ * This will just take file [file] add it. If [demo] is non-zero, changes will
+ * not actually be commited.
+ *
+ */
+void
+scanFile_raw (char* file, SCAN_SIGNATURE* sig, int demo) {
+	char title[TRACK_MAX_TITLE_LEN];
+	char* ptr = strrchr (file, '/');
+
+	// these file are all headerless (as far as I know at least), so just use
+	// the filename for them.
+	strncpy (title, ptr + 1, TRACK_MAX_TITLE_LEN - 1);
+
+	// add it
+	addTrack (file, sig, title, adlib_artist, adlib_album, 0, 0, demo);
+}
+
+/*
+ * scanFile_sid (char* file, SCAN_SIGNATURE* sig, int demo)
+ *
+ * This will just take SID file [file] add it. If [demo] is non-zero, changes
+ * will not actually be commited.
+ *
+ */
+void
+scanFile_sid (char* file, SCAN_SIGNATURE* sig, int demo) {
+	char title[TRACK_MAX_TITLE_LEN];
+	char* ptr = strrchr (file, '/');
+
+	// these file are all headerless (as far as I know at least), so just use
+	// the filename for them.
+	strncpy (title, ptr + 1, TRACK_MAX_TITLE_LEN - 1);
+
+	// add it
+	addTrack (file, sig, title, sid_artist, sid_album, 0, 0, demo);
+}
+
+/*
+ * scanFile_adlib (char* file, SCAN_SIGNATURE* sig, char* hdr, int len,
+ *                 int demo)
+ *
+ * This will add AdLib file [file], using the [len] bytes of the title read
+ * at [hdr]. If [demo] is non-zero, changes will not actually be commited.
+ *
+ */
+void
+scanFile_adlib (char* file, SCAN_SIGNATURE* sig, char* hdr, int len, int demo) {
+	char title[TRACK_MAX_TITLE_LEN];
+	char* ptr = strrchr (file, '/');
+
+	// the title is all that was read
+	memset (title, 0, TRACK_MAX_TITLE_LEN);
+	memcpy (title, hdr, (len < TRACK_MAX_TITLE_LEN - 1) ? len : TRACK_MAX_TITLE_LEN - 1);
+
+	// got a title?
+	if (!*title)
+		// no. use the filename instead
+		strncpy (title, ptr + 1, TRACK_MAX_TITLE_LEN - 1);
+
+	// add it
+	addTrack (file, sig, title, adlib_artist, adlib_album, 0, 0, demo);
+}
+
+/*
+ * fileFormat (const char* fname)
+ *
+ * This will return the SCAN_FORMAT_xxx kind of file [fname], as told by its
+ * extension.
+ *
+ */
+int
+fileFormat (const char* fname) {
+	const char* ext = strrchr (fname, '.');
+
+	// isolate the extension
+	if (ext == NULL)
+		return SCAN_FORMAT_NONE;
+	ext++;
+
+	// mp3?
+	if (!strcasecmp (ext, "mp3"))
+		return SCAN_FORMAT_MP3;
+
+	// ogg, oga, opus?
+	if ((!strcasecmp (ext, "ogg")) || (!strcasecmp (ext, "oga")) || (!strcasecmp (ext, "opus")))
+		return SCAN_FORMAT_OGG;
+
+	// flac?
+	if (!strcasecmp (ext, "flac"))
+		return SCAN_FORMAT_FLAC;
+
+	// mod, s3m, stm, it, xm?
+	if ((!strcasecmp (ext, "mod")) || (!strcasecmp (ext, "s3m")) || (!strcasecmp (ext, "stm")) ||
+			(!strcasecmp (ext,  "it")) || (!strcasecmp (ext,  "xm")))
+		return SCAN_FORMAT_MODULE;
+
+	// rad?
+	if (!strcasecmp (ext, "rad"))
+		return SCAN_FORMAT_RAD;
+
+	// raw, laa, lds, sci, hsc, sat, sa2?
+	if ((!strcasecmp (ext, "raw")) || (!strcasecmp (ext, "laa")) || (!strcasecmp (ext, "lds")) ||
+			(!strcasecmp (ext, "sci")) || (!strcasecmp (ext, "hsc")) || (!strcasecmp (ext, "sat")) ||
+			(!strcasecmp (ext, "sa2")) )
+		return SCAN_FORMAT_RAW;
+
+	// d00, amd?
+	if ((!strcasecmp (ext, "d00")) || (!strcasecmp (ext, "amd")))
+		return SCAN_FORMAT_ADLIB;
+
+	// sid?
+	if (!strcasecmp (ext, "sid"))
+		return SCAN_FORMAT_SID;
+
+	return SCAN_FORMAT_NONE;
+}
+
+/*
+ * headerWindow (int format, const char* fname, int* offset, int* len)
+ *
+ * This will put the part of file [fname] of kind [format] which holds its
+ * title in [offset] and [len]. [len] is zero if nothing has to be read, as
+ * the tags are read by a library or there are none.
+ *
+ */
+void
+headerWindow (int format, const char* fname, int* offset, int* len) {
+	const char* ext = strrchr (fname, '.') + 1;
+
+	*offset = 0; *len = 0;
+	switch (format) {
+		case SCAN_FORMAT_MODULE: // depending on the extension, set options
+		                         if ((!strcasecmp (ext, "mod")) || (!strcasecmp (ext, "stm")))
+		                           // .MOD and .STM files have 20 bytes title length at offset 0
+		                           *len = 20;
+		                         else if (!strcasecmp (ext, "s3m"))
+		                           // .S3M files have 28 bytes title length at offset 0
+		                           *len = 28;
+		                         else if (!strcasecmp (ext,  "it")) {
+		                           // .IT files have 26 bytes title length at offset 4
+		                           *len = 26; *offset = 4;
+		                         } else if (!strcasecmp (ext,  "xm")) {
+		                           // .XM files have 20 bytes title length at offset 17
+		                           *len = 20; *offset = 17;
+		                         }
+		                         break;
+		   case SCAN_FORMAT_RAD: // the description follows the header, if there is one
+		                         *len = SCAN_HEADER_LEN;
+		                         break;
+		 case SCAN_FORMAT_ADLIB: if (!strcasecmp (ext, "d00")) {
+		                           // .D00 files have 32 bytes title length at offset 11
+		                           *len = 32; *offset = 11;
+		                         } else if (!strcasecmp (ext, "amd"))
+		                           // .AMD files have 24 bytes title length at offset 0
+		                           *len = 24;
+		                         break;
+	}
+}
+
+/*
+ * fileChanged (char* file, struct stat* st, SCAN_SIGNATURE* sig)
+ *
+ * This will put the signature of file [file], which [st] tells about, in
+ * [sig]. It will return non-zero if the file changed since the last scan, or
+ * zero if it didn't.
+ *
+ */
+int
+fileChanged (char* file, struct stat* st, SCAN_SIGNATURE* sig) {
+	sig->size = st->st_size; sig->mtime = st->st_mtime;
+	sig->inode = st->st_ino; sig->device = st->st_dev;
+	*sig->fingerprint = '\0';
+	sig->audio.duration = 0; sig->audio.bitrate = 0; sig->audio.samplerate = 0;
+	if (isUnchanged (file, sig)) {
+		// no. no need to look at the tags again
+		__sync_fetch_and_add (&numUnchanged, 1);
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * scanRequest (FILEIO_REQUEST* req, SCAN_SIGNATURE* sig, int format, int demo)
+ *
+ * This will scan the file of [req], of kind [format] and with signature [sig],
+ * for tags and add it. Its header must be read already. If [demo] is
+ * non-zero, changes will not actually be commited.
+ *
+ */
+void
+scanRequest (FILEIO_REQUEST* req, SCAN_SIGNATURE* sig, int format, int demo) {
+	char* file = req->fname;
+
+	// a title which is cut short means the file isn't what it claims to be
+	if ((req->error) || ((format != SCAN_FORMAT_RAD) && (req->numRead < req->len)))
+		return;
+
+	switch (format) {
+		   case SCAN_FORMAT_MP3: scanFile_MP3 (file, sig, demo);
+		                         break;
+		   case SCAN_FORMAT_OGG: scanFile_ogg (file, sig, demo);
+		                         break;
+		  case SCAN_FORMAT_FLAC: scanFile_flac (file, sig, demo);
+		                         break;
+		case SCAN_FORMAT_MODULE: scanFile_module (file, sig, req->buf, req->numRead, demo);
+		                         break;
+		   case SCAN_FORMAT_RAD: scanFile_rad (file, sig, req->buf, req->numRead, demo);
+		                         break;
+		   case SCAN_FORMAT_RAW: scanFile_raw (file, sig, demo);
+		                         break;
+		 case SCAN_FORMAT_ADLIB: scanFile_adlib (file, sig, req->buf, req->numRead, demo);
+		                         break;
+		   case SCAN_FORMAT_SID: scanFile_sid (file, sig, demo);
+		                         break;
+	}
+}
+
+/*
+ * scanFile (char* file, struct stat* st, int demo)
+ *
+ * This will scan file [file] for tags and add it, unless [st] shows it didn't
+ * change since the last scan. If [demo] is non-zero, changes will not actually
+ * be commited.
+ *
+ */
+void
+scanFile (char* file, struct stat* st, int demo) {
+	char hdr[SCAN_HEADER_LEN];
+	FILEIO_REQUEST req;
+	SCAN_SIGNATURE sig;
+	int format = fileFormat (file);
+
+	// anything to do?
+	if ((format == SCAN_FORMAT_NONE) || (!fileChanged (file, st, &sig)))
+		// no. bail out
+		return;
+
+	// read the title, if it's in the file itself
+	memset (&req, 0, sizeof (req));
+	req.fname = file; req.st = *st; req.buf = hdr;
+	headerWindow (format, file, &req.offset, &req.len);
+	if (req.len > 0) {
+		req.ops = FILEIO_READ;
+		FILEIO::process (&req, 1);
+	}
+	scanRequest (&req, &sig, format, demo);
+}
+
+/*
+ * showProgress()
+ *
+ * This will advance the twirlie, unless we are to be quiet.
+ *
+ */
+void
+showProgress() {
+	// silence?
+	if ((!quiet) && (!watching)) {
+		// no. show the twirlie
+		printf ("%c%c", 8, twirl[tpos++]);
+		tpos %= (sizeof (twirl) - 1);
+		fflush (stdout);
+	}
+}
+
+/*
+ * pushDirectory (SCAN_WALKER* w, char* dirname)
+ *
+ * This will queue directory [dirname] to be scanned by walker [w], or by
+ * whoever steals it.
+ *
+ */
+void
+pushDirectory (SCAN_WALKER* w, char* dirname) {
+	char** ptr;
+	char* name = strdup (dirname);
+
+	if (name == NULL)
+		return;
+
+	pthread_mutex_lock (&w->lock);
+	if (w->numDirs == w->dirSize) {
+		ptr = (char**)realloc (w->dirs, (w->dirSize + 64) * sizeof (char*));
+		if (ptr == NULL) {
+			// this failed. skip the directory then
+			pthread_mutex_unlock (&w->lock);
+			free (name);
+			return;
+		}
+		w->dirs = ptr; w->dirSize += 64;
+	}
+	w->dirs[w->numDirs++] = name;
+	pthread_mutex_unlock (&w->lock);
+
+	// it's pending until it has been scanned, and anyone idle may have it
+	__sync_fetch_and_add (&pendingDirs, 1);
+	pthread_mutex_lock (&idleLock);
+	queuedDirs++;
+	pthread_cond_signal (&idleCond);
+	pthread_mutex_unlock (&idleLock);
+}
+
+/*
+ * takeDirectory (SCAN_WALKER* w, int own)
+ *
+ * This will take a directory from walker [w]: the newest one if [own] is
+ * non-zero, as it is probably still in the cache, or the oldest one if it is
+ * stolen, as it probably has the most below it. It will return the directory
+ * name, which must be freed, or NULL if there is none.
+ *
+ */
+char*
+takeDirectory (SCAN_WALKER* w, int own) {
+	char* name = NULL;
+
+	pthread_mutex_lock (&w->lock);
+	if (w->numDirs > 0) {
+		if (own)
+			name = w->dirs[--w->numDirs];
+		else {
+			name = w->dirs[0];
+			memmove (w->dirs, w->dirs + 1, --w->numDirs * sizeof (char*));
+		}
+	}
+	pthread_mutex_unlock (&w->lock);
+
+	if (name != NULL) {
+		pthread_mutex_lock (&idleLock);
+		queuedDirs--;
+		pthread_mutex_unlock (&idleLock);
+	}
+	return name;
+}
+
+// scanBatch() and walkDirectory() call each other
+void walkDirectory (SCAN_WALKER* w, char* dirname, int demo);
+
+/*
+ * scanBatch (SCAN_WALKER* w, SCAN_BATCH* b, int demo)
+ *
+ * This will scan the entries of batch [b] on behalf of walker [w]. Everything
+ * is stat()-ed in one go, after which the headers of the files which changed
+ * are read in one go. Directories are queued for walker [w], or scanned right
+ * away if there is none. If [demo] is non-zero, changes will not really be
+ * committed.
+ *
+ */
+void
+scanBatch (SCAN_WALKER* w, SCAN_BATCH* b, int demo) {
+	FILEIO_REQUEST* req;
+	int i;
+
+	// stat whatever readdir() couldn't tell about
+	FILEIO::process (b->req, b->num);
+
+	// find out which files changed, and what to read of them
+	for (i = 0; i < b->num; i++) {
+		req = &b->req[i];
+		b->format[i] = SCAN_FORMAT_NONE;
+		if (req->error) {
+			// only a file which vanished since readdir() is really gone
+			if (req->error != ENOENT)
+				keepFile (req->fname);
+			continue;
+		}
+		if (!S_ISREG (req->st.st_mode))
+			continue;
+		b->format[i] = fileFormat (req->fname);
+		if ((b->format[i] == SCAN_FORMAT_NONE) || (!fileChanged (req->fname, &req->st, &b->sig[i]))) {
+			b->format[i] = SCAN_FORMAT_NONE;
+			continue;
+		}
+		headerWindow (b->format[i], req->fname, &req->offset, &req->len);
+		if (req->len > 0) {
+			req->buf = b->hdr[i]; req->ops = FILEIO_READ;
+		}
+	}
+	FILEIO::process (b->req, b->num);
+
+	for (i = 0; i < b->num; i++) {
+		req = &b->req[i];
+
+		// is it... a file ?
+		if (b->format[i] != SCAN_FORMAT_NONE) {
+			// yes. be verbose if needed
+			if (verbose > 3)
+				printf ("Scanning [%s]\n", req->fname);
+			scanRequest (req, &b->sig[i], b->format[i], demo);
+
+			// without a writer, there's no one else to show progress
+			if (!queueTracks)
+				showProgress();
+		}
+
+		// is it, a dir ?
+		if ((!req->error) && (S_ISDIR (req->st.st_mode))) {
+			// yes. leave it for later or for someone else, or scan it now
+			if (w != NULL)
+				pushDirectory (w, req->fname);
+			else
+				walkDirectory (NULL, req->fname, demo);
+		}
+		free (req->fname);
+	}
+	b->num = 0;
+}
+
+/*
+ * walkDirectory (SCAN_WALKER* w, char* dirname, int demo)
+ *
+ * This will scan the files in directory [dirname] on behalf of walker [w].
+ * Directories below it are queued rather than scanned right away, so other
+ * threads can take them; without a walker, they are scanned right away.
+ * Files which aren't scanned anyway aren't even stat()-ed, if readdir() can
+ * tell what they are. If [demo] is non-zero, changes will not really be
+ * committed.
+ *
+ */
+void
+walkDirectory (SCAN_WALKER* w, char* dirname, int demo) {
+	char tmp[PATH_MAX];
+	struct dirent* dent;
+	FILEIO_REQUEST* req;
+	SCAN_BATCH* b;
+	DIR* dir = opendir (dirname);
+
+	// did this work?
+	if (dir == NULL) {
+		// no. files in there can't be told from vanished ones now
+		__sync_fetch_and_add (&scanErrors, 1);
+		return;
+	}
+	b = (SCAN_BATCH*)malloc (sizeof (SCAN_BATCH));
+	if (b == NULL) {
+		// out of memory. same thing
+		__sync_fetch_and_add (&scanErrors, 1);
+		closedir (dir);
+		return;
+	}
+	b->num = 0;
+
+	// wade through the directory. readdir() is fine, as the stream is ours
+	while ((dent = readdir (dir)) != NULL) {
+		// skip '.' and '..'
+		if ((!strcmp (dent->d_name, ".")) || (!strcmp (dent->d_name, "..")))
+			continue;
+
+		// skip what can't be scanned, if we can tell
+		if ((dent->d_type == DT_REG) && (fileFormat (dent->d_name) == SCAN_FORMAT_NONE))
+			continue;
+		if ((dent->d_type != DT_REG) && (dent->d_type != DT_DIR) &&
+		    (dent->d_type != DT_LNK) && (dent->d_type != DT_UNKNOWN))
+			continue;
+
+		// add it to the batch. directories needn't be stat()-ed
+		snprintf (tmp, sizeof (tmp) - 1, "%s/%s", dirname, dent->d_name);
+		req = &b->req[b->num];
+		memset (req, 0, sizeof (FILEIO_REQUEST));
+		req->fname = strdup (tmp);
+		if (req->fname == NULL)
+			continue;
+		if (dent->d_type == DT_DIR)
+			req->st.st_mode = S_IFDIR;
+		else
+			req->ops = FILEIO_STAT;
+
+		// full?
+		if (++b->num == SCAN_BATCH_SIZE)
+			// yes. scan what we have so far
+			scanBatch (w, b, demo);
+	}
+	scanBatch (w, b, demo);
+
+	// a farewell to directories
+	closedir (dir);
+	free (b);
+}
+
+/*
+ * scanDirectory (char* dirname, int demo)
+ *
+ * This will scan directory [dirname] and all its children. If [demo] is
+ * non-zero, changes will not really be committed.
+ *
+ */
+void
+scanDirectory (char* dirname, int demo) {
+	walkDirectory (NULL, dirname, demo);
+}
+
+/*
+ * walkerMain (void* arg)
+ *
+ * This is the entry point of the scanning threads. [arg] is the walker.
+ * Directories are scanned until there are none left anywhere and no other
+ * thread is scanning one that could yield more.
+ *
+ */
+void*
+walkerMain (void* arg) {
+	SCAN_WALKER* w = (SCAN_WALKER*)arg;
+	char* name;
+	int i;
+
+	while (1) {
+		// try our own directories first, then everyone else's
+		name = takeDirectory (w, 1);
+		for (i = 1; (name == NULL) && (i < numThreads); i++)
+			name = takeDirectory (&walkers[(w->index + i) % numThreads], 0);
+
+		// got one?
+		if (name != NULL) {
+			// yes. scan it
+			walkDirectory (w, name, w->demo);
+			free (name);
+
+			// was this the last one? if so, wake up everyone so they can leave
+			if (__sync_sub_and_fetch (&pendingDirs, 1) == 0) {
+				pthread_mutex_lock (&idleLock);
+				pthread_cond_broadcast (&idleCond);
+				pthread_mutex_unlock (&idleLock);
+			}
+			continue;
+		}
+
+		// no. wait until something is queued, or everything is done
+		pthread_mutex_lock (&idleLock);
+		while ((queuedDirs == 0) && (pendingDirs > 0))
+			pthread_cond_wait (&idleCond, &idleLock);
+		i = (pendingDirs == 0);
+		pthread_mutex_unlock (&idleLock);
+		if (i)
+			break;
+	}
+
+	// the ring of this thread, if any, is no longer needed
+	FILEIO::done();
+
+	// tell the writer there's one less thread feeding it
+	pthread_mutex_lock (&itemLock);
+	activeWalkers--;
+	pthread_cond_broadcast (&itemNotEmpty);
+	pthread_mutex_unlock (&itemLock);
+	return NULL;
+}
+
+/*
+ * writeTracks (int demo)
+ *
+ * This will write the tracks found by the scanning threads to the database,
+ * until all threads are done. If [demo] is non-zero, changes will not really
+ * be committed.
+ *
+ */
+void
+writeTracks (int demo) {
+	SCAN_ITEM* item;
+
+	while (1) {
+		// wait for a track, or for everyone to finish
+		pthread_mutex_lock (&itemLock);
+		while ((itemCount == 0) && (activeWalkers > 0))
+			pthread_cond_wait (&itemNotEmpty, &itemLock);
+		if (itemCount == 0) {
+			// all done
+			pthread_mutex_unlock (&itemLock);
+			break;
+		}
+		item = itemQueue[itemHead];
+		itemHead = (itemHead + 1) % SCAN_QUEUE_SIZE; itemCount--;
+		pthread_cond_signal (&itemNotFull);
+		pthread_mutex_unlock (&itemLock);
+
+		// store it
+		storeTrack (item->fname, &item->sig, item->title, item->artist, item->album, item->year, item->trackno, demo);
+		showProgress();
+		free (item->fname); free (item->title); free (item->artist); free (item->album);
+		free (item);
+	}
+}
+
+/*
+ * scanParallel (char** dirs, int num, int demo)
+ *
+ * This will scan the [num] directories [dirs] using [numThreads] threads,
+ * while this thread writes the tracks found to the database. If [demo] is
+ * non-zero, changes will not really be committed.
+ *
+ */
+void
+scanParallel (char** dirs, int num, int demo) {
+	int i, started = 0;
+
+	// set up the walkers, and hand out the directories
+	walkers = (SCAN_WALKER*)calloc (numThreads, sizeof (SCAN_WALKER));
+	for (i = 0; i < numThreads; i++) {
+		pthread_mutex_init (&walkers[i].lock, NULL);
+		walkers[i].index = i; walkers[i].demo = demo;
+	}
+	for (i = 0; i < num; i++)
+		pushDirectory (&walkers[i % numThreads], dirs[i]);
+
+	// off they go
+	queueTracks = 1; activeWalkers = numThreads;
+	for (i = 0; i < numThreads; i++)
+		if (pthread_create (&walkers[i].thread, NULL, walkerMain, &walkers[i]) == 0) {
+			walkers[i].running = 1;
+			started++;
+		} else {
+			// this failed. one less to wait for
+			pthread_mutex_lock (&itemLock);
+			activeWalkers--;
+			pthread_mutex_unlock (&itemLock);
+		}
+
+	// did any of them start?
+	if (started == 0) {
+		// no. do it all ourselves then
+		logger->log (LOG_WARNING, "Unable to start scanning threads, scanning sequentially");
+		queueTracks = 0;
+		walkerMain (&walkers[0]);
+	} else {
+		writeTracks (demo);
+		for (i = 0; i < numThreads; i++)
+			if (walkers[i].running)
+				pthread_join (walkers[i].thread, NULL);
+	}
+	queueTracks = 0;
+
+	for (i = 0; i < numThreads; i++) {
+		pthread_mutex_destroy (&walkers[i].lock);
+		if (walkers[i].dirs) free (walkers[i].dirs);
+	}
+	free (walkers);
+	walkers = NULL;
+}
+
+/*
+ * hasPrefix (const char* path, const char* dir)
+ *
+ * This will return non-zero if [path] is [dir] or resides in it.
+ *
+ */
+int
+hasPrefix (const char* path, const char* dir) {
+	int len = strlen (dir);
+
+	return (!strncmp (path, dir, len)) && ((path[len] == '\0') || (path[len] == '/'));
+}
+
+/*
+ * unlinkFile (SCAN_FILE* f)
+ *
+ * This will take file [f] out of the known files, without freeing it.
+ *
+ */
+void
+unlinkFile (SCAN_FILE* f) {
+	SCAN_FILE** ptr = &knownFiles[hashName (f->fname, 0)];
+
+	while (*ptr != NULL) {
+		if (*ptr == f) {
+			*ptr = f->next;
+			break;
+		}
+		ptr = &(*ptr)->next;
+	}
+	f->next = NULL;
+}
+
+/*
+ * takeFiles (const char* path, int isdir)
+ *
+ * This will take file [path] out of the known files, or all files within it
+ * if [isdir] is non-zero. The files are returned as a list.
+ *
+ */
+SCAN_FILE*
+takeFiles (const char* path, int isdir) {
+	SCAN_FILE* list = NULL;
+	SCAN_FILE* f;
+	SCAN_FILE* next;
+	int i;
+
+	// just a file?
+	if (!isdir) {
+		// yes. this is easy
+		f = findFile (knownFiles, path);
+		if (f != NULL)
+			unlinkFile (f);
+		return f;
+	}
+
+	// go through them all
+	for (i = 0; i < SCAN_HASH_SIZE; i++)
+		for (f = knownFiles[i]; f != NULL; f = next) {
+			next = f->next;
+			if (hasPrefix (f->fname, path)) {
+				unlinkFile (f);
+				f->next = list; list = f;
+			}
+		}
+	return list;
+}
+
+/*
+ * removeFiles (const char* path, int isdir)
+ *
+ * This will remove the track of file [path] from the database, or those of
+ * all files within it if [isdir] is non-zero.
+ *
+ */
+void
+removeFiles (const char* path, int isdir) {
+	SCAN_FILE* f = takeFiles (path, isdir);
+	SCAN_FILE* next;
+
+	for (; f != NULL; f = next) {
+		next = f->next;
+		TRACK::remove (f->id);
+		countChange();
+
+		// be verbose if needed
+		if (verbose > 1)
+			printf ("Removed track [%s][%u]\n", f->fname, f->id);
+		freeFile (f);
+	}
+}
+
+/*
+ * renameFiles (const char* from, const char* to, int isdir)
+ *
+ * This will rename the track of file [from] to [to], or those of all files
+ * within directory [from] if [isdir] is non-zero. The tracks keep their IDs.
+ *
+ */
+void
+renameFiles (const char* from, const char* to, int isdir) {
+	SCAN_FILE* f = takeFiles (from, isdir);
+	SCAN_FILE* next;
+	SCAN_FILE* g;
+	TRACK* t;
+	char fname[PATH_MAX];
+	unsigned int h;
+
+	for (; f != NULL; f = next) {
+		next = f->next;
+		snprintf (fname, sizeof (fname), "%s%s", to, f->fname + strlen (from));
+
+		// anything replaced?
+		g = takeFiles (fname, 0);
+		if (g != NULL) {
+			// yes. it's gone now
+			TRACK::remove (g->id);
+			countChange();
+			freeFile (g);
+		}
+
+		// move the track along
+		try {
+			t = new TRACK (f->id);
+			t->setFilename (fname);
+			t->update();
+			delete t;
+			countChange();
+		} catch (TrackException e) {
+			// it's gone. forget about it
+			freeFile (f);
+			continue;
+		}
+
+		// be verbose if needed
+		if (verbose > 1)
+			printf ("Moved track [%s][%u] to [%s]\n", f->fname, f->id, fname);
+
+		free (f->fname); f->fname = strdup (fname);
+		h = hashName (f->fname, 0);
+		f->next = knownFiles[h]; knownFiles[h] = f;
+	}
+}
+
+/*
+ * addWatch (const char* dir)
+ *
+ * This will watch directory [dir]. It will return non-zero if it's a new
+ * watch or zero if the directory was watched already or can't be watched.
+ *
+ */
+int
+addWatch (const char* dir) {
+	char** ptr;
+	int wd;
+
+	wd = inotify_add_watch (watchFD, dir, IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+	if (wd < 0) {
+		// out of watches?
+		if ((errno == ENOSPC) && (!watchLimited)) {
+			// yes. fall back to rescanning every now and then
+			logger->log (LOG_WARNING, "Out of inotify watches, raise fs.inotify.max_user_watches; rescanning every %u seconds instead", SCAN_WATCH_RESCAN);
+			watchLimited++;
+		}
+		return 0;
+	}
+
+	// make room
+	if (wd >= watchSize) {
+		ptr = (char**)realloc (watchDirs, (wd + 256) * sizeof (char*));
+		if (ptr == NULL) {
+			// out of memory. never mind then
+			inotify_rm_watch (watchFD, wd);
+			return 0;
+		}
+		memset (ptr + watchSize, 0, (wd + 256 - watchSize) * sizeof (char*));
+		watchDirs = ptr; watchSize = wd + 256;
+	}
+
+	// watched already?
+	if (watchDirs[wd] != NULL)
+		// yes. a symlink must be pointing here
+		return 0;
+	watchDirs[wd] = strdup (dir);
+	return 1;
+}
+
+/*
+ * watchTree (const char* dirname)
+ *
+ * This will watch directory [dirname] and everything below it.
+ *
+ */
+void
+watchTree (const char* dirname) {
+	char tmp[PATH_MAX];
+	struct dirent* dent;
+	struct stat st;
+	DIR* dir;
+
+	// new watch?
+	if (!addWatch (dirname))
+		// no. there's nothing below it we don't know of
+		return;
+
+	dir = opendir (dirname);
+	if (dir == NULL)
+		return;
+	while ((dent = readdir (dir)) != NULL) {
+		// skip '.' and '..'
+		if ((!strcmp (dent->d_name, ".")) || (!strcmp (dent->d_name, "..")))
+			continue;
+
+		// watch the directories too
+		snprintf (tmp, sizeof (tmp) - 1, "%s/%s", dirname, dent->d_name);
+		if ((stat (tmp, &st) == 0) && (S_ISDIR (st.st_mode)))
+			watchTree (tmp);
+	}
+	closedir (dir);
 }
-#endif /* OGG_SUPPORT */
 
 /*
- * scanFile_module (char* file, int demo)
+ * moveWatches (const char* from, const char* to)
  *
- * This will scan file [file] for module tags and add it. If [demo] is non-zero,
- * changes will not actually be commited. [ext] should be the extension and is
- * used to determine the file type.
+ * This will update the watches of directory [from] and everything below it,
+ * which is now known as [to].
  *
  */
 void
-scanFile_module (char* file, char* ext, int demo) {
-	char title[TRACK_MAX_TITLE_LEN];
-	FILE* f;
-	int offset = 0;
-	int titleLength = 0;
-	char* ptr = strrchr (file, '/');
-
-	// defaults
-	strcpy (title,  "?");
-
-	// depending on the extension, set options
-	if ((!strcasecmp (ext, "mod"))) {
-		// .MOD files have 20 bytes title length at offset 0 */
-		titleLength = 20;
-	} else if (!strcasecmp (ext, "s3m")) {
-		// .S3M files have 20 bytes title length at offset 0 */
-		titleLength = 28;
-	} else if (!strcasecmp (ext, "stm")) {
-		// .STM files have 20 bytes title length at offset 0 */
-		titleLength = 20;
-	} else if (!strcasecmp (ext,  "it")) {
-		// .IT files have 26 bytes title length at offset 4 */
-		titleLength = 26; offset = 4;
-	} else if (!strcasecmp (ext,  "xm")) {
-		// .XM files have 20 bytes title length at offset 17 */
-		titleLength = 20; offset = 17;
-	} else
-		// ?
-		return;
+moveWatches (const char* from, const char* to) {
+	char tmp[PATH_MAX];
+	int i;
 
-	// open the file
-	if ((f = fopen (file, "rb")) == NULL)
-		// this failed. leave
-		return;
+	for (i = 0; i < watchSize; i++)
+		if ((watchDirs[i] != NULL) && (hasPrefix (watchDirs[i], from))) {
+			snprintf (tmp, sizeof (tmp), "%s%s", to, watchDirs[i] + strlen (from));
+			free (watchDirs[i]); watchDirs[i] = strdup (tmp);
+		}
+}
 
-	// seek to the correct offset */
-	fseek (f, offset, SEEK_SET);
+/*
+ * dropWatches (const char* dir)
+ *
+ * This will stop watching directory [dir] and everything below it.
+ *
+ */
+void
+dropWatches (const char* dir) {
+	int i;
 
-	// read the title
-	memset (title, 0, TRACK_MAX_TITLE_LEN);
-	if (!fread (title, titleLength, 1, f)) {
-		// this failed. close the file and bail out
-		fclose (f);
-		return;
-	}
+	for (i = 0; i < watchSize; i++)
+		if ((watchDirs[i] != NULL) && (hasPrefix (watchDirs[i], dir))) {
+			inotify_rm_watch (watchFD, i);
+			free (watchDirs[i]); watchDirs[i] = NULL;
+		}
+}
 
-	// got a title?
-	if (!*title)
-		// no. use the filename instead
-		strncpy (title, ptr + 1, TRACK_MAX_TITLE_LEN - 1);
+/*
+ * isWatched (const char* dir)
+ *
+ * This will return non-zero if directory [dir] is watched.
+ *
+ */
+int
+isWatched (const char* dir) {
+	int i;
 
-	// add it
-	addTrack (file, title, module_artist, module_album, 0, 0, demo);
+	for (i = 0; i < watchSize; i++)
+		if ((watchDirs[i] != NULL) && (!strcmp (watchDirs[i], dir)))
+			return 1;
+	return 0;
 }
 
 /*
- * scanFile_rad (char* file, int demo)
+ * addEvent (int type, const char* path, char* from)
  *
- * This will scan file [file] for a RAD module title and add it. If [demo] is
- * non-zero, changes will not actually be commited.
+ * This will have change [type] to [path] applied later on. [from] must be
+ * allocated already, if given.
  *
  */
 void
-scanFile_rad (char* file, int demo) {
-	char title[TRACK_MAX_TITLE_LEN];
-	char tmp[TRACK_MAX_TITLE_LEN];
-	char* ptr = strrchr (file, '/');
-	FILE* f;
-	int i = 0, j;
-
-	// defaults
-	strcpy (title,  "?");
+addEvent (int type, const char* path, char* from) {
+	SCAN_EVENT* ptr;
+
+	// make room
+	if (numEvents == eventSize) {
+		ptr = (SCAN_EVENT*)realloc (events, (eventSize + 256) * sizeof (SCAN_EVENT));
+		if (ptr == NULL) {
+			// out of memory. have everything rescanned instead
+			if (from) free (from);
+			needRescan++;
+			return;
+		}
+		events = ptr; eventSize += 256;
+	}
+	events[numEvents].type = type; events[numEvents].from = from;
+	events[numEvents].path = strdup (path);
+	numEvents++;
+}
 
-	// open the file
-	if ((f = fopen (file, "rb")) == NULL)
-		// this failed. leave
+/*
+ * flushMove()
+ *
+ * This will handle a move away which wasn't followed by an arrival, meaning
+ * the file or directory left the library.
+ *
+ */
+void
+flushMove() {
+	if (moveFrom == NULL)
 		return;
 
-	// fetch the first 3 bytes
-	if (!fread (tmp, 3, 1, f)) {
-		// this failed. close the file and bail out
-		fclose (f);
-		return;
-	}
+	addEvent (SCAN_EVENT_GONE, moveFrom, (moveIsDir) ? strdup (moveFrom) : NULL);
+	free (moveFrom); moveFrom = NULL;
+}
 
-	// got a RAD file?
-	if ((tmp[0] != 'R') || (tmp[1] != 'A') || (tmp[2] != 'D')) {
-		// no. close the file and bail out
-		fclose (f);
+/*
+ * readEvents()
+ *
+ * This will read the events inotify has for us, and turn them into changes
+ * to be applied.
+ *
+ */
+void
+readEvents() {
+	char buf[65536] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+	struct inotify_event* ev;
+	char path[PATH_MAX];
+	int len, i;
+
+	len = read (watchFD, buf, sizeof (buf));
+	if (len <= 0)
 		return;
-	}
 
-	// reset the title
-	memset (title, 0, TRACK_MAX_TITLE_LEN);
+	for (i = 0; i < len; i += sizeof (struct inotify_event) + ev->len) {
+		ev = (struct inotify_event*)(buf + i);
 
-	// check for a description
-	fseek (f, 0x11, SEEK_SET);
-	if (!fread (tmp, 1, 1, f)) {
-		// this failed. close the file and bail out
-		fclose (f);
-		return;
-	}
-	if (tmp[0] & 0x80) {
-		// we have a description! fetch it
-		do {
-			// fetch the char
-			if (!fread (tmp, 1, 1, f)) {
-				// this failed. close the file and bail out
-				fclose (f);
-				return;
+		// did inotify lose track?
+		if (ev->mask & IN_Q_OVERFLOW) {
+			// yes. everything has to be rescanned
+			needRescan++;
+			continue;
+		}
+
+		// watch gone?
+		if (ev->mask & IN_IGNORED) {
+			// yes. forget about it
+			if ((ev->wd < watchSize) && (watchDirs[ev->wd] != NULL)) {
+				free (watchDirs[ev->wd]); watchDirs[ev->wd] = NULL;
 			}
+			continue;
+		}
 
-			// newline?
-			if (tmp[0] == 1)
-				// yes. stop adding the song name then
-				tmp[0] = 0;
-			else if ((tmp[0] >= 0x2) && (tmp[0] <= 0x1f))
-				// output this many spaces
-				for (j = 0; j < tmp[0]; j++)
-					title[i++] = ' ';
-			else if (tmp[0])
-				// just append it
-				title[i++] = tmp[0];
-		} while (tmp[0]);
-	}
+		// build the name
+		if ((ev->wd >= watchSize) || (watchDirs[ev->wd] == NULL) || (ev->len == 0))
+			continue;
+		snprintf (path, sizeof (path) - 1, "%s/%s", watchDirs[ev->wd], ev->name);
+
+		// does this complete a move?
+		if ((ev->mask & IN_MOVED_TO) && (moveFrom != NULL) && (ev->cookie == moveCookie)) {
+			// yes. the watches within a directory move along right away
+			if (ev->mask & IN_ISDIR)
+				moveWatches (moveFrom, path);
+			addEvent (SCAN_EVENT_MOVED, path, moveFrom);
+			moveFrom = NULL;
+			continue;
+		}
 
-	// got a title?
-	if (!*title)
-		// no. use the filename instead
-		strncpy (title, ptr + 1, TRACK_MAX_TITLE_LEN - 1);
+		// anything else means the last move away left the library
+		flushMove();
+		if (ev->mask & IN_MOVED_FROM) {
+			// wait for it to arrive
+			moveFrom = strdup (path); moveCookie = ev->cookie;
+			moveIsDir = (ev->mask & IN_ISDIR) ? 1 : 0;
+			continue;
+		}
 
-	// add it
-	addTrack (file, title, adlib_artist, adlib_album, 0, 0, demo);
+		// new directory?
+		if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) && (ev->mask & IN_ISDIR))
+			// yes. watch it right away, so nothing within it is missed
+			watchTree (path);
+
+		// removed directories have their contents removed first
+		if ((ev->mask & IN_DELETE) && (ev->mask & IN_ISDIR))
+			continue;
+
+		addEvent (SCAN_EVENT_CHANGED, path, NULL);
+	}
 }
 
 /*
- * scanFile_raw (char* file, int demo)
+ * applyEvents()
  *
- * This will just take file [file] add it. If [demo] is non-zero, changes will
- * not actually be commited.
+ * This will apply all changes seen, in the order they happened.
  *
  */
 void
-scanFile_raw (char* file, int demo) {
-	char title[TRACK_MAX_TITLE_LEN];
-	char* ptr = strrchr (file, '/');
+applyEvents() {
+	struct stat st;
+	SCAN_EVENT* ev;
+	unsigned int changes = numChanges;
+	int i, isdir;
+
+	// everything goes in a single transaction, unless there's a lot of it
+	if (batchSize > 0)
+		DBUTIL::begin();
+
+	for (i = 0; i < numEvents; i++) {
+		ev = &events[i];
+		switch (ev->type) {
+			case SCAN_EVENT_CHANGED: // is it still there?
+			                         if (stat (ev->path, &st) < 0) {
+			                           // no. it's gone then
+			                           isdir = isWatched (ev->path);
+			                           removeFiles (ev->path, isdir);
+			                           if (isdir)
+			                             dropWatches (ev->path);
+			                           break;
+			                         }
+			                         if (S_ISREG (st.st_mode))
+			                           scanFile (ev->path, &st, 0);
+			                         else if (S_ISDIR (st.st_mode))
+			                           scanDirectory (ev->path, 0);
+			                         break;
+			  case SCAN_EVENT_MOVED: // the tracks keep their IDs
+			                         isdir = (stat (ev->path, &st) == 0) && (S_ISDIR (st.st_mode));
+			                         renameFiles (ev->from, ev->path, isdir);
+
+			                         // whatever else happened is picked up by a scan
+			                         if (isdir)
+			                           scanDirectory (ev->path, 0);
+			                         else if (stat (ev->path, &st) == 0)
+			                           scanFile (ev->path, &st, 0);
+			                         break;
+			   case SCAN_EVENT_GONE: // [from] is only there for directories
+			                         removeFiles (ev->path, (ev->from != NULL));
+			                         if (ev->from != NULL)
+			                           dropWatches (ev->path);
+			                         break;
+		}
+		free (ev->path);
+		if (ev->from) free (ev->from);
+	}
+	numEvents = 0;
 
-	// these file are all headerless (as far as I know at least), so just use
-	// the filename for them.
-	strncpy (title, ptr + 1, TRACK_MAX_TITLE_LEN - 1);
+	if (batchSize > 0)
+		checkpoint();
 
-	// add it
-	addTrack (file, title, adlib_artist, adlib_album, 0, 0, demo);
+	// keep the change log in bounds, if anything was logged at all
+	if ((catalog_log_size > 0) && (numChanges != changes))
+		CHANGE::prune (catalog_log_size);
 }
 
+// rescan() has to get rid of what it didn't see, like the first scan
+void pruneFiles (char** dirs, int num, int demo);
+
 /*
- * scanFile_sid (char* file, int demo)
+ * rescan (char** dirs, int num)
  *
- * This will just take SID file [file] add it. If [demo] is non-zero, changes
- * will not actually be commited.
+ * This will scan the [num] directories [dirs] for changes inotify didn't tell
+ * about, and watch everything which isn't watched yet. The tracks of files
+ * which weren't seen, as their removal went untold as well, are removed.
  *
  */
 void
-scanFile_sid (char* file, int demo) {
-	char title[TRACK_MAX_TITLE_LEN];
-	char* ptr = strrchr (file, '/');
-
-	// these file are all headerless (as far as I know at least), so just use
-	// the filename for them.
-	strncpy (title, ptr + 1, TRACK_MAX_TITLE_LEN - 1);
+rescan (char** dirs, int num) {
+	SCAN_FILE* f;
+	int i;
+
+	// start counting afresh
+	for (i = 0; i < SCAN_HASH_SIZE; i++)
+		for (f = knownFiles[i]; f != NULL; f = f->next)
+			f->seen = 0;
+	scanErrors = 0;
+
+	if (batchSize > 0)
+		DBUTIL::begin();
+	for (i = 0; i < num; i++) {
+		watchTree (dirs[i]);
+		scanDirectory (dirs[i], 0);
+	}
+	if (batchSize > 0)
+		checkpoint();
 
-	// add it
-	addTrack (file, title, sid_artist, sid_album, 0, 0, demo);
+	pruneFiles (dirs, num, 0);
 }
 
 /*
- * scanFile_adlib (char* file, int demo)
+ * stopWatch (int sig)
  *
- * This will scan file [file] for module tags and add it. If [demo] is non-zero,
- * changes will not actually be commited. [ext] should be the extension and is
- * used to determine the file type.
+ * This will handle signal [sig] by stopping to watch.
  *
  */
 void
-scanFile_adlib (char* file, char* ext, int demo) {
-	char title[TRACK_MAX_TITLE_LEN];
-	FILE* f;
-	int offset = 0;
-	int titleLength = 0;
-	char* ptr = strrchr (file, '/');
+stopWatch (int sig) {
+	stopWatching++;
+}
 
-	// defaults
-	strcpy (title,  "?");
-
-	// depending on the extension, set options
-	if ((!strcasecmp (ext, "d00"))) {
-		// .D00 files have 32 bytes title length at offset 11 */
-		titleLength = 32; offset = 11;
-	} else if (!strcasecmp (ext, "amd")) {
-		// .AMD files have 24 bytes title length at offset 0 */
-		titleLength = 24;
-	} else
-		// ?
-		return;
+/*
+ * watchDirectories (char** dirs, int num)
+ *
+ * This will watch the [num] directories [dirs] for changes and apply them,
+ * until told to stop. It will return zero on failure or non-zero on success.
+ *
+ */
+int
+watchDirectories (char** dirs, int num) {
+	time_t now, firstEvent = 0, lastEvent = 0, lastScan;
+	struct pollfd pfd;
+	int i;
 
-	// open the file
-	if ((f = fopen (file, "rb")) == NULL)
-		// this failed. leave
-		return;
+	watchFD = inotify_init();
+	if (watchFD < 0) {
+		// this failed. complain
+		fprintf (stderr, "Unable to initialize inotify: %s\n", strerror (errno));
+		return 0;
+	}
 
-	// seek to the correct offset */
-	fseek (f, offset, SEEK_SET);
+	// the tracks added so far could be moved or removed now
+	adoptAddedFiles();
+	watching++;
+	for (i = 0; i < num; i++)
+		watchTree (dirs[i]);
 
-	// read the title
-	memset (title, 0, TRACK_MAX_TITLE_LEN);
-	if (!fread (title, titleLength, 1, f)) {
-		// this failed. close the file and bail out
-		fclose (f);
-		return;
-	}
+	signal (SIGINT, stopWatch);
+	signal (SIGTERM, stopWatch);
+	if (!quiet)
+		printf ("- Watching for changes\n");
+
+	lastScan = time (NULL);
+	while (!stopWatching) {
+		pfd.fd = watchFD; pfd.events = POLLIN; pfd.revents = 0;
+		if ((poll (&pfd, 1, 1000) > 0) && (pfd.revents & POLLIN)) {
+			readEvents();
+			now = time (NULL);
+			if (numEvents == 0 && moveFrom == NULL)
+				continue;
+			if (firstEvent == 0)
+				firstEvent = now;
+			lastEvent = now;
+		}
+		now = time (NULL);
+
+		// quiet for a while, or held back long enough?
+		if ((firstEvent != 0) && ((now - lastEvent >= SCAN_WATCH_QUIET) || (now - firstEvent >= SCAN_WATCH_MAX_DELAY))) {
+			// yes. apply the changes
+			flushMove();
+			if (verbose)
+				printf ("Applying %u changes\n", numEvents);
+			applyEvents();
+			firstEvent = 0;
+		}
 
-	// got a title?
-	if (!*title)
-		// no. use the filename instead
-		strncpy (title, ptr + 1, TRACK_MAX_TITLE_LEN - 1);
+		// need to look for changes ourselves?
+		if ((needRescan) || ((watchLimited) && (now - lastScan >= SCAN_WATCH_RESCAN))) {
+			// yes. do it
+			if (verbose)
+				printf ("Rescanning\n");
+			rescan (dirs, num);
+			needRescan = 0; lastScan = now;
+		}
+	}
 
-	// add it
-	addTrack (file, title, adlib_artist, adlib_album, 0, 0, demo);
+	// apply whatever is left
+	flushMove();
+	applyEvents();
+
+	for (i = 0; i < watchSize; i++)
+		if (watchDirs[i] != NULL)
+			free (watchDirs[i]);
+	if (watchDirs) free (watchDirs);
+	if (events) free (events);
+	close (watchFD);
+	return 1;
 }
 
 /*
- * scanFile (char* file, int demo)
+ * goneBucket (SCAN_SIGNATURE* sig)
  *
- * This will scan file [file] for tags and add it. If [demo] is non-zero,
- * changes will not actually be commited.
+ * This will return the bucket of a vanished file with signature [sig]. Files
+ * are known by their fingerprint, or by their inode if they have none yet.
  *
  */
-void
-scanFile (char* file, int demo) {
-	char* ext = strrchr (file, '.');
-
-	// isolate the extension
-	if (ext == NULL)
-		return;
-	ext++;
-
-#ifdef MP3_SUPPORT
-	// mp3?
-	if (!strcasecmp (ext, "mp3")) {
-		// yes. do it
-		scanFile_MP3 (file, demo);
-		return;
-	}
-#endif /* MP3_SUPPORT */
-
-#ifdef OGG_SUPPORT
-	// ogg?
-	if (!strcasecmp (ext, "ogg")) {
-		// yes. do it
-		scanFile_ogg (file, demo);
-		return;
-	}
-#endif /* OGG_SUPPORT */
+unsigned int
+goneBucket (SCAN_SIGNATURE* sig) {
+	return hashName (sig->fingerprint, (*sig->fingerprint) ? 0 : (int)(sig->inode ^ (sig->inode >> 32)));
+}
 
-	// mod, s3m, stm, it, xm?
-	if ((!strcasecmp (ext, "mod")) || (!strcasecmp (ext, "s3m")) || (!strcasecmp (ext, "stm")) ||
-			(!strcasecmp (ext,  "it")) || (!strcasecmp (ext,  "xm"))) {
-		// yes. do it
-		scanFile_module (file, ext, demo);
-		return;
+/*
+ * takeGone (SCAN_FILE** gone, SCAN_SIGNATURE* sig)
+ *
+ * This will take the vanished file from [gone] which has the audio of a
+ * file with signature [sig], and return it. It will return NULL if there is
+ * no such file.
+ *
+ */
+SCAN_FILE*
+takeGone (SCAN_FILE** gone, SCAN_SIGNATURE* sig) {
+	SCAN_FILE** ptr;
+	SCAN_FILE* g;
+	int pass;
+
+	for (pass = 0; pass < 2; pass++) {
+		// first by fingerprint, then by inode for files which have none yet
+		if ((pass == 0) && (*sig->fingerprint == '\0'))
+			continue;
+		ptr = &gone[hashName ((pass == 0) ? sig->fingerprint : "", (pass == 0) ? 0 : (int)(sig->inode ^ (sig->inode >> 32)))];
+		for (; (g = *ptr) != NULL; ptr = &g->next) {
+			if (pass == 0) {
+				if (strcmp (g->sig.fingerprint, sig->fingerprint))
+					continue;
+			} else if ((*g->sig.fingerprint) || (g->sig.inode != sig->inode) ||
+			           (g->sig.device != sig->device) || (g->sig.size != sig->size))
+				continue;
+
+			// got it
+			*ptr = g->next; g->next = NULL;
+			return g;
+		}
 	}
+	return NULL;
+}
 
-	// rad?
-	if (!strcasecmp (ext, "rad")) {
-		// yes. do it
-		scanFile_rad (file, demo);
-		return;
-	}
+/*
+ * moveTrack (SCAN_FILE* g, SCAN_FILE* f)
+ *
+ * This will move the track of vanished file [g] to file [f], which was added
+ * by the scan. The track added for [f] is removed, so the original one keeps
+ * its ID and play count. It will return zero on failure or non-zero on
+ * success.
+ *
+ */
+int
+moveTrack (SCAN_FILE* g, SCAN_FILE* f) {
+	TRACK* t;
+	TRACK* old;
 
-	// raw, laa, lds, sci, hsc, sat, sa2?
-	if ((!strcasecmp (ext, "raw")) || (!strcasecmp (ext, "laa")) || (!strcasecmp (ext, "lds")) ||
-			(!strcasecmp (ext, "sci")) || (!strcasecmp (ext, "hsc")) || (!strcasecmp (ext, "sat")) ||
-			(!strcasecmp (ext, "sa2")) ) {
-		// yes. do it
-		scanFile_raw (file, demo);
-		return;
+	try {
+		t = new TRACK (f->fname);
+	} catch (TrackException e) {
+		// it never made it. too bad
+		return 0;
 	}
-
-	// d00, amd?
-	if ((!strcasecmp (ext, "d00")) || (!strcasecmp (ext, "amd"))) {
-		// yes. do it
-		scanFile_adlib (file, ext, demo);
-		return;
+	try {
+		old = new TRACK (g->id);
+	} catch (TrackException e) {
+		// someone else removed it already
+		delete t;
+		return 0;
 	}
 
-	// sid?
-	if (!strcasecmp (ext, "sid")) {
-		// yes. process them
-		scanFile_sid (file, demo);
-		return;
-	}
+	// the tags may have changed along the way
+	old->setFilename (f->fname);
+	old->setTitle (t->getTitle());
+	old->setArtistID (t->getArtistID());
+	old->setAlbumID (t->getAlbumID());
+	old->setYear (t->getYear());
+	old->setTrackNo (t->getTrackNo());
+	old->setSignature (f->sig.size, f->sig.mtime, f->sig.inode, f->sig.device);
+	old->setFingerprint (f->sig.fingerprint);
+	old->setAudio (f->sig.audio.duration, f->sig.audio.bitrate, f->sig.audio.samplerate);
+	TRACK::remove (t->getID());
+	old->update();
+	countChange();
+
+	delete old;
+	delete t;
+	return 1;
 }
 
 /*
- * scanDirectory (char* dirname, int demo)
+ * pruneFiles (char** dirs, int num, int demo)
  *
- * This will scan directory [dirname] and all its children. If [demo] is
- * non-zero, changes will not really be committed.
+ * This will remove the tracks of the files within the [num] directories
+ * [dirs] which the scan didn't see. A file the scan added with the audio of
+ * such a file is taken to be moved there, and gets its track instead. If
+ * [demo] is non-zero, changes will not actually be committed.
  *
  */
 void
-scanDirectory (char* dirname, int demo) {
-	char tmp[PATH_MAX];
-	struct dirent* dent;
-	struct stat st;
-	DIR* dir = opendir (dirname);
-
-	// did this work?
-	if (dir == NULL)
-		// no. bail out
+pruneFiles (char** dirs, int num, int demo) {
+	SCAN_FILE** gone;
+	SCAN_FILE* f;
+	SCAN_FILE* g;
+	SCAN_FILE* next;
+	int* ids;
+	int numGone = 0, batching, i, j;
+	unsigned int h;
+
+	// were all directories read?
+	if (scanErrors > 0) {
+		// no. the files in them may still be there
+		fprintf (stderr, "Not removing any tracks, as %u files or directories could not be read\n", scanErrors);
 		return;
+	}
 
-	// wade through the tree
-	while ((dent = readdir (dir)) != NULL) {
-		// skip '.' and '..'
-		if ((!strcmp (dent->d_name, ".")) || (!strcmp (dent->d_name, "..")))
-			continue;
-
-		// build the file name
-		snprintf (tmp, sizeof (tmp) - 1, "%s/%s", dirname, dent->d_name);
-
-		// stat the file/dir
-		if (stat (tmp, &st) < 0)
-			// this failed. ignore it
-			continue;
-
-		// is it... a file ?
-		if (st.st_mode & S_IFREG) {
-			// yes.  be verbose if needed
-			if (verbose > 3)
-				printf ("Scanning [%s]\n", tmp);
+	gone = (SCAN_FILE**)calloc (SCAN_HASH_SIZE, sizeof (SCAN_FILE*));
+	if (gone == NULL)
+		// out of memory. never mind then
+		return;
 
-			// build the name
-			scanFile (tmp, demo);
+	// the set difference: known files in the directories scanned, but not seen
+	for (i = 0; i < SCAN_HASH_SIZE; i++)
+		for (f = knownFiles[i]; f != NULL; f = next) {
+			next = f->next;
+			if (f->seen)
+				continue;
+			for (j = 0; (j < num) && (!hasPrefix (f->fname, dirs[j])); j++);
+			if (j == num)
+				continue;
+
+			unlinkFile (f);
+			h = goneBucket (&f->sig);
+			f->next = gone[h]; gone[h] = f;
+			numGone++;
+		}
 
-			// silence?
-			if (!quiet) {
-				// no. show the twirlie
-				printf ("%c%c", 8, twirl[tpos++]);
-				tpos %= (sizeof (twirl) - 1);
-				fflush (stdout);
+	batching = (numGone > 0) && (batchSize > 0);
+	if (batching)
+		DBUTIL::begin();
+
+	// files which were moved keep their tracks
+	for (i = 0; (i < SCAN_HASH_SIZE) && (numGone > 0); i++)
+		for (f = addedFiles[i]; f != NULL; f = f->next) {
+			g = takeGone (gone, &f->sig);
+			if (g == NULL)
+				continue;
+			numGone--;
+
+			if (demo) {
+				// be verbose if needed
+				if (verbose > 1)
+					printf ("Would move track [%s][%u] to [%s]\n", g->fname, g->id, f->fname);
+				numMoved++;
+			} else if (moveTrack (g, f)) {
+				// be verbose if needed
+				if (verbose > 1)
+					printf ("Moved track [%s][%u] to [%s]\n", g->fname, g->id, f->fname);
+				numMoved++; numNew--;
 			}
+			freeFile (g);
 		}
 
-		// is it, a dir ?
-		if (st.st_mode & S_IFDIR) {
-			// yes. scan it
-			scanDirectory (tmp, demo);
+	// the rest is gone for good
+	ids = (numGone > 0) ? (int*)malloc (numGone * sizeof (int)) : NULL;
+	for (i = 0, j = 0; i < SCAN_HASH_SIZE; i++)
+		while ((g = gone[i]) != NULL) {
+			gone[i] = g->next;
+
+			// be verbose if needed
+			if (verbose > 1)
+				printf ("%s track [%s][%u]\n", (demo) ? "Would remove" : "Removed", g->fname, g->id);
+			if (ids != NULL)
+				ids[j++] = g->id;
+			freeFile (g);
 		}
+	if ((!demo) && (j > 0)) {
+		TRACK::remove (ids, j);
+		numChanges += j;
 	}
+	numRemoved += j;
 
-	// a farewell to directories
-	closedir (dir);
+	if (ids) free (ids);
+	free (gone);
+	if (batching)
+		checkpoint();
 }
 
 /*
@@ -749,12 +2764,14 @@ scanDirectory (char* dirname, int demo) {
  */
 void
 usuage() {
-	fprintf (stderr, "usuage: scan [-w] [-c filename] directory ...\n\n");
+	fprintf (stderr, "usuage: scan [-w] [-c filename] [-j threads] [--watch] directory ...\n\n");
 	fprintf (stderr, "        -w            Wipe database before adding files\n");
 	fprintf (stderr, "        -c filename   Specify configuration filename\n");
 	fprintf (stderr, "        -v            Increase verbosity (repeat for more)\n");
 	fprintf (stderr, "        -d            Demo mode: don't change anything\n");
 	fprintf (stderr, "        -q            Quiet mode: don't print progress\n");
+	fprintf (stderr, "        -j threads    Scan using this many threads (default 1)\n");
+	fprintf (stderr, "        -W, --watch   Keep watching for changes after scanning\n");
 }
 
 /*
@@ -765,12 +2782,16 @@ usuage() {
  */
 int
 main (int argc, char** argv) {
-	int wflag = 0, demo = 0, ch;
+	int wflag = 0, demo = 0, watch = 0, ch, i;
 	char* configfile = CONFIG_FILENAME;
 	int dir_begin;
+	static struct option longopts[] = {
+		{ "watch", no_argument, NULL, 'W' },
+		{ NULL,    0,           NULL, 0   }
+	};
 
 	// parse the parameters
-	while ((ch = getopt (argc, argv, "wc:d?hvq")) != -1) {
+	while ((ch = getopt_long (argc, argv, "wc:d?hvqj:W", longopts, NULL)) != -1) {
 		switch (ch) {
 			case 'd': // demo mode
 			          demo++;
@@ -787,6 +2808,14 @@ main (int argc, char** argv) {
 			case 'q': // quietness
 			          quiet++;
 			          break;
+			case 'j': // threads
+			          numThreads = atoi (optarg);
+			          if (numThreads < 1) numThreads = 1;
+			          if (numThreads > SCAN_MAX_THREADS) numThreads = SCAN_MAX_THREADS;
+			          break;
+			case 'W': // watch mode
+			          watch++;
+			          break;
 			case '?':
 			case 'h':
 			 default: // help
@@ -803,6 +2832,13 @@ main (int argc, char** argv) {
 		exit (EXIT_FAILURE);
 	}
 
+	// demo mode only goes so far
+	if ((watch) && (demo)) {
+		// no point in watching then. complain
+		fprintf (stderr, "Watch mode can't be combined with demo mode\n");
+		exit (EXIT_FAILURE);
+	}
+
 	// load the configuration
 	config = new JUKECONFIG();
 	if (config->load (configfile) != CONFIGFILE_OK) {
@@ -822,6 +2858,8 @@ main (int argc, char** argv) {
 	config->get_string ("modules", "album", &module_album);
 	config->get_string ("adlib", "artist", &adlib_artist);
 	config->get_string ("adlib", "album", &adlib_album);
+	config->get_value ("general", "catalog_log_size", &catalog_log_size);
+	config->get_value ("general", "scan_batch_size", &batchSize);
 
 	// initialize the logger
 	logger = new SYSLOG("jukescan");
@@ -844,6 +2882,9 @@ main (int argc, char** argv) {
 		return EXIT_FAILURE;
 	}
 
+	// some things have to be done in the dialect of the database
+	DBUTIL::setType (config->getDatabaseType());
+
 #if 0
 	// do we have to chroot?
 	if (config->chroot != NULL) {
@@ -886,18 +2927,71 @@ main (int argc, char** argv) {
 		db->execute ("DELETE FROM artists");
 		db->execute ("DELETE FROM queue");
 		db->execute ("DELETE FROM tracks");
+
+		// clients caching the catalog have to start over
+		CHANGE::record (CHANGE_KIND_CATALOG, CHANGE_ACTION_DELETE, 0);
+	}
+
+	// unless starting over, learn what's there already
+	if ((!wflag) && (!loadCatalog())) {
+		// this failed. complain
+		fprintf (stderr, "Unable to load the catalog, out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	// need to batch the changes?
+	if (demo)
+		// no. there won't be any
+		batchSize = 0;
+	if (batchSize > 0) {
+		// yes. get ready to add tracks in bulk
+		newTracks = (SCAN_INSERT*)malloc (batchSize * sizeof (SCAN_INSERT));
+		if (newTracks == NULL)
+			// no memory. just don't batch then
+			batchSize = 0;
+	}
+	if (batchSize > 0) {
+		// start a transaction
+		buildInsertQueries();
+		DBUTIL::begin();
 	}
 
 	// handle the directories
 	if (!quiet)
 		printf ("- Scanning %c", twirl[tpos++]);
-	while (dir_begin < argc)
-		scanDirectory (argv[dir_begin++], demo);
+	if (numThreads > 1)
+		scanParallel (argv + dir_begin, argc - dir_begin, demo);
+	else
+		for (i = dir_begin; i < argc; i++)
+			scanDirectory (argv[i], demo);
+
+	// commit whatever is left
+	if (batchSize > 0)
+		checkpoint();
+
+	// get rid of the tracks whose files are gone
+	pruneFiles (argv + dir_begin, argc - dir_begin, demo);
 
 	if (!quiet)
-		printf ("%c%c... done, %u tracks added, %u updated, %u skipped\n", 8, 8, numNew, numUpdated, skip);
+		printf ("%c%c... done, %u tracks added, %u updated, %u moved, %u removed, %u unchanged, %u skipped\n", 8, 8, numNew, numUpdated, numMoved, numRemoved, numUnchanged, skip);
+
+	// keep the catalog change log in bounds. a scan which changed nothing
+	// leaves it alone, as it has nothing to write
+	if ((!demo) && (catalog_log_size > 0) && ((numChanges > 0) || (wflag)))
+		CHANGE::prune (catalog_log_size);
+
+	// keep the library up to date if needed
+	if ((watch) && (!watchDirectories (argv + dir_begin, argc - dir_begin))) {
+		// this failed. bail out
+		freeCatalog();
+		delete db;
+		delete logger;
+		return EXIT_FAILURE;
+	}
 
 	// remove all objects
+	FILEIO::done();
+	freeCatalog();
 	delete db;
 	delete logger;
 
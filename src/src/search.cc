@@ -0,0 +1,1174 @@
+/*
+ * search.cc - Jukebox search index code
+ *
+ */
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+#include "album.h"
+#include "artist.h"
+#include "change.h"
+#include "fold.h"
+#include "fuzzy.h"
+#include "jukebox.h"
+#include "search.h"
+#include "track.h"
+
+/*
+ * fieldWeight (int fields)
+ *
+ * This will return the score of a term appearing in [fields].
+ *
+ */
+static inline unsigned int
+fieldWeight (int fields) {
+	return ((fields & SEARCH_FIELD_TITLE)  ? SEARCH_WEIGHT_TITLE  : 0) +
+	       ((fields & SEARCH_FIELD_ARTIST) ? SEARCH_WEIGHT_ARTIST : 0) +
+	       ((fields & SEARCH_FIELD_ALBUM)  ? SEARCH_WEIGHT_ALBUM  : 0);
+}
+
+/*
+ * hashTerm (const char* text)
+ *
+ * This will return the FNV-1a hash of [text].
+ *
+ */
+static unsigned int
+hashTerm (const char* text) {
+	unsigned int h = 2166136261U;
+
+	while (*text)
+		h = (h ^ (unsigned char)*text++) * 16777619U;
+	return h;
+}
+
+/*
+ * splitTerms (char* text, char** terms, int max)
+ *
+ * This will split folded [text] in place into at most [max] terms, which are
+ * stored in [terms]. Terms which are too long are cut off. It will return
+ * the number of terms.
+ *
+ */
+static int
+splitTerms (char* text, char** terms, int max) {
+	char* ptr = text;
+	char* end;
+	int n = 0;
+
+	while ((*ptr) && (n < max)) {
+		// isolate the term
+		end = strchr (ptr, ' ');
+		if (end != NULL)
+			*end++ = 0;
+		if (strlen (ptr) >= SEARCH_MAX_TERM_LEN)
+			ptr[SEARCH_MAX_TERM_LEN - 1] = 0;
+		terms[n++] = ptr;
+
+		// next
+		if (end == NULL)
+			break;
+		ptr = end;
+	}
+	return n;
+}
+
+/*
+ * intersect (const unsigned int* a, int na, const unsigned int* b, int nb,
+ *            int* ai, int* bi)
+ *
+ * This will find the values which appear in both ordered lists [a] of [na]
+ * and [b] of [nb] values; their positions are stored in [ai] and [bi]. It
+ * will return the number of values found.
+ *
+ */
+static int
+intersect (const unsigned int* a, int na, const unsigned int* b, int nb, int* ai, int* bi) {
+	int i = 0, j = 0, n = 0, k, l, mask;
+#ifdef __SSE2__
+	__m128i va, vb, m;
+
+	// compare four values of each list at a time, advancing the list whose
+	// fourth value is the lowest
+	while ((i + 4 <= na) && (j + 4 <= nb)) {
+		va = _mm_loadu_si128 ((const __m128i*)(a + i));
+		vb = _mm_loadu_si128 ((const __m128i*)(b + j));
+		m = _mm_or_si128 (
+		      _mm_or_si128 (_mm_cmpeq_epi32 (va, vb),
+		                    _mm_cmpeq_epi32 (va, _mm_shuffle_epi32 (vb, 0x39))),
+		      _mm_or_si128 (_mm_cmpeq_epi32 (va, _mm_shuffle_epi32 (vb, 0x4e)),
+		                    _mm_cmpeq_epi32 (va, _mm_shuffle_epi32 (vb, 0x93))));
+		mask = _mm_movemask_ps (_mm_castsi128_ps (m));
+
+		// anything in common?
+		if (mask)
+			// yes. figure out where
+			for (k = 0; k < 4; k++)
+				if (mask & (1 << k))
+					for (l = 0; l < 4; l++)
+						if (b[j + l] == a[i + k]) {
+							ai[n] = i + k; bi[n] = j + l; n++;
+							break;
+						}
+
+		if (a[i + 3] <= b[j + 3]) i += 4;
+		else j += 4;
+	}
+#endif /* __SSE2__ */
+
+	// handle whatever is left one by one
+	while ((i < na) && (j < nb)) {
+		if (a[i] < b[j])
+			i++;
+		else if (a[i] > b[j])
+			j++;
+		else {
+			ai[n] = i++; bi[n] = j++; n++;
+		}
+	}
+
+	return n;
+}
+
+/*
+ * compareResults (const void* a, const void* b)
+ *
+ * This will order search results by descending score, and by ID after that.
+ *
+ */
+static int
+compareResults (const void* a, const void* b) {
+	const SEARCH_RESULT* ra = (const SEARCH_RESULT*)a;
+	const SEARCH_RESULT* rb = (const SEARCH_RESULT*)b;
+
+	if (ra->score != rb->score)
+		return (ra->score > rb->score) ? -1 : 1;
+	return (ra->id < rb->id) ? -1 : ((ra->id > rb->id) ? 1 : 0);
+}
+
+/*
+ * SEARCHINDEX::SEARCHINDEX()
+ *
+ * This will construct an empty index.
+ *
+ */
+SEARCHINDEX::SEARCHINDEX() {
+	artists = albums = NULL; numArtists = artistSize = numAlbums = albumSize = 0;
+	tracks = NULL; numTracks = trackSize = 0;
+	terms = NULL; numTerms = termSize = 0;
+	scratchDocs = NULL; scratchFields = NULL; scratchSize = 0;
+}
+
+/*
+ * SEARCHINDEX::~SEARCHINDEX()
+ *
+ * This will destroy the index.
+ *
+ */
+SEARCHINDEX::~SEARCHINDEX() {
+	int i;
+
+	for (i = 0; i < termSize; i++)
+		if (terms[i] != NULL) {
+			free (terms[i]->text);
+			if (terms[i]->data) free (terms[i]->data);
+			if (terms[i]->blocks) free (terms[i]->blocks);
+			free (terms[i]);
+		}
+	if (terms) free (terms);
+
+	for (i = 0; i < numArtists; i++)
+		free (artists[i].name);
+	for (i = 0; i < numAlbums; i++)
+		free (albums[i].name);
+	for (i = 0; i < numTracks; i++)
+		free (tracks[i].title);
+	if (artists) free (artists);
+	if (albums) free (albums);
+	if (tracks) free (tracks);
+
+	if (scratchDocs) free (scratchDocs);
+	if (scratchFields) free (scratchFields);
+}
+
+/*
+ * SEARCHINDEX::findName (SEARCH_NAME* list, int num, int id, int* pos)
+ *
+ * This will look for [id] in [list] of [num] names. Its position, or where it
+ * should go, is stored in [pos]. It will return 1 if it was found or 0 if not.
+ *
+ */
+int
+SEARCHINDEX::findName (SEARCH_NAME* list, int num, int id, int* pos) {
+	int lo = 0, hi = num, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (list[mid].id < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*pos = lo;
+	return ((lo < num) && (list[lo].id == id)) ? 1 : 0;
+}
+
+/*
+ * SEARCHINDEX::findTrack (int id, int* pos)
+ *
+ * This will look for track [id]. Its position, or where it should go, is
+ * stored in [pos]. It will return 1 if it was found or 0 if not.
+ *
+ */
+int
+SEARCHINDEX::findTrack (int id, int* pos) {
+	int lo = 0, hi = numTracks, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (tracks[mid].id < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*pos = lo;
+	return ((lo < numTracks) && (tracks[lo].id == id)) ? 1 : 0;
+}
+
+/*
+ * SEARCHINDEX::setName (SEARCH_NAME** list, int* num, int* size, int id,
+ *                       const char* name, int field)
+ *
+ * This will set name [id] in [list] of [num] names, with room for [size], to
+ * [name]. The tracks which have it as [field] are indexed anew.
+ *
+ */
+void
+SEARCHINDEX::setName (SEARCH_NAME** list, int* num, int* size, int id, const char* name, int field) {
+	SEARCH_NAME* ptr;
+	int pos, i, kind;
+
+	// do we know this one?
+	if (findName (*list, *num, id, &pos)) {
+		// yes. did it change at all?
+		if (!strcmp ((*list)[pos].name, name))
+			// no. we're done
+			return;
+	} else {
+		// no. make room for it
+		if (*num == *size) {
+			ptr = (SEARCH_NAME*)realloc (*list, (*size + 256) * sizeof (SEARCH_NAME));
+			if (ptr == NULL)
+				// this failed. too bad
+				return;
+			*list = ptr; *size += 256;
+		}
+		memmove (*list + pos + 1, *list + pos, (*num - pos) * sizeof (SEARCH_NAME));
+		(*list)[pos].id = id; (*list)[pos].name = strdup ("");
+		(*num)++;
+	}
+
+	// take the tracks out under the old name, and put them back under the new
+	for (i = 0; i < numTracks; i++)
+		if (((field == SEARCH_FIELD_ARTIST) ? tracks[i].artistid : tracks[i].albumid) == id)
+			indexTrack (&tracks[i], 0);
+	kind = (field == SEARCH_FIELD_ARTIST) ? COMPLETE_KIND_ARTIST : COMPLETE_KIND_ALBUM;
+	removeName (kind, (*list)[pos].name, id);
+	free ((*list)[pos].name);
+	(*list)[pos].name = strdup (name);
+	addName (kind, name, id);
+	for (i = 0; i < numTracks; i++)
+		if (((field == SEARCH_FIELD_ARTIST) ? tracks[i].artistid : tracks[i].albumid) == id)
+			indexTrack (&tracks[i], 1);
+}
+
+/*
+ * SEARCHINDEX::setArtist (int id, const char* name)
+ *
+ * This will set the name of artist [id] to [name].
+ *
+ */
+void
+SEARCHINDEX::setArtist (int id, const char* name) {
+	setName (&artists, &numArtists, &artistSize, id, name, SEARCH_FIELD_ARTIST);
+}
+
+/*
+ * SEARCHINDEX::setAlbum (int id, const char* name)
+ *
+ * This will set the name of album [id] to [name].
+ *
+ */
+void
+SEARCHINDEX::setAlbum (int id, const char* name) {
+	setName (&albums, &numAlbums, &albumSize, id, name, SEARCH_FIELD_ALBUM);
+}
+
+/*
+ * SEARCHINDEX::getArtistName (int id)
+ *
+ * This will return the name of artist [id], or "?" if it is not known.
+ *
+ */
+const char*
+SEARCHINDEX::getArtistName (int id) {
+	int pos;
+
+	return (findName (artists, numArtists, id, &pos)) ? artists[pos].name : "?";
+}
+
+/*
+ * SEARCHINDEX::getAlbumName (int id)
+ *
+ * This will return the name of album [id], or "?" if it is not known.
+ *
+ */
+const char*
+SEARCHINDEX::getAlbumName (int id) {
+	int pos;
+
+	return (findName (albums, numAlbums, id, &pos)) ? albums[pos].name : "?";
+}
+
+/*
+ * SEARCHINDEX::getTrack (int id)
+ *
+ * This will return track [id], or NULL if it is not known.
+ *
+ */
+SEARCH_DOC*
+SEARCHINDEX::getTrack (int id) {
+	int pos;
+
+	return (findTrack (id, &pos)) ? &tracks[pos] : NULL;
+}
+
+/*
+ * SEARCHINDEX::setTrack (int id, int artistid, int albumid, const char* title)
+ *
+ * This will add or update track [id].
+ *
+ */
+void
+SEARCHINDEX::setTrack (int id, int artistid, int albumid, const char* title) {
+	SEARCH_DOC* ptr;
+	int pos;
+
+	// do we know this one?
+	if (findTrack (id, &pos)) {
+		// yes. did anything we care about change?
+		if ((tracks[pos].artistid == artistid) && (tracks[pos].albumid == albumid) &&
+		    (!strcmp (tracks[pos].title, title)))
+			// no. we're done
+			return;
+
+		// take it out first
+		indexTrack (&tracks[pos], 0);
+		removeName (COMPLETE_KIND_TITLE, tracks[pos].title, id);
+		free (tracks[pos].title);
+	} else {
+		// no. make room for it
+		if (numTracks == trackSize) {
+			ptr = (SEARCH_DOC*)realloc (tracks, (trackSize + 1024) * sizeof (SEARCH_DOC));
+			if (ptr == NULL)
+				// this failed. too bad
+				return;
+			tracks = ptr; trackSize += 1024;
+		}
+		memmove (tracks + pos + 1, tracks + pos, (numTracks - pos) * sizeof (SEARCH_DOC));
+		numTracks++;
+	}
+
+	// put it in
+	tracks[pos].id = id; tracks[pos].artistid = artistid; tracks[pos].albumid = albumid;
+	tracks[pos].title = strdup (title);
+	indexTrack (&tracks[pos], 1);
+	addName (COMPLETE_KIND_TITLE, title, id);
+}
+
+/*
+ * SEARCHINDEX::removeTrack (int id)
+ *
+ * This will remove track [id].
+ *
+ */
+void
+SEARCHINDEX::removeTrack (int id) {
+	int pos;
+
+	// do we know this one?
+	if (!findTrack (id, &pos))
+		// no. nothing to do
+		return;
+
+	indexTrack (&tracks[pos], 0);
+	removeName (COMPLETE_KIND_TITLE, tracks[pos].title, id);
+	free (tracks[pos].title);
+	memmove (tracks + pos, tracks + pos + 1, (numTracks - pos - 1) * sizeof (SEARCH_DOC));
+	numTracks--;
+}
+
+/*
+ * SEARCHINDEX::lookupTerm (const char* text, int create)
+ *
+ * This will return term [text]. If it is not there, it is added if [create]
+ * is non-zero, or NULL is returned otherwise.
+ *
+ */
+SEARCH_TERM*
+SEARCHINDEX::lookupTerm (const char* text, int create) {
+	SEARCH_TERM** table;
+	SEARCH_TERM* t;
+	unsigned int h = hashTerm (text);
+	int i, size;
+
+	// look it up
+	if (termSize > 0)
+		for (i = h & (termSize - 1); terms[i] != NULL; i = (i + 1) & (termSize - 1))
+			if ((terms[i]->hash == h) && (!strcmp (terms[i]->text, text)))
+				return terms[i];
+
+	// not there. may we add it?
+	if (!create)
+		// no. bail out
+		return NULL;
+
+	// keep the table at most half full
+	if ((numTerms + 1) * 2 > termSize) {
+		size = (termSize > 0) ? termSize * 2 : 1024;
+		table = (SEARCH_TERM**)calloc (size, sizeof (SEARCH_TERM*));
+		if (table == NULL)
+			// this failed. too bad
+			return NULL;
+		for (i = 0; i < termSize; i++)
+			if (terms[i] != NULL) {
+				h = terms[i]->hash & (size - 1);
+				while (table[h] != NULL)
+					h = (h + 1) & (size - 1);
+				table[h] = terms[i];
+			}
+		if (terms) free (terms);
+		terms = table; termSize = size;
+		h = hashTerm (text);
+	}
+
+	// create the term
+	t = (SEARCH_TERM*)calloc (1, sizeof (SEARCH_TERM));
+	if (t == NULL)
+		return NULL;
+	t->text = strdup (text); t->hash = h;
+	for (i = h & (termSize - 1); terms[i] != NULL; i = (i + 1) & (termSize - 1));
+	terms[i] = t;
+	numTerms++;
+	return t;
+}
+
+/*
+ * SEARCHINDEX::indexTrack (SEARCH_DOC* d, int add)
+ *
+ * This will add the postings of track [d] if [add] is non-zero, or remove
+ * them if it is zero.
+ *
+ */
+void
+SEARCHINDEX::indexTrack (SEARCH_DOC* d, int add) {
+	char text[3][SEARCH_MAX_TEXT];
+	char* found[SEARCH_MAX_DOC_TERMS];
+	char* list[SEARCH_MAX_DOC_TERMS];
+	int fields[SEARCH_MAX_DOC_TERMS];
+	static const int field[3] = { SEARCH_FIELD_TITLE, SEARCH_FIELD_ARTIST, SEARCH_FIELD_ALBUM };
+	SEARCH_TERM* t;
+	int i, j, k, n, num = 0;
+
+	// fold all fields
+	foldText (d->title, text[0], SEARCH_MAX_TEXT);
+	foldText (getArtistName (d->artistid), text[1], SEARCH_MAX_TEXT);
+	foldText (getAlbumName (d->albumid), text[2], SEARCH_MAX_TEXT);
+
+	// collect the distinct terms, along with the fields they appear in
+	for (i = 0; i < 3; i++) {
+		n = splitTerms (text[i], found, SEARCH_MAX_DOC_TERMS);
+		for (j = 0; j < n; j++) {
+			for (k = 0; (k < num) && (strcmp (list[k], found[j])); k++);
+			if (k < num)
+				fields[k] |= field[i];
+			else if (num < SEARCH_MAX_DOC_TERMS) {
+				list[num] = found[j]; fields[num] = field[i]; num++;
+			}
+		}
+	}
+
+	// update the postings
+	for (i = 0; i < num; i++) {
+		t = lookupTerm (list[i], add);
+		if (t == NULL)
+			continue;
+		if (add)
+			addPosting (t, d->id, fields[i]);
+		else
+			removePosting (t, d->id);
+	}
+}
+
+/*
+ * SEARCHINDEX::appendPosting (SEARCH_TERM* t, unsigned int doc, int fields)
+ *
+ * This will append track [doc] with [fields] to the postings of term [t].
+ * The track must come after all tracks already there.
+ *
+ */
+void
+SEARCHINDEX::appendPosting (SEARCH_TERM* t, unsigned int doc, int fields) {
+	SEARCH_BLOCK* b;
+	unsigned char* data;
+	unsigned int delta;
+	int size;
+
+	// is there room for the posting? it takes at most six bytes
+	if (t->dataLen + 6 > t->dataSize) {
+		// no. grow the buffer
+		size = (t->dataSize > 0) ? t->dataSize * 2 : 32;
+		data = (unsigned char*)realloc (t->data, size);
+		if (data == NULL)
+			// this failed. drop it
+			return;
+		t->data = data; t->dataSize = size;
+	}
+
+	// does the last block have room?
+	if ((t->numBlocks == 0) || (t->blocks[t->numBlocks - 1].count == SEARCH_BLOCK_SIZE)) {
+		// no. start a new one
+		if (t->numBlocks == t->blockSize) {
+			size = (t->blockSize > 0) ? t->blockSize * 2 : 1;
+			b = (SEARCH_BLOCK*)realloc (t->blocks, size * sizeof (SEARCH_BLOCK));
+			if (b == NULL)
+				// this failed. drop it
+				return;
+			t->blocks = b; t->blockSize = size;
+		}
+		b = &t->blocks[t->numBlocks++];
+		b->first = b->last = doc; b->offset = t->dataLen; b->count = 0;
+	} else
+		b = &t->blocks[t->numBlocks - 1];
+
+	// store the difference with the previous track, seven bits at a time
+	delta = doc - b->last;
+	while (delta >= 0x80) {
+		t->data[t->dataLen++] = (delta & 0x7f) | 0x80;
+		delta >>= 7;
+	}
+	t->data[t->dataLen++] = delta;
+	t->data[t->dataLen++] = fields;
+	b->last = doc; b->count++;
+	t->count++;
+}
+
+/*
+ * SEARCHINDEX::decodeBlock (SEARCH_TERM* t, int b, unsigned int* docs,
+ *                           unsigned char* fields)
+ *
+ * This will decode block [b] of term [t] into [docs] and [fields].
+ *
+ */
+void
+SEARCHINDEX::decodeBlock (SEARCH_TERM* t, int b, unsigned int* docs, unsigned char* fields) {
+	unsigned char* ptr = t->data + t->blocks[b].offset;
+	unsigned int doc = t->blocks[b].first, delta;
+	int i, shift;
+
+	for (i = 0; i < t->blocks[b].count; i++) {
+		delta = 0; shift = 0;
+		while (*ptr & 0x80) {
+			delta |= (*ptr++ & 0x7f) << shift;
+			shift += 7;
+		}
+		delta |= *ptr++ << shift;
+		doc += delta;
+		docs[i] = doc; fields[i] = *ptr++;
+	}
+}
+
+/*
+ * SEARCHINDEX::growScratch (int n)
+ *
+ * This will make sure the scratch buffers hold [n] postings. It will return
+ * 0 on failure or 1 on success.
+ *
+ */
+int
+SEARCHINDEX::growScratch (int n) {
+	unsigned int* docs;
+	unsigned char* fields;
+
+	if (n <= scratchSize)
+		return 1;
+
+	n += SEARCH_BLOCK_SIZE;
+	docs = (unsigned int*)realloc (scratchDocs, n * sizeof (unsigned int));
+	if (docs == NULL)
+		return 0;
+	scratchDocs = docs;
+	fields = (unsigned char*)realloc (scratchFields, n);
+	if (fields == NULL)
+		return 0;
+	scratchFields = fields;
+	scratchSize = n;
+	return 1;
+}
+
+/*
+ * SEARCHINDEX::decodeAll (SEARCH_TERM* t)
+ *
+ * This will decode all postings of term [t] into the scratch buffers. It will
+ * return 0 on failure or 1 on success.
+ *
+ */
+int
+SEARCHINDEX::decodeAll (SEARCH_TERM* t) {
+	int b, n = 0;
+
+	if (!growScratch (t->count + 1))
+		return 0;
+	for (b = 0; b < t->numBlocks; b++) {
+		decodeBlock (t, b, scratchDocs + n, scratchFields + n);
+		n += t->blocks[b].count;
+	}
+	return 1;
+}
+
+/*
+ * SEARCHINDEX::addPosting (SEARCH_TERM* t, unsigned int doc, int fields)
+ *
+ * This will add track [doc] with [fields] to the postings of term [t].
+ *
+ */
+void
+SEARCHINDEX::addPosting (SEARCH_TERM* t, unsigned int doc, int fields) {
+	int i, n;
+
+	// does it go at the end? (this is always the case while building)
+	if ((t->numBlocks == 0) || (doc > t->blocks[t->numBlocks - 1].last)) {
+		// yes. just append it
+		appendPosting (t, doc, fields);
+		return;
+	}
+
+	// no. unpack the postings, put it in place and pack them again
+	if (!decodeAll (t))
+		return;
+	n = t->count;
+	for (i = 0; (i < n) && (scratchDocs[i] < doc); i++);
+	if ((i < n) && (scratchDocs[i] == doc))
+		// already there
+		return;
+	memmove (scratchDocs + i + 1, scratchDocs + i, (n - i) * sizeof (unsigned int));
+	memmove (scratchFields + i + 1, scratchFields + i, n - i);
+	scratchDocs[i] = doc; scratchFields[i] = fields;
+
+	t->dataLen = t->numBlocks = t->count = 0;
+	for (i = 0; i <= n; i++)
+		appendPosting (t, scratchDocs[i], scratchFields[i]);
+}
+
+/*
+ * SEARCHINDEX::removePosting (SEARCH_TERM* t, unsigned int doc)
+ *
+ * This will remove track [doc] from the postings of term [t].
+ *
+ */
+void
+SEARCHINDEX::removePosting (SEARCH_TERM* t, unsigned int doc) {
+	int i, n;
+
+	// unpack the postings, take it out and pack them again
+	if (!decodeAll (t))
+		return;
+	n = t->count;
+	for (i = 0; (i < n) && (scratchDocs[i] != doc); i++);
+	if (i == n)
+		// not there
+		return;
+	memmove (scratchDocs + i, scratchDocs + i + 1, (n - i - 1) * sizeof (unsigned int));
+	memmove (scratchFields + i, scratchFields + i + 1, n - i - 1);
+
+	t->dataLen = t->numBlocks = t->count = 0;
+	for (i = 0; i < n - 1; i++)
+		appendPosting (t, scratchDocs[i], scratchFields[i]);
+}
+
+/*
+ * SEARCHINDEX::search (const char* query, SEARCH_RESULT* results, int max)
+ *
+ * This will look up the tracks containing all words of [query], and store
+ * the best [max] of them in [results]. It will return the number of results.
+ *
+ */
+int
+SEARCHINDEX::search (const char* query, SEARCH_RESULT* results, int max) {
+	char text[SEARCH_MAX_TEXT];
+	char* found[SEARCH_MAX_QUERY_TERMS];
+	SEARCH_TERM* list[SEARCH_MAX_QUERY_TERMS];
+	unsigned int docs[SEARCH_BLOCK_SIZE];
+	unsigned char fields[SEARCH_BLOCK_SIZE];
+	int ai[SEARCH_BLOCK_SIZE], bi[SEARCH_BLOCK_SIZE];
+	unsigned int* cand;
+	unsigned int* score;
+	SEARCH_RESULT* all;
+	SEARCH_TERM* t;
+	int i, j, k, l, m, b, n, num = 0, matches;
+
+	// look all terms up. if one is unknown, nothing matches
+	foldText (query, text, sizeof (text));
+	n = splitTerms (text, found, SEARCH_MAX_QUERY_TERMS);
+	for (i = 0; i < n; i++) {
+		t = lookupTerm (found[i], 0);
+		if ((t == NULL) || (t->count == 0))
+			return 0;
+		for (j = 0; (j < num) && (list[j] != t); j++);
+		if (j == num)
+			list[num++] = t;
+	}
+	if (num == 0)
+		return 0;
+
+	// start with the rarest term, which limits the candidates most
+	for (i = 1; i < num; i++)
+		for (j = i; (j > 0) && (list[j]->count < list[j - 1]->count); j--) {
+			t = list[j]; list[j] = list[j - 1]; list[j - 1] = t;
+		}
+	n = list[0]->count;
+	cand = (unsigned int*)malloc (n * sizeof (unsigned int));
+	score = (unsigned int*)malloc (n * sizeof (unsigned int));
+	if ((cand == NULL) || (score == NULL)) {
+		// this failed. bail out
+		if (cand) free (cand);
+		if (score) free (score);
+		return 0;
+	}
+	for (b = 0, m = 0; b < list[0]->numBlocks; b++) {
+		decodeBlock (list[0], b, cand + m, fields);
+		for (i = 0; i < list[0]->blocks[b].count; i++)
+			score[m + i] = fieldWeight (fields[i]);
+		m += list[0]->blocks[b].count;
+	}
+
+	// weed out the candidates which lack one of the other terms
+	for (k = 1; (k < num) && (n > 0); k++) {
+		t = list[k];
+		for (b = 0, i = 0, m = 0; (b < t->numBlocks) && (i < n); b++) {
+			// can this block hold any of the candidates?
+			if (t->blocks[b].last < cand[i])
+				// no. skip it without decoding
+				continue;
+			if (t->blocks[b].first > cand[n - 1])
+				// no, and neither can the rest
+				break;
+
+			// find the candidates within the block and match them. as
+			// the survivors are moved to the front, this is done in place
+			for (j = i; (j < n) && (cand[j] <= t->blocks[b].last); j++);
+			decodeBlock (t, b, docs, fields);
+			matches = intersect (cand + i, j - i, docs, t->blocks[b].count, ai, bi);
+			for (l = 0; l < matches; l++) {
+				cand[m] = cand[i + ai[l]];
+				score[m] = score[i + ai[l]] + fieldWeight (fields[bi[l]]);
+				m++;
+			}
+			i = j;
+		}
+		n = m;
+	}
+
+	// rank what is left
+	all = (SEARCH_RESULT*)malloc ((n + 1) * sizeof (SEARCH_RESULT));
+	if (all == NULL)
+		n = 0;
+	for (i = 0; i < n; i++) {
+		all[i].id = cand[i]; all[i].score = score[i];
+	}
+	qsort (all, n, sizeof (SEARCH_RESULT), compareResults);
+	if (n > max)
+		n = max;
+	if (n > 0)
+		memcpy (results, all, n * sizeof (SEARCH_RESULT));
+
+	if (all) free (all);
+	free (cand); free (score);
+	return n;
+}
+
+/*
+ * SEARCHINDEX::complete (int kind, const char* prefix, int* ids, int max)
+ *
+ * This will store the IDs of at most [max] objects of kind [kind] whose name
+ * starts with [prefix] in [ids]. It will return the number of IDs stored.
+ *
+ */
+int
+SEARCHINDEX::complete (int kind, const char* prefix, int* ids, int max) {
+	if ((kind < 0) || (kind >= COMPLETE_NUM_KINDS))
+		return 0;
+
+	return completions[kind].find (prefix, ids, max);
+}
+
+/*
+ * SEARCHINDEX::match (int kind, const char* query, FUZZY_RESULT* results,
+ *                     int max)
+ *
+ * This will store at most [max] objects of kind [kind] whose name resembles
+ * [query] in [results], closest first. It will return the number stored.
+ *
+ */
+int
+SEARCHINDEX::match (int kind, const char* query, FUZZY_RESULT* results, int max) {
+	if ((kind < 0) || (kind >= COMPLETE_NUM_KINDS))
+		return 0;
+
+	return fuzzyLists[kind].find (query, results, max);
+}
+
+/*
+ * SEARCHINDEX::addName (int kind, const char* name, int id)
+ *
+ * This will add [name] of object [id] to the name lists of kind [kind].
+ *
+ */
+void
+SEARCHINDEX::addName (int kind, const char* name, int id) {
+	completions[kind].add (name, id);
+	fuzzyLists[kind].add (name, id);
+}
+
+/*
+ * SEARCHINDEX::removeName (int kind, const char* name, int id)
+ *
+ * This will remove [name] of object [id] from the name lists of kind [kind].
+ *
+ */
+void
+SEARCHINDEX::removeName (int kind, const char* name, int id) {
+	completions[kind].remove (name, id);
+	fuzzyLists[kind].remove (name, id);
+}
+
+/*
+ * SEARCHINDEX::finish()
+ *
+ * This will sort the completion lists, so the first lookups don't have to.
+ *
+ */
+void
+SEARCHINDEX::finish() {
+	int i;
+
+	for (i = 0; i < COMPLETE_NUM_KINDS; i++)
+		completions[i].sort();
+}
+
+/*
+ * SEARCH::SEARCH()
+ *
+ * This will construct the manager. There is no index until start() has been
+ * called and the worker pool is done.
+ *
+ */
+SEARCH::SEARCH() {
+	index = NULL; seq = 0; busy = 0; nextRefresh = 0;
+}
+
+/*
+ * SEARCH::~SEARCH()
+ *
+ * This will destroy the manager and the index.
+ *
+ */
+SEARCH::~SEARCH() {
+	if (index)
+		delete index;
+}
+
+/*
+ * SEARCH::submit (int type)
+ *
+ * This will hand a job of type [type] to the worker pool.
+ *
+ */
+void
+SEARCH::submit (int type) {
+	busy = 1;
+	workers->submit (new SEARCH_JOB (type, seq));
+}
+
+/*
+ * SEARCH::start()
+ *
+ * This will start building the index.
+ *
+ */
+void
+SEARCH::start() {
+	nextRefresh = time ((time_t*)NULL) + config->getSearchRefresh();
+	submit (SEARCH_JOB_BUILD);
+}
+
+/*
+ * SEARCH::poll()
+ *
+ * This will check the catalog for changes if it is time to do so.
+ *
+ */
+void
+SEARCH::poll() {
+	time_t now;
+
+	// is a job running, or are we not to look at all?
+	if ((busy) || (config->getSearchRefresh() <= 0))
+		// yes. bail out
+		return;
+
+	// is it time yet?
+	now = time ((time_t*)NULL);
+	if (now < nextRefresh)
+		// no. bail out
+		return;
+
+	// yes. go
+	nextRefresh = now + config->getSearchRefresh();
+	submit ((index == NULL) ? SEARCH_JOB_BUILD : SEARCH_JOB_REFRESH);
+}
+
+/*
+ * SEARCH::install (SEARCHINDEX* idx, unsigned int seq)
+ *
+ * This will replace the index by [idx], which includes all catalog changes
+ * up to [seq].
+ *
+ */
+void
+SEARCH::install (SEARCHINDEX* idx, unsigned int seq) {
+	if (index)
+		delete index;
+	index = idx; this->seq = seq; busy = 0;
+	logger->log (LOG_INFO, "Search index built, %d tracks and %d terms", index->getNumTracks(), index->getNumTerms());
+}
+
+/*
+ * SEARCH::apply (SEARCH_CHANGE* list, unsigned int seq, int reload)
+ *
+ * This will apply the catalog changes in [list], up to [seq], to the index.
+ * If [reload] is non-zero, they are ignored and a new index is built instead.
+ *
+ */
+void
+SEARCH::apply (SEARCH_CHANGE* list, unsigned int seq, int reload) {
+	SEARCH_CHANGE* c;
+
+	busy = 0;
+
+	// do we have to start over?
+	if ((reload) || (index == NULL)) {
+		// yes. do so
+		logger->log (LOG_INFO, "Catalog changed too much, rebuilding search index");
+		submit (SEARCH_JOB_BUILD);
+		return;
+	}
+
+	for (c = list; c != NULL; c = c->next)
+		switch (c->kind) {
+			case CHANGE_KIND_ARTIST: index->setArtist (c->id, (c->gone) ? "" : c->name);
+			                         break;
+			 case CHANGE_KIND_ALBUM: index->setAlbum (c->id, (c->gone) ? "" : c->name);
+			                         break;
+			 case CHANGE_KIND_TRACK: if (c->gone)
+			                           index->removeTrack (c->id);
+			                         else
+			                           index->setTrack (c->id, c->artistid, c->albumid, c->name);
+			                         break;
+		}
+	this->seq = seq;
+}
+
+/*
+ * SEARCH_JOB::SEARCH_JOB (int t, unsigned int since)
+ *
+ * This will construct a job of type [t]. [since] is the last catalog change
+ * the index includes.
+ *
+ */
+SEARCH_JOB::SEARCH_JOB (int t, unsigned int since) {
+	type = t; seq = since; reload = 0;
+	index = NULL; changes = lastChange = NULL;
+}
+
+/*
+ * SEARCH_JOB::~SEARCH_JOB()
+ *
+ * This will destroy the job, along with anything not handed over.
+ *
+ */
+SEARCH_JOB::~SEARCH_JOB() {
+	SEARCH_CHANGE* c;
+
+	if (index)
+		delete index;
+	while (changes != NULL) {
+		c = changes; changes = c->next;
+		if (c->name) free (c->name);
+		free (c);
+	}
+}
+
+/*
+ * SEARCH_JOB::run()
+ *
+ * This will do the work. It runs on a worker thread, so it may not touch
+ * the index in use.
+ *
+ */
+void
+SEARCH_JOB::run() {
+	if (type == SEARCH_JOB_BUILD)
+		build();
+	else
+		refresh();
+}
+
+/*
+ * SEARCH_JOB::build()
+ *
+ * This will build a new index of the entire catalog.
+ *
+ */
+void
+SEARCH_JOB::build() {
+	unsigned int oldest, latest;
+	ARTIST* artist;
+	ALBUM* album;
+	TRACK* track;
+
+	// whatever changes while we are at it will be applied afterwards
+	if (CHANGE::getRange (&oldest, &latest))
+		seq = latest;
+
+	// the names go first, so the tracks can be indexed right away
+	index = new SEARCHINDEX();
+	artist = new ARTIST();
+	while (artist->fetchNext())
+		index->setArtist (artist->getID(), artist->getName());
+	delete artist;
+	album = new ALBUM();
+	while (album->fetchNext())
+		index->setAlbum (album->getID(), album->getName());
+	delete album;
+	track = new TRACK();
+	while (track->fetchNext())
+		index->setTrack (track->getID(), track->getArtistID(), track->getAlbumID(), track->getTitle());
+	delete track;
+	index->finish();
+
+	result = 1;
+}
+
+/*
+ * SEARCH_JOB::refresh()
+ *
+ * This will fetch the catalog changes made since the index was updated, along
+ * with the current data of the objects involved.
+ *
+ */
+void
+SEARCH_JOB::refresh() {
+	unsigned int oldest, latest;
+	SEARCH_CHANGE* c;
+	CHANGE* change;
+	ARTIST* artist;
+	ALBUM* album;
+	TRACK* track;
+
+	// do we still know what happened, and is it not too much?
+	if (!CHANGE::getRange (&oldest, &latest))
+		// this failed. try again later
+		return;
+	result = 1;
+	if ((seq > latest) || (seq + 1 < oldest) || (latest - seq > SEARCH_MAX_CHANGES)) {
+		// no. a new index is needed
+		reload = 1;
+		return;
+	}
+
+	change = new CHANGE (seq);
+	while (change->fetchNext()) {
+		seq = change->getSeq();
+
+		// was the catalog wiped?
+		if (change->getKind() == CHANGE_KIND_CATALOG) {
+			// yes. start over
+			reload = 1;
+			break;
+		}
+
+		c = (SEARCH_CHANGE*)calloc (1, sizeof (SEARCH_CHANGE));
+		if (c == NULL)
+			break;
+		c->kind = change->getKind(); c->id = change->getObjectID();
+		c->gone = (change->getAction() == CHANGE_ACTION_DELETE) ? 1 : 0;
+
+		// fetch what it looks like now
+		if (!c->gone) {
+			try {
+				switch (c->kind) {
+					case CHANGE_KIND_ARTIST: artist = new ARTIST (c->id);
+					                         c->name = strdup (artist->getName());
+					                         delete artist;
+					                         break;
+					 case CHANGE_KIND_ALBUM: album = new ALBUM (c->id);
+					                         c->name = strdup (album->getName());
+					                         delete album;
+					                         break;
+					 case CHANGE_KIND_TRACK: track = new TRACK (c->id);
+					                         c->name = strdup (track->getTitle());
+					                         c->artistid = track->getArtistID();
+					                         c->albumid = track->getAlbumID();
+					                         delete track;
+					                         break;
+				}
+			} catch (ArtistException e) {
+				c->gone = 1;
+			} catch (AlbumException e) {
+				c->gone = 1;
+			} catch (TrackException e) {
+				c->gone = 1;
+			}
+		}
+
+		// add it to the list
+		if (lastChange) lastChange->next = c; else changes = c;
+		lastChange = c;
+	}
+	delete change;
+}
+
+/*
+ * SEARCH_JOB::complete()
+ *
+ * This will hand the outcome to the manager.
+ *
+ */
+void
+SEARCH_JOB::complete() {
+	if (type == SEARCH_JOB_BUILD) {
+		search->install (index, seq);
+		index = NULL;
+	} else if (result)
+		search->apply (changes, seq, reload);
+	else
+		search->apply (NULL, seq, 0);
+}
+
+/* vim:set ts=2 sw=2: */
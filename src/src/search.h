@@ -0,0 +1,471 @@
+/*
+ * search.h
+ *
+ * This is the jukebox search index.
+ *
+ */
+#include <sys/types.h>
+#include <stdlib.h>
+#include <time.h>
+#include "complete.h"
+#include "fuzzy.h"
+#include "worker.h"
+
+#ifndef __SEARCH_H__
+#define __SEARCH_H__
+
+//! \brief SEARCH_BLOCK_SIZE is the number of postings per block
+#define SEARCH_BLOCK_SIZE					64
+
+//! \brief SEARCH_MAX_TERM_LEN is the maximum length of a term
+#define SEARCH_MAX_TERM_LEN				64
+
+//! \brief SEARCH_MAX_DOC_TERMS is the maximum number of terms indexed per track
+#define SEARCH_MAX_DOC_TERMS			128
+
+//! \brief SEARCH_MAX_QUERY_TERMS is the maximum number of terms per query
+#define SEARCH_MAX_QUERY_TERMS		8
+
+//! \brief SEARCH_MAX_RESULTS is the maximum number of results returned
+#define SEARCH_MAX_RESULTS				50
+
+//! \brief SEARCH_MAX_TEXT is the maximum length of folded text
+#define SEARCH_MAX_TEXT						1024
+
+//! \brief SEARCH_MAX_CHANGES is the number of catalog changes above which the index is rebuilt
+#define SEARCH_MAX_CHANGES				5000
+
+//! \brief SEARCH_DEFAULT_REFRESH is the default interval between index updates, in seconds
+#define SEARCH_DEFAULT_REFRESH		10
+
+// SEARCH_FIELD_xxx are the fields a term can appear in
+#define SEARCH_FIELD_TITLE				1
+#define SEARCH_FIELD_ARTIST				2
+#define SEARCH_FIELD_ALBUM				4
+
+// SEARCH_WEIGHT_xxx are the scores of a term appearing in the fields
+#define SEARCH_WEIGHT_TITLE				3
+#define SEARCH_WEIGHT_ARTIST			2
+#define SEARCH_WEIGHT_ALBUM				1
+
+// SEARCH_JOB_xxx are the jobs handed to the worker pool
+#define SEARCH_JOB_BUILD					0
+#define SEARCH_JOB_REFRESH				1
+
+/*!
+ * \struct SEARCH_BLOCK
+ * \brief The skip entry of a block of postings
+ */
+struct SEARCH_BLOCK {
+	//! \brief The first and last track in the block
+	unsigned int first, last;
+
+	//! \brief The offset of the block in the posting data
+	int offset;
+
+	//! \brief The number of postings in the block
+	int count;
+};
+
+/*!
+ * \struct SEARCH_TERM
+ * \brief A term, along with the tracks it appears in
+ *
+ * The postings are kept in blocks of SEARCH_BLOCK_SIZE. Every posting is the
+ * difference with the previous track in the block as a variable length
+ * number, followed by a byte with the SEARCH_FIELD_xxx fields the term
+ * appears in. The skip entries allow blocks to be passed over without
+ * decoding them.
+ */
+struct SEARCH_TERM {
+	//! \brief The term and its hash
+	char*					text;
+	unsigned int	hash;
+
+	//! \brief The posting data, its length and its size
+	unsigned char*	data;
+	int						dataLen, dataSize;
+
+	//! \brief The skip entries, their number and the number there is room for
+	SEARCH_BLOCK*	blocks;
+	int						numBlocks, blockSize;
+
+	//! \brief The number of postings
+	int						count;
+};
+
+/*!
+ * \struct SEARCH_NAME
+ * \brief The name of an artist or album
+ */
+struct SEARCH_NAME {
+	int		id;
+	char*	name;
+};
+
+/*!
+ * \struct SEARCH_DOC
+ * \brief A track, as far as the index is concerned
+ */
+struct SEARCH_DOC {
+	int		id, artistid, albumid;
+	char*	title;
+};
+
+/*!
+ * \struct SEARCH_RESULT
+ * \brief A track found, along with its score
+ */
+struct SEARCH_RESULT {
+	int						id;
+	unsigned int	score;
+};
+
+/*!
+ * \struct SEARCH_CHANGE
+ * \brief A catalog change fetched by a refresh job
+ */
+struct SEARCH_CHANGE {
+	//! \brief The CHANGE_KIND_xxx kind of object and its ID
+	int		kind, id;
+
+	//! \brief Non-zero if the object is gone
+	int		gone;
+
+	//! \brief The artist and album of a track
+	int		artistid, albumid;
+
+	//! \brief The name or title of the object
+	char*	name;
+
+	//! \brief The next change
+	SEARCH_CHANGE* next;
+};
+
+/*!
+ * \class SEARCHINDEX
+ * \brief An inverted index over the titles, artists and albums of all tracks
+ *
+ * All text is folded using foldText() and split at the spaces into terms. A
+ * query matches the tracks which contain all its terms, in any field; they
+ * are ranked by the fields the terms were found in. The names are also kept
+ * in completion lists, so they can be looked up by prefix, and in fuzzy lists,
+ * so they can be looked up despite typos. The index does
+ * not touch the database, so it may be built on a worker thread.
+ */
+class SEARCHINDEX {
+public:
+	//! \brief Constructs an empty index
+	SEARCHINDEX();
+
+	//! \brief Destroys the index
+	~SEARCHINDEX();
+
+	/*! \brief Adds or updates an artist
+	 *  \param id The ID of the artist
+	 *  \param name The name of the artist
+	 */
+	void setArtist (int id, const char* name);
+
+	/*! \brief Adds or updates an album
+	 *  \param id The ID of the album
+	 *  \param name The name of the album
+	 */
+	void setAlbum (int id, const char* name);
+
+	/*! \brief Adds or updates a track
+	 *  \param id The ID of the track
+	 *  \param artistid The artist of the track
+	 *  \param albumid The album of the track
+	 *  \param title The title of the track
+	 */
+	void setTrack (int id, int artistid, int albumid, const char* title);
+
+	/*! \brief Removes a track
+	 *  \param id The ID of the track
+	 */
+	void removeTrack (int id);
+
+	/*! \brief Looks tracks up
+	 *  \param query The words to look for
+	 *  \param results Receives the tracks found, best first
+	 *  \param max The number of results there is room for
+	 *
+	 *  This will return the number of results.
+	 */
+	int search (const char* query, SEARCH_RESULT* results, int max);
+
+	/*! \brief Looks names up by prefix
+	 *  \param kind The COMPLETE_KIND_xxx kind of names
+	 *  \param prefix The prefix
+	 *  \param ids Receives the IDs of the artists, albums or tracks found
+	 *  \param max The number of IDs there is room for
+	 *
+	 *  This will return the number of IDs found.
+	 */
+	int complete (int kind, const char* prefix, int* ids, int max);
+
+	/*! \brief Looks names up approximately
+	 *  \param kind The COMPLETE_KIND_xxx kind of names
+	 *  \param query The name to look for
+	 *  \param results Receives the artists, albums or tracks found, closest first
+	 *  \param max The number of results there is room for
+	 *
+	 *  This will return the number of results.
+	 */
+	int match (int kind, const char* query, FUZZY_RESULT* results, int max);
+
+	//! \brief Prepares a freshly built index for lookups
+	void finish();
+
+	/*! \brief Returns a track, or NULL if it is not known
+	 *  \param id The ID of the track
+	 */
+	SEARCH_DOC* getTrack (int id);
+
+	/*! \brief Returns the name of an artist, or "?" if it is not known
+	 *  \param id The ID of the artist
+	 */
+	const char* getArtistName (int id);
+
+	/*! \brief Returns the name of an album, or "?" if it is not known
+	 *  \param id The ID of the album
+	 */
+	const char* getAlbumName (int id);
+
+	//! \brief Returns the number of tracks indexed
+	inline int getNumTracks() { return numTracks; }
+
+	//! \brief Returns the number of distinct terms
+	inline int getNumTerms() { return numTerms; }
+
+private:
+	/*! \brief Finds a name
+	 *  \param list The names, ordered by ID
+	 *  \param num The number of names
+	 *  \param id The ID to look for
+	 *  \param pos Receives the position of the name, or where it should go
+	 *
+	 *  This will return non-zero if the name was found or zero if not.
+	 */
+	int findName (SEARCH_NAME* list, int num, int id, int* pos);
+
+	/*! \brief Adds or updates a name
+	 *  \param list The names
+	 *  \param num The number of names
+	 *  \param size The number of names there is room for
+	 *  \param id The ID of the name
+	 *  \param name The name
+	 *  \param field The SEARCH_FIELD_xxx field of tracks the name appears in
+	 */
+	void setName (SEARCH_NAME** list, int* num, int* size, int id, const char* name, int field);
+
+	/*! \brief Adds a name to the completion and fuzzy lists
+	 *  \param kind The COMPLETE_KIND_xxx kind of name
+	 *  \param name The name
+	 *  \param id The ID of the object it names
+	 */
+	void addName (int kind, const char* name, int id);
+
+	/*! \brief Removes a name from the completion and fuzzy lists
+	 *  \param kind The COMPLETE_KIND_xxx kind of name
+	 *  \param name The name
+	 *  \param id The ID of the object it names
+	 */
+	void removeName (int kind, const char* name, int id);
+
+	/*! \brief Finds a track
+	 *  \param id The ID to look for
+	 *  \param pos Receives the position of the track, or where it should go
+	 *
+	 *  This will return non-zero if the track was found or zero if not.
+	 */
+	int findTrack (int id, int* pos);
+
+	/*! \brief Looks a term up
+	 *  \param text The term
+	 *  \param create Non-zero if the term is to be added if it is not there
+	 *
+	 *  This will return the term, or NULL if it is not there.
+	 */
+	SEARCH_TERM* lookupTerm (const char* text, int create);
+
+	/*! \brief Adds or removes the postings of a track
+	 *  \param d The track
+	 *  \param add Non-zero to add the postings, zero to remove them
+	 */
+	void indexTrack (SEARCH_DOC* d, int add);
+
+	/*! \brief Adds a posting to a term
+	 *  \param t The term
+	 *  \param doc The track
+	 *  \param fields The SEARCH_FIELD_xxx fields the term appears in
+	 */
+	void addPosting (SEARCH_TERM* t, unsigned int doc, int fields);
+
+	/*! \brief Removes a posting from a term
+	 *  \param t The term
+	 *  \param doc The track
+	 */
+	void removePosting (SEARCH_TERM* t, unsigned int doc);
+
+	/*! \brief Appends a posting to the end of a term
+	 *  \param t The term
+	 *  \param doc The track, which must come after all others
+	 *  \param fields The SEARCH_FIELD_xxx fields the term appears in
+	 */
+	void appendPosting (SEARCH_TERM* t, unsigned int doc, int fields);
+
+	/*! \brief Decodes a block of postings
+	 *  \param t The term
+	 *  \param b The block
+	 *  \param docs Receives the tracks
+	 *  \param fields Receives the fields
+	 */
+	void decodeBlock (SEARCH_TERM* t, int b, unsigned int* docs, unsigned char* fields);
+
+	/*! \brief Decodes all postings of a term
+	 *  \param t The term
+	 *
+	 *  The postings are put in the scratch buffers. This will return zero on
+	 *  failure or non-zero on success.
+	 */
+	int decodeAll (SEARCH_TERM* t);
+
+	/*! \brief Grows the scratch buffers
+	 *  \param n The number of postings they must hold
+	 *
+	 *  This will return zero on failure or non-zero on success.
+	 */
+	int growScratch (int n);
+
+	//! \brief The artists and albums, ordered by ID
+	SEARCH_NAME*	artists;
+	SEARCH_NAME*	albums;
+	int						numArtists, artistSize, numAlbums, albumSize;
+
+	//! \brief The tracks, ordered by ID
+	SEARCH_DOC*		tracks;
+	int						numTracks, trackSize;
+
+	//! \brief The terms, hashed with open addressing
+	SEARCH_TERM**	terms;
+	int						numTerms, termSize;
+
+	//! \brief The names by COMPLETE_KIND_xxx, for lookups by prefix
+	COMPLETELIST	completions[COMPLETE_NUM_KINDS];
+
+	//! \brief The names by COMPLETE_KIND_xxx, for approximate lookups
+	FUZZYLIST			fuzzyLists[COMPLETE_NUM_KINDS];
+
+	//! \brief Scratch buffers used while rewriting postings
+	unsigned int*		scratchDocs;
+	unsigned char*	scratchFields;
+	int							scratchSize;
+};
+
+/*!
+ * \class SEARCH
+ * \brief This will keep the search index up to date
+ *
+ * The index is built by the worker pool when the daemon starts. Every few
+ * seconds, the catalog change log is checked by the worker pool, and the
+ * changes are applied to the index by the main loop. If the change log does
+ * not go back far enough, or the catalog was wiped, a new index is built;
+ * the old one is used until it is done.
+ */
+class SEARCH {
+public:
+	//! \brief Constructs the manager, without an index
+	SEARCH();
+
+	//! \brief Destroys the manager and the index
+	~SEARCH();
+
+	//! \brief Starts building the index
+	void start();
+
+	//! \brief Checks for catalog changes if it is time to, to be called from the main loop
+	void poll();
+
+	//! \brief Returns the index, or NULL if it is not built yet
+	inline SEARCHINDEX* getIndex() { return index; }
+
+	/*! \brief Puts a freshly built index in place
+	 *  \param idx The index
+	 *  \param seq The last catalog change it includes
+	 */
+	void install (SEARCHINDEX* idx, unsigned int seq);
+
+	/*! \brief Applies catalog changes to the index
+	 *  \param list The changes
+	 *  \param seq The last catalog change in the list
+	 *  \param reload Non-zero if the index has to be built anew instead
+	 */
+	void apply (SEARCH_CHANGE* list, unsigned int seq, int reload);
+
+private:
+	//! \brief Hands a job to the worker pool
+	void submit (int type);
+
+	//! \brief The index
+	SEARCHINDEX*	index;
+
+	//! \brief The last catalog change included in the index
+	unsigned int	seq;
+
+	//! \brief Flag: Is a job in progress?
+	int						busy;
+
+	//! \brief The moment to check for changes next
+	time_t				nextRefresh;
+};
+
+/*!
+ * \class SEARCH_JOB
+ * \brief Builds the search index or fetches catalog changes
+ */
+class SEARCH_JOB : public WORKJOB {
+public:
+	/*! \brief Constructs a new job
+	 *  \param t The SEARCH_JOB_xxx type of the job
+	 *  \param since The last catalog change known
+	 */
+	SEARCH_JOB (int t, unsigned int since);
+
+	//! \brief Destroys the job
+	~SEARCH_JOB();
+
+	//! \brief Does the actual work, called on a worker thread
+	void			run();
+
+	//! \brief Hands the outcome to the manager, called on the network thread
+	void			complete();
+
+private:
+	//! \brief Builds a new index
+	void			build();
+
+	//! \brief Fetches the catalog changes
+	void			refresh();
+
+	//! \brief The type of the job
+	int						type;
+
+	//! \brief The last catalog change included
+	unsigned int	seq;
+
+	//! \brief Flag: Does the index have to be built anew?
+	int						reload;
+
+	//! \brief The index built
+	SEARCHINDEX*	index;
+
+	//! \brief The changes fetched, in order, and the last one
+	SEARCH_CHANGE*	changes;
+	SEARCH_CHANGE*	lastChange;
+};
+
+#endif /* __SEARCH_H__ */
+
+/* vim:set ts=2 sw=2: */
@@ -2,13 +2,59 @@
  * server.cc - Jukebox server code
  *
  */
+#include <sys/types.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <libplusplus/network.h>
 #include "client.h"
+#include "jukebox.h"
+#include "local.h"
 #include "server.h"
 
+/*
+ * JUKESERVER::JUKESERVER()
+ *
+ * This will construct the server.
+ *
+ */
+JUKESERVER::JUKESERVER() {
+	memset (&counters, 0, sizeof (counters));
+	lastQueueVersion = lastUsers = 0;
+	tickerRunning = tickerStopping = 0;
+	timerclear (&flushDue);
+	pthread_mutex_init (&tickLock, NULL);
+	pthread_cond_init (&tickCond, NULL);
+}
+
+/*
+ * JUKESERVER::~JUKESERVER()
+ *
+ * This will stop the ticker and destroy the server.
+ *
+ */
+JUKESERVER::~JUKESERVER() {
+	// is the ticker running?
+	if (tickerRunning) {
+		// yes. have it exit and wait for it
+		pthread_mutex_lock (&tickLock);
+		tickerStopping = 1;
+		pthread_cond_signal (&tickCond);
+		pthread_mutex_unlock (&tickLock);
+		pthread_join (ticker, NULL);
+	}
+
+	pthread_cond_destroy (&tickCond);
+	pthread_mutex_destroy (&tickLock);
+}
+
 /*
  * JUKESERVER::incoming()
  *
@@ -24,29 +70,311 @@ JUKESERVER::incoming() {
 		// this failed. bail out
 		return;
 
+	// are we willing to talk to it?
+	if (!admit (c)) {
+		// no. hang up
+		c->close();
+		delete c;
+		return;
+	}
+
 	// be polite and greet the client
 	c->welcome();
 }
 
 /*
- * JUKESERVER::sendUpdate (char* msg)
+ * JUKESERVER::admit (JUKECLIENT* c)
  *
- * This will send update [msg] to every client who cares.
+ * This will check whether freshly connected client [c] stays within the
+ * connection limits. If not, the client is told so. It will return 0 if the
+ * client has to go or 1 if it may stay.
+ *
+ */
+int
+JUKESERVER::admit (JUKECLIENT* c) {
+	int max = config->getMaxConnections();
+	int perHost = config->getMaxConnectionsPerHost();
+	struct sockaddr_in* addr;
+	struct sockaddr_in* other;
+	int i, n, num = 0;
+
+	counters.accepted++;
+
+	// too many clients overall? the new one is counted too
+	if ((max > 0) && (getNumClients() > max)) {
+		// yes. complain
+		logger->log (LOG_INFO, "Too many clients, refusing connection");
+		counters.refused++;
+		c->sendf (JUKECLIENT_MSG_TOOMANY);
+		return 0;
+	}
+
+	// local clients come from the same host by definition
+	if ((perHost <= 0) || (c->isLocal()))
+		// no need to check any further
+		return 1;
+
+	// count the TCP clients from the same address
+	n = getClients()->count();
+	addr = (struct sockaddr_in*)c->getClientAddress()->getInternalAddress();
+	for (i = 0; i < n; i++) {
+		other = (struct sockaddr_in*)((JUKECLIENT*)getClients()->elementAt (i))->getClientAddress()->getInternalAddress();
+		if (other->sin_addr.s_addr == addr->sin_addr.s_addr)
+			num++;
+	}
+
+	// too many of them?
+	if (num > perHost) {
+		// yes. complain
+		logger->log (LOG_INFO, "Too many clients from the same host, refusing connection");
+		counters.refused++;
+		c->sendf (JUKECLIENT_MSG_TOOMANY);
+		return 0;
+	}
+
+	// welcome
+	return 1;
+}
+
+/*
+ * JUKESERVER::expire()
+ *
+ * This will disconnect clients which have been idle for too long, and local
+ * clients who did not read their output before it exceeded the output limit;
+ * what TCP clients have waiting is up to the network library. Clients who
+ * are waiting for a job or want updates are never idle.
+ *
+ */
+void
+JUKESERVER::expire() {
+	int timeout = config->getIdleTimeout();
+	time_t now = time ((time_t*)NULL);
+	JUKECLIENT* c;
+	int i;
+
+	// go backwards, as clients disappear along the way
+	for (i = getNumClients() - 1; i >= 0; i--) {
+		c = getClient (i);
+
+		// did the client fall too far behind?
+		if (c->isOverflowed()) {
+			// yes. there is no telling it, just hang up
+			counters.outputOverflows++;
+			c->close();
+			delete c;
+			continue;
+		}
+
+		// has the client been idle for too long?
+		if ((timeout > 0) && (!c->isSuspended()) && (!c->wantsUpdates()) &&
+		    (now - c->getLastActive() >= timeout)) {
+			// yes. say goodbye
+			counters.idleTimeouts++;
+			c->sendf (JUKECLIENT_MSG_IDLE);
+			c->close();
+			delete c;
+		}
+	}
+}
+
+/*
+ * JUKESERVER::sendUpdate (int topic, char* msg, unsigned int count)
+ *
+ * This will send update [msg] about [count] changes of [topic] to every
+ * client who cares.
  *
  */
 void
-JUKESERVER::sendUpdate (char* msg) {
+JUKESERVER::sendUpdate (int topic, char* msg, unsigned int count) {
 	// scan all clients, too
-	for (int i = 0; i < getClients()->count(); i++) {
+	for (int i = 0; i < getNumClients(); i++) {
 		// fetch the client
-		JUKECLIENT* c = (JUKECLIENT*)getClients()->elementAt (i);
+		JUKECLIENT* c = getClient (i);
 
-		// skip clients who don't care about updates
-		if (!c->wantsUpdates()) continue;
+		// skip clients who don't care about this
+		if (!c->isSubscribed (topic)) continue;
 
 		// go!
-		c->sendf (msg);
+		c->notify (topic, msg, count);
+	}
+}
+
+/*
+ * JUKESERVER::startTicker()
+ *
+ * This will start the thread which wakes the main loop up, which is the
+ * calling thread. It will return 0 on failure or 1 on success.
+ *
+ */
+int
+JUKESERVER::startTicker() {
+	sigset_t all, old;
+
+	// the ticker should leave all signals to the main loop
+	mainThread = pthread_self();
+	sigfillset (&all);
+	pthread_sigmask (SIG_SETMASK, &all, &old);
+	tickerRunning = (pthread_create (&ticker, NULL, tickerMain, this) == 0);
+	pthread_sigmask (SIG_SETMASK, &old, NULL);
+
+	// did this work?
+	if (!tickerRunning) {
+		// no. complain
+		logger->log (LOG_INFO, "Unable to start the ticker thread");
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * JUKESERVER::tickerMain (void* arg)
+ *
+ * This is where the ticker starts. [arg] is the server it belongs to.
+ *
+ */
+void*
+JUKESERVER::tickerMain (void* arg) {
+	((JUKESERVER*)arg)->tick();
+	return NULL;
+}
+
+/*
+ * JUKESERVER::tick()
+ *
+ * This will wake the main loop up every second, as a wakeup may just miss
+ * the network wait, and whenever a flush is due. Only the main loop gets the
+ * signal, so no other thread is interrupted. It returns once the server is
+ * destroyed.
+ *
+ */
+void
+JUKESERVER::tick() {
+	struct timeval now, nextTick, until;
+	struct timespec ts;
+	int due;
+
+	gettimeofday (&nextTick, NULL);
+	nextTick.tv_sec++;
+
+	pthread_mutex_lock (&tickLock);
+	while (!tickerStopping) {
+		// sleep until the next tick or flush, whichever comes first
+		until = nextTick;
+		if ((timerisset (&flushDue)) && (timercmp (&flushDue, &until, <)))
+			until = flushDue;
+		ts.tv_sec = until.tv_sec; ts.tv_nsec = until.tv_usec * 1000;
+		if (pthread_cond_timedwait (&tickCond, &tickLock, &ts) != ETIMEDOUT)
+			// woken up early. a flush may be due sooner, or we have to leave
+			continue;
+
+		// is the flush due?
+		gettimeofday (&now, NULL);
+		due = ((timerisset (&flushDue)) && (!timercmp (&now, &flushDue, <)));
+		if (due)
+			// yes. that's taken care of
+			timerclear (&flushDue);
+
+		// is it time?
+		if ((due) || (!timercmp (&now, &nextTick, <))) {
+			// yes. wake the main loop up, the next tick is a second from now
+			pthread_kill (mainThread, JUKESERVER_TICK_SIGNAL);
+			nextTick = now; nextTick.tv_sec++;
+		}
 	}
+	pthread_mutex_unlock (&tickLock);
+}
+
+/*
+ * JUKESERVER::scheduleFlush (int ms)
+ *
+ * This will make sure the main loop wakes up within [ms] milliseconds, by
+ * having the ticker come early if need be.
+ *
+ */
+void
+JUKESERVER::scheduleFlush (int ms) {
+	struct timeval due;
+
+	gettimeofday (&due, NULL);
+	due.tv_sec += ms / 1000;
+	due.tv_usec += (ms % 1000) * 1000;
+	if (due.tv_usec >= 1000000) {
+		due.tv_sec++; due.tv_usec -= 1000000;
+	}
+
+	// will the ticker come soon enough?
+	pthread_mutex_lock (&tickLock);
+	if ((!timerisset (&flushDue)) || (timercmp (&due, &flushDue, <))) {
+		// no. have it come sooner
+		flushDue = due;
+		pthread_cond_signal (&tickCond);
+	}
+	pthread_mutex_unlock (&tickLock);
+}
+
+/*
+ * JUKESERVER::flushUpdates()
+ *
+ * This will tell the subscribed clients if the queue or the set of users
+ * changed, and have all clients send the updates which are due.
+ *
+ */
+void
+JUKESERVER::flushUpdates() {
+	char tmp[256 /* XXX */];
+	struct timeval now;
+	unsigned int n;
+	int i;
+
+	// did the queue change?
+	n = queue->getVersion();
+	if (n != lastQueueVersion) {
+		// yes. tell how often
+		sendUpdate (JUKECLIENT_TOPIC_QUEUE, NULL, n - lastQueueVersion);
+		lastQueueVersion = n;
+	}
+
+	// did anyone log in or leave?
+	for (n = 0, i = 0; i < getNumClients(); i++)
+		if (getClient (i)->getState() == JUKECLIENT_STATE_AUTH)
+			n++;
+	if (n != lastUsers) {
+		// yes. tell how many are left
+		snprintf (tmp, sizeof (tmp), JUKECLIENT_UPDATE_USERS, n);
+		sendUpdate (JUKECLIENT_TOPIC_USERS, tmp, 1);
+		lastUsers = n;
+	}
+
+	// send whatever is due
+	gettimeofday (&now, NULL);
+	for (i = 0; i < getNumClients(); i++)
+		getClient (i)->flushUpdates (&now);
+}
+
+/*
+ * JUKESERVER::getNumClients()
+ *
+ * This will return the number of clients connected, including those on the
+ * local server.
+ *
+ */
+int
+JUKESERVER::getNumClients() {
+	return getClients()->count() + localserver->getNumClients();
+}
+
+/*
+ * JUKESERVER::getClient (int i)
+ *
+ * This will return client [i]. The TCP clients come first, followed by those
+ * on the local server.
+ *
+ */
+JUKECLIENT*
+JUKESERVER::getClient (int i) {
+	int n = getClients()->count();
+
+	return (i < n) ? (JUKECLIENT*)getClients()->elementAt (i) : localserver->getClient (i - n);
 }
 
 /* vim:set ts=2 sw=2: */
@@ -4,6 +4,9 @@
  * This is the jukebox server.
  *
  */
+#include <sys/time.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <libplusplus/network.h>
 #include "client.h"
@@ -11,6 +14,48 @@
 #ifndef __JUKESERVER_H__
 #define __JUKESERVER_H__
 
+//! \brief JUKESERVER_DEFAULT_MAX_CONNECTIONS is the default maximum number of clients
+#define JUKESERVER_DEFAULT_MAX_CONNECTIONS	256
+
+//! \brief JUKESERVER_DEFAULT_MAX_PER_HOST is the default maximum number of clients per address
+#define JUKESERVER_DEFAULT_MAX_PER_HOST			16
+
+//! \brief JUKESERVER_DEFAULT_IDLE_TIMEOUT is the default idle time allowed, in seconds
+#define JUKESERVER_DEFAULT_IDLE_TIMEOUT			600
+
+//! \brief JUKESERVER_DEFAULT_MAX_OUTPUT is the default maximum output buffered per client
+#define JUKESERVER_DEFAULT_MAX_OUTPUT				1048576
+
+//! \brief JUKESERVER_DEFAULT_COMMAND_RATE is the default number of commands per second
+#define JUKESERVER_DEFAULT_COMMAND_RATE			10
+
+//! \brief JUKESERVER_DEFAULT_COMMAND_BURST is the default number of commands at once
+#define JUKESERVER_DEFAULT_COMMAND_BURST		50
+
+//! \brief JUKESERVER_DEFAULT_UPDATE_WINDOW is the default update coalescing window, in ms
+#define JUKESERVER_DEFAULT_UPDATE_WINDOW		250
+
+//! \brief JUKESERVER_TICK_SIGNAL is sent to the main loop to break the network wait
+#define JUKESERVER_TICK_SIGNAL							SIGALRM
+
+/*!
+ * \struct JUKESERVER_COUNTERS
+ * \brief Statistics on the connections and the limits enforced on them
+ */
+struct JUKESERVER_COUNTERS {
+	//! \brief Connections accepted and refused because of the limits
+	unsigned long	accepted, refused;
+
+	//! \brief Connections closed because they were idle
+	unsigned long	idleTimeouts;
+
+	//! \brief Commands handled and refused because of the command rate
+	unsigned long	commands, throttled;
+
+	//! \brief Replies cut short and clients dropped because of the output limit
+	unsigned long	outputOverflows;
+};
+
 /*!
  * \class JUKESERVER
  * \brief This is the jukebox network server.
@@ -19,13 +64,90 @@ class JUKESERVER : public NETSERVER {
 	friend class JUKECLIENT;
 
 public:
+	//! \brief Constructs the server
+	JUKESERVER();
+
+	//! \brief Stops the ticker and destroys the server
+	~JUKESERVER();
+
 	//! \brief This will handle incoming connections.
 	void	incoming();
 
 	/*! \brief This will broadcast a message to all clients who desire them
+	 *  \param topic The JUKECLIENT_TOPIC_xxx topic of the message
 	 *  \param msg The message to send
+	 *  \param count The number of changes the message is about
 	 */
-	void	sendUpdate (char* msg);
+	void	sendUpdate (int topic, char* msg, unsigned int count);
+
+	/*! \brief Starts the thread which wakes the main loop up
+	 *
+	 * The ticker sends JUKESERVER_TICK_SIGNAL to the calling thread, which has
+	 * to be the main loop, every second and whenever a flush is due. This has
+	 * to be called after daemonizing. It will return zero on failure or
+	 * non-zero on success.
+	 */
+	int		startTicker();
+
+	/*! \brief Makes sure we wake up in time to send coalesced updates
+	 *  \param ms The number of milliseconds from now
+	 */
+	void	scheduleFlush (int ms);
+
+	//! \brief Notices queue and user changes and sends updates which are due, to be called from the main loop
+	void	flushUpdates();
+
+	/*! \brief Returns the number of clients, both over TCP and AF_UNIX
+	 */
+	int		getNumClients();
+
+	/*! \brief Returns a client
+	 *  \param i The index of the client, from 0 to getNumClients() - 1
+	 */
+	JUKECLIENT* getClient (int i);
+
+	/*! \brief Checks whether a new client may stay
+	 *  \param c The client, which has to be connected already
+	 *
+	 *  If the client would exceed the connection limits, it is told so and
+	 *  zero is returned; the caller has to get rid of it. Otherwise, non-zero
+	 *  is returned.
+	 */
+	int		admit (JUKECLIENT* c);
+
+	//! \brief Disconnects clients which are idle or have too much output, to be called from the main loop
+	void	expire();
+
+	//! \brief Returns the statistics
+	inline JUKESERVER_COUNTERS* getCounters() { return &counters; }
+
+private:
+	//! \brief The statistics
+	JUKESERVER_COUNTERS counters;
+
+	//! \brief The queue version and number of authenticated users last reported
+	unsigned int	lastQueueVersion, lastUsers;
+
+	//! \brief Entry point of the ticker
+	static void* tickerMain (void* arg);
+
+	//! \brief Wakes the main loop up until the server is destroyed
+	void	tick();
+
+	//! \brief The ticker and the thread it wakes up
+	pthread_t	ticker, mainThread;
+
+	//! \brief Non-zero if the ticker is running, and if it must exit
+	int			tickerRunning, tickerStopping;
+
+	//! \brief Protects flushDue and tickerStopping
+	pthread_mutex_t	tickLock;
+
+	//! \brief Signalled when a flush is due sooner or the ticker must exit
+	pthread_cond_t	tickCond;
+
+	//! \brief The moment the earliest flush is due, zero if none
+	struct timeval	flushDue;
 };
 
 #endif // __JUKESERVER_H__
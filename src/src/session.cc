@@ -0,0 +1,157 @@
+/*
+ * session.cc - Jukebox session management code
+ *
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "jukebox.h"
+#include "session.h"
+
+/*
+ * SESSIONS::SESSIONS (int max)
+ *
+ * This will initialize a session table capable of holding [max] sessions.
+ *
+ */
+SESSIONS::SESSIONS (int max) {
+	// allocate the table, all slots are free
+	if (max < 1) max = 1;
+	numSessions = max;
+	sessions = (SESSION*)malloc (numSessions * sizeof (SESSION));
+	memset (sessions, 0, numSessions * sizeof (SESSION));
+
+	// open the random device (we may be chroot()-ed later on)
+	randomfd = open (SESSION_RANDOM_DEVICE, O_RDONLY);
+	if (randomfd < 0)
+		// this failed. complain, no sessions can be issued without it
+		logger->log (LOG_ERR, "Unable to open %s, sessions are disabled", SESSION_RANDOM_DEVICE);
+}
+
+/*
+ * SESSIONS::~SESSIONS()
+ *
+ * This will destroy all sessions.
+ *
+ */
+SESSIONS::~SESSIONS() {
+	// wipe the table before handing it back
+	memset (sessions, 0, numSessions * sizeof (SESSION));
+	free (sessions);
+
+	if (randomfd >= 0)
+		close (randomfd);
+}
+
+/*
+ * SESSIONS::getRandom (unsigned char* buf, int len)
+ *
+ * This will fill [buf] with [len] random bytes from the random device. It
+ * will return zero on failure or non-zero on success.
+ *
+ */
+int
+SESSIONS::getRandom (unsigned char* buf, int len) {
+	// got a random device?
+	if (randomfd < 0)
+		// no. tokens anyone could guess are worse than none at all
+		return 0;
+
+	return (read (randomfd, buf, len) == len);
+}
+
+/*
+ * SESSIONS::create (USER* user, char* token)
+ *
+ * This will create a new session for [user] and store the token in [token],
+ * which must be SESSION_TOKEN_LEN + 1 bytes long. It will return zero on
+ * failure or non-zero on success.
+ *
+ */
+int
+SESSIONS::create (USER* user, char* token) {
+	unsigned char rnd[SESSION_TOKEN_LEN / 2];
+	time_t now = time ((time_t*)NULL);
+	int ttl = config->getSessionTTL();
+	int i, slot = 0;
+
+	// are sessions enabled?
+	if (ttl <= 0)
+		// no. bail out
+		return 0;
+
+	// find a free or expired slot. if there is none, use the oldest one
+	for (i = 0; i < numSessions; i++) {
+		if ((!sessions[i].token[0]) || (sessions[i].expires <= now)) {
+			slot = i;
+			break;
+		}
+		if (sessions[i].expires < sessions[slot].expires)
+			slot = i;
+	}
+
+	// build the token
+	if (!getRandom (rnd, sizeof (rnd))) {
+		// no randomness. refuse rather than hand out a predictable token
+		logger->log (LOG_ERR, "Unable to read %s, session not created", SESSION_RANDOM_DEVICE);
+		return 0;
+	}
+	for (i = 0; i < (int)sizeof (rnd); i++)
+		sprintf (token + i * 2, "%02x", rnd[i]);
+	token[SESSION_TOKEN_LEN] = 0;
+
+	// fill the slot out. the password is never kept
+	memcpy (&sessions[slot].user, user, sizeof (USER));
+	memset (sessions[slot].user.password, 0, USER_MAX_PASSWORD_LEN);
+	strcpy (sessions[slot].token, token);
+	sessions[slot].expires = now + ttl;
+
+	// victory
+	return 1;
+}
+
+/*
+ * SESSIONS::resume (const char* token, USER* user)
+ *
+ * This will look up session [token] and copy the user to [user]. It will
+ * return zero on failure or non-zero on success.
+ *
+ */
+int
+SESSIONS::resume (const char* token, USER* user) {
+	time_t now = time ((time_t*)NULL);
+	int ttl = config->getSessionTTL();
+	int i, j, diff;
+
+	// is the token sane?
+	if ((ttl <= 0) || (strlen (token) != SESSION_TOKEN_LEN))
+		// no. don't even bother
+		return 0;
+
+	// scan the table
+	for (i = 0; i < numSessions; i++) {
+		// skip free and expired slots
+		if ((!sessions[i].token[0]) || (sessions[i].expires <= now))
+			continue;
+
+		// compare the entire token, so timing reveals nothing
+		for (j = 0, diff = 0; j < SESSION_TOKEN_LEN; j++)
+			diff |= sessions[i].token[j] ^ token[j];
+		if (diff)
+			continue;
+
+		// got it. extend the session and hand the user over
+		sessions[i].expires = now + ttl;
+		memcpy (user, &sessions[i].user, sizeof (USER));
+		strcpy (user->password, "*");
+		return 1;
+	}
+
+	// no such session
+	return 0;
+}
+
+/* vim:set ts=2 sw=2: */
@@ -0,0 +1,102 @@
+/*
+ * session.h
+ *
+ * This is the jukebox session manager.
+ *
+ */
+#include <stdlib.h>
+#include <time.h>
+#include "user.h"
+
+#ifndef __SESSION_H__
+#define __SESSION_H__
+
+//! \brief SESSION_TOKEN_LEN is the length of a session token, in characters
+#define SESSION_TOKEN_LEN				32
+
+//! \brief SESSION_DEFAULT_TTL is the default session lifetime, in seconds
+#define SESSION_DEFAULT_TTL			3600
+
+//! \brief SESSION_DEFAULT_MAX is the default number of sessions kept
+#define SESSION_DEFAULT_MAX			256
+
+//! \brief SESSION_RANDOM_DEVICE is where we get our randomness from
+#define SESSION_RANDOM_DEVICE		"/dev/urandom"
+
+/*!
+ * \struct SESSION
+ * \brief Capable of storing a single authenticated session.
+ */
+struct SESSION {
+	//! \brief The token handed to the client, or empty if the slot is free
+	char		token[SESSION_TOKEN_LEN + 1];
+
+	//! \brief The user who authenticated, without password
+	USER		user;
+
+	//! \brief The moment this session is no longer valid
+	time_t	expires;
+};
+
+/*!
+ * \class SESSIONS
+ * \brief This will manage the authenticated sessions.
+ *
+ * Once an user has been authenticated, a session token is handed out. The
+ * client may use this token to restore the authentication on a new connection
+ * by using the RESUME command, without bothering the user backends again.
+ */
+class SESSIONS {
+public:
+	/*! \brief This will set the session table up
+	 *  \param max The maximum number of sessions to keep
+	 *
+	 * This has to be called before chroot()-ing, as the random device is
+	 * opened here.
+	 */
+	SESSIONS(int max);
+
+	//! \brief This will destroy all sessions
+	~SESSIONS();
+
+	/*! \brief Creates a new session
+	 *  \param user The user to create the session for
+	 *  \param token Buffer of SESSION_TOKEN_LEN + 1 bytes receiving the token
+	 *
+	 * This will return zero on failure or non-zero on success. If the table
+	 * is full, the session closest to expiry is evicted.
+	 */
+	int create (USER* user, char* token);
+
+	/*! \brief Resumes an existing session
+	 *  \param token The token handed out by create()
+	 *  \param user Buffer to put the user information in
+	 *
+	 * This will return zero if the session is unknown or expired, or non-zero
+	 * on success. On success, the lifetime of the session is extended.
+	 */
+	int resume (const char* token, USER* user);
+
+private:
+	/*! \brief Fills a buffer with random bytes
+	 *  \param buf The buffer to fill
+	 *  \param len The number of bytes needed
+	 *
+	 *  This will return zero if the random device couldn't be read or
+	 *  non-zero on success.
+	 */
+	int getRandom (unsigned char* buf, int len);
+
+	//! \brief The session table
+	SESSION*	sessions;
+
+	//! \brief The number of slots in the session table
+	int				numSessions;
+
+	//! \brief File descriptor of the random device, or -1 if none
+	int				randomfd;
+};
+
+#endif /* __SESSION_H__ */
+
+/* vim:set ts=2 sw=2: */
@@ -0,0 +1,790 @@
+/*
+ * tagreader.cc - Jukebox tag reading code
+ *
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include "tagreader.h"
+#include "utf8.h"
+
+// ID3V1_LEN is the length of an ID3v1 tag
+#define ID3V1_LEN		128
+
+// ID3V2_HEADER_LEN is the length of the header (and footer) of an ID3v2 tag
+#define ID3V2_HEADER_LEN	10
+
+// ID3V2_NUMBER_LEN is the size of the buffer numeric frames are decoded to
+#define ID3V2_NUMBER_LEN	32
+
+// OGG_PAGE_MAX is the largest an Ogg page can be
+#define OGG_PAGE_MAX		(27 + 255 + 255 * 255)
+
+// OGG_READ_LEN is the number of bytes read at once while walking the pages
+#define OGG_READ_LEN		8192
+
+// OGG_MAX_PAGES is the number of pages looked at for the comment header at most
+#define OGG_MAX_PAGES		64
+
+// OGG_CODEC_xxx are the codecs whose comments we know
+#define OGG_CODEC_NONE		0
+#define OGG_CODEC_VORBIS	1
+#define OGG_CODEC_OPUS		2
+#define OGG_CODEC_FLAC		3
+
+// FLAC_READ_LEN is the number of bytes read at once from the start of a FLAC file
+#define FLAC_READ_LEN			8192
+
+// FLAC_MAX_BLOCKS is the number of metadata blocks looked at for the comments at most
+#define FLAC_MAX_BLOCKS		64
+
+// FLAC_BLOCK_COMMENT is the type of the VORBIS_COMMENT metadata block
+#define FLAC_BLOCK_COMMENT	4
+
+// COMMENT_MAX_LEN is the size of the comment header parsed at most
+#define COMMENT_MAX_LEN		(1024 * 1024)
+
+/*
+ * readSyncsafe (const unsigned char* p)
+ *
+ * This will return the 28-bit syncsafe integer at [p].
+ *
+ */
+static inline int
+readSyncsafe (const unsigned char* p) {
+	return ((p[0] & 0x7f) << 21) | ((p[1] & 0x7f) << 14) | ((p[2] & 0x7f) << 7) | (p[3] & 0x7f);
+}
+
+/*
+ * readBE32 (const unsigned char* p)
+ *
+ * This will return the big endian 32-bit value at [p].
+ *
+ */
+static inline unsigned int
+readBE32 (const unsigned char* p) {
+	return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | (unsigned int)p[3];
+}
+
+/*
+ * readLE32 (const unsigned char* p)
+ *
+ * This will return the little endian 32-bit value at [p].
+ *
+ */
+static inline unsigned int
+readLE32 (const unsigned char* p) {
+	return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+/*
+ * undoUnsync (const unsigned char* src, int len, unsigned char* dest)
+ *
+ * This will copy [len] bytes of unsynchronised data from [src] to [dest],
+ * dropping the zero byte inserted after each 0xff. It will return the
+ * number of bytes copied.
+ *
+ */
+static int
+undoUnsync (const unsigned char* src, int len, unsigned char* dest) {
+	int i, n = 0;
+
+	for (i = 0; i < len; i++) {
+		dest[n++] = src[i];
+		if ((src[i] == 0xff) && (i + 1 < len) && (src[i + 1] == 0))
+			// skip the stuffing
+			i++;
+	}
+	return n;
+}
+
+/*
+ * decodeText (const unsigned char* p, int len, char* dest, int size)
+ *
+ * This will decode the body of ID3v2 text frame [p], which is [len] bytes
+ * long, to [dest], which is [size] bytes. Only the first of multiple values
+ * is used.
+ *
+ */
+static void
+decodeText (const unsigned char* p, int len, char* dest, int size) {
+	int enc, pos = 0, i, be;
+
+	if ((len < 1) || (size < 1)) {
+		// nothing there
+		if (size > 0)
+			dest[0] = 0;
+		return;
+	}
+	enc = *p++; len--;
+
+	if ((enc == 0) || (enc == 3)) {
+		// Latin-1 or UTF-8; this is copied as it is
+		for (i = 0; (i < len) && (p[i] != 0) && (pos < size - 1); i++)
+			dest[pos++] = p[i];
+		dest[pos] = 0;
+		return;
+	}
+
+	// UTF-16, big endian unless the BOM says otherwise or it's type 1 without one
+	be = (enc == 2) ? 1 : 0;
+	if ((len >= 2) && (p[0] == 0xfe) && (p[1] == 0xff)) {
+		be = 1; p += 2; len -= 2;
+	} else if ((len >= 2) && (p[0] == 0xff) && (p[1] == 0xfe)) {
+		be = 0; p += 2; len -= 2;
+	}
+	utf16ToUTF8 (p, len, be, dest, size);
+}
+
+/*
+ * frameField (const unsigned char* id, int version)
+ *
+ * This will return the TAGINFO_xxx field frame [id] of an ID3v2.[version]
+ * tag holds, or zero if it's of no interest.
+ *
+ */
+static int
+frameField (const unsigned char* id, int version) {
+	if (version == 2) {
+		// three character frame IDs
+		if (!memcmp (id, "TT2", 3)) return TAGINFO_TITLE;
+		if (!memcmp (id, "TP1", 3)) return TAGINFO_ARTIST;
+		if (!memcmp (id, "TAL", 3)) return TAGINFO_ALBUM;
+		if (!memcmp (id, "TYE", 3)) return TAGINFO_YEAR;
+		if (!memcmp (id, "TRK", 3)) return TAGINFO_TRACKNO;
+		return 0;
+	}
+
+	if (!memcmp (id, "TIT2", 4)) return TAGINFO_TITLE;
+	if (!memcmp (id, "TPE1", 4)) return TAGINFO_ARTIST;
+	if (!memcmp (id, "TALB", 4)) return TAGINFO_ALBUM;
+	if (!memcmp (id, "TRCK", 4)) return TAGINFO_TRACKNO;
+	// 2.4 replaced TYER by TDRC, but plenty of taggers write TYER anyway
+	if (!memcmp (id, "TYER", 4)) return TAGINFO_YEAR;
+	if ((version == 4) && (!memcmp (id, "TDRC", 4))) return TAGINFO_YEAR;
+	return 0;
+}
+
+/*
+ * storeFrame (const unsigned char* p, int len, int field, TAGINFO* tag)
+ *
+ * This will decode text frame [p], which is [len] bytes long, to [field]
+ * of [tag].
+ *
+ */
+static void
+storeFrame (const unsigned char* p, int len, int field, TAGINFO* tag) {
+	char tmp[ID3V2_NUMBER_LEN];
+
+	switch (field) {
+		  case TAGINFO_TITLE: decodeText (p, len, tag->title, tag->titleLen);
+		                      break;
+		 case TAGINFO_ARTIST: decodeText (p, len, tag->artist, tag->artistLen);
+		                      break;
+		  case TAGINFO_ALBUM: decodeText (p, len, tag->album, tag->albumLen);
+		                      break;
+		   case TAGINFO_YEAR: // "2003" or "2003-05-01"
+		                      decodeText (p, len, tmp, sizeof (tmp));
+		                      tag->year = atoi (tmp);
+		                      break;
+		case TAGINFO_TRACKNO: // "3" or "3/12"
+		                      decodeText (p, len, tmp, sizeof (tmp));
+		                      tag->trackno = atoi (tmp);
+		                      break;
+	}
+}
+
+/*
+ * parseID3v2 (const unsigned char* data, int len, TAGINFO* tag)
+ *
+ * This will parse the ID3v2 tag at [data], of which [len] bytes are
+ * available, into [tag]. It will return the TAGINFO_xxx fields found.
+ *
+ */
+int
+parseID3v2 (const unsigned char* data, int len, TAGINFO* tag) {
+	const unsigned char* p;
+	const unsigned char* end;
+	const unsigned char* body;
+	unsigned char* copy = NULL;
+	unsigned char* frame = NULL;
+	int version, flags, size, found = 0;
+	int hdrLen, fsize, fflags, field, blen;
+	unsigned long ext;
+
+	// is this an ID3v2 tag we know?
+	if ((len < ID3V2_HEADER_LEN) || (memcmp (data, "ID3", 3)))
+		return 0;
+	version = data[3]; flags = data[5];
+	if ((version < 2) || (version > 4))
+		// no. bail out
+		return 0;
+	if ((version == 2) && (flags & 0x40))
+		// compressed 2.2 tags were never defined properly
+		return 0;
+
+	size = readSyncsafe (data + 6);
+	if (size > len - ID3V2_HEADER_LEN)
+		size = len - ID3V2_HEADER_LEN;
+	p = data + ID3V2_HEADER_LEN; end = p + size;
+
+	if ((flags & 0x80) && (version < 4)) {
+		// the whole tag is unsynchronised. undo that on a copy
+		copy = (unsigned char*)malloc (size + 1);
+		if (copy == NULL)
+			return 0;
+		size = undoUnsync (p, size, copy);
+		p = copy; end = copy + size;
+	}
+
+	if ((flags & 0x40) && (end - p >= 4)) {
+		// skip the extended header. 2.3 doesn't count the size itself, 2.4 does.
+		// check the size against what's left before adding anything to it
+		if (version == 3) {
+			ext = readBE32 (p);
+			p = (ext > (unsigned long)(end - p - 4)) ? end : p + 4 + ext;
+		} else {
+			ext = readSyncsafe (p);
+			p = (ext > (unsigned long)(end - p)) ? end : p + ext;
+		}
+	}
+
+	hdrLen = (version == 2) ? 6 : 10;
+	while ((end - p >= hdrLen) && (p[0] != 0) && (found != TAGINFO_ALL)) {
+		// fetch the frame header
+		if (version == 2) {
+			fsize = (p[3] << 16) | (p[4] << 8) | p[5];
+			fflags = 0;
+		} else {
+			fsize = readBE32 (p + 4);
+			fflags = p[9];
+			if ((version == 4) && (!(p[4] & 0x80) && !(p[5] & 0x80) && !(p[6] & 0x80) && !(p[7] & 0x80)))
+				// 2.4 sizes are syncsafe, except for those written by broken taggers
+				fsize = readSyncsafe (p + 4);
+		}
+		body = p + hdrLen;
+		if ((fsize < 0) || (fsize > end - body))
+			// this frame is broken. stop here
+			break;
+		p = body + fsize;
+
+		field = frameField (body - hdrLen, version);
+		if ((field == 0) || (found & field))
+			// not interesting, or seen already
+			continue;
+
+		blen = fsize;
+		if (version == 3) {
+			if (fflags & 0xc0)
+				// compressed or encrypted
+				continue;
+			if (fflags & 0x20) {
+				// skip the group ID
+				body++; blen--;
+			}
+		} else if (version == 4) {
+			if (fflags & 0x0c)
+				// compressed or encrypted
+				continue;
+			if (fflags & 0x40) {
+				// skip the group ID
+				body++; blen--;
+			}
+			if (fflags & 0x01) {
+				// skip the data length indicator
+				body += 4; blen -= 4;
+			}
+			if (blen < 0)
+				continue;
+			if ((fflags & 0x02) || (flags & 0x80)) {
+				// this frame is unsynchronised. undo that on a copy
+				frame = (unsigned char*)realloc (frame, blen + 1);
+				if (frame == NULL)
+					break;
+				blen = undoUnsync (body, blen, frame);
+				body = frame;
+			}
+		}
+		if (blen < 0)
+			continue;
+
+		storeFrame (body, blen, field, tag);
+		found |= field;
+	}
+
+	if (frame != NULL)
+		free (frame);
+	if (copy != NULL)
+		free (copy);
+	return found;
+}
+
+/*
+ * copyField (const unsigned char* src, int len, char* dest, int size)
+ *
+ * This will copy ID3v1 field [src], which is [len] bytes long, to [dest],
+ * which is [size] bytes, without the trailing padding. It will return
+ * zero if the field was blank or non-zero if it wasn't.
+ *
+ */
+static int
+copyField (const unsigned char* src, int len, char* dest, int size) {
+	int n = 0;
+
+	while ((n < len) && (src[n] != 0))
+		n++;
+	while ((n > 0) && (src[n - 1] == ' '))
+		n--;
+	if (n == 0)
+		// blank
+		return 0;
+
+	if (n > size - 1)
+		n = size - 1;
+	memcpy (dest, src, n);
+	dest[n] = 0;
+	return 1;
+}
+
+/*
+ * parseID3v1 (const unsigned char* data, TAGINFO* tag, int found)
+ *
+ * This will fill the fields of [tag] not in [found] from the ID3v1 tag at
+ * [data]. It will return [found] along with the fields it filled.
+ *
+ */
+int
+parseID3v1 (const unsigned char* data, TAGINFO* tag, int found) {
+	char tmp[5];
+
+	if (memcmp (data, "TAG", 3))
+		// no tag here
+		return found;
+
+	if ((!(found & TAGINFO_TITLE)) && (copyField (data + 3, 30, tag->title, tag->titleLen)))
+		found |= TAGINFO_TITLE;
+	if ((!(found & TAGINFO_ARTIST)) && (copyField (data + 33, 30, tag->artist, tag->artistLen)))
+		found |= TAGINFO_ARTIST;
+	if ((!(found & TAGINFO_ALBUM)) && (copyField (data + 63, 30, tag->album, tag->albumLen)))
+		found |= TAGINFO_ALBUM;
+	if ((!(found & TAGINFO_YEAR)) && (copyField (data + 93, 4, tmp, sizeof (tmp))) && (atoi (tmp) > 0)) {
+		tag->year = atoi (tmp);
+		found |= TAGINFO_YEAR;
+	}
+	if ((!(found & TAGINFO_TRACKNO)) && (data[125] == 0) && (data[126] != 0)) {
+		// ID3v1.1 keeps the track number at the end of the comment
+		tag->trackno = data[126];
+		found |= TAGINFO_TRACKNO;
+	}
+	return found;
+}
+
+/*
+ * readID3 (const char* fname, TAGINFO* tag)
+ *
+ * This will read the ID3 tags of [fname] into [tag]. Only the part of the
+ * file the ID3v2 tag claims is mapped, and the last 128 bytes are read for
+ * an ID3v1 tag. It will return the TAGINFO_xxx fields found.
+ *
+ */
+int
+readID3 (const char* fname, TAGINFO* tag) {
+	unsigned char hdr[ID3V1_LEN];
+	unsigned char* data;
+	struct stat fs;
+	int fd, len, found = 0;
+	void* map;
+
+	// open the file
+	fd = open (fname, O_RDONLY);
+	if (fd < 0)
+		// this failed. bail out
+		return 0;
+	if (fstat (fd, &fs) < 0) {
+		close (fd);
+		return 0;
+	}
+
+	if ((pread (fd, hdr, ID3V2_HEADER_LEN, 0) == ID3V2_HEADER_LEN) && (!memcmp (hdr, "ID3", 3))) {
+		// there's an ID3v2 tag. map just that; pictures we don't touch won't be read
+		len = ID3V2_HEADER_LEN + readSyncsafe (hdr + 6);
+		if (len > fs.st_size)
+			len = fs.st_size;
+		map = mmap (NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			found = parseID3v2 ((const unsigned char*)map, len, tag);
+			munmap (map, len);
+		} else {
+			// no mapping. read it the old-fashioned way
+			data = (unsigned char*)malloc (len);
+			if ((data != NULL) && (pread (fd, data, len, 0) == len))
+				found = parseID3v2 (data, len, tag);
+			if (data != NULL)
+				free (data);
+		}
+	}
+
+	if ((found != TAGINFO_ALL) && (fs.st_size >= ID3V1_LEN) &&
+	    (pread (fd, hdr, ID3V1_LEN, fs.st_size - ID3V1_LEN) == ID3V1_LEN))
+		// fill the gaps from the ID3v1 tag
+		found = parseID3v1 (hdr, tag, found);
+
+	close (fd);
+	return found;
+}
+
+/*
+ * commentField (const unsigned char* key, int len)
+ *
+ * This will return the TAGINFO_xxx field Vorbis comment [key], which is
+ * [len] bytes long, holds, or zero if it's of no interest.
+ *
+ */
+static int
+commentField (const unsigned char* key, int len) {
+	const char* k = (const char*)key;
+
+	switch (len) {
+		 case 4: if (!strncasecmp (k, "DATE", 4)) return TAGINFO_YEAR;
+		         break;
+		 case 5: if (!strncasecmp (k, "TITLE", 5)) return TAGINFO_TITLE;
+		         if (!strncasecmp (k, "ALBUM", 5)) return TAGINFO_ALBUM;
+		         break;
+		 case 6: if (!strncasecmp (k, "ARTIST", 6)) return TAGINFO_ARTIST;
+		         break;
+		case 11: if (!strncasecmp (k, "TRACKNUMBER", 11)) return TAGINFO_TRACKNO;
+		         break;
+	}
+	return 0;
+}
+
+/*
+ * copyValue (const unsigned char* src, int len, char* dest, int size)
+ *
+ * This will copy the [len] bytes of [src] to [dest], which is [size] bytes,
+ * cutting it short if needed.
+ *
+ */
+static void
+copyValue (const unsigned char* src, int len, char* dest, int size) {
+	if (size < 1)
+		return;
+	if (len > size - 1)
+		len = size - 1;
+	memcpy (dest, src, len);
+	dest[len] = 0;
+}
+
+/*
+ * parseVorbisComment (const unsigned char* data, int len, TAGINFO* tag)
+ *
+ * This will parse the Vorbis comment header at [data], of which [len] bytes
+ * are available, into [tag]. It will return the TAGINFO_xxx fields found.
+ *
+ */
+int
+parseVorbisComment (const unsigned char* data, int len, TAGINFO* tag) {
+	const unsigned char* p = data;
+	const unsigned char* end = data + len;
+	const unsigned char* eq;
+	char tmp[ID3V2_NUMBER_LEN];
+	unsigned int n, num;
+	int found = 0, field;
+
+	// skip the vendor string
+	if (len < 4)
+		return 0;
+	n = readLE32 (p); p += 4;
+	if (n > (unsigned int)(end - p))
+		// this is broken. bail out
+		return 0;
+	p += n;
+	if (end - p < 4)
+		return 0;
+	num = readLE32 (p); p += 4;
+
+	// handle the comments, which are KEY=value
+	while ((num-- > 0) && (end - p >= 4) && (found != TAGINFO_ALL)) {
+		n = readLE32 (p); p += 4;
+		if (n > (unsigned int)(end - p))
+			// cut short. stop here
+			break;
+
+		eq = (const unsigned char*)memchr (p, '=', n);
+		field = (eq != NULL) ? commentField (p, eq - p) : 0;
+		if ((field != 0) && (!(found & field))) {
+			// a field we want, and the first of its kind
+			eq++;
+			switch (field) {
+				  case TAGINFO_TITLE: copyValue (eq, p + n - eq, tag->title, tag->titleLen);
+				                      break;
+				 case TAGINFO_ARTIST: copyValue (eq, p + n - eq, tag->artist, tag->artistLen);
+				                      break;
+				  case TAGINFO_ALBUM: copyValue (eq, p + n - eq, tag->album, tag->albumLen);
+				                      break;
+				   case TAGINFO_YEAR: // "2003" or "2003-05-01"; hope it's the year :)
+				                      copyValue (eq, p + n - eq, tmp, sizeof (tmp));
+				                      tag->year = atoi (tmp);
+				                      break;
+				case TAGINFO_TRACKNO: // "3" or "3/12"
+				                      copyValue (eq, p + n - eq, tmp, sizeof (tmp));
+				                      tag->trackno = atoi (tmp);
+				                      break;
+			}
+			found |= field;
+		}
+		p += n;
+	}
+	return found;
+}
+
+/*
+ * oggCodec (const unsigned char* p, int len)
+ *
+ * This will return the OGG_CODEC_xxx codec of identification header [p],
+ * which is [len] bytes long.
+ *
+ */
+static int
+oggCodec (const unsigned char* p, int len) {
+	if ((len >= 7) && (!memcmp (p, "\001vorbis", 7)))
+		return OGG_CODEC_VORBIS;
+	if ((len >= 8) && (!memcmp (p, "OpusHead", 8)))
+		return OGG_CODEC_OPUS;
+	if ((len >= 5) && (!memcmp (p, "\177FLAC", 5)))
+		return OGG_CODEC_FLAC;
+	return OGG_CODEC_NONE;
+}
+
+/*
+ * oggComments (int codec, const unsigned char* p, int len, TAGINFO* tag)
+ *
+ * This will parse comment header [p] of [codec], which is [len] bytes
+ * long, into [tag]. It will return the TAGINFO_xxx fields found.
+ *
+ */
+static int
+oggComments (int codec, const unsigned char* p, int len, TAGINFO* tag) {
+	switch (codec) {
+		case OGG_CODEC_VORBIS: if ((len < 7) || (memcmp (p, "\003vorbis", 7)))
+		                         return 0;
+		                       return parseVorbisComment (p + 7, len - 7, tag);
+		  case OGG_CODEC_OPUS: if ((len < 8) || (memcmp (p, "OpusTags", 8)))
+		                         return 0;
+		                       return parseVorbisComment (p + 8, len - 8, tag);
+		  case OGG_CODEC_FLAC: // a metadata block, which must be the comments
+		                       if ((len < 4) || ((p[0] & 0x7f) != FLAC_BLOCK_COMMENT))
+		                         return 0;
+		                       return parseVorbisComment (p + 4, len - 4, tag);
+	}
+	return 0;
+}
+
+/*
+ * fetchWindow (int fd, long pos, int need, unsigned char* buf, long* start, int* have)
+ *
+ * This will make sure [need] bytes at [pos] of [fd] are in [buf], which
+ * holds [have] bytes from offset [start]. If they aren't, at least
+ * OGG_READ_LEN bytes are read at [pos]. It will return zero if the bytes
+ * aren't there or non-zero if they are.
+ *
+ */
+static int
+fetchWindow (int fd, long pos, int need, unsigned char* buf, long* start, int* have) {
+	if ((pos >= *start) && (pos + need <= *start + *have))
+		// at hand already
+		return 1;
+
+	*start = pos;
+	*have = pread (fd, buf, (need > OGG_READ_LEN) ? need : OGG_READ_LEN, pos);
+	if (*have < 0)
+		*have = 0;
+	return (*have >= need);
+}
+
+/*
+ * readOggTags (const char* fname, TAGINFO* tag)
+ *
+ * This will read the comments of Ogg file [fname] into [tag]. The pages are
+ * walked up to the comment header, which is the second packet of the first
+ * stream we know the codec of. It will return the TAGINFO_xxx fields found.
+ *
+ */
+int
+readOggTags (const char* fname, TAGINFO* tag) {
+	unsigned char buf[OGG_PAGE_MAX];
+	unsigned char* copy = NULL;
+	unsigned char* grown;
+	const unsigned char* h;
+	const unsigned char* body;
+	unsigned int serial = 0;
+	long start = 0, pos = 0;
+	int have = 0, fd, pages, nsegs, bodyLen, i, off, pieceStart, pieceLen, ended;
+	int codec = OGG_CODEC_NONE, packet = 0, seen = 0, copyLen = 0, found = 0, done = 0;
+
+	// open the file
+	fd = open (fname, O_RDONLY);
+	if (fd < 0)
+		// this failed. bail out
+		return 0;
+
+	for (pages = 0; (pages < OGG_MAX_PAGES) && (!done); pages++) {
+		// fetch the page header, the segment table and the body
+		if (!fetchWindow (fd, pos, 27, buf, &start, &have))
+			break;
+		h = buf + (pos - start);
+		if ((memcmp (h, "OggS", 4)) || (h[4] != 0))
+			// not a page. bail out
+			break;
+		nsegs = h[26];
+		if (!fetchWindow (fd, pos, 27 + nsegs, buf, &start, &have))
+			break;
+		h = buf + (pos - start);
+		for (i = 0, bodyLen = 0; i < nsegs; i++)
+			bodyLen += h[27 + i];
+		if (!fetchWindow (fd, pos, 27 + nsegs + bodyLen, buf, &start, &have))
+			break;
+		h = buf + (pos - start);
+		body = h + 27 + nsegs;
+		pos += 27 + nsegs + bodyLen;
+
+		if ((codec == OGG_CODEC_NONE) && (h[5] & 0x02)) {
+			// the first page of a stream. perhaps we know this one
+			serial = readLE32 (h + 14);
+			packet = 0; seen = 0;
+		} else if (codec == OGG_CODEC_NONE)
+			// all streams started and none we know. give up
+			break;
+		if (readLE32 (h + 14) != serial)
+			// another stream
+			continue;
+
+		// split the body into pieces of packets
+		for (i = 0, off = 0, pieceStart = 0; (i < nsegs) && (!done); i++) {
+			off += h[27 + i];
+			ended = (h[27 + i] < 255);
+			if ((!ended) && (i + 1 < nsegs))
+				// the packet goes on in this page
+				continue;
+			pieceLen = off - pieceStart;
+
+			if (packet == 0) {
+				// the identification header tells what this is
+				if (seen == 0)
+					codec = oggCodec (body + pieceStart, pieceLen);
+			} else if ((seen == 0) && (ended)) {
+				// the comment header in one piece. parse it where it lies
+				found = oggComments (codec, body + pieceStart, pieceLen, tag);
+				done = 1;
+			} else {
+				// the comment header spans pages. gather it, up to a limit
+				if (pieceLen > COMMENT_MAX_LEN - copyLen)
+					pieceLen = COMMENT_MAX_LEN - copyLen;
+				grown = (unsigned char*)realloc (copy, copyLen + pieceLen);
+				if (grown == NULL) {
+					// out of memory. give up
+					done = 1;
+					break;
+				}
+				copy = grown;
+				memcpy (copy + copyLen, body + pieceStart, pieceLen);
+				copyLen += pieceLen;
+				if ((ended) || (copyLen == COMMENT_MAX_LEN)) {
+					found = oggComments (codec, copy, copyLen, tag);
+					done = 1;
+				}
+			}
+
+			pieceStart = off;
+			seen = (ended) ? 0 : seen + pieceLen;
+			if (ended)
+				packet++;
+		}
+	}
+
+	if (copy != NULL)
+		free (copy);
+	close (fd);
+	return found;
+}
+
+/*
+ * readFLACTags (const char* fname, TAGINFO* tag)
+ *
+ * This will read the comments of FLAC file [fname] into [tag]. The metadata
+ * blocks before the VORBIS_COMMENT block are skipped without reading them.
+ * It will return the TAGINFO_xxx fields found.
+ *
+ */
+int
+readFLACTags (const char* fname, TAGINFO* tag) {
+	unsigned char buf[FLAC_READ_LEN];
+	unsigned char hdr[4];
+	unsigned char* data;
+	const unsigned char* p;
+	long pos = 0;
+	int fd, have, len, blocks, found = 0;
+
+	// open the file, and fetch the start of it
+	fd = open (fname, O_RDONLY);
+	if (fd < 0)
+		// this failed. bail out
+		return 0;
+	have = pread (fd, buf, sizeof (buf), 0);
+	if (have < ID3V2_HEADER_LEN) {
+		close (fd);
+		return 0;
+	}
+
+	if (!memcmp (buf, "ID3", 3))
+		// some taggers put an ID3v2 tag up front anyway
+		pos = ID3V2_HEADER_LEN + readSyncsafe (buf + 6) + ((buf[5] & 0x10) ? ID3V2_HEADER_LEN : 0);
+
+	for (blocks = 0; blocks <= FLAC_MAX_BLOCKS; blocks++) {
+		// fetch the marker, or the next block header
+		if (pos + 4 <= have)
+			p = buf + pos;
+		else if (pread (fd, hdr, 4, pos) == 4)
+			p = hdr;
+		else
+			break;
+		pos += 4;
+		if (blocks == 0) {
+			// is this FLAC at all?
+			if (memcmp (p, "fLaC", 4))
+				break;
+			continue;
+		}
+
+		len = (p[1] << 16) | (p[2] << 8) | p[3];
+		if ((p[0] & 0x7f) == FLAC_BLOCK_COMMENT) {
+			// the comments. parse them where they lie if we can
+			if (len > COMMENT_MAX_LEN)
+				len = COMMENT_MAX_LEN;
+			if (pos + len <= have)
+				found = parseVorbisComment (buf + pos, len, tag);
+			else if ((data = (unsigned char*)malloc (len)) != NULL) {
+				len = pread (fd, data, len, pos);
+				if (len > 0)
+					found = parseVorbisComment (data, len, tag);
+				free (data);
+			}
+			break;
+		}
+		if (p[0] & 0x80)
+			// this was the last block
+			break;
+		pos += len;
+	}
+
+	close (fd);
+	return found;
+}
+
+/* vim:set ts=2 sw=2: */
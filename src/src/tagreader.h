@@ -0,0 +1,111 @@
+/*
+ * tagreader.h
+ *
+ * This is the jukebox tag reader, which fetches the few fields the catalog
+ * needs from the ID3 tags and Vorbis comments of audio files.
+ *
+ */
+#include <stdlib.h>
+
+#ifndef __TAGREADER_H__
+#define __TAGREADER_H__
+
+//! \brief TAGINFO_xxx are the fields a tag reader can find
+#define TAGINFO_TITLE		1
+#define TAGINFO_ARTIST	2
+#define TAGINFO_ALBUM		4
+#define TAGINFO_YEAR		8
+#define TAGINFO_TRACKNO	16
+#define TAGINFO_ALL			31
+
+/*!
+ * \struct TAGINFO
+ * \brief This is where the fields of a tag go
+ *
+ * The text fields are decoded straight into the buffers given. Latin-1 and
+ * UTF-8 text is copied as it is, UTF-16 text is converted to UTF-8. Text
+ * which does not fit is cut off.
+ */
+struct TAGINFO {
+	//! \brief The title, and the size of its buffer
+	char*	title;
+	int		titleLen;
+
+	//! \brief The artist, and the size of its buffer
+	char*	artist;
+	int		artistLen;
+
+	//! \brief The album, and the size of its buffer
+	char*	album;
+	int		albumLen;
+
+	//! \brief The year and track number
+	int		year, trackno;
+};
+
+/*! \brief Reads the ID3 tags of a file
+ *  \param fname The file to read
+ *  \param tag Where the fields go
+ *
+ *  Only the part of the file an ID3v2 tag claims is mapped, and the last
+ *  128 bytes are read for an ID3v1 tag. Fields missing from the ID3v2 tag
+ *  are taken from the ID3v1 tag. This will return the TAGINFO_xxx fields
+ *  found, which is zero if there were no tags or the file couldn't be read.
+ */
+int readID3 (const char* fname, TAGINFO* tag);
+
+/*! \brief Parses an ID3v2 tag
+ *  \param data The tag, starting with its header
+ *  \param len The number of bytes available
+ *  \param tag Where the fields go
+ *
+ *  Versions 2.2, 2.3 and 2.4 are handled, including unsynchronisation.
+ *  Compressed and encrypted frames are skipped. This will return the
+ *  TAGINFO_xxx fields found.
+ */
+int parseID3v2 (const unsigned char* data, int len, TAGINFO* tag);
+
+/*! \brief Parses an ID3v1 tag
+ *  \param data The 128 bytes of the tag
+ *  \param tag Where the fields go
+ *  \param found The TAGINFO_xxx fields found already, which are left alone
+ *
+ *  This will return [found] along with the fields found. Fields which are
+ *  blank don't count.
+ */
+int parseID3v1 (const unsigned char* data, TAGINFO* tag, int found);
+
+/*! \brief Reads the comments of an Ogg Vorbis, Opus or Ogg FLAC file
+ *  \param fname The file to read
+ *  \param tag Where the fields go
+ *
+ *  Only the first pages of the file are read, up to the comment header,
+ *  which is parsed where it lies unless it spans pages. This will return
+ *  the TAGINFO_xxx fields found, which is zero if there were none or the
+ *  file couldn't be read.
+ */
+int readOggTags (const char* fname, TAGINFO* tag);
+
+/*! \brief Reads the comments of a FLAC file
+ *  \param fname The file to read
+ *  \param tag Where the fields go
+ *
+ *  The metadata blocks are skipped up to the VORBIS_COMMENT block, so
+ *  pictures are never read. This will return the TAGINFO_xxx fields found.
+ */
+int readFLACTags (const char* fname, TAGINFO* tag);
+
+/*! \brief Parses a Vorbis comment header
+ *  \param data The comments, starting with the vendor string length
+ *  \param len The number of bytes available
+ *  \param tag Where the fields go
+ *
+ *  TITLE, ARTIST, ALBUM, DATE and TRACKNUMBER are used; the first of each
+ *  counts. A header which is cut short is parsed up to where it ends. This
+ *  will return the TAGINFO_xxx fields found.
+ */
+int parseVorbisComment (const unsigned char* data, int len, TAGINFO* tag);
+
+#endif /* __TAGREADER_H__ */
+
+/* vim:set ts=2 sw=2: */
@@ -6,6 +6,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include "change.h"
+#include "dbutil.h"
+#include "fingerprint.h"
 #include "jukebox.h"
 #include "track.h"
 
@@ -16,8 +19,10 @@
  *
  */
 TRACK::TRACK() {
-	id = artistID = albumID = year = 0; playcount = 0;
-	title    = NULL; filename = NULL;
+	id = artistID = albumID = year = trackno = 0; playcount = 0;
+	fileSize = modifyTime = inode = device = 0;
+	title    = NULL; filename = NULL; fingerprint[0] = '\0';
+	duration = bitrate = sampleRate = 0;
 }
 
 /*
@@ -29,10 +34,12 @@ TRACK::TRACK() {
 TRACK::TRACK(int id) {
 	// reset the object first
 	artistID = albumID = year = trackno = this->id = 0;
-	title = filename = NULL;
+	fileSize = modifyTime = inode = device = 0;
+	title = filename = NULL; fingerprint[0] = '\0';
+	duration = bitrate = sampleRate = 0;
 
 	// fetch the information from the database
-	DBRESULT* res = db->query ("SELECT artistid,albumid,year,title,filename,trackno,playcount FROM tracks WHERE id=#", id);
+	DBRESULT* res = db->query ("SELECT artistid,albumid,year,title,filename,trackno,playcount,filesize,mtime,inode,device,fingerprint,duration,bitrate,samplerate FROM tracks WHERE id=#", id);
 	if (res == NULL)
 		// this failed. oh my...
 		throw TrackException();
@@ -53,6 +60,14 @@ TRACK::TRACK(int id) {
 	filename  = strdup (res->fetchColumnAsString (4));
 	trackno   = res->fetchColumnAsInteger (5);
 	playcount = res->fetchColumnAsInteger (6);
+	fileSize   = DBUTIL::fetchBigInt (res, 7);
+	modifyTime = DBUTIL::fetchBigInt (res, 8);
+	inode      = DBUTIL::fetchBigInt (res, 9);
+	device     = DBUTIL::fetchBigInt (res, 10);
+	setFingerprint (res->fetchColumnAsString (11));
+	duration   = res->fetchColumnAsInteger (12);
+	bitrate    = res->fetchColumnAsInteger (13);
+	sampleRate = res->fetchColumnAsInteger (14);
 
 	// all done! ditch the result handle
 	delete res;
@@ -67,10 +82,12 @@ TRACK::TRACK(int id) {
 TRACK::TRACK(char* fname) {
 	// reset the object first
 	artistID = albumID = year = id = playcount = 0;
-	title = filename = NULL;
+	fileSize = modifyTime = inode = device = 0;
+	title = filename = NULL; fingerprint[0] = '\0';
+	duration = bitrate = sampleRate = 0;
 
 	// fetch the information from the database
-	DBRESULT* res = db->query ("SELECT id,artistid,albumid,year,title,filename,trackno,playcount FROM tracks WHERE filename=?", fname);
+	DBRESULT* res = db->query ("SELECT id,artistid,albumid,year,title,filename,trackno,playcount,filesize,mtime,inode,device,fingerprint,duration,bitrate,samplerate FROM tracks WHERE filename=?", fname);
 	if (res == NULL)
 		// this failed. oh my...
 		throw TrackException();
@@ -91,6 +108,14 @@ TRACK::TRACK(char* fname) {
 	filename    = strdup (res->fetchColumnAsString (5));
 	trackno     = res->fetchColumnAsInteger (6);
 	playcount = res->fetchColumnAsInteger (7);
+	fileSize   = DBUTIL::fetchBigInt (res, 8);
+	modifyTime = DBUTIL::fetchBigInt (res, 9);
+	inode      = DBUTIL::fetchBigInt (res, 10);
+	device     = DBUTIL::fetchBigInt (res, 11);
+	setFingerprint (res->fetchColumnAsString (12));
+	duration   = res->fetchColumnAsInteger (13);
+	bitrate    = res->fetchColumnAsInteger (14);
+	sampleRate = res->fetchColumnAsInteger (15);
 
 	// all done! ditch the result handle
 	delete res;
@@ -173,6 +198,43 @@ void TRACK::setYear(int year) { this->year = year; }
  */
 void TRACK::setTrackNo(int newno) { trackno = newno; }
 
+/*
+ * TRACK::setSignature (long long size, long long mtime, long long inode,
+ *                      long long device)
+ *
+ * Sets the signature of the file of this track.
+ *
+ */
+void
+TRACK::setSignature (long long size, long long mtime, long long inode, long long device) {
+	fileSize = size; modifyTime = mtime;
+	this->inode = inode; this->device = device;
+}
+
+/*
+ * TRACK::setFingerprint (const char* fp)
+ *
+ * Sets the fingerprint of the audio of this track.
+ *
+ */
+void
+TRACK::setFingerprint (const char* fp) {
+	strncpy (fingerprint, (fp != NULL) ? fp : "", FINGERPRINT_LEN);
+	fingerprint[FINGERPRINT_LEN] = '\0';
+}
+
+/*
+ * TRACK::setAudio (int duration, int bitrate, int samplerate)
+ *
+ * Sets the [duration], [bitrate] and [samplerate] of the audio of this
+ * track.
+ *
+ */
+void
+TRACK::setAudio (int duration, int bitrate, int samplerate) {
+	this->duration = duration; this->bitrate = bitrate; sampleRate = samplerate;
+}
+
 /*
  * TRACK::update()
  *
@@ -182,28 +244,103 @@ void TRACK::setTrackNo(int newno) { trackno = newno; }
  */
 void
 TRACK::update() {
+	char size[DBUTIL_BIGINT_LEN], mtime[DBUTIL_BIGINT_LEN];
+	char ino[DBUTIL_BIGINT_LEN], dev[DBUTIL_BIGINT_LEN];
+
+	// the signature is 64 bits wide, which # can't pass
+	DBUTIL::formatBigInt (fileSize, size); DBUTIL::formatBigInt (modifyTime, mtime);
+	DBUTIL::formatBigInt (inode, ino); DBUTIL::formatBigInt (device, dev);
+
 	// got an ID?
 	if (id != 0) {
 		// yes. just update the track
-		db->execute ("UPDATE tracks SET albumid=#,artistid=#,title=?,filename=?,year=#,trackno=#,playcount=# WHERE id=#", albumID, artistID, title, filename, year, trackno, playcount, id);
+		db->execute ("UPDATE tracks SET albumid=#,artistid=#,title=?,filename=?,year=#,trackno=#,playcount=#,filesize=?,mtime=?,inode=?,device=?,fingerprint=?,duration=#,bitrate=#,samplerate=# WHERE id=#", albumID, artistID, title, filename, year, trackno, playcount, size, mtime, ino, dev, fingerprint, duration, bitrate, sampleRate, id);
+		CHANGE::record (CHANGE_KIND_TRACK, CHANGE_ACTION_UPDATE, id);
 		return;
 	}
 
 	// no. create a new album
-	db->execute ("INSERT INTO tracks (artistid,albumid,title,filename,year,trackno,playcount) VALUES (#,#,?,?,#,#,#)", artistID, albumID, title, filename, year, trackno, playcount);
-
-	// fetch the id
-	DBRESULT* res = db->query ("SELECT id FROM tracks WHERE filename=?", filename);
-	if (res == NULL) {
-		// this shouldn't happen...
-	 id = 0;
-	 return;
+	db->execute ("INSERT INTO tracks (artistid,albumid,title,filename,year,trackno,playcount,filesize,mtime,inode,device,fingerprint,duration,bitrate,samplerate) VALUES (#,#,?,?,#,#,#,?,?,?,?,?,#,#,#)", artistID, albumID, title, filename, year, trackno, playcount, size, mtime, ino, dev, fingerprint, duration, bitrate, sampleRate);
+
+	// fetch the id, looking it up if the database can't tell
+	id = DBUTIL::lastInsertID ("tracks");
+	if (id == 0) {
+		DBRESULT* res = db->query ("SELECT id FROM tracks WHERE filename=?", filename);
+		if (res == NULL)
+			// this shouldn't happen...
+			return;
+
+		id = res->fetchColumnAsInteger (0);
+		delete res;
 	}
 
-	id = res->fetchColumnAsInteger (0);
+	// tell the world it's there
+	if (id != 0)
+		CHANGE::record (CHANGE_KIND_TRACK, CHANGE_ACTION_INSERT, id);
+}
 
-	// all done
-	delete res;
+/*
+ * TRACK::updateSignature (int id, long long size, long long mtime,
+ *                         long long inode, long long device, const char* fp,
+ *                         int duration, int bitrate, int samplerate)
+ *
+ * This will only update the signature, fingerprint [fp] and audio details
+ * of the file of track [id]. As the catalog itself doesn't change, this isn't
+ * recorded as a change.
+ *
+ */
+void
+TRACK::updateSignature (int id, long long size, long long mtime, long long inode, long long device, const char* fp, int duration, int bitrate, int samplerate) {
+	char s[DBUTIL_BIGINT_LEN], m[DBUTIL_BIGINT_LEN], i[DBUTIL_BIGINT_LEN], d[DBUTIL_BIGINT_LEN];
+
+	db->execute ("UPDATE tracks SET filesize=?,mtime=?,inode=?,device=?,fingerprint=?,duration=#,bitrate=#,samplerate=# WHERE id=#",
+	             DBUTIL::formatBigInt (size, s), DBUTIL::formatBigInt (mtime, m),
+	             DBUTIL::formatBigInt (inode, i), DBUTIL::formatBigInt (device, d),
+	             fp, duration, bitrate, samplerate, id);
+}
+
+/*
+ * TRACK::remove (int id)
+ *
+ * This will remove track [id] from the database, and from any collections
+ * holding it.
+ *
+ */
+void
+TRACK::remove (int id) {
+	db->execute ("DELETE FROM collection_contents WHERE trackid=#", id);
+	db->execute ("DELETE FROM tracks WHERE id=#", id);
+	CHANGE::record (CHANGE_KIND_TRACK, CHANGE_ACTION_DELETE, id);
+}
+
+/*
+ * TRACK::remove (const int* ids, int num)
+ *
+ * This will remove the [num] tracks [ids] from the database, and from any
+ * collections holding them. Up to TRACK_REMOVE_ROWS tracks are removed by a
+ * single query.
+ *
+ */
+void
+TRACK::remove (const int* ids, int num) {
+	char query[64 + TRACK_REMOVE_ROWS * 12];
+	char list[TRACK_REMOVE_ROWS * 12];
+	int i, j, n, len;
+
+	for (i = 0; i < num; i += n) {
+		// list as many as a single query can handle
+		n = (num - i > TRACK_REMOVE_ROWS) ? TRACK_REMOVE_ROWS : num - i;
+		for (j = 0, len = 0; j < n; j++)
+			len += sprintf (list + len, (j > 0) ? ",%d" : "%d", ids[i + j]);
+
+		// the IDs are numbers, so they can go in the query as they are
+		snprintf (query, sizeof (query), "DELETE FROM collection_contents WHERE trackid IN (%s)", list);
+		db->execute (query);
+		snprintf (query, sizeof (query), "DELETE FROM tracks WHERE id IN (%s)", list);
+		db->execute (query);
+		for (j = 0; j < n; j++)
+			CHANGE::record (CHANGE_KIND_TRACK, CHANGE_ACTION_DELETE, ids[i + j]);
+	}
 }
 
 /*
@@ -217,4 +354,96 @@ TRACK::incrementPlaycount() {
 	playcount++;
 }
 
+/*
+ * TRACK::fetchNext()
+ *
+ * This will try to fetch the next track in place. It will return 0 on
+ * failure or non-zero on success.
+ *
+ */
+int
+TRACK::fetchNext() {
+	// fetch the information from the database
+	return copyFetched (db->limitQuery ("SELECT id,artistid,albumid,year,title,filename,trackno,playcount,filesize,mtime,inode,device,fingerprint,duration,bitrate,samplerate FROM tracks WHERE id># ORDER BY id ASC", 1, 0, id));
+}
+
+/*
+ * TRACK::fetchAlbumNext (int albumid)
+ *
+ * This will try to fetch the next track of album [albumid] in place. The
+ * current track number and ID are the position to continue from. It will
+ * return 0 on failure or non-zero on success.
+ *
+ */
+int
+TRACK::fetchAlbumNext (int albumid) {
+	// fetch the information from the database
+	return copyFetched (db->limitQuery ("SELECT id,artistid,albumid,year,title,filename,trackno,playcount,filesize,mtime,inode,device,fingerprint,duration,bitrate,samplerate FROM tracks WHERE albumid=# AND (trackno># OR (trackno=# AND id>#)) ORDER BY trackno ASC, id ASC", 1, 0, albumid, trackno, trackno, id));
+}
+
+/*
+ * TRACK::fetchAlbumNextByTitle (int albumid)
+ *
+ * This will try to fetch the next track of album [albumid] by title in
+ * place. It will return 0 on failure or non-zero on success.
+ *
+ */
+int
+TRACK::fetchAlbumNextByTitle (int albumid) {
+	const char* cur = (title != NULL) ? title : "";
+
+	// fetch the information from the database
+	return copyFetched (db->limitQuery ("SELECT id,artistid,albumid,year,title,filename,trackno,playcount,filesize,mtime,inode,device,fingerprint,duration,bitrate,samplerate FROM tracks WHERE albumid=# AND (title>? OR (title=? AND id>#)) ORDER BY title ASC, id ASC", 1, 0, albumid, cur, cur, id));
+}
+
+/*
+ * TRACK::copyFetched (DBRESULT* res)
+ *
+ * This will copy the track fetched by [res] in place, and free [res]. It
+ * will return 0 if nothing was fetched or non-zero if something was.
+ *
+ */
+int
+TRACK::copyFetched (DBRESULT* res) {
+	if (res == NULL)
+		// this failed. oh my...
+		return 0;
+
+	// got a result?
+	if (res->numRows() == 0) {
+		// no. free the result and return failure
+		delete res;
+		return 0;
+	}
+
+	// free the strings first, if needed
+	if (title)
+		free (title);
+	if (filename)
+		free (filename);
+
+	// copy the data
+	id        = res->fetchColumnAsInteger (0);
+	artistID  = res->fetchColumnAsInteger (1);
+	albumID   = res->fetchColumnAsInteger (2);
+	year      = res->fetchColumnAsInteger (3);
+	title     = strdup (res->fetchColumnAsString (4));
+	filename  = strdup (res->fetchColumnAsString (5));
+	trackno   = res->fetchColumnAsInteger (6);
+	playcount = res->fetchColumnAsInteger (7);
+	fileSize   = DBUTIL::fetchBigInt (res, 8);
+	modifyTime = DBUTIL::fetchBigInt (res, 9);
+	inode      = DBUTIL::fetchBigInt (res, 10);
+	device     = DBUTIL::fetchBigInt (res, 11);
+	setFingerprint (res->fetchColumnAsString (12));
+	duration   = res->fetchColumnAsInteger (13);
+	bitrate    = res->fetchColumnAsInteger (14);
+	sampleRate = res->fetchColumnAsInteger (15);
+
+	delete res;
+
+	// all done
+	return 1;
+}
+
 /* vim:set ts=2 sw=2: */
@@ -5,6 +5,9 @@
  *
  */
 #include <stdlib.h>
+#include "fingerprint.h"
+
+class DBRESULT;
 
 #ifndef __TRACK_H__
 #define __TRACK_H__
@@ -18,6 +21,9 @@
 //! \brief TRACK_MAX_FILENAME_LEN is the maximum length of a filename
 #define QUEUE_MAX_FILENAME_LEN 1024
 
+//! \brief TRACK_REMOVE_ROWS is the number of tracks removed by a single query
+#define TRACK_REMOVE_ROWS 256
+
 /*!
  * \class TrackException
  * \brief This indicates a failure within the tracks.
@@ -98,6 +104,69 @@ public:
 	 */
 	void setTrackNo (int newtrackno);
 
+	/*! \brief Sets the signature of the file
+	 *
+	 * \param size The size of the file
+	 * \param mtime The time the file was last modified
+	 * \param inode The inode number of the file
+	 * \param device The device the file resides on
+	 *
+	 * The scanner uses this to tell whether a file may have changed since it
+	 * was last scanned.
+	 */
+	void setSignature (long long size, long long mtime, long long inode, long long device);
+
+	/*! \brief Sets the fingerprint of the audio
+	 *
+	 * \param fp The fingerprint, as made by fingerprintFile()
+	 *
+	 * Files with the same fingerprint are taken to have the same audio, so a
+	 * moved file can be told from a new one.
+	 */
+	void setFingerprint (const char* fp);
+
+	/*! \brief Sets what is known about the audio
+	 *
+	 * \param duration The playing time in milliseconds, 0 if unknown
+	 * \param bitrate The average bitrate in kbit/s, 0 if unknown
+	 * \param samplerate The sample rate in Hz, 0 if unknown
+	 */
+	void setAudio (int duration, int bitrate, int samplerate);
+
+	/*! \brief Updates only the signature of the file of a track in the database
+	 *
+	 * \param id The track to update
+	 * \param size The size of the file
+	 * \param mtime The time the file was last modified
+	 * \param inode The inode number of the file
+	 * \param device The device the file resides on
+	 * \param fp The fingerprint of the audio
+	 * \param duration The playing time in milliseconds
+	 * \param bitrate The average bitrate in kbit/s
+	 * \param samplerate The sample rate in Hz
+	 *
+	 * Unlike update(), this will not be recorded as a change to the catalog.
+	 */
+	static void updateSignature (int id, long long size, long long mtime, long long inode, long long device, const char* fp, int duration, int bitrate, int samplerate);
+
+	/*! \brief Removes a track from the database
+	 *
+	 * \param id The track to remove
+	 *
+	 * The track is removed from all collections as well. This is recorded as
+	 * a change to the catalog.
+	 */
+	static void remove (int id);
+
+	/*! \brief Removes tracks from the database
+	 *
+	 * \param ids The tracks to remove
+	 * \param num The number of tracks
+	 *
+	 * Like remove(), but using a few queries for all of them.
+	 */
+	static void remove (const int* ids, int num);
+
 	//! \brief Increments the track's play count
 	void incrementPlaycount();
 
@@ -113,16 +182,71 @@ public:
 	//! \brief Returns the album's ID
 	inline int getAlbumID() { return albumID; }
 
+	//! \brief Returns the year
+	inline int getYear() { return year; }
+
 	//! \brief Returns the track number
 	inline int getTrackNo() { return trackno; }
 
+	//! \brief Returns the size of the file
+	inline long long getFileSize() { return fileSize; }
+
+	//! \brief Returns the time the file was last modified
+	inline long long getModifyTime() { return modifyTime; }
+
+	//! \brief Returns the inode number of the file
+	inline long long getInode() { return inode; }
+
+	//! \brief Returns the device the file resides on
+	inline long long getDevice() { return device; }
+
+	//! \brief Returns the fingerprint of the audio, which is empty if unknown
+	inline const char* getFingerprint() { return fingerprint; }
+
+	//! \brief Returns the playing time in milliseconds, or 0 if unknown
+	inline int getDuration() { return duration; }
+
+	//! \brief Returns the average bitrate in kbit/s, or 0 if unknown
+	inline int getBitrate() { return bitrate; }
+
+	//! \brief Returns the sample rate in Hz, or 0 if unknown
+	inline int getSampleRate() { return sampleRate; }
+
 	//! \brief Returns the track's ID
 	inline int getID() { return id; }
 
 	//! \brief Returns the track's play count
 	inline int getPlaycount() { return playcount; }
 
+	/*! \brief Fetches the next available track
+	 *
+	 *  This will return zero on failure or non-zero on success.
+	 */
+	int fetchNext();
+
+	/*! \brief Fetches the next track of an album
+	 *  \param albumid The album ID to fetch for
+	 *
+	 *  The tracks are ordered by track number, and by ID if the numbers are
+	 *  equal. This will return zero on failure or non-zero on success.
+	 */
+	int fetchAlbumNext (int albumid);
+
+	/*! \brief Fetches the next track of an album by title
+	 *  \param albumid The album ID to fetch for
+	 *
+	 *  This will return zero on failure or non-zero on success.
+	 */
+	int fetchAlbumNextByTitle (int albumid);
+
 private:
+	/*! \brief Copies the track fetched
+	 *  \param res The result of the query, which is freed
+	 *
+	 *  This will return zero if there was nothing fetched or non-zero if there was.
+	 */
+	int copyFetched (DBRESULT* res);
+
 	int   id;
 	int   artistID;
 	int   albumID;
@@ -131,6 +255,14 @@ private:
 	int   year;
 	int   trackno;
 	int   playcount;
+	long long fileSize;
+	long long modifyTime;
+	long long inode;
+	long long device;
+	char  fingerprint[FINGERPRINT_LEN + 1];
+	int   duration;
+	int   bitrate;
+	int   sampleRate;
 };
 
 #endif /* __TRACK_H__ */
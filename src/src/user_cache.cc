@@ -0,0 +1,418 @@
+/*
+ * user_cache.cc - Jukebox user lookup cache code
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "jukebox.h"
+#include "user_cache.h"
+
+/*
+ * USERS_CACHE::USERS_CACHE (USERS* c)
+ *
+ * This will construct a cache for the user database chain starting at [c].
+ *
+ */
+USERS_CACHE::USERS_CACHE (USERS* c) {
+	chain = c; nextDB = NULL;
+	entries = NULL; numEntries = 0;
+	ttl = negttl = 0;
+	pthread_mutex_init (&lock, NULL);
+	configure();
+}
+
+/*
+ * USERS_CACHE::~USERS_CACHE()
+ *
+ * This will destruct the cache and the entire chain.
+ *
+ */
+USERS_CACHE::~USERS_CACHE() {
+	USERS* tmpUsers;
+
+	// get rid of the chain
+	while (chain) {
+		tmpUsers = chain->getNextDB();
+		delete chain;
+		chain = tmpUsers;
+	}
+
+	// wipe the entries before handing them back
+	if (entries) {
+		memset (entries, 0, numEntries * sizeof (USERS_CACHE_ENTRY));
+		free (entries);
+	}
+
+	pthread_mutex_destroy (&lock);
+}
+
+/*
+ * USERS_CACHE::init()
+ *
+ * This will initialize the cache. The backends have already been initialized
+ * by now. It will return 0 on failure or 1 on success.
+ *
+ */
+int
+USERS_CACHE::init() {
+	return 1;
+}
+
+/*
+ * USERS_CACHE::reloadConfig()
+ *
+ * This will reload the cache settings and the configuration of all backends.
+ * The cache is emptied, as anything in it may be wrong by now. No other
+ * thread may be using the backends while this runs.
+ *
+ */
+void
+USERS_CACHE::reloadConfig() {
+	USERS* db;
+
+	// reload the backends
+	for (db = chain; db != NULL; db = db->getNextDB())
+		db->reloadConfig();
+
+	// and ourselves
+	pthread_mutex_lock (&lock);
+	configure();
+	pthread_mutex_unlock (&lock);
+}
+
+/*
+ * USERS_CACHE::configure()
+ *
+ * This will fetch the cache settings and empty the cache.
+ *
+ */
+void
+USERS_CACHE::configure() {
+	int size = USERS_CACHE_DEFAULT_SIZE;
+
+	// fetch the lifetimes and size
+	ttl = USERS_CACHE_DEFAULT_TTL; negttl = USERS_CACHE_DEFAULT_NEGTTL;
+	config->get_value ("userdb", "cache_ttl", &ttl);
+	config->get_value ("userdb", "cache_negative_ttl", &negttl);
+	config->get_value ("userdb", "cache_size", &size);
+	if (size < 1) size = 1;
+
+	// need to resize the table?
+	if (size != numEntries) {
+		// yes. do it
+		if (entries) {
+			memset (entries, 0, numEntries * sizeof (USERS_CACHE_ENTRY));
+			free (entries);
+		}
+		numEntries = size;
+		entries = (USERS_CACHE_ENTRY*)malloc (numEntries * sizeof (USERS_CACHE_ENTRY));
+	}
+
+	// start afresh
+	flush();
+}
+
+/*
+ * USERS_CACHE::flush()
+ *
+ * This will remove all entries from the cache.
+ *
+ */
+void
+USERS_CACHE::flush() {
+	int i;
+
+	// clear the buckets and the list
+	memset (buckets, 0, sizeof (buckets));
+	lruHead = lruTail = NULL;
+
+	// chain all entries together as free
+	memset (entries, 0, numEntries * sizeof (USERS_CACHE_ENTRY));
+	freeList = NULL;
+	for (i = numEntries - 1; i >= 0; i--) {
+		entries[i].hashNext = freeList;
+		freeList = &entries[i];
+	}
+}
+
+/*
+ * USERS_CACHE::hash (int byName, int id, const char* name)
+ *
+ * This will return the bucket of the key.
+ *
+ */
+unsigned int
+USERS_CACHE::hash (int byName, int id, const char* name) {
+	unsigned int h = 2166136261U;
+
+	// by ID?
+	if (!byName)
+		// yes. just scramble the number
+		return ((unsigned int)id * 2654435761U) & (USERS_CACHE_HASH_SIZE - 1);
+
+	// FNV-1a over the name
+	while (*name) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619U;
+	}
+	return h & (USERS_CACHE_HASH_SIZE - 1);
+}
+
+/*
+ * USERS_CACHE::unlink (USERS_CACHE_ENTRY* e)
+ *
+ * This will remove [e] from both the hash bucket and the LRU list. The entry
+ * itself is left as it is.
+ *
+ */
+void
+USERS_CACHE::unlink (USERS_CACHE_ENTRY* e) {
+	USERS_CACHE_ENTRY** ptr = &buckets[hash (e->byName, e->id, e->name)];
+
+	// remove it from the bucket
+	while (*ptr != NULL) {
+		if (*ptr == e) {
+			*ptr = e->hashNext;
+			break;
+		}
+		ptr = &(*ptr)->hashNext;
+	}
+
+	// remove it from the list
+	if (e->lruPrev) e->lruPrev->lruNext = e->lruNext; else lruHead = e->lruNext;
+	if (e->lruNext) e->lruNext->lruPrev = e->lruPrev; else lruTail = e->lruPrev;
+	e->hashNext = e->lruPrev = e->lruNext = NULL;
+}
+
+/*
+ * USERS_CACHE::lookup (int byName, int id, const char* name)
+ *
+ * This will look up the entry for [name] if [byName] is non-zero, or [id]
+ * otherwise. Expired entries are thrown out. It will return the entry, or
+ * NULL if there is no valid one.
+ *
+ */
+USERS_CACHE_ENTRY*
+USERS_CACHE::lookup (int byName, int id, const char* name) {
+	USERS_CACHE_ENTRY* e;
+
+	// scan the bucket
+	for (e = buckets[hash (byName, id, name)]; e != NULL; e = e->hashNext) {
+		if (e->byName != byName)
+			continue;
+		if ((byName) && (!strcmp (e->name, name)))
+			break;
+		if ((!byName) && (e->id == id))
+			break;
+	}
+
+	// found anything?
+	if (e == NULL)
+		// no. bail out
+		return NULL;
+
+	// is it still valid?
+	unlink (e);
+	if (e->expires <= time ((time_t*)NULL)) {
+		// no. hand it back
+		memset (e, 0, sizeof (USERS_CACHE_ENTRY));
+		e->hashNext = freeList;
+		freeList = e;
+		return NULL;
+	}
+
+	// yes. put it back as most recently used
+	e->hashNext = buckets[hash (byName, id, name)];
+	buckets[hash (byName, id, name)] = e;
+	e->lruNext = lruHead;
+	if (lruHead) lruHead->lruPrev = e; else lruTail = e;
+	lruHead = e;
+	return e;
+}
+
+/*
+ * USERS_CACHE::store (int byName, int id, const char* name, USER* user)
+ *
+ * This will store the result of looking up [name] or [id], depending on
+ * [byName]. If [user] is NULL, the user is remembered to be unknown.
+ *
+ */
+void
+USERS_CACHE::store (int byName, int id, const char* name, USER* user) {
+	USERS_CACHE_ENTRY* e;
+	int lifetime = (user != NULL) ? ttl : negttl;
+	unsigned int bucket;
+
+	// should this be cached at all?
+	if ((lifetime <= 0) || ((byName) && (strlen (name) >= USER_MAX_USERNAME_LEN)))
+		// no. bail out
+		return;
+
+	// grab a free entry. if there is none, evict the least recently used one
+	e = freeList;
+	if (e != NULL)
+		freeList = e->hashNext;
+	else {
+		e = lruTail;
+		unlink (e);
+	}
+
+	// fill it out
+	memset (e, 0, sizeof (USERS_CACHE_ENTRY));
+	e->byName = byName;
+	if (byName)
+		strcpy (e->name, name);
+	else
+		e->id = id;
+	if (user != NULL) {
+		e->found = 1;
+		memcpy (&e->user, user, sizeof (USER));
+
+		// but never the password, which may change while this is cached
+		memset (e->user.password, 0, USER_MAX_PASSWORD_LEN);
+	}
+	e->expires = time ((time_t*)NULL) + lifetime;
+
+	// hook it up as most recently used
+	bucket = hash (byName, id, name);
+	e->hashNext = buckets[bucket];
+	buckets[bucket] = e;
+	e->lruNext = lruHead;
+	if (lruHead) lruHead->lruPrev = e; else lruTail = e;
+	lruHead = e;
+}
+
+/*
+ * USERS_CACHE::cached (int byName, int id, const char* name, USER* user,
+ *                      int* found)
+ *
+ * This will look up [name] or [id], depending on [byName], with the cache
+ * locked. If there is a valid entry, [found] is set to whether the user
+ * exists and the user is copied to [user] if so. It will return non-zero if
+ * there was an entry or zero if not.
+ *
+ */
+int
+USERS_CACHE::cached (int byName, int id, const char* name, USER* user, int* found) {
+	USERS_CACHE_ENTRY* e;
+
+	pthread_mutex_lock (&lock);
+	e = lookup (byName, id, name);
+	if (e != NULL) {
+		// got it. hand it over, if it exists
+		*found = e->found;
+		if (e->found)
+			memcpy (user, &e->user, sizeof (USER));
+	}
+	pthread_mutex_unlock (&lock);
+	return (e != NULL);
+}
+
+/*
+ * USERS_CACHE::remember (int byName, int id, const char* name, USER* user)
+ *
+ * This will call store() with the cache locked.
+ *
+ */
+void
+USERS_CACHE::remember (int byName, int id, const char* name, USER* user) {
+	pthread_mutex_lock (&lock);
+	store (byName, id, name, user);
+	pthread_mutex_unlock (&lock);
+}
+
+/*
+ * USERS_CACHE::fetchUserByID (int id, USER* user)
+ *
+ * This will fetch user information by ID [id] into [user]. The backends are
+ * asked without holding the cache lock. It will return zero on failure or
+ * non-zero on success.
+ *
+ */
+int
+USERS_CACHE::fetchUserByID (int id, USER* user) {
+	USERS* db;
+	int found;
+
+	// got it cached?
+	if (cached (0, id, NULL, user, &found))
+		// yes. that's all
+		return found;
+
+	// no. ask the backends one by one
+	for (db = chain; db != NULL; db = db->getNextDB())
+		if (db->fetchUserByID (id, user)) {
+			// got it. remember this
+			remember (0, id, NULL, user);
+			return 1;
+		}
+
+	// nobody knows this user
+	remember (0, id, NULL, NULL);
+	return 0;
+}
+
+/*
+ * USERS_CACHE::fetchUserByName (const char* name, USER* user)
+ *
+ * This will fetch user information by name [name] into [user]. The backends
+ * are asked without holding the cache lock. It will return zero on failure
+ * or non-zero on success.
+ *
+ */
+int
+USERS_CACHE::fetchUserByName (const char* name, USER* user) {
+	USERS* db;
+	int found;
+
+	// got it cached?
+	if (cached (1, 0, name, user, &found))
+		// yes. that's all
+		return found;
+
+	// no. ask the backends one by one
+	for (db = chain; db != NULL; db = db->getNextDB())
+		if (db->fetchUserByName (name, user)) {
+			// got it. remember this
+			remember (1, 0, name, user);
+			return 1;
+		}
+
+	// nobody knows this user
+	remember (1, 0, name, NULL);
+	return 0;
+}
+
+/*
+ * USERS_CACHE::verifyPassword (const char* password, USER* user)
+ *
+ * This will verify whether [password] is valid for [user]. Cached entries
+ * carry no password, so every backend is asked to fetch the user afresh and
+ * check it; results are never cached, so the cache isn't locked at all. On
+ * success, [user] is updated with what the backend knows. It will return zero
+ * on failure or non-zero on success.
+ *
+ */
+int
+USERS_CACHE::verifyPassword (const char* password, USER* user) {
+	USERS* db;
+	USER fresh;
+	int ok = 0;
+
+	// try all backends
+	for (db = chain; db != NULL; db = db->getNextDB())
+		if ((db->fetchUserByName (user->username, &fresh)) && (db->verifyPassword (password, &fresh))) {
+			// this worked. hand over the current information
+			memcpy (user, &fresh, sizeof (USER));
+			ok = 1;
+			break;
+		}
+
+	// don't leave the password lying around
+	memset (&fresh, 0, sizeof (USER));
+	return ok;
+}
+
+/* vim:set ts=2 sw=2: */
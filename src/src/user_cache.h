@@ -0,0 +1,209 @@
+/*
+ * user_cache.h
+ *
+ * This is the jukebox user lookup cache.
+ *
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include "user.h"
+
+#ifndef __USERCACHE_H__
+#define __USERCACHE_H__
+
+//! \brief USERS_CACHE_DEFAULT_TTL is the default lifetime of found users
+#define USERS_CACHE_DEFAULT_TTL				300
+
+//! \brief USERS_CACHE_DEFAULT_NEGTTL is the default lifetime of unknown users
+#define USERS_CACHE_DEFAULT_NEGTTL		60
+
+//! \brief USERS_CACHE_DEFAULT_SIZE is the default number of entries cached
+#define USERS_CACHE_DEFAULT_SIZE			1024
+
+//! \brief USERS_CACHE_HASH_SIZE is the number of hash buckets, a power of two
+#define USERS_CACHE_HASH_SIZE					256
+
+/*!
+ * \struct USERS_CACHE_ENTRY
+ * \brief A single cached lookup, which may or may not have found an user
+ */
+struct USERS_CACHE_ENTRY {
+	//! \brief Non-zero if this was looked up by name, zero if by ID
+	int			byName;
+
+	//! \brief The ID looked up, if byName is zero
+	int			id;
+
+	//! \brief The name looked up, if byName is non-zero
+	char		name[USER_MAX_USERNAME_LEN];
+
+	//! \brief Non-zero if the user exists
+	int			found;
+
+	//! \brief The user, if found, without the password
+	USER		user;
+
+	//! \brief The moment this entry is no longer valid
+	time_t	expires;
+
+	//! \brief Next entry in the same hash bucket
+	USERS_CACHE_ENTRY* hashNext;
+
+	//! \brief Neighbours in the least-recently-used list
+	USERS_CACHE_ENTRY* lruPrev;
+	USERS_CACHE_ENTRY* lruNext;
+};
+
+/*!
+ * \class USERS_CACHE
+ * \brief This will cache lookups done on a chain of user databases
+ *
+ * Both found and unknown users are remembered, so repeated logins and
+ * mistyped usernames won't hit the (possibly slow) backends every time. The
+ * cache is bounded; the least recently used entry is evicted when it is full.
+ *
+ * The cache itself is locked only while looking up or storing an entry; the
+ * backends are called without it, so a slow lookup doesn't hold up other
+ * threads. The backends must therefore be thread-safe.
+ */
+class USERS_CACHE : public USERS {
+public:
+	/*! \brief Constructs a new cache
+	 *  \param chain The first user database of the chain to cache
+	 *
+	 *  The chain will be owned, and destroyed, by the cache.
+	 */
+	USERS_CACHE(USERS* chain);
+
+	//! \brief Destructs the cache and the chain
+	~USERS_CACHE();
+
+	/*!
+	 * \brief Initialises the cache.
+	 *
+	 * This will return zero on failure or non-zero on success.
+	 *
+	 */
+	int init();
+
+	/*!
+	 * \brief This will fetch user information by ID.
+	 *
+	 * This will return zero on failure or non-zero on success.
+	 *
+	 * \param id The user ID to fetch information about.
+	 * \param user Buffer to put the information in.
+	 *
+	 */
+	int		fetchUserByID (int id, USER* user);
+
+	/*!
+	 * \brief This will fetch user information by name.
+	 *
+	 * This will return zero on failure or non-zero on success.
+	 *
+	 * \param name The user name to fetch information about.
+	 * \param user Buffer to put the information in.
+	 *
+	 */
+	int		fetchUserByName (const char* name, USER* user);
+
+	/*!
+	 * \brief Verifies an username and password combination
+	 *
+	 * Passwords are never cached; all backends are tried in turn, each
+	 * fetching the user afresh.
+	 *
+	 * This will return zero on failure or non-zero on success.
+	 *
+	 * \param user The user to verify the password of
+	 * \param password The password to verify
+	 */
+	int verifyPassword (const char* password, USER* user);
+
+	/*!
+	 * \brief Reloads the configuration of the cache and all backends
+	 *
+	 * This will also empty the cache. The backends are reconfigured in place,
+	 * so no other thread may be using them; pause the workers first.
+	 */
+	void reloadConfig();
+
+	//! \brief Removes all entries from the cache
+	void flush();
+
+private:
+	//! \brief Fetches the cache settings and empties the cache
+	void configure();
+
+	/*! \brief Looks an entry up with the cache locked
+	 *  \param byName Non-zero to look up by name, zero by ID
+	 *  \param id The ID to look for
+	 *  \param name The name to look for
+	 *  \param user Buffer to put the user in, if found
+	 *  \param found Set to non-zero if the user exists, zero if not
+	 *  \return Non-zero if there was a valid entry, zero if not
+	 */
+	int		cached (int byName, int id, const char* name, USER* user, int* found);
+
+	//! \brief store(), with the cache locked
+	void	remember (int byName, int id, const char* name, USER* user);
+
+	/*! \brief Looks an entry up
+	 *  \param byName Non-zero to look up by name, zero by ID
+	 *  \param id The ID to look for
+	 *  \param name The name to look for
+	 *  \return The entry, or NULL if there is no valid entry
+	 */
+	USERS_CACHE_ENTRY* lookup (int byName, int id, const char* name);
+
+	/*! \brief Stores the result of a lookup
+	 *  \param byName Non-zero if looked up by name, zero by ID
+	 *  \param id The ID looked up
+	 *  \param name The name looked up
+	 *  \param user The user found, or NULL if there is none
+	 */
+	void store (int byName, int id, const char* name, USER* user);
+
+	/*! \brief Removes an entry from the hash and LRU lists
+	 *  \param e The entry to remove
+	 */
+	void unlink (USERS_CACHE_ENTRY* e);
+
+	/*! \brief Calculates the hash bucket of a key
+	 *  \param byName Non-zero for a name, zero for an ID
+	 *  \param id The ID
+	 *  \param name The name
+	 */
+	static unsigned int hash (int byName, int id, const char* name);
+
+	//! \brief The first user database of the chain
+	USERS*	chain;
+
+	//! \brief All entries
+	USERS_CACHE_ENTRY* entries;
+
+	//! \brief Unused entries
+	USERS_CACHE_ENTRY* freeList;
+
+	//! \brief The hash buckets
+	USERS_CACHE_ENTRY* buckets[USERS_CACHE_HASH_SIZE];
+
+	//! \brief Most and least recently used entries
+	USERS_CACHE_ENTRY* lruHead;
+	USERS_CACHE_ENTRY* lruTail;
+
+	//! \brief Number of entries allocated
+	int			numEntries;
+
+	//! \brief Lifetime of found and unknown users, in seconds
+	int			ttl, negttl;
+
+	//! \brief Protects the entries, but not the backends
+	pthread_mutex_t lock;
+};
+
+#endif /* __USERCACHE_H__ */
+
+/* vim:set ts=2 sw=2: */
@@ -5,6 +5,7 @@
 #ifdef USERDB_LDAP
 
 #include <sys/types.h>
+#include <sys/time.h>
 #include <config.h>
 #include <ldap.h>
 #include <stdio.h>
@@ -12,6 +13,7 @@
 #include <string.h>
 #include <grp.h>
 #include <pwd.h>
+#include <time.h>
 #include <unistd.h>
 #include "jukebox.h"
 #include "user_ldap.h"
@@ -24,8 +26,11 @@
  */
 USERS_LDAP::USERS_LDAP() {
 	/* defaults for all */
-	ldaphost = NULL; basedn = NULL; login_attr = NULL;
+	ldaphost = NULL; basedn = NULL; login_attr = NULL; member_attr = NULL;
+	binddn = NULL; bindpw = NULL;
 	ldap_admin_groups = NULL; nextDB = NULL; ssl = 0;
+	pool = NULL; poolSize = numIdle = 0;
+	pthread_mutex_init (&poolLock, NULL);
 }
 
 /*
@@ -35,11 +40,21 @@ USERS_LDAP::USERS_LDAP() {
  *
  */
 USERS_LDAP::~USERS_LDAP() {
+	// close all connections
+	pthread_mutex_lock (&poolLock);
+	drainPool();
+	pthread_mutex_unlock (&poolLock);
+	if (pool) free (pool);
+	pthread_mutex_destroy (&poolLock);
+
 	// free all memory
 	if (ldap_admin_groups) free (ldap_admin_groups);
 	if (ldaphost) free (ldaphost);
 	if (basedn) free (basedn);
 	if (login_attr) free (login_attr);
+	if (member_attr) free (member_attr);
+	if (binddn) free (binddn);
+	if (bindpw) free (bindpw);
 }
 
 /*
@@ -60,8 +75,39 @@ USERS_LDAP::init() {
 	if (ld == NULL)
 		return 0;
 
-	// yeppee!
-	closeConnection (ld);
+	// yeppee! keep it around for the first user
+	releaseConnection (ld, 1);
+	return 1;
+}
+
+/*
+ * USERS_LDAP::escapeFilter (char* dest, int len, const char* src)
+ *
+ * This will escape [src] for use as a value in a search filter, as described
+ * in RFC 4515, and store the result in [dest] which is [len] bytes long. It
+ * will return 0 if the result does not fit or 1 on success.
+ *
+ */
+int
+USERS_LDAP::escapeFilter (char* dest, int len, const char* src) {
+	while (*src) {
+		// special character?
+		if ((*src == '*') || (*src == '(') || (*src == ')') || (*src == '\\')) {
+			// yes. escape it
+			if (len < 4)
+				return 0;
+			sprintf (dest, "\\%02x", (unsigned char)*src);
+			dest += 3; len -= 3;
+		} else {
+			// no. just copy it
+			if (len < 2)
+				return 0;
+			*dest++ = *src; len--;
+		}
+		src++;
+	}
+
+	*dest = 0;
 	return 1;
 }
 
@@ -81,11 +127,10 @@ USERS_LDAP::fetchUser (int id, const char* name, USER* user) {
 	char* a;
 	char** vals;
 	char* attrs[] = { "uidNumber", login_attr, NULL };
-	char filter[512];
-	char* curoffs;
-	char* tmp;
-	char tempgroup[512];
-	LDAP* ld = openConnection();
+	char filter[USERS_LDAP_MAX_FILTER_LEN];
+	char value[USER_MAX_USERNAME_LEN * 3];
+	int rc = LDAP_SUCCESS;
+	LDAP* ld = acquireConnection();
 	if (ld == NULL)
 		return 0;
 
@@ -93,16 +138,18 @@ USERS_LDAP::fetchUser (int id, const char* name, USER* user) {
 	memset (user, 0, sizeof (USER));
 
 	// username given?
-	if (id == 0)
+	if (id == 0) {
 		// yes. filter on the username
-		snprintf (filter, sizeof (filter), "(%s=%s)", login_attr, name);
-	else
+		if (!escapeFilter (value, sizeof (value), name))
+			goto fail;
+		snprintf (filter, sizeof (filter), "(%s=%s)", login_attr, value);
+	} else
 		// no. filter on the user id
 		snprintf (filter, sizeof (filter), "(uidNumber=%u)", id);
 
 	// search the the user
-	if (ldap_search_s (ld, basedn, LDAP_SCOPE_SUBTREE, filter, attrs, 0, &res) != LDAP_SUCCESS)
-		return 0;
+	if ((rc = search (&ld, filter, attrs, &res)) != LDAP_SUCCESS)
+		goto fail;
 
 	// fetch the first entry
 	e = ldap_first_entry (ld, res);
@@ -125,7 +172,7 @@ USERS_LDAP::fetchUser (int id, const char* name, USER* user) {
 		/* got an uid? */
 		if (!strcmp (a, login_attr))
 			/* yes. store it */
-			strncpy (user->username, vals[0], USER_MAX_USERNAME_LEN);
+			strncpy (user->username, vals[0], USER_MAX_USERNAME_LEN - 1);
 		else if (!strcmp (a, "uidNumber")) {
 			/* no, we got an user id! store it */
 			user->id = atoi (vals[0]);
@@ -136,59 +183,26 @@ USERS_LDAP::fetchUser (int id, const char* name, USER* user) {
 		ldap_memfree (a);
 	}
 
-	// fix the rest of the entry
+	// fix the password field and user status
 	strcpy (user->password, "*");
 	user->status = USER_STATUS_USER;
 
+	// got everything, and does the user live in an admin group?
+	if ((user->id) && (user->username[0]) && (isUserAdmin (&ld, user->username)))
+		// yes. grant the user admin rights
+		user->status = USER_STATUS_ADMIN;
+
 fail:
 	/* free everything */
 	if (res) ldap_msgfree (res);
 	if (ber) ber_free (ber, 0);
-	closeConnection (ld);
+	releaseConnection (ld, (rc == LDAP_SUCCESS) ? 1 : 0);
 
 	// got everything?
 	if ((!user->id) || (!user->username[0]))
 		// no. bail out
 		return 0;
 
-	// fix the password field and user status
-	strcpy (user->password, "*");
-	user->status = USER_STATUS_USER;
-
-	// is the admin group known?
-	if (ldap_admin_groups == NULL)
-		return 1;
-
-	// check whether the user is in the group
-	curoffs = ldap_admin_groups;
-	while (1) {
-		// locate a splitter
-		tmp = strchr (curoffs, ',');
-		if (tmp == NULL)
-			// none found. use the end of the string then
-			tmp = strchr (curoffs, 0);
-
-		// copy the group name
-		strncpy (tempgroup, curoffs, (tmp - curoffs));
-
-		// does the user live in this group?
-		if (isUserInGroup (user->username, tempgroup)) {
-			// yes. grant the user admin rights
-			user->status = USER_STATUS_ADMIN;
-
-			// all done
-			return 1;
-		}
-
-		// end of the line?
-		if (!*tmp)
-			// yes. bail out
-			break;
-
-		// no. start at this offset
-		curoffs = tmp + 1;
-	}
-
 	// all done. return victory
 	return 1;
 }
@@ -228,11 +242,14 @@ USERS_LDAP::fetchUserByID (int id, USER* user) {
  */
 int
 USERS_LDAP::verifyPassword (const char* password, USER* user) {
-	char filter[512];
+	char filter[USERS_LDAP_MAX_FILTER_LEN];
+	char value[USER_MAX_USERNAME_LEN * 3];
+	char* attrs[] = { "1.1", NULL };
 	LDAPMessage* res = NULL;
 	LDAPMessage* e;
 	char* dn = NULL;
 	int result = 0;
+	int healthy = 1;
 	LDAP* ld;
 
 	// even got a password?
@@ -240,8 +257,8 @@ USERS_LDAP::verifyPassword (const char* password, USER* user) {
 		// no. auto-deny
 		return 0;
 
-	// establish an LDAP connection
-	ld = openConnection();
+	// fetch an LDAP connection
+	ld = acquireConnection();
 	if (ld == NULL)
 		return 0;
 
@@ -254,12 +271,16 @@ USERS_LDAP::verifyPassword (const char* password, USER* user) {
 	 */
 
 	// filter on the username
-	snprintf (filter, sizeof (filter), "(%s=%s)", login_attr, user->username);
+	if (!escapeFilter (value, sizeof (value), user->username))
+		goto leave;
+	snprintf (filter, sizeof (filter), "(%s=%s)", login_attr, value);
 
 	// search the the user
-	if (ldap_search_s (ld, basedn, LDAP_SCOPE_SUBTREE, filter, NULL, 0, &res) != LDAP_SUCCESS)
+	if (search (&ld, filter, attrs, &res) != LDAP_SUCCESS) {
 		// this failed. bail out
+		healthy = 0;
 		goto leave;
+	}
 
 	// fetch the first entry
 	e = ldap_first_entry (ld, res);
@@ -274,18 +295,19 @@ USERS_LDAP::verifyPassword (const char* password, USER* user) {
 		goto leave;
 
 	// bind to the host as user
-	if (ldap_bind_s (ld, dn, password, LDAP_AUTH_SIMPLE) != LDAP_SUCCESS)
-		// this failed. complain
-		goto leave;
+	if (ldap_bind_s (ld, dn, password, LDAP_AUTH_SIMPLE) == LDAP_SUCCESS)
+		// victory!
+		result++;
 
-	// victory!
-	result++;
+	// the connection must be ours again before anyone else may use it
+	if (!bindConnection (ld))
+		healthy = 0;
 
 leave:
 	// if we got a DN, free it
 	if (dn) ldap_memfree (dn);
 	if (res) ldap_msgfree (res);
-	closeConnection (ld);
+	releaseConnection (ld, healthy);
 
 	// return whatever status code we got
 	return result;
@@ -293,16 +315,27 @@ leave:
 
 /*
  * Reloads the LDAP configuration
- * 
+ *
  */
 void
 USERS_LDAP::reloadConfig() {
 	char* ptr = NULL;
+	int size;
 
-	// got admin groups?
-	if (ldap_admin_groups)
-		// yes. free them
-		free (ldap_admin_groups);
+	// the connections may point to the wrong server by now
+	pthread_mutex_lock (&poolLock);
+	drainPool();
+	pthread_mutex_unlock (&poolLock);
+
+	// free whatever we had
+	if (ldap_admin_groups) free (ldap_admin_groups);
+	if (ldaphost) free (ldaphost);
+	if (basedn) free (basedn);
+	if (login_attr) free (login_attr);
+	if (member_attr) free (member_attr);
+	if (binddn) free (binddn);
+	if (bindpw) free (bindpw);
+	binddn = bindpw = NULL;
 
 	// fetch the LDAP configuration file name
 	if (config->get_string ("userdb", "ldap_admin_groups", &ptr) != CONFIGFILE_OK)
@@ -319,96 +352,323 @@ USERS_LDAP::reloadConfig() {
 
 	// fetch the LDAP host
 	if (config->get_string ("userdb", "ldap_host", &ptr) != CONFIGFILE_OK)
-		ldaphost = "localhost";
-	else
-		ldaphost = strdup (ptr);
+		ptr = "localhost";
+	ldaphost = strdup (ptr);
 
 	// base dn
 	if (config->get_string ("userdb", "ldap_basedn", &ptr) != CONFIGFILE_OK)
-		basedn = "";
-	else
-		basedn = strdup (ptr);
+		ptr = "";
+	basedn = strdup (ptr);
 
 	// login attribute
 	if (config->get_string ("userdb", "ldap_login_attr", &ptr) != CONFIGFILE_OK)
-		login_attr = "uid";
-	else
-		login_attr = strdup (ptr);
+		ptr = "uid";
+	login_attr = strdup (ptr);
+
+	// group membership attribute
+	if (config->get_string ("userdb", "ldap_member_attr", &ptr) != CONFIGFILE_OK)
+		ptr = "memberUid";
+	member_attr = strdup (ptr);
+
+	// credentials to bind with. if none are given, we bind anonymously
+	if (config->get_string ("userdb", "ldap_binddn", &ptr) == CONFIGFILE_OK)
+		binddn = strdup (ptr);
+	if (config->get_string ("userdb", "ldap_bindpw", &ptr) == CONFIGFILE_OK)
+		bindpw = strdup (ptr);
 
 	// ssl
-	if (config->get_string ("userdb", "ldap_ssl", &ptr) != CONFIGFILE_OK)
+	if (config->get_string ("userdb", "ldap_ssl", &ptr) == CONFIGFILE_OK)
 		ssl = ((!strcasecmp (ptr, "yes")) || (!strcasecmp (ptr, "on"))) ? 1 : 0;
 	else
 		ssl = 0;
+
+	// operation timeout
+	if (config->get_value ("userdb", "ldap_timeout", &timeout) != CONFIGFILE_OK)
+		timeout = USERS_LDAP_DEFAULT_TIMEOUT;
+
+	// idle time after which pooled connections are checked
+	if (config->get_value ("userdb", "ldap_check_interval", &check_interval) != CONFIGFILE_OK)
+		check_interval = USERS_LDAP_DEFAULT_CHECKINTERVAL;
+
+	// number of connections to keep around
+	if (config->get_value ("userdb", "ldap_pool_size", &size) != CONFIGFILE_OK)
+		size = USERS_LDAP_DEFAULT_POOLSIZE;
+	setPoolSize (size);
+}
+
+/*
+ * USERS_LDAP::setPoolSize (int size)
+ *
+ * This will change the number of idle connections kept to [size]. Any idle
+ * connections are closed.
+ *
+ */
+void
+USERS_LDAP::setPoolSize (int size) {
+	// close everything we have
+	pthread_mutex_lock (&poolLock);
+	drainPool();
+	if (pool) free (pool);
+	pool = NULL;
+
+	// build a new pool
+	poolSize = (size < 0) ? 0 : size;
+	if (poolSize > 0)
+		pool = (USERS_LDAP_CONN*)malloc (poolSize * sizeof (USERS_LDAP_CONN));
+	pthread_mutex_unlock (&poolLock);
 }
 
-int 
-USERS_LDAP::isUserInGroup (char* username, char* groupname) {
+/*
+ * USERS_LDAP::isUserAdmin (LDAP** ld, char* username)
+ *
+ * This will check whether user [username] is a member of any of the admin
+ * groups, using connection [ld]. It will return non-zero if the user is, or
+ * zero if not.
+ *
+ */
+int
+USERS_LDAP::isUserAdmin (LDAP** ld, char* username) {
 	LDAPMessage* res = NULL;
-	LDAPMessage* e;
-	BerElement* ber = NULL;
-	char* a;
-	char** vals;
-	char* attrs[] = { "memberUid", NULL };
-	char filter[512];
-	int i, result = 0;
-	LDAP* ld = openConnection();
-	if (ld == NULL)
+	char* attrs[] = { "1.1", NULL };
+	char value[USER_MAX_USERNAME_LEN * 3];
+	char* filter;
+	char* group;
+	char* curoffs;
+	char* tmp;
+	int len, size, pos, result = 0;
+
+	// is the admin group known?
+	if (ldap_admin_groups == NULL)
 		return 0;
 
-	// build the filter on the username
-	snprintf (filter, sizeof (filter), "(cn=%s)", groupname);
+	// and the user must be a member
+	if (!escapeFilter (value, sizeof (value), username))
+		return 0;
 
-	// search the the group
-	if (ldap_search_s (ld, basedn, LDAP_SCOPE_SUBTREE, filter, attrs, 0, &res) != LDAP_SUCCESS)
-		// this failed. bail out
+	// every character of the groups may need escaping, and every group a '(cn=)'
+	len = strlen (ldap_admin_groups);
+	size = 3 * len + 5 * (len + 1) + strlen (member_attr) + strlen (value) + 16;
+	filter = (char*)malloc (size);
+	group = (char*)malloc (len + 1);
+	if ((filter == NULL) || (group == NULL)) {
+		// out of memory. too bad
+		free (filter); free (group);
 		return 0;
+	}
 
-	// fetch the first entry
-	e = ldap_first_entry (ld, res);
-	if (e == NULL)
-		// this failed. bail out
-		goto leave;
+	// build a filter matching the user in any of the groups
+	strcpy (filter, "(&(|");
+	pos = strlen (filter);
+	curoffs = ldap_admin_groups;
+	while (*curoffs) {
+		// skip leading spaces
+		while (*curoffs == ' ') curoffs++;
 
-	/* do all attributes */
-	for (a = ldap_first_attribute (ld, e, &ber); a != NULL;
-		a = ldap_next_attribute (ld, e, ber)) {
+		// locate a splitter
+		tmp = strchr (curoffs, ',');
+		if (tmp == NULL)
+			// none found. use the end of the string then
+			tmp = strchr (curoffs, 0);
 
-		/* fetch the values */
-		vals = ldap_get_values (ld, e, a);
-		if (vals != NULL) {
-			/* wade through all values */
-			for (i = 0; vals[i] != NULL; i++)
-				/* match? */
-				if (!strcasecmp (vals[i], username))
-					/* yes. victory */
-					result++;
-
-			/* free the values and attribute name */
-			ldap_value_free (vals);
+		// isolate the group name
+		len = tmp - curoffs;
+		while ((len > 0) && (curoffs[len - 1] == ' ')) len--;
+		memcpy (group, curoffs, len); group[len] = 0;
+
+		// add it to the filter
+		if (len > 0) {
+			strcpy (filter + pos, "(cn="); pos += 4;
+			if (!escapeFilter (filter + pos, size - pos, group)) {
+				// this can't happen, as it was sized for the worst case
+				logger->log (LOG_ERR, "LDAP admin group filter doesn't fit, admin rights not granted");
+				free (filter); free (group);
+				return 0;
+			}
+			pos += strlen (filter + pos);
+			strcpy (filter + pos, ")"); pos++;
 		}
 
-		/* free the memort */
-		ldap_memfree (a);
+		// next
+		curoffs = (*tmp) ? tmp + 1 : tmp;
 	}
+	snprintf (filter + pos, size - pos, ")(%s=%s))", member_attr, value);
+
+	// search the groups. any hit will do
+	if (search (ld, filter, attrs, &res) == LDAP_SUCCESS)
+		result = (ldap_first_entry (*ld, res) != NULL) ? 1 : 0;
 
-leave:
 	/* free everything */
 	if (res) ldap_msgfree (res);
-	if (ber) ber_free (ber, 0);
-	closeConnection (ld);
+	free (filter); free (group);
 
 	// return the result
 	return result;
 }
 
 /*
- * Creates a new LDAP connection.
+ * USERS_LDAP::search (LDAP** ld, char* filter, char** attrs, LDAPMessage** res)
+ *
+ * This will search for [filter] using connection [ld], retrieving [attrs]
+ * into [res]. If the connection turns out to be broken, it is replaced and the
+ * search retried once. It will return the LDAP result code.
+ *
+ */
+int
+USERS_LDAP::search (LDAP** ld, char* filter, char** attrs, LDAPMessage** res) {
+	struct timeval tv;
+	int rc, attempt;
+
+	for (attempt = 0; attempt < 2; attempt++) {
+		// do the search
+		tv.tv_sec = timeout; tv.tv_usec = 0;
+		*res = NULL;
+		rc = ldap_search_ext_s (*ld, basedn, LDAP_SCOPE_SUBTREE, filter, attrs, 0, NULL, NULL, &tv, 0, res);
+
+		// did the connection break down?
+		if ((rc != LDAP_SERVER_DOWN) && (rc != LDAP_CONNECT_ERROR) &&
+		    (rc != LDAP_TIMEOUT) && (rc != LDAP_UNAVAILABLE))
+			// no. this is the answer
+			break;
+
+		// yes. replace the connection and try again
+		if (*res) ldap_msgfree (*res);
+		*res = NULL;
+		closeConnection (*ld);
+		*ld = openConnection();
+		if (*ld == NULL) {
+			// this failed. there's no point in retrying
+			logger->log (LOG_ERR, "LDAP server '%s' unreachable", ldaphost);
+			return rc;
+		}
+	}
+
+	return rc;
+}
+
+/*
+ * USERS_LDAP::acquireConnection()
+ *
+ * This will fetch an idle connection from the pool, or open a new one if there
+ * are none. Connections idle for too long are checked first. It will return
+ * the connection, or NULL on failure.
+ *
+ */
+LDAP*
+USERS_LDAP::acquireConnection() {
+	time_t now = time ((time_t*)NULL);
+	time_t lastUsed;
+	LDAP* ld;
+
+	// try the pool first
+	while (1) {
+		pthread_mutex_lock (&poolLock);
+		if (numIdle == 0) {
+			// it's empty. give up on it
+			pthread_mutex_unlock (&poolLock);
+			break;
+		}
+		numIdle--;
+		ld = pool[numIdle].ld; lastUsed = pool[numIdle].lastUsed;
+		pthread_mutex_unlock (&poolLock);
+
+		// recently used or still alive?
+		if (((now - lastUsed) < check_interval) || (checkConnection (ld)))
+			// yes. use it
+			return ld;
+
+		// no. get rid of it
+		closeConnection (ld);
+	}
+
+	// nothing usable in the pool. build a new connection
+	return openConnection();
+}
+
+/*
+ * USERS_LDAP::releaseConnection (LDAP* ld, int healthy)
+ *
+ * This will hand connection [ld] back to the pool. If [healthy] is zero or
+ * the pool is full, the connection is closed instead.
+ *
+ */
+void
+USERS_LDAP::releaseConnection (LDAP* ld, int healthy) {
+	// got a connection?
+	if (ld == NULL)
+		// no. nothing to do
+		return;
+
+	// can we keep it?
+	pthread_mutex_lock (&poolLock);
+	if ((healthy) && (numIdle < poolSize)) {
+		// yes. do so
+		pool[numIdle].ld = ld;
+		pool[numIdle].lastUsed = time ((time_t*)NULL);
+		numIdle++;
+		pthread_mutex_unlock (&poolLock);
+		return;
+	}
+	pthread_mutex_unlock (&poolLock);
+
+	// no. bye
+	closeConnection (ld);
+}
+
+/*
+ * USERS_LDAP::drainPool()
+ *
+ * This will close all idle connections. The caller must hold the pool lock.
+ *
+ */
+void
+USERS_LDAP::drainPool() {
+	while (numIdle > 0)
+		closeConnection (pool[--numIdle].ld);
+}
+
+/*
+ * USERS_LDAP::checkConnection (LDAP* ld)
+ *
+ * This will check whether [ld] still works by reading the root DSE. It will
+ * return non-zero if it does or zero if not.
+ *
+ */
+int
+USERS_LDAP::checkConnection (LDAP* ld) {
+	LDAPMessage* res = NULL;
+	char* attrs[] = { "1.1", NULL };
+	struct timeval tv;
+	int rc;
+
+	tv.tv_sec = timeout; tv.tv_usec = 0;
+	rc = ldap_search_ext_s (ld, "", LDAP_SCOPE_BASE, "(objectClass=*)", attrs, 0, NULL, NULL, &tv, 1, &res);
+	if (res) ldap_msgfree (res);
+
+	return (rc == LDAP_SUCCESS) ? 1 : 0;
+}
+
+/*
+ * USERS_LDAP::bindConnection (LDAP* ld)
+ *
+ * This will bind [ld] using the configured credentials, or anonymously if
+ * there are none. It will return non-zero on success or zero on failure.
+ *
+ */
+int
+USERS_LDAP::bindConnection (LDAP* ld) {
+	return (ldap_bind_s (ld, binddn, bindpw, LDAP_AUTH_SIMPLE) == LDAP_SUCCESS) ? 1 : 0;
+}
+
+/*
+ * Creates a new, bound LDAP connection.
  *
  */
 LDAP*
 USERS_LDAP::openConnection() {
 	LDAP* ld;
+#ifdef LDAP_OPT_NETWORK_TIMEOUT
+	struct timeval tv;
+#endif /* LDAP_OPT_NETWORK_TIMEOUT */
 
 	// connect to the LDAP server
 	ld = ldap_init (ldaphost, 0);
@@ -418,11 +678,25 @@ USERS_LDAP::openConnection() {
 	// we want LDAP ... whatever the user said
 	ldap_set_option (ld, LDAP_OPT_PROTOCOL_VERSION, &protocol_version);
 
+#ifdef LDAP_OPT_NETWORK_TIMEOUT
+	// don't wait forever for the server to answer
+	tv.tv_sec = timeout; tv.tv_usec = 0;
+	ldap_set_option (ld, LDAP_OPT_NETWORK_TIMEOUT, &tv);
+#endif /* LDAP_OPT_NETWORK_TIMEOUT */
+
 	// SSL?
 	if (ssl)
 		// yes. force a start
-		if (ldap_start_tls_s (ld, NULL, NULL) != LDAP_SUCCESS)
+		if (ldap_start_tls_s (ld, NULL, NULL) != LDAP_SUCCESS) {
+			ldap_unbind (ld);
 			return NULL;
+		}
+
+	// bind. this also establishes the connection
+	if (!bindConnection (ld)) {
+		ldap_unbind (ld);
+		return NULL;
+	}
 
 	// yay
 	return ld;
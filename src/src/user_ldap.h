@@ -11,9 +11,35 @@
 #define __USERLDAP_H__
 
 #ifdef USERDB_LDAP
+#include <pthread.h>
+#include <time.h>
 #include <ldap.h>
 #include <lber.h>
 
+//! \brief USERS_LDAP_DEFAULT_POOLSIZE is the default number of idle connections kept
+#define USERS_LDAP_DEFAULT_POOLSIZE		2
+
+//! \brief USERS_LDAP_DEFAULT_CHECKINTERVAL is the idle time after which a connection is probed
+#define USERS_LDAP_DEFAULT_CHECKINTERVAL	60
+
+//! \brief USERS_LDAP_DEFAULT_TIMEOUT is the default timeout of LDAP operations, in seconds
+#define USERS_LDAP_DEFAULT_TIMEOUT		5
+
+//! \brief USERS_LDAP_MAX_FILTER_LEN is the maximum length of a search filter
+#define USERS_LDAP_MAX_FILTER_LEN		1024
+
+/*!
+ * \struct USERS_LDAP_CONN
+ * \brief An idle, bound LDAP connection in the pool
+ */
+struct USERS_LDAP_CONN {
+	//! \brief The connection handle
+	LDAP*		ld;
+
+	//! \brief When the connection was last known to be working
+	time_t	lastUsed;
+};
+
 /*!
  * \class USERS_LDAP
  * \brief This will handle the user pool using LDAP
@@ -71,6 +97,11 @@ public:
 	 */
 	void reloadConfig();
 
+	/*! \brief Changes the number of idle connections kept
+	 *  \param size The new pool size, zero disables pooling
+	 */
+	void setPoolSize (int size);
+
 private:
 	/*!
 	 * \brief This will parse a pam.conf-alike config file
@@ -94,14 +125,55 @@ private:
 	 */
 	int		fetchUser (int id, const char* name, USER* user);	
 
-	/*! \brief Checks whether an user is in a LDAP group
-	 *  \returns Non-zero if user is in the group, zero otherwise
+	/*! \brief Checks whether an user is in any of the admin groups
+	 *  \returns Non-zero if user is in a group, zero otherwise
+	 *  \param ld Pointer to the connection to use, may be replaced
 	 *  \param username The name of the user
-	 *  \param groupname The name of the group
+	 *
+	 * All groups are resolved using a single search.
+	 */
+	int isUserAdmin (LDAP** ld, char* username);
+
+	/*! \brief Searches the directory below the base DN
+	 *  \return The LDAP result code
+	 *  \param ld Pointer to the connection to use, may be replaced
+	 *  \param filter The search filter
+	 *  \param attrs The attributes to retrieve
+	 *  \param res Will be set to the result, which must always be freed
+	 *
+	 * If the connection turns out to be dead, it is reopened and the search
+	 * is retried once.
 	 */
-	int isUserInGroup (char* username, char* groupname);
+	int search (LDAP** ld, char* filter, char** attrs, LDAPMessage** res);
 
-	/*! \brief Returns a LDAP connection handle
+	/*! \brief Fetches a connection from the pool, or opens a new one
+   *  \return The handle on success or NULL on failure.
+   */
+	LDAP* acquireConnection();
+
+	/*! \brief Hands a connection back to the pool
+   *  \param ld Handle to hand back, may be NULL
+   *  \param healthy Non-zero if the connection can be used again
+   */
+	void releaseConnection (LDAP* ld, int healthy);
+
+	/*! \brief Closes all idle connections in the pool, which must be locked
+   */
+	void drainPool();
+
+	/*! \brief Checks whether an idle connection still works
+   *  \return Non-zero if it does, zero if not
+   *  \param ld Handle to check
+   */
+	int checkConnection (LDAP* ld);
+
+	/*! \brief Binds a connection using our own credentials
+   *  \return Non-zero on success, zero on failure
+   *  \param ld Handle to bind
+   */
+	int bindConnection (LDAP* ld);
+
+	/*! \brief Returns a new, bound LDAP connection handle
    *  \return The handle on success or NULL on failure.
    */
 	LDAP* openConnection();
@@ -111,15 +183,44 @@ private:
    */
 	void closeConnection(LDAP* ld);
 
+	/*! \brief Escapes a value for use within a search filter (RFC 4515)
+	 *  \return Non-zero on success, zero if the value does not fit
+	 *  \param dest Buffer to put the escaped value in
+	 *  \param len The size of the buffer
+	 *  \param src The value to escape
+	 */
+	static int escapeFilter (char* dest, int len, const char* src);
+
 	char* ldaphost;
 	char* basedn;
 	char* login_attr;
 	int ssl;
 
 	char* ldap_admin_groups;
+	char* member_attr;
+	char* binddn;
+	char* bindpw;
 
 	//! \brief LDAP Protocol version used
 	int protocol_version;
+
+	//! \brief Timeout of LDAP operations, in seconds
+	int timeout;
+
+	//! \brief Idle connections older than this are probed before use
+	int check_interval;
+
+	//! \brief The pool of idle connections
+	USERS_LDAP_CONN* pool;
+
+	//! \brief The maximum number of idle connections
+	int poolSize;
+
+	//! \brief The current number of idle connections
+	int numIdle;
+
+	//! \brief Protects the pool, which is shared by all threads
+	pthread_mutex_t poolLock;
 };
 
 #endif /* USERDB_LDAP */
@@ -0,0 +1,493 @@
+/*
+ * utf8.cc - Jukebox text normalising code
+ *
+ * The kernels look at 16 (SSE2) or 32 (AVX2) bytes at once while the text
+ * is ASCII, which tag text mostly is, and handle anything else a character
+ * at a time.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utf8.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define UTF8_HAVE_SSE2
+#if defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))
+#include <immintrin.h>
+#define UTF8_HAVE_AVX2
+#endif
+#endif /* __SSE2__ */
+
+// UTF8_ASCII_MASK are the top bits of eight bytes
+#define UTF8_ASCII_MASK	0x8080808080808080ULL
+
+int utf8SIMD = -1;
+
+/*
+ * detectSIMD()
+ *
+ * This will set [utf8SIMD] to the best instruction set the CPU has.
+ *
+ */
+static void
+detectSIMD() {
+	int level = UTF8_SIMD_NONE;
+
+#ifdef UTF8_HAVE_SSE2
+	level = UTF8_SIMD_SSE2;
+#endif
+#ifdef UTF8_HAVE_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports ("avx2"))
+		level = UTF8_SIMD_AVX2;
+#endif
+	utf8SIMD = level;
+}
+
+#ifdef UTF8_HAVE_SSE2
+/*
+ * asciiPrefixSSE2 (const unsigned char* src, int len)
+ *
+ * This will return the offset of the first byte of [src] which is no ASCII,
+ * or the number of bytes looked at if there was none.
+ *
+ */
+static int
+asciiPrefixSSE2 (const unsigned char* src, int len) {
+	int i, mask;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		mask = _mm_movemask_epi8 (_mm_loadu_si128 ((const __m128i*)(src + i)));
+		if (mask)
+			return i + __builtin_ctz (mask);
+	}
+	return i;
+}
+
+/*
+ * ascii16SSE2 (const unsigned char* src, int len, int bigEndian, char* dest, int size)
+ *
+ * This will copy the UTF-16 characters of [src] to [dest] as long as they
+ * are ASCII, eight at a time. It will return the number of characters
+ * copied.
+ *
+ */
+static int
+ascii16SSE2 (const unsigned char* src, int len, int bigEndian, char* dest, int size) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i high = _mm_set1_epi16 ((short)0xff80);
+	__m128i x, bad;
+	int n;
+
+	for (n = 0; (2 * n + 16 <= len) && (n + 8 <= size); n += 8) {
+		x = _mm_loadu_si128 ((const __m128i*)(src + 2 * n));
+		if (bigEndian)
+			x = _mm_or_si128 (_mm_slli_epi16 (x, 8), _mm_srli_epi16 (x, 8));
+
+		// anything past U+007F, or a zero?
+		bad = _mm_or_si128 (_mm_cmpeq_epi16 (x, zero),
+		                    _mm_xor_si128 (_mm_cmpeq_epi16 (_mm_and_si128 (x, high), zero), _mm_set1_epi16 (-1)));
+		if (_mm_movemask_epi8 (bad))
+			// yes. leave it to the caller
+			break;
+		_mm_storel_epi64 ((__m128i*)(dest + n), _mm_packus_epi16 (x, x));
+	}
+	return n;
+}
+
+/*
+ * lowerSSE2 (const unsigned char* src, int len, char* dest)
+ *
+ * This will copy [src] to [dest] in lower case as long as it is ASCII,
+ * sixteen bytes at a time. It will return the number of bytes copied.
+ *
+ */
+static int
+lowerSSE2 (const unsigned char* src, int len, char* dest) {
+	const __m128i upperA = _mm_set1_epi8 ('A' - 1);
+	const __m128i upperZ = _mm_set1_epi8 ('Z' + 1);
+	const __m128i bit = _mm_set1_epi8 (0x20);
+	__m128i x, upper;
+	int i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		x = _mm_loadu_si128 ((const __m128i*)(src + i));
+		if (_mm_movemask_epi8 (x))
+			// not all ASCII
+			break;
+		upper = _mm_and_si128 (_mm_cmpgt_epi8 (x, upperA), _mm_cmplt_epi8 (x, upperZ));
+		_mm_storeu_si128 ((__m128i*)(dest + i), _mm_or_si128 (x, _mm_and_si128 (upper, bit)));
+	}
+	return i;
+}
+#endif /* UTF8_HAVE_SSE2 */
+
+#ifdef UTF8_HAVE_AVX2
+/*
+ * asciiPrefixAVX2 (const unsigned char* src, int len)
+ *
+ * Like asciiPrefixSSE2(), but 32 bytes at a time.
+ *
+ */
+__attribute__((target("avx2"))) static int
+asciiPrefixAVX2 (const unsigned char* src, int len) {
+	unsigned int mask;
+	int i;
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		mask = _mm256_movemask_epi8 (_mm256_loadu_si256 ((const __m256i*)(src + i)));
+		if (mask)
+			return i + __builtin_ctz (mask);
+	}
+	return i;
+}
+
+/*
+ * ascii16AVX2 (const unsigned char* src, int len, int bigEndian, char* dest, int size)
+ *
+ * Like ascii16SSE2(), but sixteen characters at a time.
+ *
+ */
+__attribute__((target("avx2"))) static int
+ascii16AVX2 (const unsigned char* src, int len, int bigEndian, char* dest, int size) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i high = _mm256_set1_epi16 ((short)0xff80);
+	__m256i x, bad;
+	int n;
+
+	for (n = 0; (2 * n + 32 <= len) && (n + 16 <= size); n += 16) {
+		x = _mm256_loadu_si256 ((const __m256i*)(src + 2 * n));
+		if (bigEndian)
+			x = _mm256_or_si256 (_mm256_slli_epi16 (x, 8), _mm256_srli_epi16 (x, 8));
+
+		// anything past U+007F, or a zero?
+		bad = _mm256_or_si256 (_mm256_cmpeq_epi16 (x, zero),
+		                       _mm256_xor_si256 (_mm256_cmpeq_epi16 (_mm256_and_si256 (x, high), zero), _mm256_set1_epi16 (-1)));
+		if (_mm256_movemask_epi8 (bad))
+			// yes. leave it to the caller
+			break;
+
+		// the packing works per lane, so put the halves back together
+		x = _mm256_permute4x64_epi64 (_mm256_packus_epi16 (x, x), 0xd8);
+		_mm_storeu_si128 ((__m128i*)(dest + n), _mm256_castsi256_si128 (x));
+	}
+	return n;
+}
+
+/*
+ * lowerAVX2 (const unsigned char* src, int len, char* dest)
+ *
+ * Like lowerSSE2(), but 32 bytes at a time.
+ *
+ */
+__attribute__((target("avx2"))) static int
+lowerAVX2 (const unsigned char* src, int len, char* dest) {
+	const __m256i upperA = _mm256_set1_epi8 ('A' - 1);
+	const __m256i upperZ = _mm256_set1_epi8 ('Z' + 1);
+	const __m256i bit = _mm256_set1_epi8 (0x20);
+	__m256i x, upper;
+	int i;
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		x = _mm256_loadu_si256 ((const __m256i*)(src + i));
+		if (_mm256_movemask_epi8 (x))
+			// not all ASCII
+			break;
+		upper = _mm256_and_si256 (_mm256_cmpgt_epi8 (x, upperA), _mm256_cmpgt_epi8 (upperZ, x));
+		_mm256_storeu_si256 ((__m256i*)(dest + i), _mm256_or_si256 (x, _mm256_and_si256 (upper, bit)));
+	}
+	return i;
+}
+#endif /* UTF8_HAVE_AVX2 */
+
+/*
+ * asciiPrefix (const unsigned char* src, int len)
+ *
+ * This will return the number of ASCII bytes [src], which is [len] bytes,
+ * starts with.
+ *
+ */
+int
+asciiPrefix (const unsigned char* src, int len) {
+	unsigned long long w;
+	int i = 0;
+
+	if (utf8SIMD < 0)
+		detectSIMD();
+	switch (utf8SIMD) {
+#ifdef UTF8_HAVE_AVX2
+		case UTF8_SIMD_AVX2: i = asciiPrefixAVX2 (src, len);
+		                     break;
+#endif
+#ifdef UTF8_HAVE_SSE2
+		case UTF8_SIMD_SSE2: i = asciiPrefixSSE2 (src, len);
+		                     break;
+#endif
+	}
+
+	// the rest a word, then a byte at a time
+	for (; i + 8 <= len; i += 8) {
+		memcpy (&w, src + i, 8);
+		if (w & UTF8_ASCII_MASK)
+			break;
+	}
+	while ((i < len) && (src[i] < 0x80))
+		i++;
+	return i;
+}
+
+/*
+ * lowerASCII (const unsigned char* src, int len, char* dest)
+ *
+ * This will copy [src], which is [len] bytes, to [dest] in lower case as
+ * long as it is ASCII. It will return the number of bytes copied.
+ *
+ */
+int
+lowerASCII (const unsigned char* src, int len, char* dest) {
+	int i = 0;
+
+	if (utf8SIMD < 0)
+		detectSIMD();
+	switch (utf8SIMD) {
+#ifdef UTF8_HAVE_AVX2
+		case UTF8_SIMD_AVX2: i = lowerAVX2 (src, len, dest);
+		                     break;
+#endif
+#ifdef UTF8_HAVE_SSE2
+		case UTF8_SIMD_SSE2: i = lowerSSE2 (src, len, dest);
+		                     break;
+#endif
+	}
+
+	for (; (i < len) && (src[i] < 0x80); i++)
+		dest[i] = ((src[i] >= 'A') && (src[i] <= 'Z')) ? src[i] + 'a' - 'A' : src[i];
+	return i;
+}
+
+/*
+ * encodeUTF8 (unsigned int cp, char* dest, int pos, int size)
+ *
+ * This will append code point [cp] as UTF-8 to [dest] at [pos], provided it
+ * fits in [size] bytes including the terminating zero. It will return the
+ * new position, which is [pos] if it didn't fit.
+ *
+ */
+int
+encodeUTF8 (unsigned int cp, char* dest, int pos, int size) {
+	int n = (cp < 0x80) ? 1 : (cp < 0x800) ? 2 : (cp < 0x10000) ? 3 : 4;
+
+	if (pos + n >= size)
+		// no room
+		return pos;
+
+	switch (n) {
+		case 1: dest[pos] = cp;
+		        break;
+		case 2: dest[pos]     = 0xc0 | (cp >> 6);
+		        dest[pos + 1] = 0x80 | (cp & 0x3f);
+		        break;
+		case 3: dest[pos]     = 0xe0 | (cp >> 12);
+		        dest[pos + 1] = 0x80 | ((cp >> 6) & 0x3f);
+		        dest[pos + 2] = 0x80 | (cp & 0x3f);
+		        break;
+		case 4: dest[pos]     = 0xf0 | (cp >> 18);
+		        dest[pos + 1] = 0x80 | ((cp >> 12) & 0x3f);
+		        dest[pos + 2] = 0x80 | ((cp >> 6) & 0x3f);
+		        dest[pos + 3] = 0x80 | (cp & 0x3f);
+		        break;
+	}
+	return pos + n;
+}
+
+/*
+ * sequenceLen (const unsigned char* s, int len)
+ *
+ * This will return the length of the UTF-8 sequence [s], of which [len]
+ * bytes are available, or zero if it isn't valid.
+ *
+ */
+static int
+sequenceLen (const unsigned char* s, int len) {
+	unsigned char lo = 0x80, hi = 0xbf;
+
+	if ((s[0] >= 0xc2) && (s[0] <= 0xdf))
+		return ((len >= 2) && ((s[1] & 0xc0) == 0x80)) ? 2 : 0;
+
+	if ((s[0] >= 0xe0) && (s[0] <= 0xef)) {
+		// no overlong forms or surrogates
+		if (s[0] == 0xe0) lo = 0xa0;
+		if (s[0] == 0xed) hi = 0x9f;
+		return ((len >= 3) && (s[1] >= lo) && (s[1] <= hi) && ((s[2] & 0xc0) == 0x80)) ? 3 : 0;
+	}
+
+	if ((s[0] >= 0xf0) && (s[0] <= 0xf4)) {
+		// no overlong forms or anything past U+10FFFF
+		if (s[0] == 0xf0) lo = 0x90;
+		if (s[0] == 0xf4) hi = 0x8f;
+		return ((len >= 4) && (s[1] >= lo) && (s[1] <= hi) && ((s[2] & 0xc0) == 0x80) &&
+		        ((s[3] & 0xc0) == 0x80)) ? 4 : 0;
+	}
+	return 0;
+}
+
+/*
+ * isUTF8 (const char* src, int len)
+ *
+ * This will return non-zero if [src], which is [len] bytes, is valid UTF-8
+ * or zero if it isn't.
+ *
+ */
+int
+isUTF8 (const char* src, int len) {
+	const unsigned char* s = (const unsigned char*)src;
+	int i = 0, n;
+
+	while (1) {
+		// skip the ASCII
+		i += asciiPrefix (s + i, len - i);
+		if (i >= len)
+			// all done
+			return 1;
+
+		// and check the character after it
+		n = sequenceLen (s + i, len - i);
+		if (n == 0)
+			return 0;
+		i += n;
+	}
+}
+
+/*
+ * latin1ToUTF8 (const char* src, int len, char* dest, int size)
+ *
+ * This will convert ISO-8859-1 text [src], which is [len] bytes, to UTF-8
+ * in [dest], which is [size] bytes. It will return the length of the
+ * result.
+ *
+ */
+int
+latin1ToUTF8 (const char* src, int len, char* dest, int size) {
+	const unsigned char* s = (const unsigned char*)src;
+	int i = 0, n = 0, run;
+
+	if (size <= 0)
+		return 0;
+
+	while (i < len) {
+		// copy the ASCII as it is
+		run = asciiPrefix (s + i, len - i);
+		if (run > size - 1 - n)
+			run = size - 1 - n;
+		memcpy (dest + n, s + i, run);
+		n += run; i += run;
+		if ((i == len) || (n + 2 > size - 1))
+			// done, or out of room
+			break;
+
+		// the character after it takes two bytes
+		dest[n++] = 0xc0 | (s[i] >> 6);
+		dest[n++] = 0x80 | (s[i] & 0x3f);
+		i++;
+	}
+	dest[n] = 0;
+	return n;
+}
+
+/*
+ * utf16ToUTF8 (const unsigned char* src, int len, int bigEndian, char* dest, int size)
+ *
+ * This will convert UTF-16 text [src], which is [len] bytes, to UTF-8 in
+ * [dest], which is [size] bytes. If [bigEndian] is non-zero, the text is
+ * big endian. It will return the length of the result.
+ *
+ */
+int
+utf16ToUTF8 (const unsigned char* src, int len, int bigEndian, char* dest, int size) {
+	unsigned int c, c2;
+	int i = 0, n = 0, m;
+
+	if (size <= 0)
+		return 0;
+	len &= ~1;
+
+	if (utf8SIMD < 0)
+		detectSIMD();
+	while (i < len) {
+		// convert the ASCII in one go if we can
+		m = 0;
+		switch (utf8SIMD) {
+#ifdef UTF8_HAVE_AVX2
+			case UTF8_SIMD_AVX2: m = ascii16AVX2 (src + i, len - i, bigEndian, dest + n, size - 1 - n);
+			                     break;
+#endif
+#ifdef UTF8_HAVE_SSE2
+			case UTF8_SIMD_SSE2: m = ascii16SSE2 (src + i, len - i, bigEndian, dest + n, size - 1 - n);
+			                     break;
+#endif
+		}
+		i += 2 * m; n += m;
+		if (i >= len)
+			break;
+
+		// and the character after it
+		c = (bigEndian) ? ((src[i] << 8) | src[i + 1]) : (src[i] | (src[i + 1] << 8));
+		if (c == 0)
+			// end of the text
+			break;
+		i += 2;
+		if ((c >= 0xd800) && (c < 0xdc00) && (i + 2 <= len)) {
+			// a surrogate pair?
+			c2 = (bigEndian) ? ((src[i] << 8) | src[i + 1]) : (src[i] | (src[i + 1] << 8));
+			if ((c2 >= 0xdc00) && (c2 < 0xe000)) {
+				// yes. combine it
+				c = 0x10000 + ((c - 0xd800) << 10) + (c2 - 0xdc00);
+				i += 2;
+			}
+		}
+		if ((c >= 0xd800) && (c < 0xe000))
+			// a lone surrogate
+			c = 0xfffd;
+
+		m = encodeUTF8 (c, dest, n, size);
+		if (m == n)
+			// no more room
+			break;
+		n = m;
+	}
+	dest[n] = 0;
+	return n;
+}
+
+/*
+ * normalizeText (const char* src, char* dest, int size)
+ *
+ * This will copy [src] to [dest], which is [size] bytes, as UTF-8. Text
+ * which is no valid UTF-8 is taken to be ISO-8859-1. It will return the
+ * length of the result.
+ *
+ */
+int
+normalizeText (const char* src, char* dest, int size) {
+	int len = strlen (src);
+
+	if (size <= 0)
+		return 0;
+	if (!isUTF8 (src, len))
+		// must be ISO-8859-1
+		return latin1ToUTF8 (src, len, dest, size);
+
+	// fine as it is. cut it off at a character boundary if needed
+	if (len > size - 1) {
+		len = size - 1;
+		while ((len > 0) && (((unsigned char)src[len] & 0xc0) == 0x80))
+			len--;
+	}
+	memcpy (dest, src, len);
+	dest[len] = 0;
+	return len;
+}
+
+/* vim:set ts=2 sw=2: */
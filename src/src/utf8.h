@@ -0,0 +1,99 @@
+/*
+ * utf8.h
+ *
+ * This is the jukebox text normaliser, which makes sure everything stored
+ * in the catalog is UTF-8.
+ *
+ */
+#include <stdlib.h>
+
+#ifndef __UTF8_H__
+#define __UTF8_H__
+
+//! \brief UTF8_SIMD_xxx are the instruction sets the kernels can use
+#define UTF8_SIMD_NONE	0
+#define UTF8_SIMD_SSE2	1
+#define UTF8_SIMD_AVX2	2
+
+/*! \brief The instruction set used by the kernels
+ *
+ *  This is set to the best one the CPU has the first time text is looked
+ *  at, unless it was set before. Lowering it is only useful to compare.
+ */
+extern int utf8SIMD;
+
+/*! \brief Returns the number of ASCII bytes [src] starts with
+ *  \param src The text
+ *  \param len The length of the text
+ */
+int asciiPrefix (const unsigned char* src, int len);
+
+/*! \brief Copies ASCII text in lower case
+ *  \param src The text
+ *  \param len The length of the text
+ *  \param dest The buffer to put the result in, which must hold [len] bytes
+ *
+ *  The copying stops at the first byte which is no ASCII. This will return
+ *  the number of bytes copied; no terminating zero is added.
+ */
+int lowerASCII (const unsigned char* src, int len, char* dest);
+
+/*! \brief Appends a character as UTF-8
+ *  \param cp The code point
+ *  \param dest The buffer
+ *  \param pos Where in the buffer the character goes
+ *  \param size The size of the buffer
+ *
+ *  The character is only added if it fits along with a terminating zero,
+ *  which is not added. This will return the position after the character,
+ *  which is [pos] if it didn't fit.
+ */
+int encodeUTF8 (unsigned int cp, char* dest, int pos, int size);
+
+/*! \brief Checks whether text is valid UTF-8
+ *  \param src The text
+ *  \param len The length of the text
+ *
+ *  Overlong forms, surrogates and code points past U+10FFFF are invalid.
+ *  This will return zero if the text is not valid UTF-8 or non-zero if it
+ *  is.
+ */
+int isUTF8 (const char* src, int len);
+
+/*! \brief Converts ISO-8859-1 text to UTF-8
+ *  \param src The text
+ *  \param len The length of the text
+ *  \param dest The buffer to put the result in
+ *  \param size The size of the buffer
+ *
+ *  Text which does not fit is cut off at a character boundary. This will
+ *  return the length of the result.
+ */
+int latin1ToUTF8 (const char* src, int len, char* dest, int size);
+
+/*! \brief Converts UTF-16 text to UTF-8
+ *  \param src The text
+ *  \param len The length of the text in bytes
+ *  \param bigEndian Non-zero if the text is big endian
+ *  \param dest The buffer to put the result in
+ *  \param size The size of the buffer
+ *
+ *  The conversion stops at the first zero character. Lone surrogates become
+ *  U+FFFD. Text which does not fit is cut off at a character boundary. This
+ *  will return the length of the result.
+ */
+int utf16ToUTF8 (const unsigned char* src, int len, int bigEndian, char* dest, int size);
+
+/*! \brief Normalises text to UTF-8
+ *  \param src The text, in UTF-8 or ISO-8859-1
+ *  \param dest The buffer to put the result in
+ *  \param size The size of the buffer
+ *
+ *  Valid UTF-8 is copied as it is; anything else is taken to be ISO-8859-1
+ *  and converted. This will return the length of the result.
+ */
+int normalizeText (const char* src, char* dest, int size);
+
+#endif /* __UTF8_H__ */
+
+/* vim:set ts=2 sw=2: */
@@ -0,0 +1,395 @@
+/*
+ * worker.cc - Jukebox worker pool code
+ *
+ */
+#include <sys/types.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "jukebox.h"
+#include "worker.h"
+
+/*
+ * WORKJOB::WORKJOB()
+ *
+ * This will construct an empty job.
+ *
+ */
+WORKJOB::WORKJOB() {
+	out = NULL; outLen = outSize = 0; next = NULL; result = 0;
+	maxOutput = 0; truncated = 0;
+}
+
+/*
+ * WORKJOB::~WORKJOB()
+ *
+ * This will destroy the job.
+ *
+ */
+WORKJOB::~WORKJOB() {
+	if (out) free (out);
+}
+
+/*
+ * WORKJOB::output (const char* fmt, ...)
+ *
+ * This will append [fmt] to the output of the job, printf() style. Once the
+ * output would exceed maxOutput, nothing more is added.
+ *
+ */
+void
+WORKJOB::output (const char* fmt, ...) {
+	va_list va;
+	int len;
+	char* ptr;
+
+	// did we give up already?
+	if (truncated)
+		// yes. bail out
+		return;
+
+	while (1) {
+		// try to print it in the space we have
+		va_start (va, fmt);
+		len = vsnprintf (out + outLen, outSize - outLen, fmt, va);
+		va_end (va);
+
+		// is this too much?
+		if ((maxOutput > 0) && (len >= 0) && (outLen + len > maxOutput)) {
+			// yes. drop it and anything after it
+			if (out) out[outLen] = 0;
+			truncated = 1;
+			return;
+		}
+
+		// did this fit?
+		if ((len >= 0) && (outLen + len < outSize)) {
+			// yes. that's all
+			outLen += len;
+			return;
+		}
+
+		// no. grow the buffer
+		ptr = (char*)realloc (out, outSize + ((len > WORKJOB_OUTPUT_CHUNK) ? len + 1 : WORKJOB_OUTPUT_CHUNK));
+		if (ptr == NULL)
+			// this failed. drop the text
+			return;
+		outSize += (len > WORKJOB_OUTPUT_CHUNK) ? len + 1 : WORKJOB_OUTPUT_CHUNK;
+		out = ptr;
+	}
+}
+
+/*
+ * WORKERS::WORKERS (int num)
+ *
+ * This will construct a pool of [num] worker threads. No threads are started
+ * yet.
+ *
+ */
+WORKERS::WORKERS (int num) {
+	// sanitize the number of threads
+	if (num < 0) num = 0;
+	if (num > WORKERS_MAX_THREADS) num = WORKERS_MAX_THREADS;
+	numThreads = num; numStarted = numAssigned = 0; stopping = 0;
+	paused = 0; numRunning = 0;
+
+	// no jobs yet
+	jobHead = jobTail = doneHead = doneTail = NULL;
+	threads = NULL; conns = NULL;
+	pid = getpid();
+
+	pthread_mutex_init (&lock, NULL);
+	pthread_cond_init (&cond, NULL);
+	pthread_cond_init (&idle, NULL);
+}
+
+/*
+ * WORKERS::~WORKERS()
+ *
+ * This will stop all threads and destroy the pool. Jobs which have not been
+ * completed are silently dropped.
+ *
+ */
+WORKERS::~WORKERS() {
+	WORKJOB* job;
+	int i;
+
+	// tell the threads to leave and wait for them
+	pthread_mutex_lock (&lock);
+	stopping = 1;
+	pthread_cond_broadcast (&cond);
+	pthread_mutex_unlock (&lock);
+	for (i = 0; i < numStarted; i++)
+		pthread_join (threads[i], NULL);
+
+	// get rid of all jobs left
+	while (jobHead != NULL) {
+		job = jobHead; jobHead = job->next;
+		delete job;
+	}
+	while (doneHead != NULL) {
+		job = doneHead; doneHead = job->next;
+		delete job;
+	}
+
+	// close the connections
+	if (conns) {
+		for (i = 0; i < numThreads; i++)
+			delete conns[i];
+		free (conns);
+	}
+	if (threads) free (threads);
+
+	pthread_cond_destroy (&idle);
+	pthread_cond_destroy (&cond);
+	pthread_mutex_destroy (&lock);
+}
+
+/*
+ * WORKERS::init()
+ *
+ * This will open a database connection for every thread. It will return 0
+ * on failure or 1 on success.
+ *
+ */
+int
+WORKERS::init() {
+	DATABASE* conn;
+	int i;
+
+	// allocate the tables
+	conns = (DATABASE**)malloc ((numThreads + 1) * sizeof (DATABASE*));
+	threads = (pthread_t*)malloc ((numThreads + 1) * sizeof (pthread_t));
+	if ((conns == NULL) || (threads == NULL)) {
+		// this failed. bail out
+		numThreads = 0;
+		return 0;
+	}
+
+	// connect them all
+	for (i = 0; i < numThreads; i++) {
+		conn = config->getDatabase();
+		if (conn == NULL)
+			// this failed. bail out
+			break;
+
+		if (!conn->connect (config->dbHostname, config->dbUsername,
+		                    config->dbPassword, config->dbDatabase)) {
+			// this failed. complain
+			logger->log (LOG_INFO, "Unable to open worker database connection: %s", conn->getErrorMsg());
+			delete conn;
+			break;
+		}
+
+		// got one
+		conns[i] = conn;
+	}
+
+	// did we get all of them?
+	if (i < numThreads)
+		// no. make do with what we have
+		logger->log (LOG_INFO, "Using %d instead of %d worker threads", i, numThreads);
+	numThreads = i;
+	return 1;
+}
+
+/*
+ * WORKERS::start()
+ *
+ * This will start the worker threads. It will return 0 on failure or 1 on
+ * success.
+ *
+ */
+int
+WORKERS::start() {
+	sigset_t all, old;
+
+	// the threads should leave all signals to the main loop
+	sigfillset (&all);
+	pthread_sigmask (SIG_SETMASK, &all, &old);
+
+	// launch them
+	pid = getpid();
+	for (numStarted = 0; numStarted < numThreads; numStarted++)
+		if (pthread_create (&threads[numStarted], NULL, threadMain, this) != 0)
+			// this failed. stop here
+			break;
+
+	pthread_sigmask (SIG_SETMASK, &old, NULL);
+
+	// got all of them?
+	if (numStarted < numThreads) {
+		// no. complain
+		logger->log (LOG_INFO, "Only %d of %d worker threads started", numStarted, numThreads);
+		return 0;
+	}
+
+	// victory
+	return 1;
+}
+
+/*
+ * WORKERS::threadMain (void* arg)
+ *
+ * This is where the threads start. [arg] is the pool they belong to.
+ *
+ */
+void*
+WORKERS::threadMain (void* arg) {
+	WORKERS* w = (WORKERS*)arg;
+	DATABASE* conn;
+
+	// grab a database connection
+	pthread_mutex_lock (&w->lock);
+	conn = w->conns[w->numAssigned++];
+	pthread_mutex_unlock (&w->lock);
+
+	// go
+	w->work (conn);
+	return NULL;
+}
+
+/*
+ * WORKERS::work (DATABASE* conn)
+ *
+ * This will handle jobs until the pool is stopped. All database queries done
+ * by the jobs go to [conn].
+ *
+ */
+void
+WORKERS::work (DATABASE* conn) {
+	WORKJOB* job;
+
+	// use our own connection from now on
+	db = conn;
+
+	pthread_mutex_lock (&lock);
+	while (1) {
+		// wait for something to do
+		while ((!stopping) && ((jobHead == NULL) || (paused)))
+			pthread_cond_wait (&cond, &lock);
+		if (stopping)
+			break;
+
+		// grab the job
+		job = jobHead; jobHead = job->next;
+		if (jobHead == NULL) jobTail = NULL;
+
+		// run it, without holding the lock
+		numRunning++;
+		pthread_mutex_unlock (&lock);
+		job->run();
+		pthread_mutex_lock (&lock);
+
+		// was this the last one someone is waiting for?
+		if ((--numRunning == 0) && (paused))
+			// yes. let them know
+			pthread_cond_signal (&idle);
+
+		// hand it to the main loop
+		job->next = NULL;
+		if (doneTail) doneTail->next = job; else doneHead = job;
+		doneTail = job;
+
+		// wake the main loop up
+		kill (pid, WORKERS_SIGNAL);
+	}
+	pthread_mutex_unlock (&lock);
+}
+
+/*
+ * WORKERS::submit (WORKJOB* job)
+ *
+ * This will queue [job]. If there are no threads, the job is run right away
+ * and completed by the next drain().
+ *
+ */
+void
+WORKERS::submit (WORKJOB* job) {
+	job->next = NULL;
+
+	// got any threads?
+	if (numStarted == 0) {
+		// no. do it ourselves
+		job->run();
+		if (doneTail) doneTail->next = job; else doneHead = job;
+		doneTail = job;
+		return;
+	}
+
+	// queue it and wake a thread up
+	pthread_mutex_lock (&lock);
+	if (jobTail) jobTail->next = job; else jobHead = job;
+	jobTail = job;
+	pthread_cond_signal (&cond);
+	pthread_mutex_unlock (&lock);
+}
+
+/*
+ * WORKERS::drain()
+ *
+ * This will complete all finished jobs. Completing a job may cause new jobs
+ * to be submitted; we keep going until there is nothing left.
+ *
+ */
+void
+WORKERS::drain() {
+	WORKJOB* job;
+	WORKJOB* list;
+
+	while (1) {
+		// grab the entire list
+		pthread_mutex_lock (&lock);
+		list = doneHead; doneHead = doneTail = NULL;
+		pthread_mutex_unlock (&lock);
+
+		// anything?
+		if (list == NULL)
+			// no. we're done
+			break;
+
+		// complete them in order
+		while (list != NULL) {
+			job = list; list = job->next;
+			job->complete();
+			delete job;
+		}
+	}
+}
+
+/*
+ * WORKERS::pause()
+ *
+ * This will keep the threads from picking up new jobs and wait until the
+ * jobs they are running have finished. Without threads, there is nothing to
+ * wait for.
+ *
+ */
+void
+WORKERS::pause() {
+	pthread_mutex_lock (&lock);
+	paused = 1;
+	while (numRunning > 0)
+		pthread_cond_wait (&idle, &lock);
+	pthread_mutex_unlock (&lock);
+}
+
+/*
+ * WORKERS::resume()
+ *
+ * This will let the threads pick up jobs again.
+ *
+ */
+void
+WORKERS::resume() {
+	pthread_mutex_lock (&lock);
+	paused = 0;
+	pthread_cond_broadcast (&cond);
+	pthread_mutex_unlock (&lock);
+}
+
+/* vim:set ts=2 sw=2: */
@@ -0,0 +1,182 @@
+/*
+ * worker.h
+ *
+ * This is the jukebox worker pool, which runs blocking jobs off the network
+ * thread.
+ *
+ */
+#include <sys/types.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <libplusplus/database.h>
+
+#ifndef __WORKER_H__
+#define __WORKER_H__
+
+//! \brief WORKERS_DEFAULT_THREADS is the default number of worker threads
+#define WORKERS_DEFAULT_THREADS		4
+
+//! \brief WORKERS_MAX_THREADS is the maximum number of worker threads
+#define WORKERS_MAX_THREADS				64
+
+//! \brief WORKERS_SIGNAL is sent to the main loop when jobs are completed
+#define WORKERS_SIGNAL						SIGUSR1
+
+//! \brief WORKJOB_OUTPUT_CHUNK is the granularity of the job output buffer
+#define WORKJOB_OUTPUT_CHUNK			1024
+
+/*!
+ * \class WORKJOB
+ * \brief A single job to be handled by the worker pool
+ *
+ * The run() method is called on a worker thread, and may only touch the
+ * job itself, the database and the user backends. Once it is done, the
+ * complete() method is called on the network thread, which can safely talk
+ * to the clients.
+ */
+class WORKJOB {
+	friend class WORKERS;
+
+public:
+	//! \brief Constructs an empty job
+	WORKJOB();
+
+	//! \brief Destroys the job
+	virtual ~WORKJOB();
+
+	//! \brief Does the actual work, called on a worker thread
+	virtual void run() = 0;
+
+	//! \brief Finishes the job, called on the network thread
+	virtual void complete() = 0;
+
+	//! \brief The outcome of the job, non-zero on success
+	int			result;
+
+	//! \brief The maximum length of the output, zero if unlimited
+	int			maxOutput;
+
+	//! \brief Flag: Was output dropped because of maxOutput?
+	int			truncated;
+
+protected:
+	/*! \brief Appends text to the output of the job
+	 *  \param fmt The format string, as per printf()
+	 */
+	void output (const char* fmt, ...);
+
+	//! \brief Output collected by run(), or NULL if there is none
+	char*		out;
+
+	//! \brief Length of the output and size of the output buffer
+	int			outLen, outSize;
+
+private:
+	//! \brief Next job in the queue
+	WORKJOB* next;
+};
+
+/*!
+ * \class WORKERS
+ * \brief This will manage the worker threads
+ *
+ * Jobs are handed to the threads through a queue; finished jobs are put on a
+ * completion queue which the main loop drains. Each thread has a database
+ * connection of its own.
+ */
+class WORKERS {
+public:
+	/*! \brief Constructs the worker pool
+	 *  \param num The number of threads wanted, 0 to run jobs in the main loop
+	 */
+	WORKERS(int num);
+
+	//! \brief Stops all threads and destroys the pool
+	~WORKERS();
+
+	/*! \brief Opens the database connections of the threads
+	 *
+	 * This has to be called before chroot()-ing. It will return zero on failure
+	 * or non-zero on success. If not all connections can be made, fewer
+	 * threads are used.
+	 */
+	int init();
+
+	/*! \brief Starts the threads
+	 *
+	 * This has to be called after daemonizing, as threads do not survive a
+	 * fork(). It will return zero on failure or non-zero on success.
+	 */
+	int start();
+
+	/*! \brief Queues a job
+	 *  \param job The job to run, which will be deleted once completed
+	 */
+	void submit (WORKJOB* job);
+
+	//! \brief Completes all finished jobs, to be called from the main loop
+	void drain();
+
+	/*! \brief Stops handing out jobs and waits for running jobs to finish
+	 *
+	 * Once this returns, no thread touches anything shared with the main
+	 * loop until resume() is called. Jobs submitted meanwhile are queued.
+	 */
+	void pause();
+
+	//! \brief Lets the threads pick up jobs again after pause()
+	void resume();
+
+	//! \brief Returns the number of running threads
+	inline int getNumThreads() { return numStarted; }
+
+private:
+	//! \brief Entry point of the threads
+	static void* threadMain (void* arg);
+
+	/*! \brief Handles jobs until the pool is stopped
+	 *  \param conn The database connection of this thread
+	 */
+	void work (DATABASE* conn);
+
+	//! \brief Protects the queues
+	pthread_mutex_t	lock;
+
+	//! \brief Signalled when a job is queued or the pool is stopped or resumed
+	pthread_cond_t	cond;
+
+	//! \brief Signalled when the last running job finishes while paused
+	pthread_cond_t	idle;
+
+	//! \brief Jobs waiting to be run
+	WORKJOB*	jobHead;
+	WORKJOB*	jobTail;
+
+	//! \brief Jobs waiting to be completed
+	WORKJOB*	doneHead;
+	WORKJOB*	doneTail;
+
+	//! \brief The threads and their database connections
+	pthread_t*	threads;
+	DATABASE**	conns;
+
+	//! \brief Number of threads wanted, started and handed a connection
+	int				numThreads, numStarted, numAssigned;
+
+	//! \brief Non-zero if the threads must exit
+	int				stopping;
+
+	//! \brief Non-zero if the threads must not pick up jobs
+	int				paused;
+
+	//! \brief Number of jobs being run right now
+	int				numRunning;
+
+	//! \brief Process to notify of completed jobs
+	pid_t			pid;
+};
+
+#endif /* __WORKER_H__ */
+
+/* vim:set ts=2 sw=2: */